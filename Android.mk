@@ -7,5 +7,10 @@ include $(MY_LOCAL_PATH)/hal/Android.mk
 include $(MY_LOCAL_PATH)/hal/audio_extn/Android.mk
 include $(MY_LOCAL_PATH)/audio-effects/Android.mk
 
+# on-device loopback measurement tool, see pal_sim/hal_loopback.cpp
+ifeq ($(strip $(AUDIO_FEATURE_ENABLED_PAL_SIM_TOOLS)),true)
+include $(MY_LOCAL_PATH)/pal_sim/Android.mk
+endif
+
 endif
 endif
@@ -50,6 +50,7 @@
 #include <unistd.h>
 
 #include "bundle.h"
+#include "effect_mutex.h"
 #include "hw_accelerator.h"
 #include "equalizer.h"
 #include "bass_boost.h"
@@ -98,7 +99,7 @@ struct listnode active_outputs_list;
  * lock must be held when modifying or accessing
  * created_effects_list or active_outputs_list
  */
-pthread_mutex_t lock;
+effect_mutex_t lock;
 
 
 /*
@@ -108,7 +109,7 @@ static void init_once() {
     list_init(&created_effects_list);
     list_init(&active_outputs_list);
 
-    pthread_mutex_init(&lock, NULL);
+    effect_mutex_init(&lock, "offload_effects_bundle");
 
     init_status = 0;
 }
@@ -211,6 +212,14 @@ bool effects_enabled()
 /*
  * Interface from audio HAL
  */
+__attribute__ ((visibility ("default")))
+void offload_effects_bundle_hal_set_mutex_hooks(effect_mutex_stats_t stats,
+                                                effect_mutex_acquired_t acquired,
+                                                effect_mutex_released_t released)
+{
+    effect_mutex_set_hooks(stats, acquired, released);
+}
+
 __attribute__ ((visibility ("default")))
 int offload_effects_bundle_hal_start_output(audio_io_handle_t output,  pal_stream_handle_t* pal_stream_handle)
 {
@@ -222,7 +231,7 @@ int offload_effects_bundle_hal_start_output(audio_io_handle_t output,  pal_strea
     if (lib_init() != 0)
         return init_status;
 
-    pthread_mutex_lock(&lock);
+    effect_mutex_lock(&lock);
     if (get_output(output) != NULL) {
         ALOGW("%s output already started", __func__);
         ret = -ENOSYS;
@@ -252,7 +261,7 @@ int offload_effects_bundle_hal_start_output(audio_io_handle_t output,  pal_strea
     }
     list_add_tail(&active_outputs_list, &out_ctxt->outputs_list_node);
 exit:
-    pthread_mutex_unlock(&lock);
+    effect_mutex_unlock(&lock);
     return ret;
 }
 
@@ -268,7 +277,7 @@ int offload_effects_bundle_hal_stop_output(audio_io_handle_t output,  pal_stream
     if (lib_init() != 0)
         return init_status;
 
-    pthread_mutex_lock(&lock);
+    effect_mutex_lock(&lock);
 
     out_ctxt = get_output(output);
     if (out_ctxt == NULL) {
@@ -290,7 +299,7 @@ int offload_effects_bundle_hal_stop_output(audio_io_handle_t output,  pal_stream
     free(out_ctxt);
 
 exit:
-    pthread_mutex_unlock(&lock);
+    effect_mutex_unlock(&lock);
     return ret;
 }
 
@@ -463,12 +472,12 @@ int effect_lib_create(const effect_uuid_t *uuid,
 
     context->state = EFFECT_STATE_INITIALIZED;
 
-    pthread_mutex_lock(&lock);
+    effect_mutex_lock(&lock);
     list_add_tail(&created_effects_list, &context->effects_list_node);
     output_context_t *out_ctxt = get_output(ioId);
     if (out_ctxt != NULL)
         add_effect_to_output(out_ctxt, context);
-    pthread_mutex_unlock(&lock);
+    effect_mutex_unlock(&lock);
 
     *pHandle = (effect_handle_t)context;
 
@@ -487,7 +496,7 @@ int effect_lib_release(effect_handle_t handle)
         return init_status;
 
     ALOGV("%s context %p", __func__, handle);
-    pthread_mutex_lock(&lock);
+    effect_mutex_lock(&lock);
     status = -EINVAL;
     if (effect_exists(context)) {
         output_context_t *out_ctxt = get_output(context->out_handle);
@@ -499,7 +508,7 @@ int effect_lib_release(effect_handle_t handle)
         free(context);
         status = 0;
     }
-    pthread_mutex_unlock(&lock);
+    effect_mutex_unlock(&lock);
 
     return status;
 }
@@ -543,7 +552,7 @@ int effect_process(effect_handle_t self,
 
     ALOGV("%s", __func__);
 
-    pthread_mutex_lock(&lock);
+    effect_mutex_lock(&lock);
     if (!effect_exists(context)) {
         status = -ENOSYS;
         goto exit;
@@ -557,7 +566,7 @@ int effect_process(effect_handle_t self,
     if (context->ops.process)
         status = context->ops.process(context, inBuffer, outBuffer);
 exit:
-    pthread_mutex_unlock(&lock);
+    effect_mutex_unlock(&lock);
     return status;
 }
 
@@ -568,7 +577,7 @@ int effect_command(effect_handle_t self, uint32_t cmdCode, uint32_t cmdSize,
     effect_context_t * context = (effect_context_t *)self;
     int status = 0;
 
-    pthread_mutex_lock(&lock);
+    effect_mutex_lock(&lock);
 
     if (!effect_exists(context)) {
         ALOGE("%s: effect doesn't exist.\n", __func__);
@@ -771,7 +780,7 @@ int effect_command(effect_handle_t self, uint32_t cmdCode, uint32_t cmdSize,
     }
 
 exit:
-    pthread_mutex_unlock(&lock);
+    effect_mutex_unlock(&lock);
 
     return status;
 }
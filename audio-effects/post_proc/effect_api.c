@@ -77,6 +77,26 @@ typedef enum eff_mode {
     HW_ACCELERATOR
 } eff_mode_t;
 
+/* UI effect payloads up to this size are built on the stack */
+#define EFFECT_PAYLOAD_INLINE_SIZE 256
+
+/* the key vector or custom payload a param is assembled in, same limit */
+typedef uint64_t effect_scratch_t[EFFECT_PAYLOAD_INLINE_SIZE / sizeof(uint64_t)];
+
+static void *scratch_get(effect_scratch_t scratch, size_t size)
+{
+    if (size > sizeof(effect_scratch_t))
+        return calloc(1, size);
+    memset(scratch, 0, size);
+    return scratch;
+}
+
+static void scratch_put(effect_scratch_t scratch, void *buf)
+{
+    if (buf != (void *)scratch)
+        free(buf);
+}
+
 #define OFFLOAD_PRESET_START_OFFSET_FOR_OPENSL 19
 const int map_eq_opensl_preset_2_offload_preset[] = {
     OFFLOAD_PRESET_START_OFFSET_FOR_OPENSL,   /* Normal Preset */
@@ -146,11 +166,17 @@ static int send_kv_payload(pal_stream_handle_t *pal_stream_handle,
    uint8_t *payload = NULL;
    pal_key_vector_t *pal_key_vector = NULL;
    uint32_t payload_size = 0;
+   uint64_t inline_buf[EFFECT_PAYLOAD_INLINE_SIZE / sizeof(uint64_t)];
    payload_size = sizeof(pal_param_payload) + sizeof(effect_pal_payload_t) +
                   sizeof(pal_key_vector_t) +
                   kvp->num_tkvs * sizeof(pal_key_value_pair_t);
 
-   payload = (uint8_t *) calloc (1, payload_size);
+   if (payload_size <= sizeof(inline_buf)) {
+       memset(inline_buf, 0, payload_size);
+       payload = (uint8_t *)inline_buf;
+   } else {
+       payload = (uint8_t *) calloc (1, payload_size);
+   }
    if (!payload) {
        ALOGE("%s:%d calloc failed for size %d", __func__, __LINE__, payload_size);
        ret = -ENOMEM;
@@ -175,7 +201,8 @@ static int send_kv_payload(pal_stream_handle_t *pal_stream_handle,
                         (kvp->num_tkvs * sizeof(pal_key_value_pair_t)));
     ret = pal_stream_set_param(pal_stream_handle, PAL_PARAM_ID_UIEFFECT,
                                pal_payload);
-    free(pal_payload);
+    if (payload != (uint8_t *)inline_buf)
+        free(pal_payload);
 done:
     return ret;
 }
@@ -190,10 +217,16 @@ static int send_custom_payload(pal_stream_handle_t *pal_stream_handle,
     uint8_t *payload = NULL;
     pal_effect_custom_payload_t *custom_payload = NULL;
     uint32_t payload_size = 0;
+    uint64_t inline_buf[EFFECT_PAYLOAD_INLINE_SIZE / sizeof(uint64_t)];
     payload_size = sizeof(pal_param_payload) + sizeof(effect_pal_payload_t) +
                    sizeof(pal_effect_custom_payload_t) + custom_data_sz;
 
-    payload = (uint8_t *) calloc (1, payload_size);
+    if (payload_size <= sizeof(inline_buf)) {
+        memset(inline_buf, 0, payload_size);
+        payload = (uint8_t *)inline_buf;
+    } else {
+        payload = (uint8_t *) calloc (1, payload_size);
+    }
     if (!payload) {
         ALOGE("%s:%d calloc failed for size %d", __func__, __LINE__, payload_size);
         ret = -ENOMEM;
@@ -218,7 +251,8 @@ static int send_custom_payload(pal_stream_handle_t *pal_stream_handle,
     memcpy(custom_payload->data, data->data, custom_data_sz);
     ret = pal_stream_set_param(pal_stream_handle, PAL_PARAM_ID_UIEFFECT,
                               pal_payload);
-    free(pal_payload);
+    if (payload != (uint8_t *)inline_buf)
+        free(pal_payload);
 done:
     return ret;
 }
@@ -235,6 +269,7 @@ static int bassboost_send_params_pal(eff_mode_t mode, pal_stream_handle_t *pal_s
                                  unsigned param_send_flags)
 {
     int ret = 0;
+    effect_scratch_t scratch;
     pal_effect_custom_payload_t *custom_payload = NULL;
 
     if (!pal_stream_handle) {
@@ -244,7 +279,7 @@ static int bassboost_send_params_pal(eff_mode_t mode, pal_stream_handle_t *pal_s
     if (param_send_flags & OFFLOAD_SEND_BASSBOOST_ENABLE_FLAG) {
         uint32_t num_kvs = 1;
         pal_key_vector_t *pal_key_vector = NULL;
-        pal_key_vector = (pal_key_vector_t *) calloc(1, sizeof(pal_key_vector_t) +
+        pal_key_vector = (pal_key_vector_t *) scratch_get(scratch, sizeof(pal_key_vector_t) +
                                             num_kvs * sizeof(pal_key_value_pair_t));
         if (!pal_key_vector) {
             ALOGE("%s:%d calloc failed for size %zu", __func__, __LINE__,
@@ -257,7 +292,7 @@ static int bassboost_send_params_pal(eff_mode_t mode, pal_stream_handle_t *pal_s
         pal_key_vector->kvp[0].value = bassboost->enable_flag;
 
         ret = send_kv_payload(pal_stream_handle, TAG_STREAM_BASS_BOOST, pal_key_vector);
-        free(pal_key_vector);
+        scratch_put(scratch, pal_key_vector);
         if (ret) {
             ALOGE("%s: pal_stream_set_param failed. ret = %d", __func__, ret);
             goto done;
@@ -266,7 +301,7 @@ static int bassboost_send_params_pal(eff_mode_t mode, pal_stream_handle_t *pal_s
 
     if (param_send_flags & OFFLOAD_SEND_BASSBOOST_STRENGTH) {
         uint32_t custom_data_sz = BASS_BOOST_STRENGTH_PARAM_LEN * sizeof(uint32_t);
-        custom_payload = (pal_effect_custom_payload_t *) calloc (1,
+        custom_payload = (pal_effect_custom_payload_t *) scratch_get(scratch,
                                            sizeof(pal_effect_custom_payload_t) +
                                            custom_data_sz);
         if (!custom_payload) {
@@ -279,7 +314,7 @@ static int bassboost_send_params_pal(eff_mode_t mode, pal_stream_handle_t *pal_s
         custom_payload->data[0] = bassboost->strength;
         ret = send_custom_payload(pal_stream_handle, TAG_STREAM_BASS_BOOST,
                               custom_payload, custom_data_sz);
-        free(custom_payload);
+        scratch_put(scratch, custom_payload);
         custom_payload = NULL;
         if (ret) {
             ALOGE("%s: pal_stream_set_param failed. ret = %d", __func__, ret);
@@ -289,7 +324,7 @@ static int bassboost_send_params_pal(eff_mode_t mode, pal_stream_handle_t *pal_s
 
     if (param_send_flags & OFFLOAD_SEND_BASSBOOST_MODE) {
         uint32_t custom_data_sz = BASS_BOOST_STRENGTH_PARAM_LEN * sizeof(uint32_t);
-        custom_payload = (pal_effect_custom_payload_t *) calloc (1,
+        custom_payload = (pal_effect_custom_payload_t *) scratch_get(scratch,
                                            sizeof(pal_effect_custom_payload_t) +
                                            custom_data_sz);
         if (!custom_payload) {
@@ -303,7 +338,7 @@ static int bassboost_send_params_pal(eff_mode_t mode, pal_stream_handle_t *pal_s
 
         ret = send_custom_payload(pal_stream_handle, TAG_STREAM_BASS_BOOST,
                               custom_payload, custom_data_sz);
-        free(custom_payload);
+        scratch_put(scratch, custom_payload);
         custom_payload = NULL;
         if (ret) {
             ALOGE("%s: pal_stream_set_param failed. ret = %d", __func__, ret);
@@ -348,6 +383,7 @@ static int pbe_send_params_pal(eff_mode_t mode, pal_stream_handle_t *pal_stream_
                             unsigned param_send_flags)
 {
     int ret = 0;
+    effect_scratch_t scratch;
 
     if (!pal_stream_handle) {
         ALOGE("%s: pal stream handle is null.\n", __func__);
@@ -359,7 +395,7 @@ static int pbe_send_params_pal(eff_mode_t mode, pal_stream_handle_t *pal_stream_
         uint32_t num_kvs = 1;
         pal_key_vector_t *pal_key_vector = NULL;
 
-        pal_key_vector = (pal_key_vector_t *) calloc (1, sizeof(pal_key_vector_t) +
+        pal_key_vector = (pal_key_vector_t *) scratch_get(scratch, sizeof(pal_key_vector_t) +
                                          num_kvs * sizeof(pal_key_value_pair_t));
         if (!pal_key_vector) {
             ALOGE("%s:%d calloc failed for size %zu", __func__, __LINE__,
@@ -374,7 +410,7 @@ static int pbe_send_params_pal(eff_mode_t mode, pal_stream_handle_t *pal_stream_
 
         ret = send_kv_payload(pal_stream_handle, TAG_STREAM_PBE,
                               pal_key_vector);
-        free(pal_key_vector);
+        scratch_put(scratch, pal_key_vector);
         if (ret) {
             ALOGE("%s: pal_stream_set_param failed. ret = %d", __func__, ret);
             goto done;
@@ -446,13 +482,14 @@ static int virtualizer_send_params_pal(eff_mode_t mode, pal_stream_handle_t *pal
                                    unsigned param_send_flags)
 {
     int ret = 0;
+    effect_scratch_t scratch;
     pal_effect_custom_payload_t *custom_payload = NULL;
 
     ALOGV("%s: flags 0x%x", __func__, param_send_flags);
     if (param_send_flags & OFFLOAD_SEND_VIRTUALIZER_ENABLE_FLAG) {
         uint32_t num_kvs = 1;
         pal_key_vector_t *pal_key_vector = NULL;
-        pal_key_vector = (pal_key_vector_t *) calloc (1, sizeof(pal_key_vector_t) +
+        pal_key_vector = (pal_key_vector_t *) scratch_get(scratch, sizeof(pal_key_vector_t) +
                                          num_kvs * sizeof(pal_key_value_pair_t));
         if (!pal_key_vector) {
             ALOGE("%s:%d calloc failed for size %zu", __func__, __LINE__,
@@ -467,7 +504,7 @@ static int virtualizer_send_params_pal(eff_mode_t mode, pal_stream_handle_t *pal
 
         ret = send_kv_payload(pal_stream_handle, TAG_STREAM_VIRTUALIZER,
                               pal_key_vector);
-        free(pal_key_vector);
+        scratch_put(scratch, pal_key_vector);
         if (ret) {
             ALOGE("%s: pal_stream_set_param failed. ret = %d", __func__, ret);
             goto done;
@@ -475,7 +512,7 @@ static int virtualizer_send_params_pal(eff_mode_t mode, pal_stream_handle_t *pal
     }
     if (param_send_flags & OFFLOAD_SEND_VIRTUALIZER_STRENGTH) {
         uint32_t custom_data_sz = VIRTUALIZER_STRENGTH_PARAM_LEN * sizeof(uint32_t);
-        custom_payload = (pal_effect_custom_payload_t *) calloc (1,
+        custom_payload = (pal_effect_custom_payload_t *) scratch_get(scratch,
                                           sizeof(pal_effect_custom_payload_t) +
                                           custom_data_sz);
         if (!custom_payload) {
@@ -489,7 +526,7 @@ static int virtualizer_send_params_pal(eff_mode_t mode, pal_stream_handle_t *pal
 
         ret = send_custom_payload(pal_stream_handle, TAG_STREAM_VIRTUALIZER,
                               custom_payload, custom_data_sz);
-        free(custom_payload);
+        scratch_put(scratch, custom_payload);
         custom_payload = NULL;
         if (ret) {
             ALOGE("%s: pal_stream_set_param failed. ret = %d", __func__, ret);
@@ -498,7 +535,7 @@ static int virtualizer_send_params_pal(eff_mode_t mode, pal_stream_handle_t *pal
     }
     if (param_send_flags & OFFLOAD_SEND_VIRTUALIZER_OUT_TYPE) {
         uint32_t custom_data_sz = VIRTUALIZER_STRENGTH_PARAM_LEN * sizeof(uint32_t);
-        custom_payload = (pal_effect_custom_payload_t *) calloc (1,
+        custom_payload = (pal_effect_custom_payload_t *) scratch_get(scratch,
                                          sizeof(pal_effect_custom_payload_t) +
                                          custom_data_sz);
         if (!custom_payload) {
@@ -511,7 +548,7 @@ static int virtualizer_send_params_pal(eff_mode_t mode, pal_stream_handle_t *pal
         custom_payload->data[0] = virtualizer->out_type;
         ret = send_custom_payload(pal_stream_handle, TAG_STREAM_VIRTUALIZER,
                               custom_payload, custom_data_sz);
-        free(custom_payload);
+        scratch_put(scratch, custom_payload);
         custom_payload = NULL;
 
         if (ret) {
@@ -521,7 +558,7 @@ static int virtualizer_send_params_pal(eff_mode_t mode, pal_stream_handle_t *pal
     }
     if (param_send_flags & OFFLOAD_SEND_VIRTUALIZER_GAIN_ADJUST) {
         uint32_t custom_data_sz = VIRTUALIZER_STRENGTH_PARAM_LEN * sizeof(uint32_t);
-        custom_payload = (pal_effect_custom_payload_t *) calloc (1,
+        custom_payload = (pal_effect_custom_payload_t *) scratch_get(scratch,
                                                 sizeof(pal_effect_custom_payload_t) +
                                                 custom_data_sz);
         if (!custom_payload) {
@@ -535,7 +572,7 @@ static int virtualizer_send_params_pal(eff_mode_t mode, pal_stream_handle_t *pal
 
         ret = send_custom_payload(pal_stream_handle, TAG_STREAM_VIRTUALIZER,
                               custom_payload, custom_data_sz);
-        free(custom_payload);
+        scratch_put(scratch, custom_payload);
         custom_payload = NULL;
         if (ret) {
             ALOGE("%s: pal_stream_set_param failed. ret = %d", __func__, ret);
@@ -608,6 +645,7 @@ static int eq_send_params_pal(eff_mode_t mode, pal_stream_handle_t *pal_stream_h
 {
     uint32_t i = 0, index = 0;
     int ret = 0;
+    effect_scratch_t scratch;
     pal_effect_custom_payload_t *custom_payload = NULL;
 
     if (!pal_stream_handle) {
@@ -624,7 +662,7 @@ static int eq_send_params_pal(eff_mode_t mode, pal_stream_handle_t *pal_stream_h
     if (param_send_flags & OFFLOAD_SEND_EQ_ENABLE_FLAG) {
         uint32_t num_kvs = 1;
         pal_key_vector_t *pal_key_vector = NULL;
-        pal_key_vector = (pal_key_vector_t *) calloc (1, sizeof(pal_key_vector_t) +
+        pal_key_vector = (pal_key_vector_t *) scratch_get(scratch, sizeof(pal_key_vector_t) +
                                            num_kvs * sizeof(pal_key_value_pair_t));
         if (!pal_key_vector) {
             ALOGE("%s:%d calloc failed for size %zu", __func__, __LINE__,
@@ -638,7 +676,7 @@ static int eq_send_params_pal(eff_mode_t mode, pal_stream_handle_t *pal_stream_h
         pal_key_vector->kvp[0].value = eq->enable_flag;
         ret = send_kv_payload(pal_stream_handle, TAG_STREAM_EQUALIZER,
                               pal_key_vector);
-        free(pal_key_vector);
+        scratch_put(scratch, pal_key_vector);
         if (ret) {
             ALOGE("%s: pal_stream_set_param failed. ret = %d", __func__, ret);
             goto done;
@@ -647,7 +685,7 @@ static int eq_send_params_pal(eff_mode_t mode, pal_stream_handle_t *pal_stream_h
 
     if (param_send_flags & OFFLOAD_SEND_EQ_PRESET) {
         uint32_t custom_data_sz = EQ_CONFIG_PARAM_LEN * sizeof(uint32_t);
-        custom_payload = (pal_effect_custom_payload_t *) calloc (1,
+        custom_payload = (pal_effect_custom_payload_t *) scratch_get(scratch,
                                            sizeof(pal_effect_custom_payload_t) +
                                            custom_data_sz);
         if (!custom_payload) {
@@ -664,7 +702,7 @@ static int eq_send_params_pal(eff_mode_t mode, pal_stream_handle_t *pal_stream_h
 
         ret = send_custom_payload(pal_stream_handle, TAG_STREAM_EQUALIZER,
                               custom_payload, custom_data_sz);
-        free(custom_payload);
+        scratch_put(scratch, custom_payload);
         custom_payload = NULL;
         if (ret) {
             ALOGE("%s: pal_stream_set_param failed. ret = %d", __func__, ret);
@@ -676,7 +714,7 @@ static int eq_send_params_pal(eff_mode_t mode, pal_stream_handle_t *pal_stream_h
         uint32_t custom_data_sz = (EQ_CONFIG_PARAM_LEN +
          (eq->config.num_bands * EQ_CONFIG_PER_BAND_PARAM_LEN)) * sizeof(uint32_t);
 
-        custom_payload = (pal_effect_custom_payload_t *) calloc (1,
+        custom_payload = (pal_effect_custom_payload_t *) scratch_get(scratch,
                                            sizeof(pal_effect_custom_payload_t) +
                                            custom_data_sz);
         if (!custom_payload) {
@@ -699,7 +737,7 @@ static int eq_send_params_pal(eff_mode_t mode, pal_stream_handle_t *pal_stream_h
         }
         ret = send_custom_payload(pal_stream_handle, TAG_STREAM_EQUALIZER,
                               custom_payload, custom_data_sz);
-        free(custom_payload);
+        scratch_put(scratch, custom_payload);
         custom_payload = NULL;
         if (ret) {
             ALOGE("%s: pal_stream_set_param failed. ret = %d", __func__, ret);
@@ -831,6 +869,7 @@ static int reverb_send_params_pal(eff_mode_t mode, pal_stream_handle_t *pal_stre
                               unsigned param_send_flags)
 {
     int ret = 0;
+    effect_scratch_t scratch;
     pal_effect_custom_payload_t *custom_payload = NULL;
 
     ALOGV("%s: flags 0x%x", __func__, param_send_flags);
@@ -838,7 +877,7 @@ static int reverb_send_params_pal(eff_mode_t mode, pal_stream_handle_t *pal_stre
     if (param_send_flags & OFFLOAD_SEND_REVERB_ENABLE_FLAG) {
         uint32_t num_kvs = 1;
         pal_key_vector_t *pal_key_vector = NULL;
-        pal_key_vector = (pal_key_vector_t *) calloc (1, sizeof(pal_key_vector_t) +
+        pal_key_vector = (pal_key_vector_t *) scratch_get(scratch, sizeof(pal_key_vector_t) +
                                          num_kvs * sizeof(pal_key_value_pair_t));
         if (!pal_key_vector) {
             ALOGE("%s:%d calloc failed for size %zu", __func__, __LINE__,
@@ -851,7 +890,7 @@ static int reverb_send_params_pal(eff_mode_t mode, pal_stream_handle_t *pal_stre
         pal_key_vector->kvp[0].value = reverb->enable_flag;
         ret = send_kv_payload(pal_stream_handle, TAG_STREAM_REVERB,
                               pal_key_vector);
-        free(pal_key_vector);
+        scratch_put(scratch, pal_key_vector);
         if (ret) {
             ALOGE("%s: pal_stream_set_param failed. ret = %d", __func__, ret);
             goto done;
@@ -860,7 +899,7 @@ static int reverb_send_params_pal(eff_mode_t mode, pal_stream_handle_t *pal_stre
     if (param_send_flags & OFFLOAD_SEND_REVERB_MODE) {
         uint32_t custom_data_sz = REVERB_MODE_PARAM_LEN * sizeof(uint32_t);
 
-        custom_payload = (pal_effect_custom_payload_t *) calloc (1,
+        custom_payload = (pal_effect_custom_payload_t *) scratch_get(scratch,
                                            sizeof(pal_effect_custom_payload_t) +
                                            custom_data_sz);
         if (!custom_payload) {
@@ -874,7 +913,7 @@ static int reverb_send_params_pal(eff_mode_t mode, pal_stream_handle_t *pal_stre
 
         ret = send_custom_payload(pal_stream_handle, TAG_STREAM_REVERB,
                               custom_payload, custom_data_sz);
-        free(custom_payload);
+        scratch_put(scratch, custom_payload);
         custom_payload = NULL;
         if (ret) {
             ALOGE("%s: pal_stream_set_param failed. ret = %d", __func__, ret);
@@ -884,7 +923,7 @@ static int reverb_send_params_pal(eff_mode_t mode, pal_stream_handle_t *pal_stre
     if (param_send_flags & OFFLOAD_SEND_REVERB_PRESET) {
         uint32_t custom_data_sz = REVERB_PRESET_PARAM_LEN * sizeof(uint32_t);
 
-        custom_payload = (pal_effect_custom_payload_t *) calloc (1,
+        custom_payload = (pal_effect_custom_payload_t *) scratch_get(scratch,
                                            sizeof(pal_effect_custom_payload_t) +
                                            custom_data_sz);
         if (!custom_payload) {
@@ -898,7 +937,7 @@ static int reverb_send_params_pal(eff_mode_t mode, pal_stream_handle_t *pal_stre
 
         ret = send_custom_payload(pal_stream_handle, TAG_STREAM_REVERB,
                               custom_payload, custom_data_sz);
-        free(custom_payload);
+        scratch_put(scratch, custom_payload);
         custom_payload = NULL;
         if (ret) {
             ALOGE("%s: pal_stream_set_param failed. ret = %d", __func__, ret);
@@ -909,7 +948,7 @@ static int reverb_send_params_pal(eff_mode_t mode, pal_stream_handle_t *pal_stre
         // param_id + actual payload
         uint32_t custom_data_sz = REVERB_WET_MIX_PARAM_LEN * sizeof(uint32_t);
 
-        custom_payload = (pal_effect_custom_payload_t *) calloc (1,
+        custom_payload = (pal_effect_custom_payload_t *) scratch_get(scratch,
                                             sizeof(pal_effect_custom_payload_t) +
                                             custom_data_sz);
         if (!custom_payload) {
@@ -924,7 +963,7 @@ static int reverb_send_params_pal(eff_mode_t mode, pal_stream_handle_t *pal_stre
 
         ret = send_custom_payload(pal_stream_handle, TAG_STREAM_REVERB,
                               custom_payload, custom_data_sz);
-        free(custom_payload);
+        scratch_put(scratch, custom_payload);
         custom_payload = NULL;
         if (ret) {
             ALOGE("%s: pal_stream_set_param failed. ret = %d", __func__, ret);
@@ -934,7 +973,7 @@ static int reverb_send_params_pal(eff_mode_t mode, pal_stream_handle_t *pal_stre
     if (param_send_flags & OFFLOAD_SEND_REVERB_GAIN_ADJUST) {
         uint32_t custom_data_sz = REVERB_GAIN_ADJUST_PARAM_LEN * sizeof(uint32_t);
 
-        custom_payload = (pal_effect_custom_payload_t *) calloc (1,
+        custom_payload = (pal_effect_custom_payload_t *) scratch_get(scratch,
                                             sizeof(pal_effect_custom_payload_t) +
                                             custom_data_sz);
         if (!custom_payload) {
@@ -949,7 +988,7 @@ static int reverb_send_params_pal(eff_mode_t mode, pal_stream_handle_t *pal_stre
 
         ret = send_custom_payload(pal_stream_handle, TAG_STREAM_REVERB,
                               custom_payload, custom_data_sz);
-        free(custom_payload);
+        scratch_put(scratch, custom_payload);
         custom_payload = NULL;
         if (ret) {
             ALOGE("%s: pal_stream_set_param failed. ret = %d", __func__, ret);
@@ -958,7 +997,7 @@ static int reverb_send_params_pal(eff_mode_t mode, pal_stream_handle_t *pal_stre
     }
     if (param_send_flags & OFFLOAD_SEND_REVERB_ROOM_LEVEL) {
         uint32_t custom_data_sz = REVERB_ROOM_LEVEL_PARAM_LEN * sizeof(uint32_t);
-        custom_payload = (pal_effect_custom_payload_t *) calloc (1,
+        custom_payload = (pal_effect_custom_payload_t *) scratch_get(scratch,
                                             sizeof(pal_effect_custom_payload_t) +
                                             custom_data_sz);
         if (!custom_payload) {
@@ -972,7 +1011,7 @@ static int reverb_send_params_pal(eff_mode_t mode, pal_stream_handle_t *pal_stre
 
         ret = send_custom_payload(pal_stream_handle, TAG_STREAM_REVERB,
                               custom_payload, custom_data_sz);
-        free(custom_payload);
+        scratch_put(scratch, custom_payload);
         custom_payload = NULL;
         if (ret) {
             ALOGE("%s: pal_stream_set_param failed. ret = %d", __func__, ret);
@@ -981,7 +1020,7 @@ static int reverb_send_params_pal(eff_mode_t mode, pal_stream_handle_t *pal_stre
     }
     if (param_send_flags & OFFLOAD_SEND_REVERB_ROOM_HF_LEVEL) {
         uint32_t custom_data_sz = REVERB_ROOM_HF_LEVEL_PARAM_LEN * sizeof(uint32_t);
-        custom_payload = (pal_effect_custom_payload_t *) calloc (1,
+        custom_payload = (pal_effect_custom_payload_t *) scratch_get(scratch,
                                             sizeof(pal_effect_custom_payload_t) +
                                             custom_data_sz);
         if (!custom_payload) {
@@ -995,7 +1034,7 @@ static int reverb_send_params_pal(eff_mode_t mode, pal_stream_handle_t *pal_stre
 
         ret = send_custom_payload(pal_stream_handle, TAG_STREAM_REVERB,
                               custom_payload, custom_data_sz);
-        free(custom_payload);
+        scratch_put(scratch, custom_payload);
         custom_payload = NULL;
         if (ret) {
             ALOGE("%s: pal_stream_set_param failed. ret = %d", __func__, ret);
@@ -1004,7 +1043,7 @@ static int reverb_send_params_pal(eff_mode_t mode, pal_stream_handle_t *pal_stre
     }
     if (param_send_flags & OFFLOAD_SEND_REVERB_DECAY_TIME) {
         uint32_t custom_data_sz = REVERB_DECAY_TIME_PARAM_LEN * sizeof(uint32_t);
-        custom_payload = (pal_effect_custom_payload_t *) calloc (1,
+        custom_payload = (pal_effect_custom_payload_t *) scratch_get(scratch,
                                               sizeof(pal_effect_custom_payload_t) +
                                               custom_data_sz);
         if (!custom_payload) {
@@ -1018,7 +1057,7 @@ static int reverb_send_params_pal(eff_mode_t mode, pal_stream_handle_t *pal_stre
 
         ret = send_custom_payload(pal_stream_handle, TAG_STREAM_REVERB,
                               custom_payload, custom_data_sz);
-        free(custom_payload);
+        scratch_put(scratch, custom_payload);
         custom_payload = NULL;
         if (ret) {
             ALOGE("%s: pal_stream_set_param failed. ret = %d", __func__, ret);
@@ -1027,7 +1066,7 @@ static int reverb_send_params_pal(eff_mode_t mode, pal_stream_handle_t *pal_stre
     }
     if (param_send_flags & OFFLOAD_SEND_REVERB_DECAY_HF_RATIO) {
         uint32_t custom_data_sz = REVERB_DECAY_HF_RATIO_PARAM_LEN * sizeof(uint32_t);
-        custom_payload = (pal_effect_custom_payload_t *) calloc (1,
+        custom_payload = (pal_effect_custom_payload_t *) scratch_get(scratch,
                                               sizeof(pal_effect_custom_payload_t) +
                                               custom_data_sz);
         if (!custom_payload) {
@@ -1041,7 +1080,7 @@ static int reverb_send_params_pal(eff_mode_t mode, pal_stream_handle_t *pal_stre
 
         ret = send_custom_payload(pal_stream_handle, TAG_STREAM_REVERB,
                               custom_payload, custom_data_sz);
-        free(custom_payload);
+        scratch_put(scratch, custom_payload);
         custom_payload = NULL;
         if (ret) {
             ALOGE("%s: pal_stream_set_param failed. ret = %d", __func__, ret);
@@ -1050,7 +1089,7 @@ static int reverb_send_params_pal(eff_mode_t mode, pal_stream_handle_t *pal_stre
     }
     if (param_send_flags & OFFLOAD_SEND_REVERB_REFLECTIONS_LEVEL) {
         uint32_t custom_data_sz = REVERB_REFLECTIONS_LEVEL_PARAM_LEN * sizeof(uint32_t);
-        custom_payload = (pal_effect_custom_payload_t *) calloc (1,
+        custom_payload = (pal_effect_custom_payload_t *) scratch_get(scratch,
                                             sizeof(pal_effect_custom_payload_t) +
                                             custom_data_sz);
         if (!custom_payload) {
@@ -1064,7 +1103,7 @@ static int reverb_send_params_pal(eff_mode_t mode, pal_stream_handle_t *pal_stre
         custom_payload->data[0] = reverb->reflections_level;
         ret = send_custom_payload(pal_stream_handle, TAG_STREAM_REVERB,
                               custom_payload, custom_data_sz);
-        free(custom_payload);
+        scratch_put(scratch, custom_payload);
         custom_payload = NULL;
         if (ret) {
             ALOGE("%s: pal_stream_set_param failed. ret = %d", __func__, ret);
@@ -1073,7 +1112,7 @@ static int reverb_send_params_pal(eff_mode_t mode, pal_stream_handle_t *pal_stre
     }
     if (param_send_flags & OFFLOAD_SEND_REVERB_REFLECTIONS_DELAY) {
         uint32_t custom_data_sz = REVERB_REFLECTIONS_DELAY_PARAM_LEN * sizeof(uint32_t);
-        custom_payload = (pal_effect_custom_payload_t *) calloc (1,
+        custom_payload = (pal_effect_custom_payload_t *) scratch_get(scratch,
                                              sizeof(pal_effect_custom_payload_t) +
                                              custom_data_sz);
         if (!custom_payload) {
@@ -1088,7 +1127,7 @@ static int reverb_send_params_pal(eff_mode_t mode, pal_stream_handle_t *pal_stre
 
         ret = send_custom_payload(pal_stream_handle, TAG_STREAM_REVERB,
                               custom_payload, custom_data_sz);
-        free(custom_payload);
+        scratch_put(scratch, custom_payload);
         custom_payload = NULL;
         if (ret) {
             ALOGE("%s: pal_stream_set_param failed. ret = %d", __func__, ret);
@@ -1097,7 +1136,7 @@ static int reverb_send_params_pal(eff_mode_t mode, pal_stream_handle_t *pal_stre
     }
     if (param_send_flags & OFFLOAD_SEND_REVERB_LEVEL) {
         uint32_t custom_data_sz = REVERB_LEVEL_PARAM_LEN * sizeof(uint32_t);
-        custom_payload = (pal_effect_custom_payload_t *) calloc (1,
+        custom_payload = (pal_effect_custom_payload_t *) scratch_get(scratch,
                                               sizeof(pal_effect_custom_payload_t) +
                                               custom_data_sz);
         if (!custom_payload) {
@@ -1110,7 +1149,7 @@ static int reverb_send_params_pal(eff_mode_t mode, pal_stream_handle_t *pal_stre
         custom_payload->data[0] = reverb->level;
         ret = send_custom_payload(pal_stream_handle, TAG_STREAM_REVERB,
                               custom_payload, custom_data_sz);
-        free(custom_payload);
+        scratch_put(scratch, custom_payload);
         custom_payload = NULL;
         if (ret) {
             ALOGE("%s: pal_stream_set_param failed. ret = %d", __func__, ret);
@@ -1120,7 +1159,7 @@ static int reverb_send_params_pal(eff_mode_t mode, pal_stream_handle_t *pal_stre
     }
     if (param_send_flags & OFFLOAD_SEND_REVERB_DELAY) {
         uint32_t custom_data_sz = REVERB_DELAY_PARAM_LEN * sizeof(uint32_t);
-        custom_payload = (pal_effect_custom_payload_t *) calloc (1,
+        custom_payload = (pal_effect_custom_payload_t *) scratch_get(scratch,
                                              sizeof(pal_effect_custom_payload_t) +
                                              custom_data_sz);
         if (!custom_payload) {
@@ -1133,7 +1172,7 @@ static int reverb_send_params_pal(eff_mode_t mode, pal_stream_handle_t *pal_stre
         custom_payload->data[0] = reverb->delay;
         ret = send_custom_payload(pal_stream_handle, TAG_STREAM_REVERB,
                               custom_payload, custom_data_sz);
-        free(custom_payload);
+        scratch_put(scratch, custom_payload);
         custom_payload = NULL;
         if (ret) {
             ALOGE("%s: pal_stream_set_param failed. ret = %d", __func__, ret);
@@ -1142,7 +1181,7 @@ static int reverb_send_params_pal(eff_mode_t mode, pal_stream_handle_t *pal_stre
     }
     if (param_send_flags & OFFLOAD_SEND_REVERB_DIFFUSION) {
         uint32_t custom_data_sz = REVERB_DIFFUSION_PARAM_LEN * sizeof(uint32_t);
-        custom_payload = (pal_effect_custom_payload_t *) calloc (1,
+        custom_payload = (pal_effect_custom_payload_t *) scratch_get(scratch,
                                            sizeof(pal_effect_custom_payload_t) +
                                            custom_data_sz);
         if (!custom_payload) {
@@ -1156,7 +1195,7 @@ static int reverb_send_params_pal(eff_mode_t mode, pal_stream_handle_t *pal_stre
 
         ret = send_custom_payload(pal_stream_handle, TAG_STREAM_REVERB,
                               custom_payload, custom_data_sz);
-        free(custom_payload);
+        scratch_put(scratch, custom_payload);
         custom_payload = NULL;
         if (ret) {
             ALOGE("%s: pal_stream_set_param failed. ret = %d", __func__, ret);
@@ -1165,7 +1204,7 @@ static int reverb_send_params_pal(eff_mode_t mode, pal_stream_handle_t *pal_stre
     }
     if (param_send_flags & OFFLOAD_SEND_REVERB_DENSITY) {
         uint32_t custom_data_sz = REVERB_DENSITY_PARAM_LEN * sizeof(uint32_t);
-        custom_payload = (pal_effect_custom_payload_t *) calloc (1,
+        custom_payload = (pal_effect_custom_payload_t *) scratch_get(scratch,
                                            sizeof(pal_effect_custom_payload_t) +
                                            custom_data_sz);
         if (!custom_payload) {
@@ -1178,7 +1217,7 @@ static int reverb_send_params_pal(eff_mode_t mode, pal_stream_handle_t *pal_stre
         custom_payload->data[0] = reverb->density;
         ret = send_custom_payload(pal_stream_handle, TAG_STREAM_REVERB,
                               custom_payload, custom_data_sz);
-        free(custom_payload);
+        scratch_put(scratch, custom_payload);
         custom_payload = NULL;
         if (ret) {
             ALOGE("%s: pal_stream_set_param failed. ret = %d", __func__, ret);
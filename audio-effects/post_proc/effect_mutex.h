@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+#ifndef OFFLOAD_EFFECT_MUTEX_H_
+#define OFFLOAD_EFFECT_MUTEX_H_
+
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
+
+/*
+ * pthread mutex that reports waits and hold times to the audio HAL, where
+ * they show up in the lock contention section of the HAL dump next to its
+ * own AudioMutex locks. The effect libraries do not link the HAL, so the
+ * HAL entry points (audio_hw_mutex_*, see hal/AudioMutex.h) arrive through
+ * effect_mutex_set_hooks(). Without them, and always on HAL builds without
+ * mutex profiling, this is a plain pthread mutex.
+ *
+ * Stats are looked up per lock name under the lock itself, so hooks set
+ * while the lock is in use take effect from the next acquisition on.
+ */
+typedef void *(*effect_mutex_stats_t)(const char *name);
+typedef void (*effect_mutex_acquired_t)(void *stats, int contended, void *blocker,
+                                        uint64_t wait_ns);
+typedef void (*effect_mutex_released_t)(void *stats, uint64_t hold_ns);
+
+typedef struct effect_mutex {
+    pthread_mutex_t mutex;
+    const char *name;
+    void *stats;                /* HAL side stats, NULL until hooks are set */
+    void *owner_pc;
+    uint64_t acquired_ns;
+} effect_mutex_t;
+
+static effect_mutex_stats_t effect_mutex_stats_hook;
+static effect_mutex_acquired_t effect_mutex_acquired_hook;
+static effect_mutex_released_t effect_mutex_released_hook;
+
+static inline void effect_mutex_set_hooks(effect_mutex_stats_t stats,
+                                          effect_mutex_acquired_t acquired,
+                                          effect_mutex_released_t released)
+{
+    if (!stats || !acquired || !released)
+        return;
+    effect_mutex_acquired_hook = acquired;
+    effect_mutex_released_hook = released;
+    /* published last, lockers only go on to the others once they see it */
+    __atomic_store_n(&effect_mutex_stats_hook, stats, __ATOMIC_RELEASE);
+}
+
+static inline void effect_mutex_init(effect_mutex_t *m, const char *name)
+{
+    pthread_mutex_init(&m->mutex, NULL);
+    m->name = name;
+    m->stats = NULL;
+    m->owner_pc = NULL;
+    m->acquired_ns = 0;
+}
+
+static inline uint64_t effect_mutex_now()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static inline void effect_mutex_acquired(effect_mutex_t *m, void *pc, int contended,
+                                         void *blocker, uint64_t wait_ns)
+{
+    __atomic_store_n(&m->owner_pc, pc, __ATOMIC_RELAXED);
+    m->acquired_ns = effect_mutex_now();
+    effect_mutex_acquired_hook(m->stats, contended, blocker, wait_ns);
+}
+
+static __attribute__((noinline, unused)) void effect_mutex_lock(effect_mutex_t *m)
+{
+    void *pc = __builtin_return_address(0);
+    effect_mutex_stats_t get_stats;
+    void *blocker;
+    uint64_t start;
+
+    if (!__atomic_load_n(&m->stats, __ATOMIC_ACQUIRE)) {
+        pthread_mutex_lock(&m->mutex);
+        get_stats = __atomic_load_n(&effect_mutex_stats_hook, __ATOMIC_ACQUIRE);
+        if (!get_stats)
+            return;
+        /* first acquisition since the HAL handed its hooks over */
+        __atomic_store_n(&m->stats, get_stats(m->name), __ATOMIC_RELEASE);
+        if (m->stats)
+            effect_mutex_acquired(m, pc, 0, NULL, 0);
+        return;
+    }
+
+    if (!pthread_mutex_trylock(&m->mutex)) {
+        effect_mutex_acquired(m, pc, 0, NULL, 0);
+        return;
+    }
+    /* unlocked read, only names the likely holder */
+    blocker = __atomic_load_n(&m->owner_pc, __ATOMIC_RELAXED);
+    start = effect_mutex_now();
+    pthread_mutex_lock(&m->mutex);
+    effect_mutex_acquired(m, pc, 1, blocker, effect_mutex_now() - start);
+}
+
+static inline void effect_mutex_unlock(effect_mutex_t *m)
+{
+    void *stats = m->stats;
+    uint64_t hold = stats ? effect_mutex_now() - m->acquired_ns : 0;
+
+    pthread_mutex_unlock(&m->mutex);
+    if (stats)
+        effect_mutex_released_hook(stats, hold);
+}
+
+#endif /* OFFLOAD_EFFECT_MUTEX_H_ */
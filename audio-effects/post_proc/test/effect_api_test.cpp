@@ -0,0 +1,253 @@
+/*
+ * Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "AllocCount.h"
+#include "PalSim.h"
+#include "effect_api.h"
+#include "kvh2xml.h"
+
+/* EFFECT_PAYLOAD_INLINE_SIZE in effect_api.c */
+#define INLINE_PAYLOAD_SIZE 256
+
+/* one PAL_PARAM_ID_UIEFFECT payload as the simulator saw it */
+typedef struct sent_param {
+    uint32_t param_id;
+    std::vector<uint8_t> payload;
+} sent_param_t;
+
+class EffectApiTest : public ::testing::Test {
+protected:
+    static void SetUpTestSuite() {
+        ASSERT_EQ(0, pal_init());
+    }
+
+    static void TearDownTestSuite() {
+        pal_deinit();
+    }
+
+    void SetUp() override {
+        struct pal_stream_attributes attr = {};
+
+        /* the simulator reports set_param of PCM outputs only */
+        attr.type = PAL_STREAM_DEEP_BUFFER;
+        attr.direction = PAL_AUDIO_OUTPUT;
+        attr.out_media_config.sample_rate = 48000;
+        attr.out_media_config.bit_width = 16;
+        attr.out_media_config.ch_info.channels = 2;
+        ASSERT_EQ(0, pal_stream_open(&attr, 0, nullptr, 0, nullptr, nullptr, 0, &handle_));
+        pal_sim_clear_faults();
+        sent_.clear();
+        pal_sim_set_param_hook(Hook, this);
+    }
+
+    void TearDown() override {
+        pal_sim_set_param_hook(nullptr, nullptr);
+        pal_stream_close(handle_);
+    }
+
+    static void Hook(uint32_t param_id, const void *payload, size_t size,
+                     uint64_t render_ns, void *cookie) {
+        const uint8_t *p = (const uint8_t *)payload;
+
+        ((EffectApiTest *)cookie)->sent_.push_back({param_id,
+                                                   std::vector<uint8_t>(p, p + size)});
+    }
+
+    /* header of the i-th payload, checks it is well formed */
+    const effect_pal_payload_t *Effect(size_t i) {
+        const effect_pal_payload_t *effect;
+
+        if (i >= sent_.size() || sent_[i].payload.size() < sizeof(*effect))
+            return nullptr;
+        effect = (const effect_pal_payload_t *)sent_[i].payload.data();
+        EXPECT_EQ(PAL_PARAM_ID_UIEFFECT, sent_[i].param_id);
+        EXPECT_EQ(sent_[i].payload.size(), sizeof(*effect) + effect->payloadSize);
+        return effect;
+    }
+
+    const pal_effect_custom_payload_t *Custom(size_t i, uint32_t words) {
+        const effect_pal_payload_t *effect = Effect(i);
+
+        if (!effect || effect->isTKV != PARAM_NONTKV ||
+            effect->payloadSize != sizeof(pal_effect_custom_payload_t) + words * sizeof(uint32_t))
+            return nullptr;
+        return (const pal_effect_custom_payload_t *)(effect + 1);
+    }
+
+    pal_stream_handle_t *handle_ = nullptr;
+    std::vector<sent_param_t> sent_;
+};
+
+TEST_F(EffectApiTest, EnableFlagIsOneKeyValue) {
+    struct eq_params eq = {};
+    const effect_pal_payload_t *effect;
+    const pal_key_vector_t *kv;
+
+    offload_eq_set_enable_flag(&eq, true);
+    ASSERT_EQ(0, offload_eq_send_params_pal(handle_, &eq, OFFLOAD_SEND_EQ_ENABLE_FLAG));
+    ASSERT_EQ(1u, sent_.size());
+
+    effect = Effect(0);
+    ASSERT_NE(nullptr, effect);
+    EXPECT_EQ(PARAM_TKV, effect->isTKV);
+    EXPECT_EQ(TAG_STREAM_EQUALIZER, effect->tag);
+    kv = (const pal_key_vector_t *)(effect + 1);
+    ASSERT_EQ(1u, kv->num_tkvs);
+    EXPECT_EQ(EQUALIZER_SWITCH, kv->kvp[0].key);
+    EXPECT_EQ(1u, kv->kvp[0].value);
+}
+
+TEST_F(EffectApiTest, PresetIsACustomPayload) {
+    struct eq_params eq = {};
+    const pal_effect_custom_payload_t *custom;
+
+    offload_eq_set_preset(&eq, 2);
+    ASSERT_EQ(0, offload_eq_send_params_pal(handle_, &eq, OFFLOAD_SEND_EQ_PRESET));
+    ASSERT_EQ(1u, sent_.size());
+
+    custom = Custom(0, EQ_CONFIG_PARAM_LEN);
+    ASSERT_NE(nullptr, custom);
+    EXPECT_EQ((uint32_t)PARAM_ID_EQ_CONFIG, custom->paramId);
+    EXPECT_EQ((uint32_t)eq.config.eq_pregain, custom->data[0]);
+    EXPECT_NE(0u, custom->data[1]);
+    EXPECT_EQ(0u, custom->data[2]) << "no bands with a preset";
+}
+
+/* the band payload outgrows the inline buffer on the way to MAX_EQ_BANDS */
+TEST_F(EffectApiTest, BandsSurviveEveryPayloadSize) {
+    uint16_t freq[MAX_EQ_BANDS];
+    int gain[MAX_EQ_BANDS];
+
+    for (int i = 0; i < MAX_EQ_BANDS; i++) {
+        freq[i] = 60 << (i % 8);
+        gain[i] = i - 6;
+    }
+
+    for (int bands = 1; bands <= MAX_EQ_BANDS; bands++) {
+        struct eq_params eq = {};
+        const pal_effect_custom_payload_t *custom;
+
+        SCOPED_TRACE(bands);
+        sent_.clear();
+        offload_eq_set_preset(&eq, 0);
+        offload_eq_set_bands_level(&eq, bands, freq, gain);
+        ASSERT_EQ(0, offload_eq_send_params_pal(handle_, &eq, OFFLOAD_SEND_EQ_BANDS_LEVEL));
+        ASSERT_EQ(1u, sent_.size());
+
+        custom = Custom(0, EQ_CONFIG_PARAM_LEN + bands * EQ_CONFIG_PER_BAND_PARAM_LEN);
+        ASSERT_NE(nullptr, custom);
+        EXPECT_EQ((uint32_t)bands, custom->data[2]);
+        for (int i = 0; i < bands; i++) {
+            const uint32_t *band = &custom->data[EQ_CONFIG_PARAM_LEN +
+                                                 i * EQ_CONFIG_PER_BAND_PARAM_LEN];
+
+            EXPECT_EQ(freq[i] * 1000u, band[1]);
+            EXPECT_EQ((uint32_t)(gain[i] * 100), band[2]);
+            EXPECT_EQ((uint32_t)i, band[4]);
+        }
+    }
+}
+
+TEST_F(EffectApiTest, BassBoostSendsEachRequestedParam) {
+    struct bass_boost_params bassboost = {};
+    const pal_effect_custom_payload_t *custom;
+
+    offload_bassboost_set_enable_flag(&bassboost, true);
+    offload_bassboost_set_strength(&bassboost, 500);
+    ASSERT_EQ(0, offload_bassboost_send_params_pal(handle_, &bassboost,
+                  OFFLOAD_SEND_BASSBOOST_ENABLE_FLAG | OFFLOAD_SEND_BASSBOOST_STRENGTH));
+    ASSERT_EQ(2u, sent_.size());
+
+    ASSERT_NE(nullptr, Effect(0));
+    EXPECT_EQ(TAG_STREAM_BASS_BOOST, Effect(0)->tag);
+    custom = Custom(1, BASS_BOOST_STRENGTH_PARAM_LEN);
+    ASSERT_NE(nullptr, custom);
+    EXPECT_EQ((uint32_t)PARAM_ID_BASS_BOOST_STRENGTH, custom->paramId);
+    EXPECT_EQ(500u, custom->data[0]);
+}
+
+TEST_F(EffectApiTest, PalErrorIsReturned) {
+    uint16_t freq[MAX_EQ_BANDS] = {};
+    int gain[MAX_EQ_BANDS] = {};
+    struct eq_params eq = {};
+
+    /* both the inline and the heap built payload */
+    pal_sim_set_fault(PAL_SIM_OP_SET_PARAM, 1.0, -EIO);
+    offload_eq_set_enable_flag(&eq, true);
+    EXPECT_EQ(-EIO, offload_eq_send_params_pal(handle_, &eq, OFFLOAD_SEND_EQ_ENABLE_FLAG));
+    offload_eq_set_preset(&eq, 0);
+    offload_eq_set_bands_level(&eq, MAX_EQ_BANDS, freq, gain);
+    EXPECT_EQ(-EIO, offload_eq_send_params_pal(handle_, &eq, OFFLOAD_SEND_EQ_BANDS_LEVEL));
+    EXPECT_TRUE(sent_.empty());
+}
+
+/* the hook copies every payload, so it is off while allocations are counted */
+TEST_F(EffectApiTest, InlineSizedParamsDoNotAllocate) {
+    uint16_t freq[MAX_EQ_BANDS] = {};
+    int gain[MAX_EQ_BANDS] = {};
+    struct bass_boost_params bassboost = {};
+    struct eq_params eq = {};
+    uint64_t allocs;
+    int ret;
+
+    pal_sim_set_param_hook(nullptr, nullptr);
+    offload_eq_set_enable_flag(&eq, true);
+    offload_eq_set_preset(&eq, 1);
+    offload_bassboost_set_enable_flag(&bassboost, true);
+    offload_bassboost_set_strength(&bassboost, 500);
+
+    {
+        AllocScope scope;
+
+        ret = offload_eq_send_params_pal(handle_, &eq,
+                  OFFLOAD_SEND_EQ_ENABLE_FLAG | OFFLOAD_SEND_EQ_PRESET);
+        allocs = scope.Count();
+    }
+    EXPECT_EQ(0, ret);
+    EXPECT_EQ(0u, allocs) << "eq enable and preset";
+
+    {
+        AllocScope scope;
+
+        ret = offload_bassboost_send_params_pal(handle_, &bassboost,
+                  OFFLOAD_SEND_BASSBOOST_ENABLE_FLAG | OFFLOAD_SEND_BASSBOOST_STRENGTH);
+        allocs = scope.Count();
+    }
+    EXPECT_EQ(0, ret);
+    EXPECT_EQ(0u, allocs) << "bass boost enable and strength";
+
+    for (int bands = 1; bands <= MAX_EQ_BANDS; bands++) {
+        size_t size = sizeof(pal_param_payload) + sizeof(effect_pal_payload_t) +
+                      sizeof(pal_effect_custom_payload_t) +
+                      (EQ_CONFIG_PARAM_LEN + bands * EQ_CONFIG_PER_BAND_PARAM_LEN) *
+                      sizeof(uint32_t);
+
+        if (size > INLINE_PAYLOAD_SIZE)
+            break;
+        offload_eq_set_preset(&eq, 0);
+        offload_eq_set_bands_level(&eq, bands, freq, gain);
+        {
+            AllocScope scope;
+
+            ret = offload_eq_send_params_pal(handle_, &eq, OFFLOAD_SEND_EQ_BANDS_LEVEL);
+            allocs = scope.Count();
+        }
+        EXPECT_EQ(0, ret);
+        EXPECT_EQ(0u, allocs) << bands << " bands";
+    }
+}
+
+TEST_F(EffectApiTest, NullHandleIsRejected) {
+    struct eq_params eq = {};
+
+    EXPECT_EQ(-EINVAL, offload_eq_send_params_pal(nullptr, &eq, OFFLOAD_SEND_EQ_ENABLE_FLAG));
+}
@@ -0,0 +1,188 @@
+/*
+ * Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+/*
+ * Cost of the offload effect parameter senders, on libpal_sim, and of the
+ * volume listener process call AudioFlinger makes on every mixer buffer.
+ */
+
+#include <string.h>
+
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <hardware/audio_effect.h>
+#include <sound/audio_effects.h>
+
+#include "PalSim.h"
+#include "effect_api.h"
+
+extern "C" audio_effect_library_t AUDIO_EFFECT_LIBRARY_INFO_SYM;
+
+static const effect_uuid_t vol_listener_music_uuid =
+    {0x08b8b058, 0x0590, 0x11e5, 0xac71, {0x00, 0x25, 0xb3, 0x26, 0x54, 0xa0}};
+
+static pal_stream_handle_t *OpenPalOutput() {
+    struct pal_stream_attributes attr = {};
+    pal_stream_handle_t *handle = nullptr;
+
+    attr.type = PAL_STREAM_DEEP_BUFFER;
+    attr.direction = PAL_AUDIO_OUTPUT;
+    attr.out_media_config.sample_rate = 48000;
+    attr.out_media_config.bit_width = 16;
+    attr.out_media_config.ch_info.channels = 2;
+    if (pal_stream_open(&attr, 0, nullptr, 0, nullptr, nullptr, 0, &handle))
+        return nullptr;
+    return handle;
+}
+
+static void BM_EqSend(benchmark::State& state) {
+    pal_stream_handle_t *handle = OpenPalOutput();
+    struct eq_params eq = {};
+    uint16_t freq[MAX_EQ_BANDS];
+    int gain[MAX_EQ_BANDS];
+
+    if (!handle) {
+        state.SkipWithError("pal_stream_open failed");
+        return;
+    }
+    for (int i = 0; i < MAX_EQ_BANDS; i++) {
+        freq[i] = 60 << (i % 8);
+        gain[i] = i - 6;
+    }
+    offload_eq_set_enable_flag(&eq, true);
+    offload_eq_set_preset(&eq, 0);
+    offload_eq_set_bands_level(&eq, state.range(0), freq, gain);
+    for (auto _ : state) {
+        if (offload_eq_send_params_pal(handle, &eq, OFFLOAD_SEND_EQ_ENABLE_FLAG |
+                                       OFFLOAD_SEND_EQ_BANDS_LEVEL)) {
+            state.SkipWithError("offload_eq_send_params_pal failed");
+            break;
+        }
+    }
+    pal_stream_close(handle);
+}
+/* past a few bands the payload no longer fits the inline buffer */
+BENCHMARK(BM_EqSend)->Arg(5)->Arg(MAX_EQ_BANDS);
+
+static void BM_BassBoostSend(benchmark::State& state) {
+    pal_stream_handle_t *handle = OpenPalOutput();
+    struct bass_boost_params bassboost = {};
+
+    if (!handle) {
+        state.SkipWithError("pal_stream_open failed");
+        return;
+    }
+    offload_bassboost_set_enable_flag(&bassboost, true);
+    offload_bassboost_set_strength(&bassboost, 500);
+    for (auto _ : state) {
+        if (offload_bassboost_send_params_pal(handle, &bassboost,
+                OFFLOAD_SEND_BASSBOOST_ENABLE_FLAG | OFFLOAD_SEND_BASSBOOST_STRENGTH)) {
+            state.SkipWithError("offload_bassboost_send_params_pal failed");
+            break;
+        }
+    }
+    pal_stream_close(handle);
+}
+BENCHMARK(BM_BassBoostSend);
+
+static void BM_VirtualizerSend(benchmark::State& state) {
+    pal_stream_handle_t *handle = OpenPalOutput();
+    struct virtualizer_params virtualizer = {};
+
+    if (!handle) {
+        state.SkipWithError("pal_stream_open failed");
+        return;
+    }
+    offload_virtualizer_set_enable_flag(&virtualizer, true);
+    offload_virtualizer_set_strength(&virtualizer, 500);
+    for (auto _ : state) {
+        if (offload_virtualizer_send_params_pal(handle, &virtualizer,
+                OFFLOAD_SEND_VIRTUALIZER_ENABLE_FLAG | OFFLOAD_SEND_VIRTUALIZER_STRENGTH)) {
+            state.SkipWithError("offload_virtualizer_send_params_pal failed");
+            break;
+        }
+    }
+    pal_stream_close(handle);
+}
+BENCHMARK(BM_VirtualizerSend);
+
+static void BM_ReverbSend(benchmark::State& state) {
+    pal_stream_handle_t *handle = OpenPalOutput();
+    struct reverb_params reverb = {};
+
+    if (!handle) {
+        state.SkipWithError("pal_stream_open failed");
+        return;
+    }
+    offload_reverb_set_enable_flag(&reverb, true);
+    offload_reverb_set_room_level(&reverb, -1000);
+    offload_reverb_set_decay_time(&reverb, 1490);
+    offload_reverb_set_reverb_level(&reverb, -500);
+    for (auto _ : state) {
+        if (offload_reverb_send_params_pal(handle, &reverb, OFFLOAD_SEND_REVERB_ENABLE_FLAG |
+                OFFLOAD_SEND_REVERB_ROOM_LEVEL | OFFLOAD_SEND_REVERB_DECAY_TIME |
+                OFFLOAD_SEND_REVERB_LEVEL)) {
+            state.SkipWithError("offload_reverb_send_params_pal failed");
+            break;
+        }
+    }
+    pal_stream_close(handle);
+}
+BENCHMARK(BM_ReverbSend);
+
+static int VolumeListenerCommand(effect_handle_t effect, uint32_t cmd, uint32_t size, void *data) {
+    uint32_t reply_size = sizeof(int);
+    int reply = 0;
+    int ret = (*effect)->command(effect, cmd, size, data, &reply_size, &reply);
+
+    return ret ? ret : reply;
+}
+
+/* range(0) frames of stereo 16 bit, range(1) accumulates into the output */
+static void BM_VolumeListenerProcess(benchmark::State& state) {
+    std::vector<int16_t> in(state.range(0) * 2, 1000);
+    std::vector<int16_t> out(state.range(0) * 2, 0);
+    audio_buffer_t in_buf;
+    audio_buffer_t out_buf;
+    effect_config_t config = {};
+    effect_handle_t effect;
+
+    if (AUDIO_EFFECT_LIBRARY_INFO_SYM.create_effect(&vol_listener_music_uuid, 0, 0, &effect)) {
+        state.SkipWithError("create_effect failed");
+        return;
+    }
+    config.outputCfg.accessMode = state.range(1) ? EFFECT_BUFFER_ACCESS_ACCUMULATE :
+                                                   EFFECT_BUFFER_ACCESS_WRITE;
+    if (VolumeListenerCommand(effect, EFFECT_CMD_SET_CONFIG, sizeof(config), &config) ||
+        VolumeListenerCommand(effect, EFFECT_CMD_ENABLE, 0, nullptr)) {
+        state.SkipWithError("volume listener setup failed");
+        AUDIO_EFFECT_LIBRARY_INFO_SYM.release_effect(effect);
+        return;
+    }
+    in_buf.frameCount = out_buf.frameCount = state.range(0);
+    in_buf.s16 = in.data();
+    out_buf.s16 = out.data();
+    for (auto _ : state) {
+        (*effect)->process(effect, &in_buf, &out_buf);
+        benchmark::ClobberMemory();
+    }
+    state.SetBytesProcessed(state.iterations() * in.size() * sizeof(int16_t));
+    AUDIO_EFFECT_LIBRARY_INFO_SYM.release_effect(effect);
+}
+BENCHMARK(BM_VolumeListenerProcess)->ArgsProduct({{240, 960, 3840}, {0, 1}});
+
+int main(int argc, char **argv) {
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+        return 1;
+    if (pal_init())
+        return 1;
+
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    pal_deinit();
+    return 0;
+}
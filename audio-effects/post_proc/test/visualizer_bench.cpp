@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+/*
+ * Cost of visualizer_process, which the offload visualizer runs on every
+ * period captured from the DSP, with and without peak/RMS measurement.
+ */
+
+#include <vector>
+
+#include <audio_effects/effect_visualizer.h>
+#include <benchmark/benchmark.h>
+#include <hardware/audio_effect.h>
+
+extern "C" {
+extern audio_effect_library_t AUDIO_EFFECT_LIBRARY_INFO_SYM;
+struct effect_context_s;
+int visualizer_process(struct effect_context_s *context, audio_buffer_t *in,
+                       audio_buffer_t *out);
+}
+
+static const effect_uuid_t offload_visualizer_uuid =
+    {0x7a8044a0, 0x1a71, 0x11e3, 0xa184, {0x00, 0x02, 0xa5, 0xd5, 0xc5, 0x1b}};
+
+static int Command(effect_handle_t effect, uint32_t cmd, uint32_t size, void *data) {
+    uint32_t reply_size = sizeof(int);
+    int reply = 0;
+    int ret = (*effect)->command(effect, cmd, size, data, &reply_size, &reply);
+
+    return ret ? ret : reply;
+}
+
+static int SetParam(effect_handle_t effect, uint32_t param, uint32_t value) {
+    uint32_t buf[sizeof(effect_param_t) / sizeof(uint32_t) + 2] = {};
+    effect_param_t *p = (effect_param_t *)buf;
+
+    p->psize = sizeof(uint32_t);
+    p->vsize = sizeof(uint32_t);
+    *(uint32_t *)p->data = param;
+    *((uint32_t *)p->data + 1) = value;
+    return Command(effect, EFFECT_CMD_SET_PARAM, sizeof(buf), buf);
+}
+
+/* range(0) frames of stereo 16 bit, range(1) adds peak/RMS measurement */
+static void BM_VisualizerProcess(benchmark::State& state) {
+    std::vector<int16_t> in(state.range(0) * 2);
+    std::vector<int16_t> out(state.range(0) * 2);
+    audio_buffer_t in_buf;
+    audio_buffer_t out_buf;
+    effect_handle_t effect;
+
+    if (AUDIO_EFFECT_LIBRARY_INFO_SYM.create_effect(&offload_visualizer_uuid, 0, 1, &effect)) {
+        state.SkipWithError("create_effect failed");
+        return;
+    }
+    if (SetParam(effect, VISUALIZER_PARAM_MEASUREMENT_MODE,
+                 state.range(1) ? MEASUREMENT_MODE_PEAK_RMS : MEASUREMENT_MODE_NONE) ||
+        Command(effect, EFFECT_CMD_ENABLE, 0, nullptr)) {
+        state.SkipWithError("visualizer setup failed");
+        AUDIO_EFFECT_LIBRARY_INFO_SYM.release_effect(effect);
+        return;
+    }
+    for (size_t i = 0; i < in.size(); i++)
+        in[i] = (int16_t)((int)((i * 997) % 16384) - 8192);
+    in_buf.frameCount = out_buf.frameCount = state.range(0);
+    in_buf.s16 = in.data();
+    out_buf.s16 = out.data();
+    for (auto _ : state) {
+        if (visualizer_process((struct effect_context_s *)effect, &in_buf, &out_buf)) {
+            state.SkipWithError("visualizer_process failed");
+            break;
+        }
+        benchmark::ClobberMemory();
+    }
+    state.SetBytesProcessed(state.iterations() * in.size() * sizeof(int16_t));
+    AUDIO_EFFECT_LIBRARY_INFO_SYM.release_effect(effect);
+}
+/* 768 frames is one capture period of the proxy port */
+BENCHMARK(BM_VisualizerProcess)->ArgsProduct({{256, 768, 3072}, {0, 1}});
+
+BENCHMARK_MAIN();
@@ -43,6 +43,7 @@
 #include <hardware/audio_effect.h>
 #include <cutils/properties.h>
 #include "PalDefs.h"
+#include "effect_mutex.h"
 
 #define PRIMARY_HAL_PATH XSTR(LIB_AUDIO_HAL)
 #define XSTR(x) STR(x)
@@ -86,6 +87,11 @@ static void get_library_path(char *lib_path)
 #define AHAL_GAIN_DEPENDENT_INTERFACE_FUNCTION "audio_hw_send_gain_dep_calibration"
 #define AHAL_GAIN_GET_MAPPING_TABLE "audio_hw_get_gain_level_mapping"
 #define AHAL_GAIN_SET_LINEAR_GAIN "audio_hw_send_linear_gain"
+
+/* only exported by HALs built with mutex profiling */
+#define AHAL_MUTEX_STATS "audio_hw_mutex_stats"
+#define AHAL_MUTEX_ACQUIRED "audio_hw_mutex_acquired"
+#define AHAL_MUTEX_RELEASED "audio_hw_mutex_released"
 #define DEFAULT_CAL_STEP 0
 #define LIN_VOLUME_QFACTOR_28 28
 
@@ -250,7 +256,7 @@ static bool dumping_enabled = false;
 struct listnode vol_effect_list;
 
 /* lock must be held when modifying or accessing created_effects_list */
-pthread_mutex_t vol_listner_init_lock;
+effect_mutex_t vol_listner_init_lock;
 
 static bool headset_cal_enabled;
 
@@ -423,7 +429,7 @@ static int vol_effect_process(effect_handle_t self,
     ALOGV("%s Called ", __func__);
 
     vol_listener_context_t *context = (vol_listener_context_t *)self;
-    pthread_mutex_lock(&vol_listner_init_lock);
+    effect_mutex_lock(&vol_listner_init_lock);
 
     if (context->state != VOL_LISTENER_STATE_ACTIVE) {
         ALOGE("%s: state is not active .. return error", __func__);
@@ -447,7 +453,7 @@ static int vol_effect_process(effect_handle_t self,
     }
 
 exit:
-    pthread_mutex_unlock(&vol_listner_init_lock);
+    effect_mutex_unlock(&vol_listner_init_lock);
     return status;
 }
 
@@ -461,7 +467,7 @@ static int vol_effect_command(effect_handle_t self,
     int status = 0;
 
     ALOGV("%s Called ", __func__);
-    pthread_mutex_lock(&vol_listner_init_lock);
+    effect_mutex_lock(&vol_listner_init_lock);
 
     if (context == NULL || context->state == VOL_LISTENER_STATE_UNINITIALIZED) {
         ALOGE("%s: %s is NULL", __func__, (context == NULL) ?
@@ -652,7 +658,7 @@ static int vol_effect_command(effect_handle_t self,
     }
 
 exit:
-    pthread_mutex_unlock(&vol_listner_init_lock);
+    effect_mutex_unlock(&vol_listner_init_lock);
     return status;
 }
 
@@ -686,7 +692,7 @@ static void init_once()
     get_custom_gain_table = NULL;
     send_linear_gain = NULL;
 
-    pthread_mutex_init(&vol_listner_init_lock, NULL);
+    effect_mutex_init(&vol_listner_init_lock, "vol_listner_init_lock");
 
     get_library_path(audio_hal_lib);
 
@@ -707,6 +713,11 @@ static void init_once()
                 ALOGE("Couldnt able to get the function %s symbol",  AHAL_GAIN_SET_LINEAR_GAIN);
             }
 
+            effect_mutex_set_hooks(
+                (effect_mutex_stats_t)dlsym(hal_lib_pointer, AHAL_MUTEX_STATS),
+                (effect_mutex_acquired_t)dlsym(hal_lib_pointer, AHAL_MUTEX_ACQUIRED),
+                (effect_mutex_released_t)dlsym(hal_lib_pointer, AHAL_MUTEX_RELEASED));
+
             get_custom_gain_table = (int (*) (struct pal_amp_db_and_gain_table *, int))
                dlsym(hal_lib_pointer, AHAL_GAIN_GET_MAPPING_TABLE);
             if (get_custom_gain_table == NULL) {
@@ -820,12 +831,12 @@ static int vol_prc_lib_create(const effect_uuid_t *uuid,
     context->session_id = session_id;
 
     // Add this to master list
-    pthread_mutex_lock(&vol_listner_init_lock);
+    effect_mutex_lock(&vol_listner_init_lock);
     list_add_tail(&vol_effect_list, &context->effect_list_node);
     if (dumping_enabled) {
         dump_list_l();
     }
-    pthread_mutex_unlock(&vol_listner_init_lock);
+    effect_mutex_unlock(&vol_listner_init_lock);
 
     *p_handle = (effect_handle_t)context;
     enable_gcov();
@@ -846,7 +857,7 @@ static int vol_prc_lib_release(effect_handle_t handle)
     if (recv_contex == NULL) {
         return status;
     }
-    pthread_mutex_lock(&vol_listner_init_lock);
+    effect_mutex_lock(&vol_listner_init_lock);
 
     // check if the handle/context provided is valid
     list_for_each_safe(node, temp_node_next, &vol_effect_list) {
@@ -868,7 +879,7 @@ static int vol_prc_lib_release(effect_handle_t handle)
 
     if (status != 0) {
         ALOGE("something wrong ... <<<--- Found NOTHING to remove ... ???? --->>>>>");
-        pthread_mutex_unlock(&vol_listner_init_lock);
+        effect_mutex_unlock(&vol_listner_init_lock);
         return status;
     }
 
@@ -885,7 +896,7 @@ static int vol_prc_lib_release(effect_handle_t handle)
     if (dumping_enabled) {
         dump_list_l();
     }
-    pthread_mutex_unlock(&vol_listner_init_lock);
+    effect_mutex_unlock(&vol_listner_init_lock);
     enable_gcov();
     return status;
 }
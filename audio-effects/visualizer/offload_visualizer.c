@@ -179,6 +179,9 @@ pthread_cond_t cond;
 bool exit_thread;
 /* 0 if the capture thread was created successfully */
 int thread_status;
+/* scheduling hooks set by the HAL, called from the capture thread */
+void (*thread_start_hook)(void);
+void (*thread_wakeup_hook)(uint64_t late_ns);
 
 
 #define DSP_OUTPUT_LATENCY_MS 0 /* Fudge factor for latency after capture point in audio DSP */
@@ -201,11 +204,21 @@ int thread_status;
 #define AUDIO_CAPTURE_PERIOD_COUNT (32)
 
 #define AUDIO_CAPTURE_BIT_WIDTH (16)
+#define AUDIO_CAPTURE_PERIOD_NS \
+    ((uint64_t)AUDIO_CAPTURE_PERIOD_SIZE * 1000000000LL / AUDIO_CAPTURE_SMP_RATE)
 
 /*
  *  Local functions
  */
 
+static uint64_t capture_time_ns()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
 static void init_once() {
     list_init(&created_effects_list);
     list_init(&active_outputs_list);
@@ -322,7 +335,8 @@ void *capture_thread_loop(void *arg)
     uint32_t in_buff_count = 1;
     struct pal_buffer in_buffer;
     ssize_t read_status = 0;
-
+    uint64_t last_read_ns = 0;
+    uint64_t read_ns;
 
     memset(&stream_attr, 0x0, sizeof(struct pal_stream_attributes));
     memset(&devices, 0x0, sizeof(struct pal_device));
@@ -347,6 +361,8 @@ void *capture_thread_loop(void *arg)
     ALOGD("thread enter");
 
     prctl(PR_SET_NAME, (unsigned long)"visualizer capture", 0, 0, 0);
+    if (thread_start_hook)
+        thread_start_hook();
 
     pthread_mutex_lock(&lock);
 
@@ -408,6 +424,7 @@ void *capture_thread_loop(void *arg)
                 }
                 ALOGD("%s: capture DISABLED", __func__);
                 capture_enabled = false;
+                last_read_ns = 0;
             }
             pthread_cond_wait(&cond, &lock);
         }
@@ -424,6 +441,13 @@ void *capture_thread_loop(void *arg)
         }
         pthread_mutex_lock(&lock);
 
+        /* a read completing more than a period after the last one means we fell behind */
+        read_ns = read_status > 0 ? capture_time_ns() : 0;
+        if (thread_wakeup_hook && last_read_ns && read_ns)
+            thread_wakeup_hook(read_ns - last_read_ns > AUDIO_CAPTURE_PERIOD_NS ?
+                               read_ns - last_read_ns - AUDIO_CAPTURE_PERIOD_NS : 0);
+        last_read_ns = read_ns;
+
         if (read_status > 0) {
             ALOGD("%s: pal_stream_read success no_of_bytes_read = %zd",
                     __func__, read_status );
@@ -474,6 +498,13 @@ void *capture_thread_loop(void *arg)
  * Interface from audio HAL
  */
 
+__attribute__ ((visibility ("default")))
+void visualizer_hal_set_thread_hooks(void (*start)(void), void (*wakeup)(uint64_t late_ns))
+{
+    thread_start_hook = start;
+    thread_wakeup_hook = wakeup;
+}
+
 __attribute__ ((visibility ("default")))
 int visualizer_hal_start_output(audio_io_handle_t output,
                                     pal_stream_handle_t* pal_stream_handle) {
@@ -19,7 +19,8 @@ LOCAL_VENDOR_MODULE := true
 LOCAL_MODULE_OWNER := qti
 
 LOCAL_SRC_FILES:= \
-    voice_processing.c
+    voice_processing.c \
+    voice_processing_sw.c
 
 LOCAL_C_INCLUDES += \
     $(call include-path-for, audio-effects)
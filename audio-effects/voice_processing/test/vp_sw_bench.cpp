@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+/*
+ * Cost of the software voice processing chain per 20 ms capture period.
+ * "make bench" writes the results to vp_sw_bench.json; budget_pct is the
+ * share of real time used, to hold against VP_SW_CPU_BUDGET_PCT.
+ */
+
+#include <random>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "voice_processing_sw.h"
+
+static void BM_VpSwProcess(benchmark::State& state) {
+    uint32_t rate = state.range(0);
+    uint32_t enabled = state.range(1);
+    size_t period = rate / 50;
+    struct vp_sw_engine *eng = vp_sw_create(rate);
+    std::vector<int16_t> near(period), far(period), out(period);
+    std::mt19937 gen(1);
+    std::normal_distribution<float> dist(0.0f, 3000.0f);
+    struct vp_sw_stats stats;
+
+    for (size_t i = 0; i < period; i++) {
+        far[i] = (int16_t)dist(gen);
+        near[i] = (int16_t)(far[i] / 2 + dist(gen) / 10);
+    }
+
+    for (auto _ : state) {
+        if (enabled & VP_SW_AEC)
+            vp_sw_process_reverse(eng, far.data(), period);
+        vp_sw_process(eng, near.data(), out.data(), period, enabled);
+        benchmark::DoNotOptimize(out.data());
+    }
+
+    vp_sw_get_stats(eng, &stats);
+    state.SetItemsProcessed(state.iterations() * period);
+    state.counters["partitions"] = stats.partitions;
+    state.counters["budget_pct"] = benchmark::Counter(
+            (double)period / rate / 100, benchmark::Counter::kIsIterationInvariantRate |
+            benchmark::Counter::kInvert);
+    vp_sw_release(eng);
+}
+
+BENCHMARK(BM_VpSwProcess)
+        ->ArgNames({"rate", "enabled"})
+        ->ArgsProduct({{16000, 48000},
+                       {VP_SW_AEC, VP_SW_NS, VP_SW_AGC, VP_SW_AEC | VP_SW_NS | VP_SW_AGC}})
+        ->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_MAIN();
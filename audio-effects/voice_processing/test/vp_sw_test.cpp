@@ -0,0 +1,238 @@
+/*
+ * Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+#include <math.h>
+
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "voice_processing_sw.h"
+
+#define RATE 16000
+#define PERIOD (RATE / 50)      /* 20 ms, as StreamInPrimary reads */
+
+static std::vector<float> Noise(size_t n, float rms, uint32_t seed) {
+    std::mt19937 gen(seed);
+    std::normal_distribution<float> dist(0.0f, rms);
+    std::vector<float> v(n);
+
+    for (auto& x : v)
+        x = dist(gen);
+    return v;
+}
+
+static std::vector<float> Tone(size_t n, float hz, float rms) {
+    std::vector<float> v(n);
+
+    for (size_t i = 0; i < n; i++)
+        v[i] = rms * sqrtf(2.0f) * sinf(2 * (float)M_PI * hz * i / RATE);
+    return v;
+}
+
+/* room like echo path: pure delay, then an exponentially decaying tail */
+static std::vector<float> EchoPath(size_t delay, size_t len, float gain, uint32_t seed) {
+    std::vector<float> h = Noise(len, 1.0f, seed);
+    float norm = 0.0f;
+
+    for (size_t i = 0; i < len; i++) {
+        h[i] *= expf(-6.9f * i / len);      /* -60 dB over the tail */
+        norm += h[i] * h[i];
+    }
+    for (auto& x : h)
+        x *= gain / sqrtf(norm);
+    h.insert(h.begin(), delay, 0.0f);
+    return h;
+}
+
+static std::vector<float> Convolve(const std::vector<float>& x, const std::vector<float>& h) {
+    std::vector<float> y(x.size(), 0.0f);
+
+    for (size_t n = 0; n < x.size(); n++)
+        for (size_t k = 0; k < h.size() && k <= n; k++)
+            y[n] += h[k] * x[n - k];
+    return y;
+}
+
+static std::vector<int16_t> ToPcm(const std::vector<float>& v) {
+    std::vector<int16_t> pcm(v.size());
+
+    for (size_t i = 0; i < v.size(); i++)
+        pcm[i] = (int16_t)lrintf(fmaxf(fminf(v[i] * 32768.0f, 32767.0f), -32768.0f));
+    return pcm;
+}
+
+static double Power(const std::vector<int16_t>& v, size_t from, size_t to) {
+    double sum = 0.0;
+
+    for (size_t i = from; i < to; i++)
+        sum += (double)v[i] * v[i];
+    return sum / (to - from) + 1e-9;
+}
+
+static double Db(double ratio) {
+    return 10.0 * log10(ratio);
+}
+
+/* runs near (and far, if any) through the engine in capture periods */
+static std::vector<int16_t> Process(struct vp_sw_engine *eng, const std::vector<int16_t>& near,
+                                    const std::vector<int16_t> *far, uint32_t enabled) {
+    std::vector<int16_t> out(near.size());
+
+    for (size_t pos = 0; pos + PERIOD <= near.size(); pos += PERIOD) {
+        /* the far end reaches the effect ahead of the capture holding its echo */
+        if (far)
+            vp_sw_process_reverse(eng, far->data() + pos, PERIOD);
+        EXPECT_EQ(0, vp_sw_process(eng, near.data() + pos, out.data() + pos, PERIOD, enabled));
+    }
+    return out;
+}
+
+class VpSwTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        eng_ = vp_sw_create(RATE);
+        ASSERT_NE(nullptr, eng_);
+    }
+    void TearDown() override {
+        vp_sw_release(eng_);
+    }
+
+    struct vp_sw_engine *eng_ = nullptr;
+};
+
+TEST_F(VpSwTest, BlockIsPowerOfTwoNearTenMs) {
+    struct vp_sw_stats stats;
+
+    vp_sw_get_stats(eng_, &stats);
+    EXPECT_EQ(128u, stats.block_frames);
+    EXPECT_GE(stats.partitions, 2u);
+}
+
+TEST_F(VpSwTest, AecErleOnFarEndOnly) {
+    const size_t n = 6 * RATE;
+    std::vector<float> far = Noise(n, 0.1f, 1);
+    std::vector<int16_t> far_pcm = ToPcm(far);
+    std::vector<int16_t> near = ToPcm(Convolve(far, EchoPath(RATE / 200, RATE / 20, 0.5f, 2)));
+    std::vector<int16_t> out = Process(eng_, near, &far_pcm, VP_SW_AEC);
+    struct vp_sw_stats stats;
+    double erle = Db(Power(near, n - RATE, n) / Power(out, n - RATE, n));
+
+    vp_sw_get_stats(eng_, &stats);
+    RecordProperty("erle_db", std::to_string(erle));
+    EXPECT_GE(erle, 20.0) << "converged ERLE over the last second";
+    EXPECT_NEAR(erle, stats.erle_db, 6.0) << "reported ERLE";
+}
+
+TEST_F(VpSwTest, AecKeepsNearEndDuringDoubleTalk) {
+    const size_t n = 6 * RATE;
+    std::vector<float> far = Noise(n, 0.1f, 3);
+    std::vector<int16_t> far_pcm = ToPcm(far);
+    std::vector<float> echo = Convolve(far, EchoPath(RATE / 200, RATE / 20, 0.5f, 4));
+    std::vector<float> talk = Tone(n, 440.0f, 0.1f);
+    std::vector<float> mix(n);
+    std::vector<int16_t> out;
+    std::vector<float> res;
+
+    /* far end alone for 3 s, then the near end talks over it */
+    for (size_t i = 0; i < n; i++)
+        mix[i] = echo[i] + (i >= n / 2 ? talk[i] : 0.0f);
+    out = Process(eng_, ToPcm(mix), &far_pcm, VP_SW_AEC);
+
+    /* what is left after removing the talker is the uncancelled echo */
+    for (size_t i = n - RATE; i < n; i++) {
+        /* the output lags by one block */
+        size_t src = i - 128;
+
+        res.push_back(out[i] / 32768.0f - talk[src]);
+    }
+    std::vector<int16_t> res_pcm = ToPcm(res);
+    std::vector<int16_t> echo_pcm = ToPcm(std::vector<float>(echo.end() - RATE, echo.end()));
+    std::vector<int16_t> talk_pcm = ToPcm(std::vector<float>(talk.end() - RATE, talk.end()));
+
+    /* the talker passes and the filter does not diverge on it */
+    EXPECT_GE(Db(Power(talk_pcm, 0, RATE) / Power(res_pcm, 0, RATE)), 15.0)
+            << "near end SNR after the canceller";
+    EXPECT_GE(Db(Power(echo_pcm, 0, RATE) / Power(res_pcm, 0, RATE)), 10.0)
+            << "echo still cancelled during double talk";
+}
+
+TEST_F(VpSwTest, NsImprovesSnr) {
+    const size_t n = 6 * RATE;
+    const size_t seg = RATE / 5;            /* 200 ms talk, 200 ms pause */
+    const size_t guard = RATE / 25;         /* block delay and gain release */
+    std::vector<float> talk = Tone(n, 500.0f, 0.1f);
+    std::vector<float> noise = Noise(n, 0.01f, 5);
+    std::vector<float> mix(n);
+    std::vector<int16_t> in, out;
+    double in_talk = 0, in_pause = 0, out_talk = 0, out_pause = 0;
+    double snr_in, snr_out;
+
+    for (size_t i = 0; i < n; i++)
+        mix[i] = noise[i] + ((i / seg) % 2 ? 0.0f : talk[i]);
+    in = ToPcm(mix);
+    out = Process(eng_, in, nullptr, VP_SW_NS);
+
+    /* skip the first second while the noise floor is learned */
+    for (size_t s = RATE / seg; s < n / seg - 1; s++) {
+        size_t from = s * seg + guard, to = (s + 1) * seg;
+        /* NS adds a block on top of the one of the engine */
+        double pi = Power(in, from, to), po = Power(out, from + 256, to + 256);
+
+        if (s % 2) {
+            in_pause += pi;
+            out_pause += po;
+        } else {
+            in_talk += pi;
+            out_talk += po;
+        }
+    }
+    snr_in = Db(in_talk / in_pause);
+    snr_out = Db(out_talk / out_pause);
+    RecordProperty("snr_gain_db", std::to_string(snr_out - snr_in));
+    /* plain spectral subtraction on a raw periodogram, ~8 dB on white noise */
+    EXPECT_GE(snr_out - snr_in, 6.0) << "SNR " << snr_in << " dB in, " << snr_out << " dB out";
+    EXPECT_GE(Db(out_talk / in_talk), -3.0) << "talk level loss";
+}
+
+TEST_F(VpSwTest, AgcReachesTarget) {
+    const size_t n = 4 * RATE;
+    std::vector<int16_t> in = ToPcm(Tone(n, 300.0f, 0.01f));     /* -40 dBFS */
+    std::vector<int16_t> out = Process(eng_, in, nullptr, VP_SW_AGC);
+    double level = Db(Power(out, n - RATE / 2, n) / (32768.0 * 32768.0));
+
+    EXPECT_NEAR(-20.0, level, 2.0);
+}
+
+TEST_F(VpSwTest, AgcHoldsGainOnSilence) {
+    std::vector<int16_t> silence(2 * RATE, 0);
+    std::vector<int16_t> out = Process(eng_, silence, nullptr, VP_SW_AGC);
+    struct vp_sw_stats stats;
+
+    vp_sw_get_stats(eng_, &stats);
+    EXPECT_NEAR(0.0f, stats.agc_gain_db, 0.01f);
+    EXPECT_LT(Power(out, 0, out.size()), 1.0);
+}
+
+TEST_F(VpSwTest, InPlaceMatchesSeparateBuffers) {
+    const size_t n = RATE;
+    std::vector<int16_t> in = ToPcm(Noise(n, 0.05f, 6));
+    std::vector<int16_t> out = Process(eng_, in, nullptr, VP_SW_NS | VP_SW_AGC);
+    std::vector<int16_t> io = in;
+    struct vp_sw_engine *eng = vp_sw_create(RATE);
+
+    for (size_t pos = 0; pos + PERIOD <= n; pos += PERIOD)
+        vp_sw_process(eng, io.data() + pos, io.data() + pos, PERIOD, VP_SW_NS | VP_SW_AGC);
+    vp_sw_release(eng);
+    EXPECT_EQ(out, io);
+}
+
+TEST(VpSw, RejectsBadArguments) {
+    int16_t buf[PERIOD] = {};
+
+    EXPECT_EQ(-EINVAL, vp_sw_process(nullptr, buf, buf, PERIOD, VP_SW_NS));
+    EXPECT_EQ(-EINVAL, vp_sw_process_reverse(nullptr, buf, PERIOD));
+}
@@ -19,14 +19,18 @@
 /*#define LOG_NDEBUG 0*/
 #include <stdlib.h>
 #include <dlfcn.h>
+#include <pthread.h>
 #include <stdlib.h>
+#include <string.h>
 #include <log/log.h>
 #include <cutils/list.h>
+#include <cutils/properties.h>
 #include <unistd.h>
 #include <hardware/audio_effect.h>
 #include <audio_effects/effect_aec.h>
 #include <audio_effects/effect_agc.h>
 #include <audio_effects/effect_ns.h>
+#include "voice_processing_sw.h"
 
 
 //------------------------------------------------------------------------------
@@ -40,7 +44,7 @@ enum effect_id
 {
     AEC_ID,        // Acoustic Echo Canceler
     NS_ID,         // Noise Suppressor
-//ENABLE_AGC    AGC_ID,        // Automatic Gain Control
+    AGC_ID,        // Automatic Gain Control
     NUM_ID
 };
 
@@ -56,6 +60,15 @@ static void enable_gcov()
 }
 #endif
 
+// Software fallback mode, vendor.audio.voiceprocessing.sw_mode
+enum sw_mode {
+    SW_MODE_OFF,               // never process in software
+    SW_MODE_AUTO,              // only for capture devices not routed through the DSP
+    SW_MODE_FORCE              // always process in software
+};
+
+#define SW_REVERSE_CHUNK 256
+
 // Session state
 enum session_state {
     SESSION_STATE_INIT,        // initialized
@@ -89,6 +102,13 @@ struct session_s {
     uint32_t created_msk;            // bit field containing IDs of crested pre processors
     uint32_t enabled_msk;            // bit field containing IDs of enabled pre processors
     uint32_t processed_msk;          // bit field containing IDs of pre processors already
+    effect_config_t rev_config;      // far end reference configuration (AEC)
+    uint32_t in_device;              // capture device from EFFECT_CMD_SET_INPUT_DEVICE
+    pthread_mutex_t sw_lock;         // sw and sw_active, the reverse stream runs on the
+                                     // playback thread while commands swap the engine
+    struct vp_sw_engine *sw;         // software fallback engine, created on first enable
+    uint32_t sw_rate;                // sampling rate sw was created for
+    bool sw_active;                  // sw is processing the current capture device
 };
 
 
@@ -126,27 +146,27 @@ static const effect_descriptor_t qcom_default_ns_descriptor = {
         "Qualcomm Fluence"
 };
 
-//ENABLE_AGC
 // Automatic Gain Control
-//static const effect_descriptor_t qcom_default_agc_descriptor = {
-//        { 0x0a8abfe0, 0x654c, 0x11e0, 0xba26, { 0x00, 0x02, 0xa5, 0xd5, 0xc5, 0x1b } }, // type
-//        { 0x0dd49521, 0x8c59, 0x40b1, 0xb403, { 0xe0, 0x8d, 0x5f, 0x01, 0x87, 0x5e } }, // uuid
-//        EFFECT_CONTROL_API_VERSION,
-//        (EFFECT_FLAG_TYPE_PRE_PROC|EFFECT_FLAG_DEVICE_IND),
-//        0,
-//        0,
-//        "Automatic Gain Control",
-//        "Qualcomm Fluence"
-//};
+static const effect_descriptor_t qcom_default_agc_descriptor = {
+        { 0x0a8abfe0, 0x654c, 0x11e0, 0xba26, { 0x00, 0x02, 0xa5, 0xd5, 0xc5, 0x1b } }, // type
+        { 0x0dd49521, 0x8c59, 0x40b1, 0xb403, { 0xe0, 0x8d, 0x5f, 0x01, 0x87, 0x5e } }, // uuid
+        EFFECT_CONTROL_API_VERSION,
+        (EFFECT_FLAG_TYPE_PRE_PROC|EFFECT_FLAG_DEVICE_IND),
+        0,
+        0,
+        "Automatic Gain Control",
+        "Qualcomm Fluence"
+};
 
 const effect_descriptor_t *descriptors[NUM_ID] = {
         &qcom_default_aec_descriptor,
         &qcom_default_ns_descriptor,
-//ENABLE_AGC       &qcom_default_agc_descriptor,
+        &qcom_default_agc_descriptor,
 };
 
 
 static int init_status = 1;
+static int sw_mode = SW_MODE_AUTO;
 struct listnode session_list;
 static const struct effect_interface_s effect_interface;
 static const effect_uuid_t * uuid_to_id_table[NUM_ID];
@@ -292,6 +312,7 @@ static int session_init(struct session_s *session)
     session->id = 0;
     session->io = 0;
     session->created_msk = 0;
+    pthread_mutex_init(&session->sw_lock, NULL);
     for (i = 0; i < NUM_ID && status == 0; i++)
         status = effect_init(&session->effects[i], i);
 
@@ -306,7 +327,8 @@ static int session_create_effect(struct session_s *session,
     int status = -ENOMEM;
 
     ALOGV("session_create_effect() %s, created_msk %08x",
-          id == AEC_ID ? "AEC" : id == NS_ID ? "NS" : "?", session->created_msk);
+          id == AEC_ID ? "AEC" : id == NS_ID ? "NS" : id == AGC_ID ? "AGC" : "?",
+          session->created_msk);
 
     if (session->created_msk == 0) {
         session->config.inputCfg.samplingRate = 16000;
@@ -315,6 +337,7 @@ static int session_create_effect(struct session_s *session,
         session->config.outputCfg.samplingRate = 16000;
         session->config.outputCfg.channels = AUDIO_CHANNEL_IN_MONO;
         session->config.outputCfg.format = AUDIO_FORMAT_PCM_16_BIT;
+        session->rev_config = session->config;
         session->enabled_msk = 0;
         session->processed_msk = 0;
     }
@@ -340,6 +363,8 @@ static int session_release_effect(struct session_s *session,
     {
         ALOGV("session_release_effect() last effect: removing session");
         list_remove(&session->node);
+        vp_sw_release(session->sw);
+        pthread_mutex_destroy(&session->sw_lock);
         free(session);
     }
 
@@ -384,11 +409,86 @@ static void session_get_config(struct session_s *session, effect_config_t *confi
 }
 
 
+static uint32_t session_sw_mask(struct session_s *session)
+{
+    uint32_t mask = 0;
+
+    if (session->enabled_msk & (1 << AEC_ID))
+        mask |= VP_SW_AEC;
+    if (session->enabled_msk & (1 << NS_ID))
+        mask |= VP_SW_NS;
+    if (session->enabled_msk & (1 << AGC_ID))
+        mask |= VP_SW_AGC;
+    return mask;
+}
+
+// USB and BT capture does not go through the DSP pre-processing chain
+static bool session_needs_sw(struct session_s *session)
+{
+    audio_devices_t device = (audio_devices_t)session->in_device;
+
+    if (session->sw == NULL || session->enabled_msk == 0 || sw_mode == SW_MODE_OFF)
+        return false;
+    if (sw_mode == SW_MODE_FORCE)
+        return true;
+
+    return audio_is_usb_in_device(device) ||
+            device == AUDIO_DEVICE_IN_BLUETOOTH_SCO_HEADSET ||
+            device == AUDIO_DEVICE_IN_BLE_HEADSET;
+}
+
+static void session_update_sw(struct session_s *session)
+{
+    bool active;
+
+    pthread_mutex_lock(&session->sw_lock);
+    active = session_needs_sw(session);
+    if (active && !session->sw_active) {
+        ALOGI("%s: session %d device %#x processed in software, mask %#x", __func__,
+              session->id, session->in_device, session_sw_mask(session));
+        vp_sw_reset(session->sw);
+    }
+    session->sw_active = active;
+    pthread_mutex_unlock(&session->sw_lock);
+}
+
+static void session_create_sw(struct session_s *session)
+{
+    if (sw_mode == SW_MODE_OFF)
+        return;
+
+    pthread_mutex_lock(&session->sw_lock);
+    if (session->config.inputCfg.channels != AUDIO_CHANNEL_IN_MONO) {
+        ALOGW("%s: channels %#x not supported in software", __func__,
+              session->config.inputCfg.channels);
+        /* an engine kept from a mono config would run on interleaved frames */
+        if (session->sw != NULL) {
+            vp_sw_release(session->sw);
+            session->sw = NULL;
+        }
+        session->sw_active = false;
+        pthread_mutex_unlock(&session->sw_lock);
+        return;
+    }
+
+    if (session->sw != NULL && session->sw_rate != session->config.inputCfg.samplingRate) {
+        vp_sw_release(session->sw);
+        session->sw = NULL;
+    }
+    if (session->sw == NULL) {
+        session->sw = vp_sw_create(session->config.inputCfg.samplingRate);
+        session->sw_rate = session->config.inputCfg.samplingRate;
+    }
+    session->sw_active = false;
+    pthread_mutex_unlock(&session->sw_lock);
+}
+
 static void session_set_fx_enabled(struct session_s *session, uint32_t id, bool enabled)
 {
     if (enabled) {
         if(session->enabled_msk == 0) {
             /* do first enable here */
+            session_create_sw(session);
         }
         session->enabled_msk |= (1 << id);
     } else {
@@ -400,6 +500,7 @@ static void session_set_fx_enabled(struct session_s *session, uint32_t id, bool
     ALOGV("session_set_fx_enabled() id %d, enabled %d enabled_msk %08x",
          id, enabled, session->enabled_msk);
     session->processed_msk = 0;
+    session_update_sw(session);
 }
 
 //------------------------------------------------------------------------------
@@ -443,6 +544,7 @@ static struct session_s *get_session(int32_t id, int32_t  sessionId, int32_t  io
 static int init() {
     void *lib_handle;
     const effect_descriptor_t *desc;
+    char value[PROPERTY_VALUE_MAX];
 
     if (init_status <= 0)
         return init_status;
@@ -463,17 +565,25 @@ static int init() {
             if (desc)
                 descriptors[NS_ID] = desc;
 
-//ENABLE_AGC
-//            desc = (const effect_descriptor_t *)dlsym(lib_handle,
-//                                                        "qcom_product_agc_descriptor");
-//            if (desc)
-//                descriptors[AGC_ID] = desc;
+            desc = (const effect_descriptor_t *)dlsym(lib_handle,
+                                                        "qcom_product_agc_descriptor");
+            if (desc)
+                descriptors[AGC_ID] = desc;
         }
     }
 
     uuid_to_id_table[AEC_ID] = FX_IID_AEC;
     uuid_to_id_table[NS_ID] = FX_IID_NS;
-//ENABLE_AGC uuid_to_id_table[AGC_ID] = FX_IID_AGC;
+    uuid_to_id_table[AGC_ID] = FX_IID_AGC;
+
+    property_get("vendor.audio.voiceprocessing.sw_mode", value, "auto");
+    if (!strcmp(value, "off"))
+        sw_mode = SW_MODE_OFF;
+    else if (!strcmp(value, "force"))
+        sw_mode = SW_MODE_FORCE;
+    else
+        sw_mode = SW_MODE_AUTO;
+    ALOGV("%s: software fallback mode %d", __func__, sw_mode);
 
     list_init(&session_list);
 
@@ -484,9 +594,13 @@ static int init() {
 static const effect_descriptor_t *get_descriptor(const effect_uuid_t *uuid)
 {
     size_t i;
-    for (i = 0; i < NUM_ID; i++)
+    for (i = 0; i < NUM_ID; i++) {
+        // the DSP chain has no AGC, only the software engine runs it
+        if (i == AGC_ID && sw_mode == SW_MODE_OFF)
+            continue;
         if (memcmp(&descriptors[i]->uuid, uuid, sizeof(effect_uuid_t)) == 0)
             return descriptors[i];
+    }
 
     return NULL;
 }
@@ -516,6 +630,18 @@ static int fx_process(effect_handle_t     self,
 
     session = (struct session_s *)effect->session;
 
+    pthread_mutex_lock(&session->sw_lock);
+    if (session->sw_active) {
+        // the first enabled effect of the round runs the whole chain
+        if ((session->processed_msk & session->enabled_msk) == 0) {
+            vp_sw_process(session->sw, inBuffer->s16, outBuffer->s16,
+                          inBuffer->frameCount, session_sw_mask(session));
+        } else if (inBuffer->raw != outBuffer->raw) {
+            memcpy(outBuffer->raw, inBuffer->raw, inBuffer->frameCount * sizeof(int16_t));
+        }
+    }
+    pthread_mutex_unlock(&session->sw_lock);
+
     session->processed_msk |= (1<<effect->id);
 
     if ((session->processed_msk & session->enabled_msk) == session->enabled_msk) {
@@ -525,6 +651,55 @@ static int fx_process(effect_handle_t     self,
         return -ENODATA;
 }
 
+static int fx_process_reverse(effect_handle_t     self,
+                              audio_buffer_t    *inBuffer,
+                              audio_buffer_t    *outBuffer __unused)
+{
+    struct effect_s *effect = (struct effect_s *)self;
+    struct session_s *session;
+    int16_t mono[SW_REVERSE_CHUNK];
+    size_t done, n, i;
+    int status = 0;
+
+    if (effect == NULL) {
+        ALOGV("fx_process_reverse() ERROR effect == NULL");
+        return -EINVAL;
+    }
+
+    if (inBuffer == NULL  || inBuffer->raw == NULL) {
+        ALOGW("fx_process_reverse() ERROR bad pointer");
+        return -EINVAL;
+    }
+
+    if (effect->id != AEC_ID || effect->state != EFFECT_STATE_ACTIVE)
+        return -EINVAL;
+
+    session = (struct session_s *)effect->session;
+    pthread_mutex_lock(&session->sw_lock);
+    if (!session->sw_active)
+        goto exit;
+
+    if (audio_channel_count_from_out_mask(session->rev_config.inputCfg.channels) == 1) {
+        status = vp_sw_process_reverse(session->sw, inBuffer->s16, inBuffer->frameCount);
+        goto exit;
+    }
+
+    // stereo reference, downmix in chunks
+    for (done = 0; done < inBuffer->frameCount; done += n) {
+        n = inBuffer->frameCount - done;
+        if (n > SW_REVERSE_CHUNK)
+            n = SW_REVERSE_CHUNK;
+        for (i = 0; i < n; i++)
+            mono[i] = (int16_t)(((int32_t)inBuffer->s16[2 * (done + i)] +
+                                 inBuffer->s16[2 * (done + i) + 1]) >> 1);
+        vp_sw_process_reverse(session->sw, mono, n);
+    }
+
+exit:
+    pthread_mutex_unlock(&session->sw_lock);
+    return status;
+}
+
 static int fx_command(effect_handle_t  self,
                             uint32_t            cmdCode,
                             uint32_t            cmdSize,
@@ -575,6 +750,41 @@ static int fx_command(effect_handle_t  self,
             break;
 
         case EFFECT_CMD_RESET:
+            pthread_mutex_lock(&effect->session->sw_lock);
+            if (effect->session->sw_active)
+                vp_sw_reset(effect->session->sw);
+            pthread_mutex_unlock(&effect->session->sw_lock);
+            break;
+
+        case EFFECT_CMD_SET_CONFIG_REVERSE: {
+            effect_config_t *config = (effect_config_t *)pCmdData;
+
+            if (pCmdData    == NULL||
+                    cmdSize     != sizeof(effect_config_t)||
+                    pReplyData  == NULL||
+                    *replySize  != sizeof(int)) {
+                ALOGV("fx_command() EFFECT_CMD_SET_CONFIG_REVERSE invalid args");
+                return -EINVAL;
+            }
+            if (config->inputCfg.samplingRate != effect->session->config.inputCfg.samplingRate ||
+                    config->inputCfg.format != AUDIO_FORMAT_PCM_16_BIT ||
+                    audio_channel_count_from_out_mask(config->inputCfg.channels) > 2) {
+                *(int *)pReplyData = -EINVAL;
+                break;
+            }
+            pthread_mutex_lock(&effect->session->sw_lock);
+            memcpy(&effect->session->rev_config, config, sizeof(effect_config_t));
+            pthread_mutex_unlock(&effect->session->sw_lock);
+            *(int *)pReplyData = 0;
+        } break;
+
+        case EFFECT_CMD_GET_CONFIG_REVERSE:
+            if (pReplyData == NULL ||
+                    *replySize != sizeof(effect_config_t)) {
+                ALOGV("fx_command() EFFECT_CMD_GET_CONFIG_REVERSE invalid args");
+                return -EINVAL;
+            }
+            memcpy(pReplyData, &effect->session->rev_config, sizeof(effect_config_t));
             break;
 
         case EFFECT_CMD_GET_PARAM: {
@@ -650,6 +860,10 @@ static int fx_command(effect_handle_t  self,
                   cmdCode == EFFECT_CMD_SET_AUDIO_MODE ? "EFFECT_CMD_SET_AUDIO_MODE":
                   "",
                   *(int *)pCmdData);
+            if (cmdCode == EFFECT_CMD_SET_INPUT_DEVICE) {
+                effect->session->in_device = *(uint32_t *)pCmdData;
+                session_update_sw(effect->session);
+            }
             break;
 
         default:
@@ -678,7 +892,7 @@ static const struct effect_interface_s effect_interface = {
     fx_process,
     fx_command,
     fx_get_descriptor,
-    NULL
+    fx_process_reverse
 };
 
 //------------------------------------------------------------------------------
@@ -723,6 +937,7 @@ static int lib_create(const effect_uuid_t *uuid,
 
     if (status < 0 && session->created_msk == 0) {
         list_remove(&session->node);
+        pthread_mutex_destroy(&session->sw_lock);
         free(session);
     }
     enable_gcov();
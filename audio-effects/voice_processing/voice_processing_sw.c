@@ -0,0 +1,806 @@
+/*
+ * Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+#define LOG_TAG "voice_processing_sw"
+/*#define LOG_NDEBUG 0*/
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <log/log.h>
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define VP_SW_NEON 1
+#endif
+
+#include "voice_processing_sw.h"
+
+#define VP_SW_MAX_BLOCK         256
+#define VP_SW_FAR_BLOCKS        8     /* far end fifo depth, in blocks */
+#define VP_SW_MIN_PARTITIONS    2
+
+/* echo canceller: partitioned block frequency domain NLMS (MDF) */
+#define AEC_MU                  0.5f
+#define AEC_REG                 1e-6f  /* per sample power floor, ~-60 dBFS */
+#define AEC_FAR_MIN             1e-4f  /* far end peak below this is silence */
+#define AEC_DT_RATIO            0.5f   /* Geigel double talk threshold */
+#define AEC_DT_HOLD_MS          40     /* adaptation stays frozen after double talk */
+#define AEC_DIVERGE_RATIO       4.0f
+#define AEC_PXX_SMOOTH          0.9f
+
+/* noise suppressor: power spectral subtraction with a tracked noise floor */
+#define NS_INIT_BLOCKS          20
+#define NS_OVERSUB              2.0f
+#define NS_FLOOR                0.125f /* -18 dB */
+#define NS_SPEECH_RATIO         4.0f   /* bins above this times noise hold the estimate */
+#define NS_NOISE_SMOOTH         0.95f
+#define NS_NOISE_RISE_DB_S      3.0f
+#define NS_GAIN_RELEASE         0.6f
+
+/* automatic gain control */
+#define AGC_TARGET              0.1f   /* -20 dBFS rms */
+#define AGC_GATE                0.00316f /* -50 dBFS rms, hold gain below */
+#define AGC_MIN_GAIN            0.5f
+#define AGC_MAX_GAIN            15.85f /* +24 dB */
+#define AGC_ATTACK              0.5f
+#define AGC_RELEASE             0.05f
+#define AGC_LIMIT               0.9f
+
+#define STATS_SMOOTH            0.95f
+#define DB_EPS                  1e-10f
+
+struct vp_fft {
+    uint32_t n;
+    uint16_t *bitrev;
+    float *cos_t;
+    float *sin_t;
+};
+
+struct vp_sw_engine {
+    uint32_t rate;
+    uint32_t block;             /* H, samples per block */
+    uint32_t fft_size;          /* N = 2 * H */
+    uint32_t stride;            /* H + 1 bins rounded up to 4 */
+    struct vp_fft fft;
+    float *pool;
+    float *fft_re;
+    float *fft_im;
+    float *tmp;
+
+    /* streaming */
+    uint32_t fill;
+    float *near_blk;
+    int16_t *out_blk;
+    int16_t *far_fifo;
+
+    /* far end fifo, written by vp_sw_process_reverse() */
+    pthread_mutex_t far_lock;
+    uint32_t far_cap;
+    uint32_t far_rd;
+    uint32_t far_count;
+    float *far_blk;
+    uint32_t far_idle;          /* blocks since the last far end data */
+
+    /* AEC */
+    uint32_t partitions;
+    uint32_t active_partitions;
+    uint32_t x_head;
+    uint32_t next_constraint;
+    float *x_frame;
+    float *x_re;
+    float *x_im;
+    float *w_re;
+    float *w_im;
+    float *pxx;
+    float *far_peak;
+    float *y_re;
+    float *y_im;
+    float *e_re;
+    float *e_im;
+    float *aec_out;
+    float erle_d;
+    float erle_e;
+    uint32_t dt_hold_blocks;
+    uint32_t dt_hold;
+
+    /* NS */
+    float *ns_in;
+    float *ns_ola;
+    float *ns_out;
+    float *window;
+    float *noise;
+    float *gain;
+    float *ns_re;
+    float *ns_im;
+    float ns_rise;
+    uint32_t ns_blocks;
+    float ns_in_pow;
+    float ns_out_pow;
+
+    /* AGC */
+    float agc_gain;
+
+    /* CPU budget */
+    uint64_t budget_ns;
+    uint64_t avg_ns;
+    struct vp_sw_stats stats;
+};
+
+//------------------------------------------------------------------------------
+// FFT and spectral helpers
+//------------------------------------------------------------------------------
+
+static void fft_run(const struct vp_fft *f, float *re, float *im, bool inverse)
+{
+    uint32_t n = f->n;
+    uint32_t i, j, k, len;
+    float t;
+
+    for (i = 0; i < n; i++) {
+        j = f->bitrev[i];
+        if (j > i) {
+            t = re[i]; re[i] = re[j]; re[j] = t;
+            t = im[i]; im[i] = im[j]; im[j] = t;
+        }
+    }
+
+    for (len = 2; len <= n; len <<= 1) {
+        uint32_t half = len >> 1;
+        uint32_t step = n / len;
+        for (i = 0; i < n; i += len) {
+            for (k = 0; k < half; k++) {
+                float wr = f->cos_t[k * step];
+                float wi = inverse ? f->sin_t[k * step] : -f->sin_t[k * step];
+                uint32_t a = i + k;
+                uint32_t b = a + half;
+                float tr = re[b] * wr - im[b] * wi;
+                float ti = re[b] * wi + im[b] * wr;
+                re[b] = re[a] - tr;
+                im[b] = im[a] - ti;
+                re[a] += tr;
+                im[a] += ti;
+            }
+        }
+    }
+
+    if (inverse) {
+        float scale = 1.0f / n;
+        for (i = 0; i < n; i++) {
+            re[i] *= scale;
+            im[i] *= scale;
+        }
+    }
+}
+
+/* N real samples to H + 1 bins, padding bins cleared */
+static void rfft(struct vp_sw_engine *eng, const float *time, float *bre, float *bim)
+{
+    uint32_t n = eng->fft_size;
+    uint32_t bins = eng->block + 1;
+
+    memcpy(eng->fft_re, time, n * sizeof(float));
+    memset(eng->fft_im, 0, n * sizeof(float));
+    fft_run(&eng->fft, eng->fft_re, eng->fft_im, false);
+    memcpy(bre, eng->fft_re, bins * sizeof(float));
+    memcpy(bim, eng->fft_im, bins * sizeof(float));
+    memset(bre + bins, 0, (eng->stride - bins) * sizeof(float));
+    memset(bim + bins, 0, (eng->stride - bins) * sizeof(float));
+}
+
+/* H + 1 bins of a real signal back to N samples */
+static void irfft(struct vp_sw_engine *eng, const float *bre, const float *bim, float *time)
+{
+    uint32_t n = eng->fft_size;
+    uint32_t k;
+
+    for (k = 0; k <= eng->block; k++) {
+        eng->fft_re[k] = bre[k];
+        eng->fft_im[k] = bim[k];
+    }
+    for (k = eng->block + 1; k < n; k++) {
+        eng->fft_re[k] = bre[n - k];
+        eng->fft_im[k] = -bim[n - k];
+    }
+    fft_run(&eng->fft, eng->fft_re, eng->fft_im, true);
+    memcpy(time, eng->fft_re, n * sizeof(float));
+}
+
+/* acc += a * b */
+static void cmac(float *restrict acc_re, float *restrict acc_im,
+                 const float *restrict a_re, const float *restrict a_im,
+                 const float *restrict b_re, const float *restrict b_im,
+                 uint32_t n)
+{
+    uint32_t k = 0;
+#ifdef VP_SW_NEON
+    for (; k + 4 <= n; k += 4) {
+        float32x4_t ar = vld1q_f32(a_re + k);
+        float32x4_t ai = vld1q_f32(a_im + k);
+        float32x4_t br = vld1q_f32(b_re + k);
+        float32x4_t bi = vld1q_f32(b_im + k);
+        float32x4_t cr = vld1q_f32(acc_re + k);
+        float32x4_t ci = vld1q_f32(acc_im + k);
+        cr = vmlaq_f32(cr, ar, br);
+        cr = vmlsq_f32(cr, ai, bi);
+        ci = vmlaq_f32(ci, ar, bi);
+        ci = vmlaq_f32(ci, ai, br);
+        vst1q_f32(acc_re + k, cr);
+        vst1q_f32(acc_im + k, ci);
+    }
+#endif
+    for (; k < n; k++) {
+        acc_re[k] += a_re[k] * b_re[k] - a_im[k] * b_im[k];
+        acc_im[k] += a_re[k] * b_im[k] + a_im[k] * b_re[k];
+    }
+}
+
+/* acc += conj(a) * b */
+static void cmac_conj(float *restrict acc_re, float *restrict acc_im,
+                      const float *restrict a_re, const float *restrict a_im,
+                      const float *restrict b_re, const float *restrict b_im,
+                      uint32_t n)
+{
+    uint32_t k = 0;
+#ifdef VP_SW_NEON
+    for (; k + 4 <= n; k += 4) {
+        float32x4_t ar = vld1q_f32(a_re + k);
+        float32x4_t ai = vld1q_f32(a_im + k);
+        float32x4_t br = vld1q_f32(b_re + k);
+        float32x4_t bi = vld1q_f32(b_im + k);
+        float32x4_t cr = vld1q_f32(acc_re + k);
+        float32x4_t ci = vld1q_f32(acc_im + k);
+        cr = vmlaq_f32(cr, ar, br);
+        cr = vmlaq_f32(cr, ai, bi);
+        ci = vmlaq_f32(ci, ar, bi);
+        ci = vmlsq_f32(ci, ai, br);
+        vst1q_f32(acc_re + k, cr);
+        vst1q_f32(acc_im + k, ci);
+    }
+#endif
+    for (; k < n; k++) {
+        acc_re[k] += a_re[k] * b_re[k] + a_im[k] * b_im[k];
+        acc_im[k] += a_re[k] * b_im[k] - a_im[k] * b_re[k];
+    }
+}
+
+static float energy(const float *x, uint32_t n)
+{
+    float acc = 0.0f;
+    uint32_t i;
+
+    for (i = 0; i < n; i++)
+        acc += x[i] * x[i];
+    return acc;
+}
+
+static float peak(const float *x, uint32_t n)
+{
+    float p = 0.0f;
+    uint32_t i;
+
+    for (i = 0; i < n; i++)
+        p = fmaxf(p, fabsf(x[i]));
+    return p;
+}
+
+static float to_db(float num, float den)
+{
+    return 10.0f * log10f((num + DB_EPS) / (den + DB_EPS));
+}
+
+//------------------------------------------------------------------------------
+// Processing stages
+//------------------------------------------------------------------------------
+
+static bool pop_far_block(struct vp_sw_engine *eng)
+{
+    uint32_t i;
+    bool have_far = false;
+
+    pthread_mutex_lock(&eng->far_lock);
+    if (eng->far_count >= eng->block) {
+        for (i = 0; i < eng->block; i++) {
+            eng->far_blk[i] = eng->far_fifo[eng->far_rd] * (1.0f / 32768.0f);
+            eng->far_rd = (eng->far_rd + 1) % eng->far_cap;
+        }
+        eng->far_count -= eng->block;
+        have_far = true;
+    }
+    pthread_mutex_unlock(&eng->far_lock);
+
+    if (!have_far)
+        memset(eng->far_blk, 0, eng->block * sizeof(float));
+    return have_far;
+}
+
+/* returns the signal to pass on, either the near end or the echo residual */
+static const float *aec_block(struct vp_sw_engine *eng, const float *d)
+{
+    uint32_t h = eng->block;
+    uint32_t s = eng->stride;
+    uint32_t p, k, idx;
+    float *x_re, *x_im;
+    float ed, ee, far_max = 0.0f, delta;
+    float *e = eng->aec_out;
+
+    /* newest far spectrum goes to x_head, older ones follow it */
+    memmove(eng->x_frame, eng->x_frame + h, h * sizeof(float));
+    memcpy(eng->x_frame + h, eng->far_blk, h * sizeof(float));
+    eng->x_head = (eng->x_head + eng->partitions - 1) % eng->partitions;
+    x_re = eng->x_re + eng->x_head * s;
+    x_im = eng->x_im + eng->x_head * s;
+    rfft(eng, eng->x_frame, x_re, x_im);
+    eng->far_peak[eng->x_head] = peak(eng->far_blk, h);
+
+    for (k = 0; k < s; k++)
+        eng->pxx[k] = AEC_PXX_SMOOTH * eng->pxx[k] +
+                (1.0f - AEC_PXX_SMOOTH) * (x_re[k] * x_re[k] + x_im[k] * x_im[k]);
+
+    /* echo estimate, overlap-save: the last H samples are valid */
+    memset(eng->y_re, 0, s * sizeof(float));
+    memset(eng->y_im, 0, s * sizeof(float));
+    for (p = 0; p < eng->active_partitions; p++) {
+        idx = (eng->x_head + p) % eng->partitions;
+        cmac(eng->y_re, eng->y_im, eng->x_re + idx * s, eng->x_im + idx * s,
+             eng->w_re + p * s, eng->w_im + p * s, s);
+        far_max = fmaxf(far_max, eng->far_peak[idx]);
+    }
+    irfft(eng, eng->y_re, eng->y_im, eng->tmp);
+    for (k = 0; k < h; k++)
+        e[k] = d[k] - eng->tmp[h + k];
+
+    ed = energy(d, h);
+    ee = energy(e, h);
+
+    if (far_max < AEC_FAR_MIN)
+        return d;
+
+    if (ee > AEC_DIVERGE_RATIO * ed + DB_EPS) {
+        ALOGV("%s: filter diverged, reset", __func__);
+        memset(eng->w_re, 0, eng->partitions * s * sizeof(float));
+        memset(eng->w_im, 0, eng->partitions * s * sizeof(float));
+        return d;
+    }
+
+    eng->erle_d = STATS_SMOOTH * eng->erle_d + (1.0f - STATS_SMOOTH) * ed;
+    eng->erle_e = STATS_SMOOTH * eng->erle_e + (1.0f - STATS_SMOOTH) * fminf(ee, ed);
+
+    /*
+     * adapt only while the far end talks alone; Geigel misses single blocks
+     * of soft near end speech, so a detection holds the filter for a while
+     */
+    if (peak(d, h) >= AEC_DT_RATIO * far_max)
+        eng->dt_hold = eng->dt_hold_blocks;
+    else if (eng->dt_hold)
+        eng->dt_hold--;
+
+    if (!eng->dt_hold) {
+        memset(eng->tmp, 0, h * sizeof(float));
+        memcpy(eng->tmp + h, e, h * sizeof(float));
+        rfft(eng, eng->tmp, eng->e_re, eng->e_im);
+
+        delta = AEC_REG * eng->fft_size;
+        for (k = 0; k < s; k++) {
+            float mu = AEC_MU / (eng->active_partitions * eng->pxx[k] + delta);
+            eng->e_re[k] *= mu;
+            eng->e_im[k] *= mu;
+        }
+        for (p = 0; p < eng->active_partitions; p++) {
+            idx = (eng->x_head + p) % eng->partitions;
+            cmac_conj(eng->w_re + p * s, eng->w_im + p * s,
+                      eng->x_re + idx * s, eng->x_im + idx * s,
+                      eng->e_re, eng->e_im, s);
+        }
+
+        /* gradient constraint, one partition per block */
+        p = eng->next_constraint % eng->active_partitions;
+        irfft(eng, eng->w_re + p * s, eng->w_im + p * s, eng->tmp);
+        memset(eng->tmp + h, 0, h * sizeof(float));
+        rfft(eng, eng->tmp, eng->w_re + p * s, eng->w_im + p * s);
+        eng->next_constraint = p + 1;
+    }
+
+    /* never hand out more energy than came in */
+    return ee > ed ? d : e;
+}
+
+static const float *ns_block(struct vp_sw_engine *eng, const float *in)
+{
+    uint32_t h = eng->block;
+    uint32_t n = eng->fft_size;
+    uint32_t k;
+    float pin = 0.0f, pout = 0.0f;
+
+    memmove(eng->ns_in, eng->ns_in + h, h * sizeof(float));
+    memcpy(eng->ns_in + h, in, h * sizeof(float));
+    for (k = 0; k < n; k++)
+        eng->tmp[k] = eng->ns_in[k] * eng->window[k];
+    rfft(eng, eng->tmp, eng->ns_re, eng->ns_im);
+
+    for (k = 0; k <= h; k++) {
+        float psd = eng->ns_re[k] * eng->ns_re[k] + eng->ns_im[k] * eng->ns_im[k];
+        float g;
+
+        if (eng->ns_blocks < NS_INIT_BLOCKS)
+            eng->noise[k] += (psd - eng->noise[k]) / (eng->ns_blocks + 1);
+        else if (psd < NS_SPEECH_RATIO * eng->noise[k])
+            eng->noise[k] = NS_NOISE_SMOOTH * eng->noise[k] + (1.0f - NS_NOISE_SMOOTH) * psd;
+        else
+            eng->noise[k] *= eng->ns_rise;
+
+        g = 1.0f - NS_OVERSUB * eng->noise[k] / (psd + DB_EPS);
+        g = sqrtf(fmaxf(g, NS_FLOOR * NS_FLOOR));
+        if (g < eng->gain[k])
+            g = NS_GAIN_RELEASE * eng->gain[k] + (1.0f - NS_GAIN_RELEASE) * g;
+        eng->gain[k] = g;
+
+        eng->ns_re[k] *= g;
+        eng->ns_im[k] *= g;
+        pin += psd;
+        pout += psd * g * g;
+    }
+    if (eng->ns_blocks < NS_INIT_BLOCKS)
+        eng->ns_blocks++;
+
+    eng->ns_in_pow = STATS_SMOOTH * eng->ns_in_pow + (1.0f - STATS_SMOOTH) * pin;
+    eng->ns_out_pow = STATS_SMOOTH * eng->ns_out_pow + (1.0f - STATS_SMOOTH) * pout;
+
+    irfft(eng, eng->ns_re, eng->ns_im, eng->tmp);
+    for (k = 0; k < h; k++) {
+        eng->ns_out[k] = eng->ns_ola[k] + eng->tmp[k] * eng->window[k];
+        eng->ns_ola[k] = eng->tmp[h + k] * eng->window[h + k];
+    }
+    return eng->ns_out;
+}
+
+static void agc_block(struct vp_sw_engine *eng, float *io)
+{
+    uint32_t h = eng->block;
+    uint32_t i;
+    float level = sqrtf(energy(io, h) / h);
+    float start = eng->agc_gain;
+    float target, step;
+
+    if (level > AGC_GATE) {
+        target = fminf(fmaxf(AGC_TARGET / level, AGC_MIN_GAIN), AGC_MAX_GAIN);
+        if (target < eng->agc_gain)
+            eng->agc_gain += AGC_ATTACK * (target - eng->agc_gain);
+        else
+            eng->agc_gain += AGC_RELEASE * (target - eng->agc_gain);
+    }
+
+    step = (eng->agc_gain - start) / h;
+    for (i = 0; i < h; i++) {
+        float v = io[i] * (start + step * (i + 1));
+        float a = fabsf(v);
+
+        if (a > AGC_LIMIT) {
+            a = AGC_LIMIT + (1.0f - AGC_LIMIT) * tanhf((a - AGC_LIMIT) / (1.0f - AGC_LIMIT));
+            v = copysignf(a, v);
+        }
+        io[i] = v;
+    }
+}
+
+static uint64_t now_ns()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void update_budget(struct vp_sw_engine *eng, uint64_t cost)
+{
+    struct vp_sw_stats *st = &eng->stats;
+
+    st->blocks++;
+    if (cost > st->max_ns)
+        st->max_ns = cost > UINT32_MAX ? UINT32_MAX : (uint32_t)cost;
+    eng->avg_ns = eng->avg_ns ? (eng->avg_ns * 15 + cost) / 16 : cost;
+    st->avg_ns = (uint32_t)eng->avg_ns;
+
+    if (cost <= eng->budget_ns)
+        return;
+
+    st->over_budget++;
+    if (eng->avg_ns > eng->budget_ns && eng->active_partitions > VP_SW_MIN_PARTITIONS) {
+        eng->active_partitions /= 2;
+        if (eng->active_partitions < VP_SW_MIN_PARTITIONS)
+            eng->active_partitions = VP_SW_MIN_PARTITIONS;
+        eng->avg_ns = eng->budget_ns / 2;
+        ALOGW("%s: %llu ns per block over budget %llu ns, echo tail cut to %u partitions",
+              __func__, (unsigned long long)cost, (unsigned long long)eng->budget_ns,
+              eng->active_partitions);
+    }
+}
+
+static void process_block(struct vp_sw_engine *eng, uint32_t enabled)
+{
+    uint32_t h = eng->block;
+    uint32_t i;
+    uint64_t start = now_ns();
+    const float *sig = eng->near_blk;
+
+    /* keep the far end fifo draining even when AEC is off */
+    if (pop_far_block(eng))
+        eng->far_idle = 0;
+    else if (eng->far_idle <= eng->partitions)
+        eng->far_idle++;
+
+    /* once the whole tail is silent there is nothing to cancel */
+    if ((enabled & VP_SW_AEC) && eng->far_idle <= eng->partitions)
+        sig = aec_block(eng, sig);
+
+    if (enabled & VP_SW_NS)
+        sig = ns_block(eng, sig);
+
+    if (enabled & VP_SW_AGC) {
+        if (sig != eng->near_blk)
+            memcpy(eng->near_blk, sig, h * sizeof(float));
+        agc_block(eng, eng->near_blk);
+        sig = eng->near_blk;
+    }
+
+    for (i = 0; i < h; i++) {
+        float v = sig[i] * 32768.0f;
+        if (v > 32767.0f)
+            v = 32767.0f;
+        else if (v < -32768.0f)
+            v = -32768.0f;
+        eng->out_blk[i] = (int16_t)lrintf(v);
+    }
+
+    update_budget(eng, now_ns() - start);
+}
+
+//------------------------------------------------------------------------------
+// Interface
+//------------------------------------------------------------------------------
+
+struct vp_sw_engine *vp_sw_create(uint32_t sample_rate)
+{
+    struct vp_sw_engine *eng;
+    uint32_t h = 1, n, s, p, i, bits;
+    size_t floats;
+    float *f;
+
+    if (sample_rate < 8000 || sample_rate > 48000) {
+        ALOGE("%s: unsupported sample rate %u", __func__, sample_rate);
+        return NULL;
+    }
+
+    while (h * 2 <= sample_rate * VP_SW_BLOCK_MS / 1000 && h * 2 <= VP_SW_MAX_BLOCK)
+        h *= 2;
+    n = 2 * h;
+    s = (h + 1 + 3) & ~3;
+    p = (sample_rate * VP_SW_TAIL_MS / 1000 + h - 1) / h;
+
+    eng = (struct vp_sw_engine *)calloc(1, sizeof(struct vp_sw_engine));
+    if (eng == NULL)
+        return NULL;
+    pthread_mutex_init(&eng->far_lock, NULL);
+
+    eng->rate = sample_rate;
+    eng->block = h;
+    eng->fft_size = n;
+    eng->stride = s;
+    eng->partitions = p;
+    eng->far_cap = VP_SW_FAR_BLOCKS * h;
+
+    floats = 3 * n              /* fft_re, fft_im, tmp */
+           + 5 * h              /* near_blk, far_blk, aec_out, ns_ola, ns_out */
+           + 3 * n              /* x_frame, ns_in, window */
+           + 4 * p * s          /* x_re, x_im, w_re, w_im */
+           + 9 * s              /* pxx, y, e, noise, gain, ns bins */
+           + p                  /* far_peak */
+           + n;                 /* cos_t, sin_t */
+    eng->pool = (float *)calloc(floats, sizeof(float));
+    eng->out_blk = (int16_t *)calloc(h + eng->far_cap, sizeof(int16_t));
+    eng->fft.bitrev = (uint16_t *)calloc(n, sizeof(uint16_t));
+    if (eng->pool == NULL || eng->out_blk == NULL || eng->fft.bitrev == NULL) {
+        ALOGE("%s: failed to allocate engine", __func__);
+        vp_sw_release(eng);
+        return NULL;
+    }
+    eng->far_fifo = eng->out_blk + h;
+
+    f = eng->pool;
+#define CARVE(ptr, count) do { (ptr) = f; f += (count); } while (0)
+    CARVE(eng->fft_re, n);
+    CARVE(eng->fft_im, n);
+    CARVE(eng->tmp, n);
+    CARVE(eng->near_blk, h);
+    CARVE(eng->far_blk, h);
+    CARVE(eng->aec_out, h);
+    CARVE(eng->ns_ola, h);
+    CARVE(eng->ns_out, h);
+    CARVE(eng->x_frame, n);
+    CARVE(eng->ns_in, n);
+    CARVE(eng->window, n);
+    CARVE(eng->x_re, p * s);
+    CARVE(eng->x_im, p * s);
+    CARVE(eng->w_re, p * s);
+    CARVE(eng->w_im, p * s);
+    CARVE(eng->pxx, s);
+    CARVE(eng->y_re, s);
+    CARVE(eng->y_im, s);
+    CARVE(eng->e_re, s);
+    CARVE(eng->e_im, s);
+    CARVE(eng->noise, s);
+    CARVE(eng->gain, s);
+    CARVE(eng->ns_re, s);
+    CARVE(eng->ns_im, s);
+    CARVE(eng->far_peak, p);
+    CARVE(eng->fft.cos_t, n / 2);
+    CARVE(eng->fft.sin_t, n / 2);
+#undef CARVE
+
+    eng->fft.n = n;
+    for (bits = 0; (1u << bits) < n; bits++)
+        ;
+    for (i = 0; i < n; i++) {
+        uint32_t r = 0, v = i, b;
+        for (b = 0; b < bits; b++) {
+            r = (r << 1) | (v & 1);
+            v >>= 1;
+        }
+        eng->fft.bitrev[i] = (uint16_t)r;
+    }
+    for (i = 0; i < n / 2; i++) {
+        eng->fft.cos_t[i] = cosf(2.0f * (float)M_PI * i / n);
+        eng->fft.sin_t[i] = sinf(2.0f * (float)M_PI * i / n);
+    }
+    /* periodic sqrt-Hann, squares sum to one at 50% overlap */
+    for (i = 0; i < n; i++)
+        eng->window[i] = sqrtf(0.5f * (1.0f - cosf(2.0f * (float)M_PI * i / n)));
+
+    eng->dt_hold_blocks = (sample_rate * AEC_DT_HOLD_MS / 1000 + h - 1) / h;
+    eng->ns_rise = powf(10.0f, NS_NOISE_RISE_DB_S * h / sample_rate / 10.0f);
+    eng->budget_ns = (uint64_t)h * 1000000000ULL / sample_rate * VP_SW_CPU_BUDGET_PCT / 100;
+
+    vp_sw_reset(eng);
+    ALOGD("%s: rate %u block %u partitions %u budget %llu ns", __func__,
+          sample_rate, h, p, (unsigned long long)eng->budget_ns);
+    return eng;
+}
+
+void vp_sw_release(struct vp_sw_engine *eng)
+{
+    if (eng == NULL)
+        return;
+
+    if (eng->stats.blocks)
+        ALOGD("%s: blocks %llu over budget %llu avg %u ns max %u ns erle %.1f dB ns %.1f dB",
+              __func__, (unsigned long long)eng->stats.blocks,
+              (unsigned long long)eng->stats.over_budget, eng->stats.avg_ns,
+              eng->stats.max_ns, to_db(eng->erle_d, eng->erle_e),
+              to_db(eng->ns_in_pow, eng->ns_out_pow));
+    pthread_mutex_destroy(&eng->far_lock);
+    free(eng->fft.bitrev);
+    free(eng->out_blk);
+    free(eng->pool);
+    free(eng);
+}
+
+void vp_sw_reset(struct vp_sw_engine *eng)
+{
+    uint32_t h, n, s, p;
+
+    if (eng == NULL)
+        return;
+
+    h = eng->block;
+    n = eng->fft_size;
+    s = eng->stride;
+    p = eng->partitions;
+
+    pthread_mutex_lock(&eng->far_lock);
+    eng->far_rd = 0;
+    eng->far_count = 0;
+    pthread_mutex_unlock(&eng->far_lock);
+
+    eng->fill = 0;
+    memset(eng->out_blk, 0, h * sizeof(int16_t));
+    memset(eng->x_frame, 0, n * sizeof(float));
+    memset(eng->x_re, 0, p * s * sizeof(float));
+    memset(eng->x_im, 0, p * s * sizeof(float));
+    memset(eng->w_re, 0, p * s * sizeof(float));
+    memset(eng->w_im, 0, p * s * sizeof(float));
+    memset(eng->pxx, 0, s * sizeof(float));
+    memset(eng->far_peak, 0, p * sizeof(float));
+    eng->x_head = 0;
+    eng->far_idle = p + 1;
+    eng->next_constraint = 0;
+    eng->active_partitions = p;
+    eng->erle_d = 0.0f;
+    eng->erle_e = 0.0f;
+    eng->dt_hold = 0;
+
+    memset(eng->ns_in, 0, n * sizeof(float));
+    memset(eng->ns_ola, 0, h * sizeof(float));
+    memset(eng->noise, 0, s * sizeof(float));
+    for (uint32_t k = 0; k < s; k++)
+        eng->gain[k] = 1.0f;
+    eng->ns_blocks = 0;
+    eng->ns_in_pow = 0.0f;
+    eng->ns_out_pow = 0.0f;
+
+    eng->agc_gain = 1.0f;
+    eng->avg_ns = 0;
+    memset(&eng->stats, 0, sizeof(eng->stats));
+}
+
+int vp_sw_process(struct vp_sw_engine *eng, const int16_t *in, int16_t *out,
+                  size_t frames, uint32_t enabled)
+{
+    size_t done = 0;
+
+    if (eng == NULL || in == NULL || out == NULL)
+        return -EINVAL;
+
+    /*
+     * Output lags input by one block: each slot of out_blk is handed out
+     * just before the matching input slot is overwritten, so in == out works.
+     */
+    while (done < frames) {
+        size_t n = eng->block - eng->fill;
+        size_t i;
+
+        if (n > frames - done)
+            n = frames - done;
+        for (i = 0; i < n; i++)
+            eng->near_blk[eng->fill + i] = in[done + i] * (1.0f / 32768.0f);
+        memcpy(out + done, eng->out_blk + eng->fill, n * sizeof(int16_t));
+        eng->fill += n;
+        done += n;
+
+        if (eng->fill == eng->block) {
+            process_block(eng, enabled);
+            eng->fill = 0;
+        }
+    }
+    return 0;
+}
+
+int vp_sw_process_reverse(struct vp_sw_engine *eng, const int16_t *far, size_t frames)
+{
+    size_t i;
+
+    if (eng == NULL || far == NULL)
+        return -EINVAL;
+
+    if (frames > eng->far_cap) {
+        far += frames - eng->far_cap;
+        frames = eng->far_cap;
+    }
+
+    pthread_mutex_lock(&eng->far_lock);
+    for (i = 0; i < frames; i++) {
+        uint32_t wr = (eng->far_rd + eng->far_count) % eng->far_cap;
+        eng->far_fifo[wr] = far[i];
+        if (eng->far_count == eng->far_cap)
+            eng->far_rd = (eng->far_rd + 1) % eng->far_cap;  /* drop oldest */
+        else
+            eng->far_count++;
+    }
+    pthread_mutex_unlock(&eng->far_lock);
+    return 0;
+}
+
+void vp_sw_get_stats(struct vp_sw_engine *eng, struct vp_sw_stats *stats)
+{
+    if (eng == NULL || stats == NULL)
+        return;
+
+    *stats = eng->stats;
+    stats->block_frames = eng->block;
+    stats->partitions = eng->active_partitions;
+    stats->erle_db = to_db(eng->erle_d, eng->erle_e);
+    stats->ns_atten_db = to_db(eng->ns_in_pow, eng->ns_out_pow);
+    stats->agc_gain_db = 20.0f * log10f(eng->agc_gain);
+}
@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+#ifndef VOICE_PROCESSING_SW_H_
+#define VOICE_PROCESSING_SW_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#if __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Software fallback for the AEC/NS/AGC pre-processors, used when the capture
+ * path does not go through the DSP (USB and BT headsets) or when forced by
+ * property. Mono, 16 bit only.
+ *
+ * Audio is handled in fixed blocks of VP_SW_BLOCK_MS rounded down to a power
+ * of two in samples (128 at 16 kHz). Capture periods of any size, 20 ms for
+ * StreamInPrimary, are streamed through them with a constant latency of one
+ * block, two while NS is enabled, and no allocation on the process path.
+ */
+
+#define VP_SW_BLOCK_MS          10
+#define VP_SW_TAIL_MS           128  /* echo tail covered by the AEC filter */
+#define VP_SW_CPU_BUDGET_PCT    25   /* of block duration, per block */
+
+#define VP_SW_AEC   (1 << 0)
+#define VP_SW_NS    (1 << 1)
+#define VP_SW_AGC   (1 << 2)
+
+struct vp_sw_stats {
+    uint64_t blocks;
+    uint64_t over_budget;
+    uint32_t block_frames;
+    uint32_t partitions;
+    uint32_t avg_ns;
+    uint32_t max_ns;
+    float erle_db;        /* smoothed echo return loss enhancement */
+    float ns_atten_db;    /* smoothed noise suppressor attenuation */
+    float agc_gain_db;
+};
+
+struct vp_sw_engine;
+
+struct vp_sw_engine *vp_sw_create(uint32_t sample_rate);
+void vp_sw_release(struct vp_sw_engine *eng);
+void vp_sw_reset(struct vp_sw_engine *eng);
+
+/* near end capture, in place allowed */
+int vp_sw_process(struct vp_sw_engine *eng, const int16_t *in, int16_t *out,
+                  size_t frames, uint32_t enabled);
+
+/* far end reference for the echo canceller, may run on another thread */
+int vp_sw_process_reverse(struct vp_sw_engine *eng, const int16_t *far,
+                          size_t frames);
+
+void vp_sw_get_stats(struct vp_sw_engine *eng, struct vp_sw_stats *stats);
+
+#if __cplusplus
+}  // extern "C"
+#endif
+
+#endif /* VOICE_PROCESSING_SW_H_ */
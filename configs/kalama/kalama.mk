@@ -123,6 +123,14 @@ CONFIG_PAL_SRC_DIR := vendor/qcom/opensource/pal/configs/kalama
 CONFIG_HAL_SRC_DIR := vendor/qcom/opensource/audio-hal/primary-hal/configs/kalama
 CONFIG_SKU_OUT_DIR := $(TARGET_COPY_OUT_VENDOR)/etc/audio/sku_$(DEVICE_SKU)
 
+# buffer policy, the platform's own file or else the common one
+AUDIO_HAL_BUFFER_POLICY := $(wildcard $(CONFIG_HAL_SRC_DIR)/audio_hal_buffer_policy.xml)
+ifeq ($(AUDIO_HAL_BUFFER_POLICY),)
+AUDIO_HAL_BUFFER_POLICY := vendor/qcom/opensource/audio-hal/primary-hal/configs/common/audio_hal_buffer_policy.xml
+endif
+PRODUCT_COPY_FILES += \
+    $(AUDIO_HAL_BUFFER_POLICY):$(TARGET_COPY_OUT_VENDOR)/etc/audio_hal_buffer_policy.xml
+
 PRODUCT_COPY_FILES += \
     $(CONFIG_HAL_SRC_DIR)/audio_effects.conf:$(CONFIG_SKU_OUT_DIR)/audio_effects.conf \
     $(CONFIG_HAL_SRC_DIR)/audio_effects.xml:$(CONFIG_SKU_OUT_DIR)/audio_effects.xml \
@@ -170,6 +170,14 @@ PRODUCT_PACKAGES += $(AUDIO_AGM)
 PRODUCT_PACKAGES += $(AUDIO_PAL)
 PRODUCT_PACKAGES += $(AUDIO_C2)
 
+# buffer policy, the platform's own file or else the common one
+AUDIO_HAL_BUFFER_POLICY := $(wildcard vendor/qcom/opensource/audio-hal/primary-hal/configs/lahaina/audio_hal_buffer_policy.xml)
+ifeq ($(AUDIO_HAL_BUFFER_POLICY),)
+AUDIO_HAL_BUFFER_POLICY := vendor/qcom/opensource/audio-hal/primary-hal/configs/common/audio_hal_buffer_policy.xml
+endif
+PRODUCT_COPY_FILES += \
+    $(AUDIO_HAL_BUFFER_POLICY):$(TARGET_COPY_OUT_VENDOR)/etc/audio_hal_buffer_policy.xml
+
 PRODUCT_COPY_FILES += \
     vendor/qcom/opensource/audio-hal/primary-hal/configs/lahaina/audio_effects.conf:$(TARGET_COPY_OUT_VENDOR)/etc/audio_effects.conf \
     vendor/qcom/opensource/audio-hal/primary-hal/configs/lahaina/audio_effects.xml:$(TARGET_COPY_OUT_VENDOR)/etc/audio_effects.xml \
@@ -64,8 +64,23 @@ LOCAL_C_INCLUDES += \
 
 LOCAL_SRC_FILES := \
     AudioStream.cpp \
+    AudioTrace.cpp \
     AudioDevice.cpp \
+    AudioMutex.cpp \
     AudioVoice.cpp \
+    BufferPolicy.cpp \
+    CallRecorder.cpp \
+    LatencyProbe.cpp \
+    MetadataAggregator.cpp \
+    MicCache.cpp \
+    MmapPosition.cpp \
+    ParamKeys.cpp \
+    PerfLockPolicy.cpp \
+    RouteTransaction.cpp \
+    SsrRecovery.cpp \
+    StreamCounters.cpp \
+    ThreadPolicy.cpp \
+    VolumeRamp.cpp \
     audio_extn/soundtrigger.cpp \
     audio_extn/Gain.cpp \
     audio_extn/AudioExtn.cpp
@@ -110,4 +125,10 @@ endif
     LOCAL_SRC_FILES += audio_extn/Gef.cpp
 endif
 
+ifneq ($(filter userdebug eng,$(TARGET_BUILD_VARIANT)),)
+  LOCAL_CFLAGS += -DAHAL_MUTEX_PROFILING
+else ifeq ($(strip $(AUDIO_FEATURE_ENABLED_MUTEX_PROFILING)),true)
+  LOCAL_CFLAGS += -DAHAL_MUTEX_PROFILING
+endif
+
 include $(BUILD_SHARED_LIBRARY)
@@ -32,6 +32,9 @@
  * SPDX-License-Identifier: BSD-3-Clause-Clear
  */
 
+#ifndef ANDROID_HARDWARE_AHAL_AUDIO_COMMON_H_
+#define ANDROID_HARDWARE_AHAL_AUDIO_COMMON_H_
+
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
@@ -43,7 +46,14 @@
 #define AHAL_LOG_DBG             (0x8) /**< debug message, required at minimum for debug.*/
 #define AHAL_LOG_VERBOSE         (0x10)/**< verbose message, useful primarily to help developers debug low-level code */
 
-static uint32_t ahal_log_lvl = AHAL_LOG_ERR|AHAL_LOG_WARN|AHAL_LOG_INFO|AHAL_LOG_DBG; /*TODO make this dynamic*/
+#define AHAL_LOG_DEFAULT (AHAL_LOG_ERR|AHAL_LOG_WARN|AHAL_LOG_INFO|AHAL_LOG_DBG)
+
+/*
+ * One copy per library, shared by its translation units. The HAL's copy is
+ * set from vendor.audio.hal.log_lvl at init and by the ahal_log_lvl
+ * parameter, both of which always keep AHAL_LOG_ERR.
+ */
+inline uint32_t ahal_log_lvl = AHAL_LOG_DEFAULT;
 
 
 #define AHAL_ERR(arg,...)                                          \
@@ -66,3 +76,5 @@ static uint32_t ahal_log_lvl = AHAL_LOG_ERR|AHAL_LOG_WARN|AHAL_LOG_INFO|AHAL_LOG
     if (ahal_log_lvl & AHAL_LOG_VERBOSE) {                          \
         ALOGV("%s: %d: "  arg, __func__, __LINE__, ##__VA_ARGS__);\
     }
+
+#endif  // ANDROID_HARDWARE_AHAL_AUDIO_COMMON_H_
@@ -48,6 +48,13 @@
 #include "AudioCommon.h"
 
 #include "AudioDevice.h"
+#include "AudioTrace.h"
+#include "CallRecorder.h"
+#include "LatencyProbe.h"
+#include "MicCache.h"
+#include "ParamKeys.h"
+#include "PerfLockPolicy.h"
+#include "ThreadPolicy.h"
 
 #include <dlfcn.h>
 #include <inttypes.h>
@@ -64,13 +71,23 @@
 #include "audio_extn.h"
 #include "battery_listener.h"
 
+/* the host build points these at a fixture, see hal/test/hal_mic_test.cpp */
+#ifndef MIC_CHARACTERISTICS_XML_FILE
 #define MIC_CHARACTERISTICS_XML_FILE "/vendor/etc/microphone_characteristics.xml"
+#endif
+#ifndef MIC_CHARACTERISTICS_CACHE_FILE
+#define MIC_CHARACTERISTICS_CACHE_FILE "/data/vendor/audio/microphone_characteristics.bin"
+#endif
+/* the host build boosts on the perf HAL of libpal_sim */
+#ifndef KPI_OPTIMIZE_DEFAULT_ENABLED
+#define KPI_OPTIMIZE_DEFAULT_ENABLED false
+#endif
 static pal_device_id_t in_snd_device = PAL_DEVICE_NONE;
 microphone_characteristics_t AudioDevice::microphones;
 snd_device_to_mic_map_t AudioDevice::microphone_maps[PAL_MAX_INPUT_DEVICES];
 bool AudioDevice::mic_characteristics_available = false;
 
-card_status_t AudioDevice::sndCardState = CARD_STATUS_ONLINE;
+std::atomic<card_status_t> AudioDevice::sndCardState(CARD_STATUS_ONLINE);
 
 btsco_lc3_cfg_t AudioDevice::btsco_lc3_cfg = {};
 
@@ -353,6 +370,8 @@ static void hdr_get_parameters(std::shared_ptr<AudioDevice> adev,
 }
 
 AudioDevice::~AudioDevice() {
+    route_batch_.Flush();
+    WaitMicCharacteristics();
     audio_extn_gef_deinit(adev_);
     audio_extn_sound_trigger_deinit(adev_);
     AudioExtn::battery_properties_listener_deinit();
@@ -409,6 +428,9 @@ std::shared_ptr<StreamOutPrimary> AudioDevice::CreateStreamOut(
 }
 
 void AudioDevice::CloseStreamOut(std::shared_ptr<StreamOutPrimary> stream) {
+    bool found = false;
+
+    route_batch_.Flush();
     out_list_mutex.lock();
     auto iter =
         std::find(stream_out_list_.begin(), stream_out_list_.end(), stream);
@@ -416,8 +438,38 @@ void AudioDevice::CloseStreamOut(std::shared_ptr<StreamOutPrimary> stream) {
         AHAL_ERR("invalid output stream");
     } else {
         stream_out_list_.erase(iter);
+        found = true;
+    }
+    out_list_mutex.unlock();
+    /* an SSR recovery still holding the stream must not reopen it */
+    if (found)
+        stream->MarkClosed();
+}
+
+/* for SSR recovery, the framework may close a stream while the card is offline */
+bool AudioDevice::IsStreamOpen(const std::shared_ptr<StreamPrimary>& stream) {
+    bool found = false;
+
+    out_list_mutex.lock();
+    for (auto& out : stream_out_list_) {
+        if (out.get() == stream.get()) {
+            found = true;
+            break;
+        }
     }
     out_list_mutex.unlock();
+    if (found)
+        return true;
+
+    in_list_mutex.lock();
+    for (auto& in : stream_in_list_) {
+        if (in.get() == stream.get()) {
+            found = true;
+            break;
+        }
+    }
+    in_list_mutex.unlock();
+    return found;
 }
 
 int AudioDevice::CreateAudioPatch(audio_patch_handle_t *handle,
@@ -501,7 +553,7 @@ int AudioDevice::CreateAudioPatch(audio_patch_handle_t *handle,
         *handle = patch->handle;
         new_patch = true;
     } else {
-        std::lock_guard<std::mutex> lock(patch_map_mutex);
+        std::lock_guard<AudioMutex> lock(patch_map_mutex);
         auto it = patch_map_.find(*handle);
         if (it == patch_map_.end()) {
             AHAL_ERR("Unable to fetch patch with handle %d", *handle);
@@ -514,9 +566,15 @@ int AudioDevice::CreateAudioPatch(audio_patch_handle_t *handle,
         patch->sinks = sinks;
     }
 
-    if (voice_ && patch_type == AudioPatch::PATCH_PLAYBACK)
-        ret = voice_->RouteStream(device_types);
-    ret |= stream->RouteStream(device_types);
+    if (!route_batch_.Add(stream, device_types,
+                          patch_type == AudioPatch::PATCH_PLAYBACK ? voice_ : nullptr)) {
+        RouteTransaction route;
+
+        if (voice_ && patch_type == AudioPatch::PATCH_PLAYBACK)
+            route.AddVoice(voice_, device_types);
+        route.AddStream(stream, device_types);
+        ret = route.Commit();
+    }
 
     if (ret) {
         if (new_patch)
@@ -524,7 +582,7 @@ int AudioDevice::CreateAudioPatch(audio_patch_handle_t *handle,
         AHAL_ERR("Stream routing failed for io_handle %d", io_handle);
     } else if (new_patch) {
         // new patch...add to patch map
-        std::lock_guard<std::mutex> lock(patch_map_mutex);
+        std::lock_guard<AudioMutex> lock(patch_map_mutex);
         patch_map_[patch->handle] = patch;
         AHAL_DBG("Added a new patch with handle %d", patch->handle);
     }
@@ -583,6 +641,8 @@ int AudioDevice::ReleaseAudioPatch(audio_patch_handle_t handle) {
         return -EINVAL;
     }
 
+    /* a route still queued for the stream must not land after this one */
+    route_batch_.Flush();
     ret = stream->RouteStream({AUDIO_DEVICE_NONE});
 
     if (ret)
@@ -619,6 +679,9 @@ std::shared_ptr<StreamInPrimary> AudioDevice::CreateStreamIn(
 }
 
 void AudioDevice::CloseStreamIn(std::shared_ptr<StreamInPrimary> stream) {
+    bool found = false;
+
+    route_batch_.Flush();
     in_list_mutex.lock();
     auto iter =
         std::find(stream_in_list_.begin(), stream_in_list_.end(), stream);
@@ -626,6 +689,7 @@ void AudioDevice::CloseStreamIn(std::shared_ptr<StreamInPrimary> stream) {
         AHAL_ERR("invalid input stream");
     } else {
         stream_in_list_.erase(iter);
+        found = true;
         if (voice_) {
             if (stream_in_list_.size() == 0) {
                 voice_->stream_in_primary_ = nullptr;
@@ -635,6 +699,8 @@ void AudioDevice::CloseStreamIn(std::shared_ptr<StreamInPrimary> stream) {
         }
     }
     in_list_mutex.unlock();
+    if (found)
+        stream->MarkClosed();
 }
 
 static int adev_close(hw_device_t *device __unused) {
@@ -654,13 +720,14 @@ void adev_on_battery_status_changed(bool charging)
 }
 
 static int adev_set_voice_volume(struct audio_hw_device *dev, float volume) {
+    AutoCallRecord rec(CALL_ADEV_SET_VOICE_VOLUME, 0, &volume, sizeof(volume));
     std::shared_ptr<AudioDevice>adevice = AudioDevice::GetInstance(dev);
     if (!adevice) {
         AHAL_ERR("invalid adevice object");
-        return -EINVAL;
+        return rec.SetRet(-EINVAL);
     }
 
-    return adevice->SetVoiceVolume(volume);
+    return rec.SetRet(adevice->SetVoiceVolume(volume));
 }
 
 static int adev_pal_global_callback(uint32_t event_id, uint32_t *event_data,
@@ -669,9 +736,9 @@ static int adev_pal_global_callback(uint32_t event_id, uint32_t *event_data,
               event_id, *event_data, cookie);
     switch (event_id) {
     case PAL_SND_CARD_STATE :
-        AudioDevice::sndCardState = (card_status_t)*event_data;
         AHAL_DBG("sound card status changed %d sndCardState %d",
-              *event_data, AudioDevice::sndCardState);
+              *event_data, AudioDevice::sndCardState.load());
+        AudioDevice::GetInstance()->OnSndCardState((card_status_t)*event_data);
         break;
     default :
        AHAL_ERR("Invalid event id:%d", event_id);
@@ -680,6 +747,23 @@ static int adev_pal_global_callback(uint32_t event_id, uint32_t *event_data,
     return 0;
 }
 
+static size_t call_record_fill_open(uint8_t *buf, audio_devices_t devices, uint32_t flags,
+                                    const struct audio_config *config, audio_source_t source,
+                                    const char *address) {
+    call_record_open_t *rec = (call_record_open_t *)buf;
+    size_t len = address ? strnlen(address, AUDIO_DEVICE_MAX_ADDRESS_LEN) : 0;
+
+    rec->devices = devices;
+    rec->flags = flags;
+    rec->sample_rate = config->sample_rate;
+    rec->channel_mask = config->channel_mask;
+    rec->format = config->format;
+    rec->source = source;
+    if (len)
+        memcpy(rec->address, address, len);
+    return sizeof(*rec) + len;
+}
+
 static int adev_open_output_stream(struct audio_hw_device *dev,
                             audio_io_handle_t handle,
                             audio_devices_t devices,
@@ -689,6 +773,12 @@ static int adev_open_output_stream(struct audio_hw_device *dev,
                             const char *address) {
     int32_t ret = 0;
     std::shared_ptr<StreamOutPrimary> astream;
+    uint8_t rec_buf[sizeof(call_record_open_t) + AUDIO_DEVICE_MAX_ADDRESS_LEN];
+    AutoCallRecord rec(CALL_ADEV_OPEN_OUTPUT, handle);
+
+    if (rec.Active())
+        rec.SetPayload(rec_buf, call_record_fill_open(rec_buf, devices, flags, config,
+                                                      AUDIO_SOURCE_DEFAULT, address));
 
     AHAL_DBG("enter: format(%#x) sample_rate(%d) channel_mask(%#x) devices(%#x)\
         flags(%#x) address(%s)", config->format, config->sample_rate,
@@ -729,7 +819,7 @@ static int adev_open_output_stream(struct audio_hw_device *dev,
     }
 exit:
     AHAL_DBG("Exit ret: %d", ret);
-    return ret;
+    return rec.SetRet(ret);
 }
 
 void adev_close_output_stream(struct audio_hw_device *dev,
@@ -749,6 +839,7 @@ void adev_close_output_stream(struct audio_hw_device *dev,
 
     AHAL_DBG("Enter:stream_handle(%p)", astream_out.get());
 
+    AutoCallRecord rec(CALL_ADEV_CLOSE_OUTPUT, astream_out->GetHandle());
     adevice->CloseStreamOut(astream_out);
 
     AHAL_DBG("Exit");
@@ -772,6 +863,7 @@ void adev_close_input_stream(struct audio_hw_device *dev,
 
     AHAL_DBG("Enter:stream_handle(%p)", astream_in.get());
 
+    AutoCallRecord rec(CALL_ADEV_CLOSE_INPUT, astream_in->GetHandle());
     adevice->CloseStreamIn(astream_in);
 
     AHAL_DBG("Exit");
@@ -803,6 +895,12 @@ static int adev_open_input_stream(struct audio_hw_device *dev,
     int32_t ret = 0;
     std::shared_ptr<StreamInPrimary> astream = nullptr;
     audio_format_t inputFormat = config->format;
+    uint8_t rec_buf[sizeof(call_record_open_t) + AUDIO_DEVICE_MAX_ADDRESS_LEN];
+    AutoCallRecord rec(CALL_ADEV_OPEN_INPUT, handle);
+
+    if (rec.Active())
+        rec.SetPayload(rec_buf, call_record_fill_open(rec_buf, devices, flags, config,
+                                                      source, address));
     AHAL_DBG("enter: sample_rate(%d) channel_mask(%#x) devices(%#x)\
         io_handle(%d) source(%d) format %x", config->sample_rate,
         config->channel_mask, devices, handle, source, config->format);
@@ -853,28 +951,32 @@ static int adev_open_input_stream(struct audio_hw_device *dev,
 
   exit:
       AHAL_DBG("Exit ret: %d", ret);
-      return ret;
+      return rec.SetRet(ret);
 }
 
 static int adev_set_mode(struct audio_hw_device *dev, audio_mode_t mode)
 {
+    int32_t rec_mode = mode;
+    AutoCallRecord rec(CALL_ADEV_SET_MODE, 0, &rec_mode, sizeof(rec_mode));
     std::shared_ptr<AudioDevice>adevice = AudioDevice::GetInstance(dev);
     if (!adevice) {
         AHAL_ERR("invalid adevice object");
-        return -EINVAL;
+        return rec.SetRet(-EINVAL);
     }
 
-    return adevice->SetMode(mode);
+    return rec.SetRet(adevice->SetMode(mode));
 }
 
 static int adev_set_mic_mute(struct audio_hw_device *dev, bool state) {
+    int32_t rec_state = state;
+    AutoCallRecord rec(CALL_ADEV_SET_MIC_MUTE, 0, &rec_state, sizeof(rec_state));
     std::shared_ptr<AudioDevice> adevice = AudioDevice::GetInstance(dev);
     if (!adevice) {
         AHAL_ERR("invalid adevice object");
-        return -EINVAL;
+        return rec.SetRet(-EINVAL);
     }
 
-    return adevice->SetMicMute(state);
+    return rec.SetRet(adevice->SetMicMute(state));
 }
 
 static int adev_get_mic_mute(const struct audio_hw_device *dev, bool *state) {
@@ -910,13 +1012,14 @@ static int adev_get_master_mute(struct audio_hw_device *dev __unused,
 
 static int adev_set_parameters(struct audio_hw_device *dev,
                                const char *kvpairs) {
+    AutoCallRecord rec(CALL_ADEV_SET_PARAMS, 0, kvpairs, kvpairs ? strlen(kvpairs) : 0);
     std::shared_ptr<AudioDevice> adevice = AudioDevice::GetInstance(dev);
     if (!adevice) {
         AHAL_ERR("invalid adevice object");
-        return -EINVAL;
+        return rec.SetRet(-EINVAL);
     }
 
-    return adevice->SetParameters(kvpairs);
+    return rec.SetRet(adevice->SetParameters(kvpairs));
 }
 
 static char* adev_get_parameters(const struct audio_hw_device *dev,
@@ -1014,12 +1117,13 @@ static size_t adev_get_input_buffer_size(
 
 int adev_release_audio_patch(struct audio_hw_device *dev,
                              audio_patch_handle_t handle) {
+    AutoCallRecord rec(CALL_ADEV_RELEASE_PATCH, handle);
     std::shared_ptr<AudioDevice> adevice = AudioDevice::GetInstance(dev);
     if (!adevice) {
         AHAL_ERR("GetInstance() failed");
-        return -EINVAL;
+        return rec.SetRet(-EINVAL);
     }
-    return adevice->ReleaseAudioPatch(handle);
+    return rec.SetRet(adevice->ReleaseAudioPatch(handle));
 }
 
 int adev_create_audio_patch(struct audio_hw_device *dev,
@@ -1042,8 +1146,24 @@ int adev_create_audio_patch(struct audio_hw_device *dev,
 
     std::vector<struct audio_port_config> source_vec(sources, sources + num_sources);
     std::vector<struct audio_port_config> sink_vec(sinks, sinks + num_sinks);
+    std::vector<uint8_t> rec_buf;
+    AutoCallRecord rec(CALL_ADEV_CREATE_PATCH, AUDIO_PATCH_HANDLE_NONE);
+    int ret;
+
+    if (rec.Active()) {
+        call_record_patch_t hdr = {*handle, num_sources, num_sinks};
+
+        rec_buf.insert(rec_buf.end(), (uint8_t *)&hdr, (uint8_t *)(&hdr + 1));
+        rec_buf.insert(rec_buf.end(), (uint8_t *)source_vec.data(),
+                       (uint8_t *)(source_vec.data() + num_sources));
+        rec_buf.insert(rec_buf.end(), (uint8_t *)sink_vec.data(),
+                       (uint8_t *)(sink_vec.data() + num_sinks));
+        rec.SetPayload(rec_buf.data(), rec_buf.size());
+    }
 
-    return adevice->CreateAudioPatch(handle, source_vec, sink_vec);
+    ret = adevice->CreateAudioPatch(handle, source_vec, sink_vec);
+    rec.SetHandle(*handle);
+    return rec.SetRet(ret);
 }
 
 int get_audio_port_v7(struct audio_hw_device *dev, struct audio_port_v7 *config) {
@@ -1071,6 +1191,14 @@ int adev_set_audio_port_config(struct audio_hw_device *dev,
     return 0;
 }
 
+static inline uint64_t param_time_ns()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
 static int adev_dump(const audio_hw_device_t *device, int fd)
 {
     dprintf(fd, " \n");
@@ -1084,6 +1212,17 @@ static int adev_dump(const audio_hw_device_t *device, int fd)
 #else
     dprintf(fd, "PAL HIDL disabled");
 #endif
+    dprintf(fd, "\n");
+
+    AudioDevice::GetInstance((audio_hw_device_t*)device)->DumpParamStats(fd);
+    AudioDevice::GetInstance((audio_hw_device_t*)device)->DumpInitStages(fd);
+    AudioDevice::GetInstance((audio_hw_device_t*)device)->DumpSsrRecovery(fd);
+    ThreadPolicy::Dump(fd);
+    PerfLockPolicy::Dump(fd);
+    AudioTrace::Dump(fd);
+    CallRecorder::Dump(fd);
+    AudioMutex::Dump(fd);
+    LatencyProbe::Dump(fd);
 
     return 0;
 }
@@ -1094,26 +1233,211 @@ static int adev_get_microphones(const struct audio_hw_device *dev __unused,
     return AudioDevice::get_microphones(mic_array, mic_count);
 }
 
+void AudioDevice::RecordInitStage(const char *name, uint64_t start_ns, bool async) {
+    uint64_t end_ns = param_time_ns();
+    std::lock_guard<std::mutex> lock(init_stage_mutex_);
+
+    init_stages_.push_back({name, start_ns - init_start_ns_, end_ns - start_ns, async});
+}
+
+void AudioDevice::DumpInitStages(int fd) {
+    std::lock_guard<std::mutex> lock(init_stage_mutex_);
+
+    dprintf(fd, "Init stages: start(us) duration(us)\n");
+    for (auto& stage : init_stages_)
+        dprintf(fd, "  %-20s %8" PRIu64 " %8" PRIu64 "%s\n", stage.name,
+                stage.start_ns / 1000, stage.duration_ns / 1000,
+                stage.async ? " (async)" : "");
+}
+
+void AudioDevice::OnSndCardState(card_status_t state) {
+    card_status_t prev = sndCardState.exchange(state);
+
+    AHAL_TRACE(AHAL_EVT_SSR, state);
+
+    if (state == CARD_STATUS_OFFLINE && prev != CARD_STATUS_OFFLINE) {
+        ssr_recovery_.OnOffline(GetAllStreams());
+    } else if (state == CARD_STATUS_ONLINE && prev == CARD_STATUS_OFFLINE) {
+        ssr_recovery_.OnOnline(voice_);
+    }
+}
+
+/*
+ * Loads the visualizer and offload effects bundle the first time an
+ * offload stream needs them. Once loaded, callers only see the atomic.
+ */
+void AudioDevice::EnsureEffectLibs() {
+    if (effect_libs_loaded_.load(std::memory_order_acquire))
+        return;
+
+    std::call_once(effect_libs_once_, [this] {
+        LoadEffectLibs();
+        effect_libs_loaded_.store(true, std::memory_order_release);
+    });
+}
+
+void AudioDevice::GetEffectLibFns(offload_effects_start_output *effect_start,
+                                  offload_effects_stop_output *effect_stop,
+                                  visualizer_hal_start_output *visualizer_start,
+                                  visualizer_hal_stop_output *visualizer_stop) {
+    EnsureEffectLibs();
+    *effect_start = fnp_offload_effect_start_output_;
+    *effect_stop = fnp_offload_effect_stop_output_;
+    *visualizer_start = fnp_visualizer_start_output_;
+    *visualizer_stop = fnp_visualizer_stop_output_;
+}
+
+void AudioDevice::LoadEffectLibs() {
+    uint64_t start_ns = param_time_ns();
+    visualizer_hal_set_thread_hooks set_thread_hooks = nullptr;
+
+    // visualizer lib
+    if (access(VISUALIZER_LIBRARY_PATH, R_OK) == 0) {
+        visualizer_lib_ = dlopen(VISUALIZER_LIBRARY_PATH, RTLD_NOW);
+        if (visualizer_lib_ == NULL) {
+            AHAL_ERR("DLOPEN failed for %s", VISUALIZER_LIBRARY_PATH);
+        } else {
+            AHAL_VERBOSE("DLOPEN successful for %s", VISUALIZER_LIBRARY_PATH);
+            fnp_visualizer_start_output_ =
+                        (int (*)(audio_io_handle_t, pal_stream_handle_t*))dlsym(visualizer_lib_,
+                                                        "visualizer_hal_start_output");
+            fnp_visualizer_stop_output_ =
+                        (int (*)(audio_io_handle_t, pal_stream_handle_t*))dlsym(visualizer_lib_,
+                                                        "visualizer_hal_stop_output");
+            set_thread_hooks = (visualizer_hal_set_thread_hooks)dlsym(visualizer_lib_,
+                                                        "visualizer_hal_set_thread_hooks");
+            if (set_thread_hooks)
+                set_thread_hooks(ThreadPolicy::VisualizerThreadStart,
+                                 ThreadPolicy::VisualizerThreadWakeup);
+        }
+    }
+
+    // offload effect lib
+    if (access(OFFLOAD_EFFECTS_BUNDLE_LIBRARY_PATH, R_OK) == 0) {
+        offload_effects_lib_ = dlopen(OFFLOAD_EFFECTS_BUNDLE_LIBRARY_PATH,
+                                      RTLD_NOW);
+        if (offload_effects_lib_ == NULL) {
+            AHAL_ERR("DLOPEN failed for %s",
+                  OFFLOAD_EFFECTS_BUNDLE_LIBRARY_PATH);
+        } else {
+            AHAL_VERBOSE("DLOPEN successful for %s",
+                  OFFLOAD_EFFECTS_BUNDLE_LIBRARY_PATH);
+            fnp_offload_effect_start_output_ =
+                (int (*)(audio_io_handle_t, pal_stream_handle_t*))dlsym(
+                                    offload_effects_lib_,
+                                    "offload_effects_bundle_hal_start_output");
+            fnp_offload_effect_stop_output_ =
+                (int (*)(audio_io_handle_t, pal_stream_handle_t*))dlsym(
+                                    offload_effects_lib_,
+                                    "offload_effects_bundle_hal_stop_output");
+            AudioMutex::SetEffectHooks((offload_effects_bundle_hal_set_mutex_hooks)dlsym(
+                                    offload_effects_lib_,
+                                    "offload_effects_bundle_hal_set_mutex_hooks"));
+        }
+    }
+    RecordInitStage("effect_libs", start_ns, true);
+}
+
+static int parse_perf_lock_opts(char *value, int *opts) {
+    char *saveptr = NULL;
+    char *tok;
+    int size = 0;
+
+    for (tok = strtok_r(value, ",", &saveptr); tok && size < MAX_PERF_LOCK_OPTS;
+         tok = strtok_r(NULL, ",", &saveptr))
+        opts[size++] = (int)strtoul(tok, NULL, 0);
+    return size;
+}
+
+/*
+ * Perf lock resources as "opcode,value,..." in vendor.audio.perf_lock.opts,
+ * the default boosts both CPU clusters.
+ */
+void AudioDevice::InitPerfLockOpts() {
+    char value[PROPERTY_VALUE_MAX];
+
+    property_get("vendor.audio.perf_lock.opts", value, DEFAULT_PERF_LOCK_OPTS);
+    perf_lock_opts_size = parse_perf_lock_opts(value, perf_lock_opts);
+    /* opts come in opcode/value pairs */
+    if (!perf_lock_opts_size || perf_lock_opts_size % 2) {
+        AHAL_ERR("bad vendor.audio.perf_lock.opts, using defaults");
+        strlcpy(value, DEFAULT_PERF_LOCK_OPTS, sizeof(value));
+        perf_lock_opts_size = parse_perf_lock_opts(value, perf_lock_opts);
+    }
+}
+
+void AudioDevice::InitBatteryListener() {
+    uint64_t start_ns = param_time_ns();
+
+    AudioExtn::battery_listener_feature_init(
+            property_get_bool("vendor.audio.feature.battery_listener.enable", false));
+    AudioExtn::battery_properties_listener_init(adev_on_battery_status_changed);
+    SetChargingMode(AudioExtn::battery_properties_is_charging());
+    RecordInitStage("battery_listener", start_ns, true);
+}
+
+void AudioDevice::InitMicCharacteristics() {
+    uint64_t start_ns = param_time_ns();
+
+    memset(&microphones, 0, sizeof(microphone_characteristics_t));
+    memset(&microphone_maps, 0, sizeof(PAL_MAX_INPUT_DEVICES*sizeof(snd_device_to_mic_map_t)));
+    if (!parse_xml())
+        mic_characteristics_available = true;
+    RecordInitStage("mic_xml", start_ns, true);
+}
+
+/* the microphone XML is only needed by get_microphones, wait for it there */
+void AudioDevice::WaitMicCharacteristics() {
+    std::lock_guard<std::mutex> lock(mic_xml_mutex_);
+
+    if (mic_xml_thread_.joinable())
+        mic_xml_thread_.join();
+}
+
+/*
+ * Init only blocks on what the first stream open needs: the HIDL services,
+ * PAL, the device map and the feature inits that touch PAL. The battery
+ * listener runs on a helper thread alongside that and is joined before
+ * Init returns, the microphone XML is left parsing until get_microphones
+ * asks for it. Effect libraries are loaded by the first offload stream
+ * unless vendor.audio.effect_libs.lazy is false. Each step is timed for
+ * adev_dump.
+ */
 int AudioDevice::Init(hw_device_t **device, const hw_module_t *module) {
     int ret = 0;
-    bool is_charging = false;
+    uint64_t start_ns = 0;
+    std::thread effects_thread;
+    std::thread battery_thread;
+    bool parallel = property_get_bool("vendor.audio.init.parallel", true);
+    bool lazy_effect_libs = property_get_bool("vendor.audio.effect_libs.lazy", true);
+
+    init_start_ns_ = param_time_ns();
+    ahal_log_lvl = (uint32_t)property_get_int32("vendor.audio.hal.log_lvl",
+                                                AHAL_LOG_DEFAULT) | AHAL_LOG_ERR;
+    AudioTrace::Init();
+    CallRecorder::Init();
+    RegisterParamHandlers();
 
     /*
      * register HIDL services for PAL & AGM
      * pal_init() depends on AGM, so need to initialize
      * hidl interface before calling to pal_init()
      */
+    start_ns = param_time_ns();
     ret = AudioExtn::audio_extn_hidl_init();
     if (ret) {
         AHAL_ERR("audio_extn_hidl_init failed ret=(%d)", ret);
         return ret;
     }
+    RecordInitStage("hidl_init", start_ns, false);
 
+    start_ns = param_time_ns();
     ret = pal_init();
     if (ret) {
         AHAL_ERR("pal_init failed ret=(%d)", ret);
         return -EINVAL;
     }
+    RecordInitStage("pal_init", start_ns, false);
 
     ret = pal_register_global_callback(&adev_pal_global_callback, (uint64_t)this);
     if (ret) {
@@ -1151,73 +1475,80 @@ int AudioDevice::Init(hw_device_t **device, const hw_module_t *module) {
     adev_->device_.get()->common.module = (struct hw_module_t *)module;
     *device = &(adev_->device_.get()->common);
 
-    // visualizer lib
-    if (access(VISUALIZER_LIBRARY_PATH, R_OK) == 0) {
-        visualizer_lib_ = dlopen(VISUALIZER_LIBRARY_PATH, RTLD_NOW);
-        if (visualizer_lib_ == NULL) {
-            AHAL_ERR("DLOPEN failed for %s", VISUALIZER_LIBRARY_PATH);
-        } else {
-            AHAL_VERBOSE("DLOPEN successful for %s", VISUALIZER_LIBRARY_PATH);
-            fnp_visualizer_start_output_ =
-                        (int (*)(audio_io_handle_t, pal_stream_handle_t*))dlsym(visualizer_lib_,
-                                                        "visualizer_hal_start_output");
-            fnp_visualizer_stop_output_ =
-                        (int (*)(audio_io_handle_t, pal_stream_handle_t*))dlsym(visualizer_lib_,
-                                                        "visualizer_hal_stop_output");
-        }
-    }
-
-    // offload effect lib
-    if (access(OFFLOAD_EFFECTS_BUNDLE_LIBRARY_PATH, R_OK) == 0) {
-        offload_effects_lib_ = dlopen(OFFLOAD_EFFECTS_BUNDLE_LIBRARY_PATH,
-                                      RTLD_NOW);
-        if (offload_effects_lib_ == NULL) {
-            AHAL_ERR("DLOPEN failed for %s",
-                  OFFLOAD_EFFECTS_BUNDLE_LIBRARY_PATH);
-        } else {
-            AHAL_VERBOSE("DLOPEN successful for %s",
-                  OFFLOAD_EFFECTS_BUNDLE_LIBRARY_PATH);
-            fnp_offload_effect_start_output_ =
-                (int (*)(audio_io_handle_t, pal_stream_handle_t*))dlsym(
-                                    offload_effects_lib_,
-                                    "offload_effects_bundle_hal_start_output");
-            fnp_offload_effect_stop_output_ =
-                (int (*)(audio_io_handle_t, pal_stream_handle_t*))dlsym(
-                                    offload_effects_lib_,
-                                    "offload_effects_bundle_hal_stop_output");
+    if (parallel) {
+        if (!lazy_effect_libs) {
+            try {
+                effects_thread = std::thread([this] {
+                    ThreadPolicy::Apply(AHAL_THREAD_WORKER);
+                    EnsureEffectLibs();
+                });
+            } catch (const std::exception& e) {
+                AHAL_WARN("failed to start effect lib thread, load inline");
+            }
         }
-    }
+        try {
+            battery_thread = std::thread([this] {
+                ThreadPolicy::Apply(AHAL_THREAD_WORKER);
+                InitBatteryListener();
+            });
+        } catch (const std::exception& e) {
+            AHAL_WARN("failed to start battery listener thread, init inline");
+        }
+        try {
+            std::lock_guard<std::mutex> lock(mic_xml_mutex_);
+
+            mic_xml_thread_ = std::thread([this] {
+                ThreadPolicy::Apply(AHAL_THREAD_WORKER);
+                InitMicCharacteristics();
+            });
+        } catch (const std::exception& e) {
+            AHAL_WARN("failed to start mic xml thread, parse inline");
+        }
+    }
+    if (!lazy_effect_libs && !effects_thread.joinable())
+        EnsureEffectLibs();
+    if (!battery_thread.joinable())
+        InitBatteryListener();
+    if (!mic_xml_thread_.joinable())
+        InitMicCharacteristics();
+
+    start_ns = param_time_ns();
     audio_extn_sound_trigger_init(adev_);
+    RecordInitStage("sound_trigger", start_ns, false);
+
+    start_ns = param_time_ns();
     AudioExtn::hfp_feature_init(property_get_bool("vendor.audio.feature.hfp.enable", false));
     AudioExtn::a2dp_source_feature_init(property_get_bool("vendor.audio.feature.a2dp_offload.enable", false));
-
     AudioExtn::audio_extn_fm_init();
     AudioExtn::audio_extn_kpi_optimize_feature_init(
-            property_get_bool("vendor.audio.feature.kpi_optimize.enable", false));
-    AudioExtn::battery_listener_feature_init(
-            property_get_bool("vendor.audio.feature.battery_listener.enable", false));
-    AudioExtn::battery_properties_listener_init(adev_on_battery_status_changed);
-    is_charging = AudioExtn::battery_properties_is_charging();
-    SetChargingMode(is_charging);
+            property_get_bool("vendor.audio.feature.kpi_optimize.enable",
+                              KPI_OPTIMIZE_DEFAULT_ENABLED));
+    RecordInitStage("feature_init", start_ns, false);
+
+    start_ns = param_time_ns();
     AudioExtn::audio_extn_perf_lock_init();
-    adev_->perf_lock_opts[0] = 0x40400000;
-    adev_->perf_lock_opts[1] = 0x1;
-    adev_->perf_lock_opts[2] = 0x40C00000;
-    adev_->perf_lock_opts[3] = 0x1;
-    adev_->perf_lock_opts_size = 4;
+    adev_->InitPerfLockOpts();
+    RecordInitStage("perf_lock", start_ns, false);
 
+    start_ns = param_time_ns();
     voice_ = VoiceInit();
     mute_ = false;
     current_rotation = PAL_SPEAKER_ROTATION_LR;
 
     FillAndroidDeviceMap();
+    RecordInitStage("voice_device_map", start_ns, false);
+
+    start_ns = param_time_ns();
     audio_extn_gef_init(adev_);
+    RecordInitStage("gef_init", start_ns, false);
     adev_init_ref_count += 1;
 
-    memset(&microphones, 0, sizeof(microphone_characteristics_t));
-    memset(&microphone_maps, 0, sizeof(PAL_MAX_INPUT_DEVICES*sizeof(snd_device_to_mic_map_t)));
-    if (!parse_xml())
-        mic_characteristics_available = true;
+    /* nothing may touch the effect libs or battery state before these land */
+    if (effects_thread.joinable())
+        effects_thread.join();
+    if (battery_thread.joinable())
+        battery_thread.join();
+    RecordInitStage("total", init_start_ns_, false);
 
     return ret;
 }
@@ -1275,6 +1606,20 @@ std::vector<std::shared_ptr<StreamOutPrimary>> AudioDevice::OutGetBLEStreamOutpu
    return astream_out_list;
 }
 
+/* every open stream, outputs first, for work that has to visit them all */
+std::vector<std::shared_ptr<StreamPrimary>> AudioDevice::GetAllStreams() {
+    std::vector<std::shared_ptr<StreamPrimary>> streams;
+
+    out_list_mutex.lock();
+    streams.assign(stream_out_list_.begin(), stream_out_list_.end());
+    out_list_mutex.unlock();
+
+    in_list_mutex.lock();
+    streams.insert(streams.end(), stream_in_list_.begin(), stream_in_list_.end());
+    in_list_mutex.unlock();
+    return streams;
+}
+
 std::shared_ptr<StreamOutPrimary> AudioDevice::OutGetStream(audio_stream_t* stream_out) {
 
     std::shared_ptr<StreamOutPrimary> astream_out = NULL;
@@ -1416,78 +1761,219 @@ int AudioDevice::add_input_headset_if_usb_out_headset(int *device_count,
     return 0;
 }
 
-int AudioDevice::SetParameters(const char *kvpairs) {
-    int ret = 0, val = 0;
-    struct str_parms *parms = NULL;
+/*
+ * SetParameters/GetParameters dispatch. Each handler owns one key, or a
+ * group of keys that have to be handled together, and only runs when one of
+ * its keys is present in the kvpairs. When several keys come in one call the
+ * handlers run in the order of the enums below, which is the order the keys
+ * were checked in before the table existed.
+ */
+enum {
+    SET_PARAM_HAC,
+    SET_PARAM_SCREEN_STATE,
+    SET_PARAM_UHQA,
+    SET_PARAM_DEVICE_CONNECT,
+    SET_PARAM_ROTATION,
+    SET_PARAM_SPKR_FTM,
+    SET_PARAM_SPKR_V_VALIDATION,
+    SET_PARAM_SPKR_CAL,
+    SET_PARAM_DEVICE_DISCONNECT,
+    SET_PARAM_A2DP_RECONFIG,
+    SET_PARAM_A2DP_SUSPENDED,
+    SET_PARAM_TWS_CHANNEL_CONFIG,
+    SET_PARAM_LEA_MONO,
+    SET_PARAM_BT_SCO,
+    SET_PARAM_BT_SCO_WB,
+    SET_PARAM_BT_SWB,
+    SET_PARAM_BT_BLE,
+    SET_PARAM_BT_NREC,
+    SET_PARAM_LC3_CFG,
+    SET_PARAM_LC3_COMMIT,
+    SET_PARAM_WFD_CHANNEL_CAP,
+    SET_PARAM_HAPTICS_VOLUME,
+    SET_PARAM_HAPTICS_INTENSITY,
+    SET_PARAM_A2DP_CAPTURE_SUSPEND,
+    SET_PARAM_LOG_LEVEL,
+    SET_PARAM_LATENCY_PROBE,
+    SET_PARAM_MAX
+};
+
+enum {
+    GET_PARAM_A2DP_RECONFIG_SUPPORTED,
+    GET_PARAM_A2DP_SUSPENDED,
+    GET_PARAM_SPKR_FTM,
+    GET_PARAM_SPKR_CAL,
+    GET_PARAM_LATENCY_PROBE,
+    GET_PARAM_MAX
+};
+
+const AudioDevice::set_param_handler_t AudioDevice::set_param_handlers_[] = {
+    {"HACSetting",          &AudioDevice::SetHacParam},
+    {"screen_state",        &AudioDevice::SetScreenStateParam},
+    {"UHQA",                &AudioDevice::SetUhqaParam},
+    {"connect",             &AudioDevice::SetDeviceConnectParam},
+    {"rotation",            &AudioDevice::SetRotationParam},
+    {"fbsp_cfg",            &AudioDevice::SetSpkrFtmParam},
+    {"fbsp_v_vali",         &AudioDevice::SetSpkrVValidationParam},
+    {"trigger_spkr_cal",    &AudioDevice::SetSpkrCalParam},
+    {"disconnect",          &AudioDevice::SetDeviceDisconnectParam},
+    {"reconfigA2dp",        &AudioDevice::SetA2dpReconfigParam},
+    {"A2dpSuspended",       &AudioDevice::SetA2dpSuspendedParam},
+    {"TwsChannelConfig",    &AudioDevice::SetTwsChannelConfigParam},
+    {"LEAMono",             &AudioDevice::SetLeaMonoParam},
+    {"BT_SCO",              &AudioDevice::SetBtScoParam},
+    {"bt_wbs",              &AudioDevice::SetBtScoWbParam},
+    {"bt_swb",              &AudioDevice::SetBtSwbParam},
+    {"bt_ble",              &AudioDevice::SetBtBleParam},
+    {"bt_headset_nrec",     &AudioDevice::SetBtNrecParam},
+    {"lc3_cfg",             &AudioDevice::SetLc3CfgParam},
+    {"lc3_commit",          &AudioDevice::SetLc3CommitParam},
+    {"wfd_channel_cap",     &AudioDevice::SetWfdChannelCapParam},
+    {"haptics_volume",      &AudioDevice::SetHapticsVolumeParam},
+    {"haptics_intensity",   &AudioDevice::SetHapticsIntensityParam},
+    {"A2dpCaptureSuspend",  &AudioDevice::SetA2dpCaptureSuspendParam},
+    {"ahal_log_lvl",        &AudioDevice::SetLogLevelParam},
+    {"latency_probe",       &AudioDevice::SetLatencyProbeParam},
+};
+
+const AudioDevice::get_param_handler_t AudioDevice::get_param_handlers_[] = {
+    {"isReconfigA2dpSupported", &AudioDevice::GetA2dpReconfigSupportedParam},
+    {"A2dpSuspended",           &AudioDevice::GetA2dpSuspendedParam},
+    {"get_ftm_param",           &AudioDevice::GetSpkrFtmParam},
+    {"get_spkr_cal",            &AudioDevice::GetSpkrCalParam},
+    {"latency_probe",           &AudioDevice::GetLatencyProbeParam},
+};
+
+static const param_key_t set_param_keys[] = {
+    {AUDIO_PARAMETER_KEY_HAC,           SET_PARAM_HAC},
+    {"screen_state",                    SET_PARAM_SCREEN_STATE},
+    {"UHQA",                            SET_PARAM_UHQA},
+    {AUDIO_PARAMETER_DEVICE_CONNECT,    SET_PARAM_DEVICE_CONNECT},
+    {"rotation",                        SET_PARAM_ROTATION},
+    {"fbsp_cfg_wait_time",              SET_PARAM_SPKR_FTM},
+    {"fbsp_v_vali_wait_time",           SET_PARAM_SPKR_V_VALIDATION},
+    {"trigger_spkr_cal",                SET_PARAM_SPKR_CAL},
+    {AUDIO_PARAMETER_DEVICE_DISCONNECT, SET_PARAM_DEVICE_DISCONNECT},
+    {AUDIO_PARAMETER_RECONFIG_A2DP,     SET_PARAM_A2DP_RECONFIG},
+    {"A2dpSuspended",                   SET_PARAM_A2DP_SUSPENDED},
+    {"TwsChannelConfig",                SET_PARAM_TWS_CHANNEL_CONFIG},
+    {"LEAMono",                         SET_PARAM_LEA_MONO},
+    {"BT_SCO",                          SET_PARAM_BT_SCO},
+    {AUDIO_PARAMETER_KEY_BT_SCO_WB,     SET_PARAM_BT_SCO_WB},
+    {"bt_swb",                          SET_PARAM_BT_SWB},
+    {"bt_ble",                          SET_PARAM_BT_BLE},
+    /* LC3 config is sent once both bt_ble and all LC3 fields are in */
+    {"bt_ble",                          SET_PARAM_LC3_COMMIT},
+    {AUDIO_PARAMETER_KEY_BT_NREC,       SET_PARAM_BT_NREC},
+    {"wfd_channel_cap",                 SET_PARAM_WFD_CHANNEL_CAP},
+    {"haptics_volume",                  SET_PARAM_HAPTICS_VOLUME},
+    {"haptics_intensity",               SET_PARAM_HAPTICS_INTENSITY},
+    {"A2dpCaptureSuspend",              SET_PARAM_A2DP_CAPTURE_SUSPEND},
+    {"ahal_log_lvl",                    SET_PARAM_LOG_LEVEL},
+    {"latency_probe",                   SET_PARAM_LATENCY_PROBE},
+};
+
+static const param_key_t get_param_keys[] = {
+    {AUDIO_PARAMETER_A2DP_RECONFIG_SUPPORTED, GET_PARAM_A2DP_RECONFIG_SUPPORTED},
+    {"A2dpSuspended",                         GET_PARAM_A2DP_SUSPENDED},
+    {"get_ftm_param",                         GET_PARAM_SPKR_FTM},
+    {"get_spkr_cal",                          GET_PARAM_SPKR_CAL},
+    {"latency_probe",                         GET_PARAM_LATENCY_PROBE},
+};
+
+static void param_stats_update(param_stats_t *stats, uint64_t ns)
+{
+    uint64_t max = stats->max_ns.load(std::memory_order_relaxed);
+
+    stats->calls.fetch_add(1, std::memory_order_relaxed);
+    stats->total_ns.fetch_add(ns, std::memory_order_relaxed);
+    while (ns > max &&
+           !stats->max_ns.compare_exchange_weak(max, ns, std::memory_order_relaxed))
+        ;
+}
+
+void AudioDevice::RegisterParamHandlers() {
+    static_assert(ARRAY_SIZE(set_param_handlers_) == SET_PARAM_MAX,
+                  "set_param_handlers_ out of sync");
+    static_assert(ARRAY_SIZE(get_param_handlers_) == GET_PARAM_MAX,
+                  "get_param_handlers_ out of sync");
+    static_assert(SET_PARAM_MAX <= 64 && GET_PARAM_MAX <= 64, "handler mask is 64 bit");
+
+    set_param_keys_.assign(set_param_keys, set_param_keys + ARRAY_SIZE(set_param_keys));
+    for (auto& key : lc3_reserved_params) {
+        set_param_keys_.push_back({key, SET_PARAM_LC3_CFG});
+        set_param_keys_.push_back({key, SET_PARAM_LC3_COMMIT});
+    }
+    SortParamKeys(set_param_keys_);
+
+    get_param_keys_.assign(get_param_keys, get_param_keys + ARRAY_SIZE(get_param_keys));
+    SortParamKeys(get_param_keys_);
+
+    set_param_stats_.reset(new param_stats_t[SET_PARAM_MAX]());
+    get_param_stats_.reset(new param_stats_t[GET_PARAM_MAX]());
+    AHAL_DBG("%zu set and %zu get parameter keys registered",
+             set_param_keys_.size(), get_param_keys_.size());
+}
+
+void AudioDevice::DumpParamStats(int fd) {
+    uint64_t calls;
+
+    if (!set_param_stats_ || !get_param_stats_)
+        return;
+
+    dprintf(fd, "SetParameters handlers: calls avg(us) max(us)\n");
+    for (int i = 0; i < SET_PARAM_MAX; i++) {
+        calls = set_param_stats_[i].calls.load(std::memory_order_relaxed);
+        if (!calls)
+            continue;
+        dprintf(fd, "  %-20s %8" PRIu64 " %8" PRIu64 " %8" PRIu64 "\n",
+                set_param_handlers_[i].name, calls,
+                set_param_stats_[i].total_ns.load(std::memory_order_relaxed) / calls / 1000,
+                set_param_stats_[i].max_ns.load(std::memory_order_relaxed) / 1000);
+    }
+
+    dprintf(fd, "GetParameters handlers: calls avg(us) max(us)\n");
+    for (int i = 0; i < GET_PARAM_MAX; i++) {
+        calls = get_param_stats_[i].calls.load(std::memory_order_relaxed);
+        if (!calls)
+            continue;
+        dprintf(fd, "  %-20s %8" PRIu64 " %8" PRIu64 " %8" PRIu64 "\n",
+                get_param_handlers_[i].name, calls,
+                get_param_stats_[i].total_ns.load(std::memory_order_relaxed) / calls / 1000,
+                get_param_stats_[i].max_ns.load(std::memory_order_relaxed) / 1000);
+    }
+}
+
+int AudioDevice::SetHacParam(struct str_parms *parms) {
+    int ret = 0;
     char value[256];
-    int pal_device_count = 0;
-    pal_device_id_t* pal_device_ids = NULL;
-    char *test_r = NULL;
-    char *cfg_str = NULL;
-    bool changes_done = false;
-    audio_stream_in* stream_in = NULL;
     audio_stream_out* stream_out = NULL;
-    std::shared_ptr<StreamInPrimary> astream_in = NULL;
     std::shared_ptr<StreamOutPrimary> astream_out = NULL;
-    uint8_t channels = 0;
     std::set<audio_devices_t> new_devices;
 
-    AHAL_DBG("enter: %s", kvpairs);
-    ret = voice_->VoiceSetParameters(kvpairs);
-    if (ret)
-        AHAL_ERR("Error in VoiceSetParameters %d", ret);
-
-    parms = str_parms_create_str(kvpairs);
-    if (!parms) {
-        AHAL_ERR("Error in str_parms_create_str");
-        ret = 0;
-        return ret;
+    ret = str_parms_get_str(parms, AUDIO_PARAMETER_KEY_HAC, value, sizeof(value));
+    if (ret >= 0) {
+        adev_->hac_voip = false;
+        if (strcmp(value, AUDIO_PARAMETER_VALUE_HAC_ON) == 0) {
+            adev_->hac_voip = true;
+            for (int i = 0; i < stream_out_list_.size(); i++) {
+                stream_out_list_[i]->GetStreamHandle(&stream_out);
+                astream_out = adev_->OutGetStream((audio_stream_t*)stream_out);
+                if (astream_out->GetUseCase() == USECASE_AUDIO_PLAYBACK_VOIP) {
+                    new_devices = astream_out->mAndroidOutDevices;
+                    astream_out->RouteStream(new_devices, true);
+                    break;
+                }
+            }
+        }
     }
-    AudioExtn::audio_extn_set_parameters(adev_, parms);
 
-    if ( (property_get_bool("vendor.audio.hdr.record.enable", false)) ||
-         (property_get_bool("vendor.audio.hdr.spf.record.enable", false))) {
-        changes_done = hdr_set_parameters(adev_, parms);
-        if (changes_done) {
-            for (int i = 0; i < stream_in_list_.size(); i++) {
-                stream_in_list_[i]->GetStreamHandle(&stream_in);
-                astream_in = adev_->InGetStream((audio_stream_t*)stream_in);
-                if ( (astream_in->source_ == AUDIO_SOURCE_UNPROCESSED) &&
-                   (astream_in->config_.sample_rate == 48000) ) {
-                    AHAL_DBG("Forcing PAL device switch for HDR");
-                    channels =
-                        audio_channel_count_from_in_mask(astream_in->config_.channel_mask);
-                    if (channels == 4) {
-                        if (adev_->hdr_record_enabled) {
-                            new_devices = astream_in->mAndroidInDevices;
-                            astream_in->RouteStream(new_devices, true);
-                        }
-                    }
-                    break;
-                } else if (property_get_bool("vendor.audio.hdr.spf.record.enable", false)) {
-                    new_devices = astream_in->mAndroidInDevices;
-                    astream_in->RouteStream(new_devices, true);
-                }
-            }
-        }
-    }
+    return 0;
+}
 
-    ret = str_parms_get_str(parms, AUDIO_PARAMETER_KEY_HAC, value, sizeof(value));
-    if (ret >= 0) {
-        adev_->hac_voip = false;
-        if (strcmp(value, AUDIO_PARAMETER_VALUE_HAC_ON) == 0) {
-            adev_->hac_voip = true;
-            for (int i = 0; i < stream_out_list_.size(); i++) {
-                stream_out_list_[i]->GetStreamHandle(&stream_out);
-                astream_out = adev_->OutGetStream((audio_stream_t*)stream_out);
-                if (astream_out->GetUseCase() == USECASE_AUDIO_PLAYBACK_VOIP) {
-                    new_devices = astream_out->mAndroidOutDevices;
-                    astream_out->RouteStream(new_devices, true);
-                    break;
-                }
-            }
-        }
-    }
+int AudioDevice::SetScreenStateParam(struct str_parms *parms) {
+    int ret = 0;
+    char value[256];
 
     ret = str_parms_get_str(parms, "screen_state", value, sizeof(value));
     if (ret >= 0) {
@@ -1503,6 +1989,13 @@ int AudioDevice::SetParameters(const char *kvpairs) {
         }
     }
 
+    return 0;
+}
+
+int AudioDevice::SetUhqaParam(struct str_parms *parms) {
+    int ret = 0;
+    char value[256];
+
     ret = str_parms_get_str(parms, "UHQA", value, sizeof(value));
     if (ret >= 0) {
         pal_param_uhqa_t param_uhqa_flag;
@@ -1519,6 +2012,16 @@ int AudioDevice::SetParameters(const char *kvpairs) {
         }
     }
 
+    return 0;
+}
+
+int AudioDevice::SetDeviceConnectParam(struct str_parms *parms) {
+    int ret = 0;
+    int val = 0;
+    char value[256];
+    int pal_device_count = 0;
+    pal_device_id_t* pal_device_ids = NULL;
+
     ret = str_parms_get_str(parms, AUDIO_PARAMETER_DEVICE_CONNECT,
                             value, sizeof(value));
     if (ret >= 0) {
@@ -1534,8 +2037,7 @@ int AudioDevice::SetParameters(const char *kvpairs) {
                     (audio_is_usb_in_device(device)) && (usb_input_dev_enabled == true)) {
                     AHAL_INFO("plugin card :%d device num=%d already added", usb_card_id_,
                           param_device_connection.device_config.usb_addr.device_num);
-                    ret = 0;
-                    goto exit;
+                    return -EALREADY;
                 }
 
                 usb_card_id_ = param_device_connection.device_config.usb_addr.card_id;
@@ -1567,7 +2069,7 @@ int AudioDevice::SetParameters(const char *kvpairs) {
                 if (pal_device_ids)
                     free(pal_device_ids);
                 AHAL_ERR("adding input headset failed, error:%d", ret);
-                goto exit;
+                return ret;
             }
             for (int i = 0; i < pal_device_count; i++) {
                 param_device_connection.connection_state = true;
@@ -1581,30 +2083,17 @@ int AudioDevice::SetParameters(const char *kvpairs) {
                 }
             }
             AHAL_INFO("pal set param success  for device connection");
+            /* policy moves streams onto the new device next */
+            route_batch_.Open();
             /* check if capture profile is supported or not */
            if (audio_is_usb_out_device(device) || audio_is_usb_in_device(device)) {
-                pal_param_device_capability_t *device_cap_query = (pal_param_device_capability_t *)
-                                                          malloc(sizeof(pal_param_device_capability_t));
-                if (device_cap_query) {
-                    dynamic_media_config_t dynamic_media_config;
-                    size_t payload_size = 0;
-                    device_cap_query->id = PAL_DEVICE_IN_USB_HEADSET;
-                    device_cap_query->addr.card_id = usb_card_id_;
-                    device_cap_query->addr.device_num = usb_dev_num_;
-                    device_cap_query->config = &dynamic_media_config;
-                    device_cap_query->is_playback = false;
-                    ret = pal_get_param(PAL_PARAM_ID_DEVICE_CAPABILITY,
-                            (void **)&device_cap_query,
-                            &payload_size, nullptr);
-                    if ((dynamic_media_config.sample_rate[0] == 0 && dynamic_media_config.format[0] == 0 &&
-                            dynamic_media_config.mask[0] == 0) || (dynamic_media_config.jack_status == false))
-                        usb_input_dev_enabled = false;
-                    else
-                        usb_input_dev_enabled = true;
-                    free(device_cap_query);
-                } else {
-                    AHAL_ERR("Failed to allocate mem for device_cap_query");
-                }
+                usb_dev_cap_t usb_cap;
+
+                /* refresh the cache so opens and reroutes don't query PAL again */
+                InvalidateUsbCapability(usb_card_id_, usb_dev_num_);
+                GetUsbCapability(usb_card_id_, usb_dev_num_, true, &usb_cap);
+                ret = GetUsbCapability(usb_card_id_, usb_dev_num_, false, &usb_cap);
+                usb_input_dev_enabled = !ret && usb_cap.available;
             }
 
             if (pal_device_ids) {
@@ -1614,7 +2103,14 @@ int AudioDevice::SetParameters(const char *kvpairs) {
         }
     }
 
-    /* Checking for Device rotation */
+    return 0;
+}
+
+/* Checking for Device rotation */
+int AudioDevice::SetRotationParam(struct str_parms *parms) {
+    int ret = 0;
+    int val = 0;
+
     ret = str_parms_get_int(parms, "rotation", &val);
     if (ret >= 0) {
         int isRotationReq = 0;
@@ -1659,7 +2155,16 @@ int AudioDevice::SetParameters(const char *kvpairs) {
         }
     }
 
-    /* Speaker Protection: Factory Test Mode */
+    return 0;
+}
+
+/* Speaker Protection: Factory Test Mode */
+int AudioDevice::SetSpkrFtmParam(struct str_parms *parms) {
+    int ret = 0;
+    char value[256];
+    char *cfg_str = NULL;
+    char *test_r = NULL;
+
     ret = str_parms_get_str(parms, "fbsp_cfg_wait_time", value, sizeof(value));
     if (ret >= 0) {
         str_parms_del(parms, "fbsp_cfg_wait_time");
@@ -1688,7 +2193,16 @@ int AudioDevice::SetParameters(const char *kvpairs) {
         }
     }
 
-    /* Speaker Protection: V-validation mode */
+    return 0;
+}
+
+/* Speaker Protection: V-validation mode */
+int AudioDevice::SetSpkrVValidationParam(struct str_parms *parms) {
+    int ret = 0;
+    char value[256];
+    char *cfg_str = NULL;
+    char *test_r = NULL;
+
     ret = str_parms_get_str(parms, "fbsp_v_vali_wait_time", value, sizeof(value));
     if (ret >= 0) {
         str_parms_del(parms, "fbsp_v_vali_wait_time");
@@ -1717,7 +2231,14 @@ int AudioDevice::SetParameters(const char *kvpairs) {
         }
     }
 
-    /* Speaker Protection: Dynamic calibration mode */
+    return 0;
+}
+
+/* Speaker Protection: Dynamic calibration mode */
+int AudioDevice::SetSpkrCalParam(struct str_parms *parms) {
+    int ret = 0;
+    char value[256];
+
     ret = str_parms_get_str(parms, "trigger_spkr_cal", value, sizeof(value));
     if (ret >= 0) {
         if ((strcmp(value, "true") == 0) || (strcmp(value, "yes") == 0)) {
@@ -1728,6 +2249,16 @@ int AudioDevice::SetParameters(const char *kvpairs) {
         }
     }
 
+    return 0;
+}
+
+int AudioDevice::SetDeviceDisconnectParam(struct str_parms *parms) {
+    int ret = 0;
+    int val = 0;
+    char value[256];
+    int pal_device_count = 0;
+    pal_device_id_t* pal_device_ids = NULL;
+
     ret = str_parms_get_str(parms, AUDIO_PARAMETER_DEVICE_DISCONNECT,
                             value, sizeof(value));
     if (ret >= 0) {
@@ -1741,6 +2272,8 @@ int AudioDevice::SetParameters(const char *kvpairs) {
             ret = str_parms_get_str(parms, "device", value, sizeof(value));
             if (ret >= 0)
                 param_device_connection.device_config.usb_addr.device_num = atoi(value);
+            InvalidateUsbCapability(param_device_connection.device_config.usb_addr.card_id,
+                                    param_device_connection.device_config.usb_addr.device_num);
             if ((usb_card_id_ == param_device_connection.device_config.usb_addr.card_id) &&
                 (audio_is_usb_in_device(device)) && (usb_input_dev_enabled == true)) {
                    usb_input_dev_enabled = false;
@@ -1764,7 +2297,7 @@ int AudioDevice::SetParameters(const char *kvpairs) {
                 if (pal_device_ids)
                     free(pal_device_ids);
                 AHAL_ERR("adding input headset failed, error:%d", ret);
-                goto exit;
+                return ret;
             }
             for (int i = 0; i < pal_device_count; i++) {
                 param_device_connection.connection_state = false;
@@ -1777,6 +2310,7 @@ int AudioDevice::SetParameters(const char *kvpairs) {
                 }
                 AHAL_INFO("pal set param sucess for device disconnect");
             }
+            route_batch_.Open();
         }
     }
 
@@ -1785,7 +2319,14 @@ int AudioDevice::SetParameters(const char *kvpairs) {
         pal_device_ids = NULL;
     }
 
-    /* A2DP parameters */
+    return 0;
+}
+
+/* A2DP parameters */
+int AudioDevice::SetA2dpReconfigParam(struct str_parms *parms) {
+    int ret = 0;
+    char value[256];
+
     ret = str_parms_get_str(parms, AUDIO_PARAMETER_RECONFIG_A2DP, value, sizeof(value));
     if (ret >= 0) {
         pal_param_bta2dp_t param_bt_a2dp;
@@ -1796,6 +2337,13 @@ int AudioDevice::SetParameters(const char *kvpairs) {
                             sizeof(pal_param_bta2dp_t));
     }
 
+    return 0;
+}
+
+int AudioDevice::SetA2dpSuspendedParam(struct str_parms *parms) {
+    int ret = 0;
+    char value[256];
+
     ret = str_parms_get_str(parms, "A2dpSuspended" , value, sizeof(value));
     if (ret >= 0) {
         pal_param_bta2dp_t param_bt_a2dp;
@@ -1812,6 +2360,13 @@ int AudioDevice::SetParameters(const char *kvpairs) {
                             sizeof(pal_param_bta2dp_t));
     }
 
+    return 0;
+}
+
+int AudioDevice::SetTwsChannelConfigParam(struct str_parms *parms) {
+    int ret = 0;
+    char value[256];
+
     ret = str_parms_get_str(parms, "TwsChannelConfig", value, sizeof(value));
     if (ret >= 0) {
         pal_param_bta2dp_t param_bt_a2dp;
@@ -1825,6 +2380,13 @@ int AudioDevice::SetParameters(const char *kvpairs) {
                             sizeof(pal_param_bta2dp_t));
     }
 
+    return 0;
+}
+
+int AudioDevice::SetLeaMonoParam(struct str_parms *parms) {
+    int ret = 0;
+    char value[256];
+
     ret = str_parms_get_str(parms, "LEAMono", value, sizeof(value));
     if (ret >= 0) {
         pal_param_bta2dp_t param_bt_a2dp;
@@ -1838,7 +2400,14 @@ int AudioDevice::SetParameters(const char *kvpairs) {
                             sizeof(pal_param_bta2dp_t));
     }
 
-    /* SCO parameters */
+    return 0;
+}
+
+/* SCO parameters */
+int AudioDevice::SetBtScoParam(struct str_parms *parms) {
+    int ret = 0;
+    char value[256];
+
     ret = str_parms_get_str(parms, "BT_SCO", value, sizeof(value));
     if (ret >= 0) {
         pal_param_btsco_t param_bt_sco;
@@ -1854,6 +2423,13 @@ int AudioDevice::SetParameters(const char *kvpairs) {
                             sizeof(pal_param_btsco_t));
     }
 
+    return 0;
+}
+
+int AudioDevice::SetBtScoWbParam(struct str_parms *parms) {
+    int ret = 0;
+    char value[256];
+
     ret = str_parms_get_str(parms, AUDIO_PARAMETER_KEY_BT_SCO_WB, value, sizeof(value));
     if (ret >= 0) {
         pal_param_btsco_t param_bt_sco = {};
@@ -1867,6 +2443,14 @@ int AudioDevice::SetParameters(const char *kvpairs) {
                             sizeof(pal_param_btsco_t));
     }
 
+    return 0;
+}
+
+int AudioDevice::SetBtSwbParam(struct str_parms *parms) {
+    int ret = 0;
+    int val = 0;
+    char value[256];
+
     ret = str_parms_get_str(parms, "bt_swb", value, sizeof(value));
     if (ret >= 0) {
         pal_param_btsco_t param_bt_sco = {};
@@ -1877,6 +2461,13 @@ int AudioDevice::SetParameters(const char *kvpairs) {
                             sizeof(pal_param_btsco_t));
     }
 
+    return 0;
+}
+
+int AudioDevice::SetBtBleParam(struct str_parms *parms) {
+    int ret = 0;
+    char value[256];
+
     ret = str_parms_get_str(parms, "bt_ble", value, sizeof(value));
     if (ret >= 0) {
         pal_param_btsco_t param_bt_sco = {};
@@ -1903,6 +2494,13 @@ int AudioDevice::SetParameters(const char *kvpairs) {
         AHAL_INFO("BTSCO LC3 mode = %d", bt_lc3_speech_enabled);
     }
 
+    return 0;
+}
+
+int AudioDevice::SetBtNrecParam(struct str_parms *parms) {
+    int ret = 0;
+    char value[256];
+
     ret = str_parms_get_str(parms, AUDIO_PARAMETER_KEY_BT_NREC, value, sizeof(value));
     if (ret >= 0) {
         pal_param_btsco_t param_bt_sco = {};
@@ -1917,6 +2515,13 @@ int AudioDevice::SetParameters(const char *kvpairs) {
                             sizeof(pal_param_btsco_t));
     }
 
+    return 0;
+}
+
+int AudioDevice::SetLc3CfgParam(struct str_parms *parms) {
+    int ret = 0;
+    char value[256];
+
     for (auto& key : lc3_reserved_params) {
         ret = str_parms_get_str(parms, key, value, sizeof(value));
         if (ret < 0)
@@ -1948,6 +2553,12 @@ int AudioDevice::SetParameters(const char *kvpairs) {
         }
     }
 
+    return 0;
+}
+
+int AudioDevice::SetLc3CommitParam(struct str_parms *parms __unused) {
+    int ret = 0;
+
     if (((btsco_lc3_cfg.fields_map & LC3_BIT_MASK) == LC3_BIT_VALID) &&
            (bt_lc3_speech_enabled == true)) {
         pal_param_btsco_t param_bt_sco = {};
@@ -1967,6 +2578,14 @@ int AudioDevice::SetParameters(const char *kvpairs) {
         memset(&btsco_lc3_cfg, 0, sizeof(btsco_lc3_cfg_t));
     }
 
+    return 0;
+}
+
+int AudioDevice::SetWfdChannelCapParam(struct str_parms *parms) {
+    int ret = 0;
+    int val = 0;
+    char value[256];
+
     ret = str_parms_get_str(parms, "wfd_channel_cap", value, sizeof(value));
     if (ret >= 0) {
         pal_param_proxy_channel_config_t param_out_proxy;
@@ -1978,6 +2597,13 @@ int AudioDevice::SetParameters(const char *kvpairs) {
                 sizeof(pal_param_proxy_channel_config_t));
     }
 
+    return 0;
+}
+
+int AudioDevice::SetHapticsVolumeParam(struct str_parms *parms) {
+    int ret = 0;
+    char value[256];
+
     ret = str_parms_get_str(parms, "haptics_volume", value, sizeof(value));
     if (ret >= 0) {
         struct pal_volume_data* volume = NULL;
@@ -1995,6 +2621,14 @@ int AudioDevice::SetParameters(const char *kvpairs) {
         }
     }
 
+    return 0;
+}
+
+int AudioDevice::SetHapticsIntensityParam(struct str_parms *parms) {
+    int ret = 0;
+    int val = 0;
+    char value[256];
+
     ret = str_parms_get_str(parms, "haptics_intensity", value, sizeof(value));
     if (ret >=0) {
         pal_param_haptics_intensity_t hIntensity;
@@ -2005,6 +2639,13 @@ int AudioDevice::SetParameters(const char *kvpairs) {
                  sizeof(pal_param_haptics_intensity_t));
     }
 
+    return 0;
+}
+
+int AudioDevice::SetA2dpCaptureSuspendParam(struct str_parms *parms) {
+    int ret = 0;
+    char value[256];
+
     ret = str_parms_get_str(parms, "A2dpCaptureSuspend", value, sizeof(value));
     if (ret >= 0) {
         pal_param_bta2dp_t param_bt_a2dp;
@@ -2021,10 +2662,106 @@ int AudioDevice::SetParameters(const char *kvpairs) {
             sizeof(pal_param_bta2dp_t));
     }
 
+    return 0;
+}
+
+/* ahal_log_lvl=<AHAL_LOG_* mask>, for debugging without a reboot */
+int AudioDevice::SetLogLevelParam(struct str_parms *parms) {
+    int ret = 0;
+    int val = 0;
 
-exit:
-    if (parms)
-        str_parms_destroy(parms);
+    ret = str_parms_get_int(parms, "ahal_log_lvl", &val);
+    if (ret >= 0) {
+        ahal_log_lvl = (uint32_t)val | AHAL_LOG_ERR;
+        ALOGI("log level set to %#x", ahal_log_lvl);
+    }
+
+    return 0;
+}
+
+/* latency_probe=<bursts>|0|clear, see LatencyProbe.h */
+int AudioDevice::SetLatencyProbeParam(struct str_parms *parms) {
+    int ret = 0;
+    char value[32];
+
+    ret = str_parms_get_str(parms, "latency_probe", value, sizeof(value));
+    if (ret >= 0)
+        LatencyProbe::SetParam(value);
+
+    return 0;
+}
+
+int AudioDevice::SetParameters(const char *kvpairs) {
+    int ret = 0;
+    struct str_parms *parms = NULL;
+    bool changes_done = false;
+    audio_stream_in* stream_in = NULL;
+    std::shared_ptr<StreamInPrimary> astream_in = NULL;
+    uint8_t channels = 0;
+    std::set<audio_devices_t> new_devices;
+    uint64_t handlers = 0;
+    uint64_t start_ns = 0;
+
+    AHAL_DBG("enter: %s", kvpairs);
+    ret = voice_->VoiceSetParameters(kvpairs);
+    if (ret)
+        AHAL_ERR("Error in VoiceSetParameters %d", ret);
+
+    parms = str_parms_create_str(kvpairs);
+    if (!parms) {
+        AHAL_ERR("Error in str_parms_create_str");
+        ret = 0;
+        return ret;
+    }
+    AudioExtn::audio_extn_set_parameters(adev_, parms);
+
+    if ( (property_get_bool("vendor.audio.hdr.record.enable", false)) ||
+         (property_get_bool("vendor.audio.hdr.spf.record.enable", false))) {
+        changes_done = hdr_set_parameters(adev_, parms);
+        if (changes_done) {
+            RouteTransaction route;
+
+            for (int i = 0; i < stream_in_list_.size(); i++) {
+                stream_in_list_[i]->GetStreamHandle(&stream_in);
+                astream_in = adev_->InGetStream((audio_stream_t*)stream_in);
+                if ( (astream_in->source_ == AUDIO_SOURCE_UNPROCESSED) &&
+                   (astream_in->config_.sample_rate == 48000) ) {
+                    AHAL_DBG("Forcing PAL device switch for HDR");
+                    channels =
+                        audio_channel_count_from_in_mask(astream_in->config_.channel_mask);
+                    if (channels == 4) {
+                        if (adev_->hdr_record_enabled) {
+                            new_devices = astream_in->mAndroidInDevices;
+                            route.AddStream(astream_in, new_devices, true);
+                        }
+                    }
+                    break;
+                } else if (property_get_bool("vendor.audio.hdr.spf.record.enable", false)) {
+                    new_devices = astream_in->mAndroidInDevices;
+                    route.AddStream(astream_in, new_devices, true);
+                }
+            }
+            if (!route.Empty() && route.Commit())
+                AHAL_ERR("HDR device switch failed");
+        }
+    }
+
+    handlers = MatchParamKeys(set_param_keys_, kvpairs);
+    AHAL_TRACE(AHAL_EVT_SET_PARAMS, (int32_t)handlers, (int32_t)(handlers >> 32));
+    for (uint32_t id = 0; handlers; id++, handlers >>= 1) {
+        if (!(handlers & 1))
+            continue;
+
+        start_ns = param_time_ns();
+        ret = (this->*set_param_handlers_[id].fn)(parms);
+        param_stats_update(&set_param_stats_[id], param_time_ns() - start_ns);
+        if (ret) {
+            AHAL_DBG("%s returned %d, skip remaining keys", set_param_handlers_[id].name, ret);
+            break;
+        }
+    }
+
+    str_parms_destroy(parms);
 
     AHAL_DBG("exit: %s", kvpairs);
     return 0;
@@ -2035,12 +2772,105 @@ int AudioDevice::SetVoiceVolume(float volume) {
     return voice_->SetVoiceVolume(volume);
 }
 
-char* AudioDevice::GetParameters(const char *keys) {
+int AudioDevice::GetA2dpReconfigSupportedParam(struct str_parms *query,
+                                               struct str_parms *reply) {
     int32_t ret;
     int32_t val = 0;
-    char *str;
-    char value[256]={0};
     size_t size = 0;
+    pal_param_bta2dp_t *param_bt_a2dp_ptr, param_bt_a2dp;
+
+    param_bt_a2dp_ptr = &param_bt_a2dp;
+    param_bt_a2dp_ptr->dev_id = PAL_DEVICE_OUT_BLUETOOTH_A2DP;
+    ret = pal_get_param(PAL_PARAM_ID_BT_A2DP_RECONFIG_SUPPORTED,
+                        (void **)&param_bt_a2dp_ptr, &size, nullptr);
+    if (!ret) {
+        if (size < sizeof(pal_param_bta2dp_t)) {
+            AHAL_ERR("size returned is smaller for BT_A2DP_RECONFIG_SUPPORTED");
+            return -EINVAL;
+        }
+        val = param_bt_a2dp_ptr->reconfig_supported;
+        str_parms_add_int(reply, AUDIO_PARAMETER_A2DP_RECONFIG_SUPPORTED, val);
+        AHAL_VERBOSE("isReconfigA2dpSupported = %d", val);
+    }
+
+    return 0;
+}
+
+int AudioDevice::GetA2dpSuspendedParam(struct str_parms *query,
+                                       struct str_parms *reply) {
+    int32_t ret;
+    int32_t val = 0;
+    size_t size = 0;
+    pal_param_bta2dp_t *param_bt_a2dp_ptr, param_bt_a2dp;
+
+    param_bt_a2dp_ptr = &param_bt_a2dp;
+    param_bt_a2dp_ptr->dev_id = PAL_DEVICE_OUT_BLUETOOTH_A2DP;
+    ret = pal_get_param(PAL_PARAM_ID_BT_A2DP_SUSPENDED,
+                  (void **)&param_bt_a2dp_ptr, &size, nullptr);
+    if (!ret) {
+        if (size < sizeof(pal_param_bta2dp_t)) {
+            AHAL_ERR("size returned is smaller for BT_A2DP_SUSPENDED");
+            return -EINVAL;
+        }
+        val = param_bt_a2dp_ptr->a2dp_suspended;
+        str_parms_add_int(reply, "A2dpSuspended", val);
+        AHAL_VERBOSE("A2dpSuspended = %d", val);
+    }
+
+    return 0;
+}
+
+int AudioDevice::GetSpkrFtmParam(struct str_parms *query,
+                                 struct str_parms *reply) {
+    int32_t ret;
+    size_t size = 0;
+    char ftm_value[255];
+
+    ret = pal_get_param(PAL_PARAM_ID_SP_MODE, (void **)&ftm_value, &size, nullptr);
+    if (!ret) {
+        if (size > 0) {
+            str_parms_add_str(reply, "get_ftm_param", ftm_value);
+        }
+        else
+            AHAL_ERR("Error happened for getting FTM param");
+    }
+
+    return 0;
+}
+
+int AudioDevice::GetSpkrCalParam(struct str_parms *query,
+                                 struct str_parms *reply) {
+    int32_t ret;
+    size_t size = 0;
+    char cal_value[255];
+
+    ret = pal_get_param(PAL_PARAM_ID_SP_GET_CAL, (void **)&cal_value, &size, nullptr);
+    if (!ret) {
+        if (size > 0) {
+            str_parms_add_str(reply, "get_spkr_cal", cal_value);
+        }
+        else
+            AHAL_ERR("Error happened for getting Cal param");
+    }
+
+    return 0;
+}
+
+int AudioDevice::GetLatencyProbeParam(struct str_parms *query,
+                                      struct str_parms *reply) {
+    char value[256];
+
+    LatencyProbe::GetParam(value, sizeof(value));
+    str_parms_add_str(reply, "latency_probe", value);
+
+    return 0;
+}
+
+char* AudioDevice::GetParameters(const char *keys) {
+    int32_t ret;
+    char *str;
+    uint64_t handlers = 0;
+    uint64_t start_ns = 0;
     struct str_parms *reply = str_parms_create();
     struct str_parms *query = str_parms_create_str(keys);
 
@@ -2057,71 +2887,16 @@ char* AudioDevice::GetParameters(const char *keys) {
 
     AHAL_VERBOSE("enter");
 
-    ret = str_parms_get_str(query, AUDIO_PARAMETER_A2DP_RECONFIG_SUPPORTED,
-                            value, sizeof(value));
-    if (ret >= 0) {
-        pal_param_bta2dp_t *param_bt_a2dp_ptr, param_bt_a2dp;
-        param_bt_a2dp_ptr = &param_bt_a2dp;
-
-        param_bt_a2dp_ptr->dev_id = PAL_DEVICE_OUT_BLUETOOTH_A2DP;
-        ret = pal_get_param(PAL_PARAM_ID_BT_A2DP_RECONFIG_SUPPORTED,
-                            (void **)&param_bt_a2dp_ptr, &size, nullptr);
-        if (!ret) {
-            if (size < sizeof(pal_param_bta2dp_t)) {
-                AHAL_ERR("size returned is smaller for BT_A2DP_RECONFIG_SUPPORTED");
-                goto exit;
-            }
-            val = param_bt_a2dp_ptr->reconfig_supported;
-            str_parms_add_int(reply, AUDIO_PARAMETER_A2DP_RECONFIG_SUPPORTED, val);
-            AHAL_VERBOSE("isReconfigA2dpSupported = %d", val);
-        }
-    }
-
-    ret = str_parms_get_str(query, "A2dpSuspended", value, sizeof(value));
-    if (ret >= 0) {
-        pal_param_bta2dp_t *param_bt_a2dp_ptr, param_bt_a2dp;
-        param_bt_a2dp_ptr = &param_bt_a2dp;
-
-        param_bt_a2dp_ptr->dev_id = PAL_DEVICE_OUT_BLUETOOTH_A2DP;
-        ret = pal_get_param(PAL_PARAM_ID_BT_A2DP_SUSPENDED,
-                      (void **)&param_bt_a2dp_ptr, &size, nullptr);
-        if (!ret) {
-            if (size < sizeof(pal_param_bta2dp_t)) {
-                AHAL_ERR("size returned is smaller for BT_A2DP_SUSPENDED");
-                goto exit;
-            }
-            val = param_bt_a2dp_ptr->a2dp_suspended;
-            str_parms_add_int(reply, "A2dpSuspended", val);
-            AHAL_VERBOSE("A2dpSuspended = %d", val);
-        }
-    }
-
-    ret = str_parms_get_str(query, "get_ftm_param", value, sizeof(value));
-
-    if (ret >= 0) {
-        char ftm_value[255];
-        ret = pal_get_param(PAL_PARAM_ID_SP_MODE, (void **)&ftm_value, &size, nullptr);
-        if (!ret) {
-            if (size > 0) {
-                str_parms_add_str(reply, "get_ftm_param", ftm_value);
-            }
-            else
-                AHAL_ERR("Error happened for getting FTM param");
-        }
-
-    }
+    handlers = MatchParamKeys(get_param_keys_, keys);
+    for (uint32_t id = 0; handlers; id++, handlers >>= 1) {
+        if (!(handlers & 1))
+            continue;
 
-    ret = str_parms_get_str(query, "get_spkr_cal", value, sizeof(value));
-    if (ret >= 0) {
-        char cal_value[255];
-        ret = pal_get_param(PAL_PARAM_ID_SP_GET_CAL, (void **)&cal_value, &size, nullptr);
-        if (!ret) {
-            if (size > 0) {
-                str_parms_add_str(reply, "get_spkr_cal", cal_value);
-            }
-            else
-                AHAL_ERR("Error happened for getting Cal param");
-        }
+        start_ns = param_time_ns();
+        ret = (this->*get_param_handlers_[id].fn)(query, reply);
+        param_stats_update(&get_param_stats_[id], param_time_ns() - start_ns);
+        if (ret)
+            goto exit;
     }
 
     AudioExtn::audio_extn_get_parameters(adev_, query, reply);
@@ -2255,6 +3030,71 @@ error:
     return device_count;
 }
 
+int AudioDevice::QueryUsbCapability(int card_id, int device_num, bool is_playback,
+                                    usb_dev_cap_t *cap) {
+    int ret = 0;
+    size_t payload_size = 0;
+    pal_param_device_capability_t device_cap_query;
+    pal_param_device_capability_t *device_cap_query_ptr = &device_cap_query;
+
+    memset(cap, 0, sizeof(usb_dev_cap_t));
+    device_cap_query.id = is_playback ? PAL_DEVICE_OUT_USB_DEVICE : PAL_DEVICE_IN_USB_DEVICE;
+    device_cap_query.addr.card_id = card_id;
+    device_cap_query.addr.device_num = device_num;
+    device_cap_query.config = &cap->config;
+    device_cap_query.is_playback = is_playback;
+    ret = pal_get_param(PAL_PARAM_ID_DEVICE_CAPABILITY,
+                        (void **)&device_cap_query_ptr, &payload_size, nullptr);
+    if (ret < 0) {
+        AHAL_ERR("capability query failed for card %d device %d %s, ret %d",
+                 card_id, device_num, is_playback ? "playback" : "capture", ret);
+        return ret;
+    }
+
+    cap->sample_rate = cap->config.sample_rate[0];
+    cap->format = (audio_format_t)cap->config.format[0];
+    cap->channel_mask = (audio_channel_mask_t)cap->config.mask[0];
+    cap->available = cap->config.jack_status &&
+                     (cap->sample_rate || cap->format || cap->channel_mask);
+    AHAL_DBG("card %d device %d %s: fs=%d format=%#x mask=%#x available %d",
+             card_id, device_num, is_playback ? "playback" : "capture",
+             cap->sample_rate, cap->format, cap->channel_mask, cap->available);
+    return 0;
+}
+
+int AudioDevice::GetUsbCapability(int card_id, int device_num, bool is_playback,
+                                  usb_dev_cap_t *cap) {
+    int ret = 0;
+    auto key = std::make_tuple(card_id, device_num, is_playback);
+
+    if (!cap)
+        return -EINVAL;
+
+    std::lock_guard<std::mutex> lock(usb_cap_mutex_);
+    auto it = usb_cap_cache_.find(key);
+    if (it != usb_cap_cache_.end()) {
+        *cap = it->second;
+        return 0;
+    }
+
+    /*
+     * Not seen at connect, e.g. HAL restarted with the device attached. A
+     * device still enumerating reports no jack or no profile yet, keep
+     * asking PAL until it does rather than pinning that answer.
+     */
+    ret = QueryUsbCapability(card_id, device_num, is_playback, cap);
+    if (!ret && cap->available)
+        usb_cap_cache_[key] = *cap;
+    return ret;
+}
+
+void AudioDevice::InvalidateUsbCapability(int card_id, int device_num) {
+    std::lock_guard<std::mutex> lock(usb_cap_mutex_);
+
+    usb_cap_cache_.erase(std::make_tuple(card_id, device_num, true));
+    usb_cap_cache_.erase(std::make_tuple(card_id, device_num, false));
+}
+
 void AudioDevice::SetChargingMode(bool is_charging) {
     int32_t result = 0;
     pal_param_charging_state_t charge_state;
@@ -2336,8 +3176,8 @@ AudioPatch::AudioPatch(PatchType patch_type,
                        const std::vector<struct audio_port_config>& sources,
                        const std::vector<struct audio_port_config>& sinks):
                        type(patch_type), sources(sources), sinks(sinks) {
-        static std::mutex patch_lock;
-        std::lock_guard<std::mutex> lock(patch_lock);
+        static AudioMutex patch_lock("patch_lock");
+        std::lock_guard<AudioMutex> lock(patch_lock);
         handle = AudioPatch::generate_patch_handle_l();
 }
 
@@ -2378,6 +3218,7 @@ bool AudioDevice::set_microphone_characteristic(struct audio_microphone_characte
 
 int32_t AudioDevice::get_microphones(struct audio_microphone_characteristic_t *mic_array, size_t *mic_count)
 {
+    GetInstance()->WaitMicCharacteristics();
     if (!mic_characteristics_available)
         return -EIO;
 
@@ -2733,8 +3574,10 @@ int32_t AudioDevice::get_active_microphones(uint32_t channels, pal_device_id_t i
     mic_info_t *m_info;
     uint32_t count = 0;
     uint32_t idx;
-    uint32_t max_mic_count = microphones.declared_mic_count;
+    uint32_t max_mic_count = 0;
 
+    WaitMicCharacteristics();
+    max_mic_count = microphones.declared_mic_count;
     if (!mic_characteristics_available)
         return -EIO;
 
@@ -2859,7 +3702,37 @@ void AudioDevice::xml_char_data_handler(void *userdata, const XML_Char *s, int l
    }
 }
 
+#define MIC_CACHE_PAYLOAD_SIZE \
+    (sizeof(AudioDevice::microphones) + sizeof(AudioDevice::microphone_maps))
+
 int AudioDevice::parse_xml()
+{
+    mic_cache_header_t hdr;
+    std::vector<uint8_t> payload(MIC_CACHE_PAYLOAD_SIZE);
+    bool use_cache = property_get_bool("vendor.audio.mic_cache.enable", true);
+    int ret = 0;
+
+    if (use_cache && MicCacheFingerprint(MIC_CHARACTERISTICS_XML_FILE, payload.size(), &hdr))
+        use_cache = false;
+
+    if (use_cache && !MicCacheLoad(MIC_CHARACTERISTICS_CACHE_FILE, &hdr,
+                                   payload.data(), payload.size())) {
+        memcpy(&microphones, payload.data(), sizeof(microphones));
+        memcpy(microphone_maps, payload.data() + sizeof(microphones), sizeof(microphone_maps));
+        AHAL_DBG("microphone characteristics loaded from cache");
+        return 0;
+    }
+
+    ret = parse_xml_file();
+    if (!ret && use_cache) {
+        memcpy(payload.data(), &microphones, sizeof(microphones));
+        memcpy(payload.data() + sizeof(microphones), microphone_maps, sizeof(microphone_maps));
+        MicCacheStore(MIC_CHARACTERISTICS_CACHE_FILE, &hdr, payload.data(), payload.size());
+    }
+    return ret;
+}
+
+int AudioDevice::parse_xml_file()
 {
     XML_Parser parser;
     FILE *file = NULL;
@@ -36,10 +36,14 @@
 
 #include <stdlib.h>
 #include <unistd.h>
+#include <atomic>
+#include <memory>
 #include <mutex>
 #include <vector>
 #include <set>
 #include <string>
+#include <thread>
+#include <tuple>
 
 #include <cutils/properties.h>
 #include <hardware/audio.h>
@@ -49,9 +53,13 @@
 
 #include "AudioStream.h"
 #include "AudioVoice.h"
+#include "ParamKeys.h"
+#include "RouteTransaction.h"
+#include "SsrRecovery.h"
 #include "PalDefs.h"
 
 #define MAX_PERF_LOCK_OPTS 20
+#define DEFAULT_PERF_LOCK_OPTS "0x40400000,0x1,0x40C00000,0x1"
 
 /* HDR Audio use case parameters */
 #define AUDIO_PARAMETER_KEY_HDR "hdr_record_on"
@@ -112,6 +120,34 @@ typedef struct snd_device_to_mic_map_t {
     uint32_t mic_count;
 } snd_device_to_mic_map_t;
 
+typedef struct param_stats_t {
+    std::atomic<uint64_t> calls;
+    std::atomic<uint64_t> total_ns;
+    std::atomic<uint64_t> max_ns;
+} param_stats_t;
+
+struct str_parms;
+
+/*
+ * USB capabilities as reported by PAL for one card/device and direction,
+ * with the first entry of each list taken as the preferred config.
+ */
+typedef struct usb_dev_cap_t {
+    dynamic_media_config_t config;
+    uint32_t sample_rate;
+    audio_format_t format;
+    audio_channel_mask_t channel_mask;
+    bool available;   /* jack connected and at least one profile reported */
+} usb_dev_cap_t;
+
+/* one step of AudioDevice::Init, times relative to the start of Init */
+typedef struct init_stage_t {
+    const char *name;
+    uint64_t start_ns;
+    uint64_t duration_ns;
+    bool async;       /* off the Init critical path */
+} init_stage_t;
+
 class AudioPatch{
     public:
         enum PatchType{
@@ -155,6 +191,7 @@ public:
     std::shared_ptr<StreamOutPrimary> OutGetStream(audio_io_handle_t handle);
     std::vector<std::shared_ptr<StreamOutPrimary>> OutGetBLEStreamOutputs();
     std::vector<std::shared_ptr<StreamInPrimary>> InGetBLEStreamInputs();
+    std::vector<std::shared_ptr<StreamPrimary>> GetAllStreams();
     std::shared_ptr<StreamOutPrimary> OutGetStream(audio_stream_t* audio_stream);
     std::shared_ptr<StreamInPrimary> CreateStreamIn(
             audio_io_handle_t handle,
@@ -165,6 +202,7 @@ public:
             audio_stream_in **stream_in,
             audio_source_t source);
     void CloseStreamIn(std::shared_ptr<StreamInPrimary> stream);
+    bool IsStreamOpen(const std::shared_ptr<StreamPrimary>& stream);
     std::shared_ptr<StreamInPrimary> InGetStream(audio_io_handle_t handle);
     std::shared_ptr<StreamInPrimary> InGetStream(audio_stream_t* stream_in);
     std::shared_ptr<AudioVoice> voice_;
@@ -186,13 +224,14 @@ public:
     int dp_stream;
     int num_va_sessions_ = 0;
     pal_speaker_rotation_type current_rotation;
-    static card_status_t sndCardState;
-    std::mutex adev_init_mutex;
+    /* written by the PAL callback thread, read by every stream */
+    static std::atomic<card_status_t> sndCardState;
+    AudioMutex adev_init_mutex{"adev_init_mutex"};
     std::mutex adev_perf_mutex;
     uint32_t adev_init_ref_count = 0;
     int32_t perf_lock_acquire_cnt = 0;
     hw_device_t *GetAudioDeviceCommon();
-    int perf_lock_handle;
+    int perf_lock_handle = 0;
     int perf_lock_opts[MAX_PERF_LOCK_OPTS];
     int perf_lock_opts_size;
     bool hdr_record_enabled = false;
@@ -228,6 +267,20 @@ public:
     static void xml_end_tag(void *userdata, const XML_Char *tag_name);
     static void xml_char_data_handler(void *userdata, const XML_Char *s, int len);
     static int parse_xml();
+    static int parse_xml_file();
+    void DumpParamStats(int fd);
+    int GetUsbCapability(int card_id, int device_num, bool is_playback,
+                         usb_dev_cap_t *cap);
+    void InvalidateUsbCapability(int card_id, int device_num);
+    void DumpInitStages(int fd);
+    void OnSndCardState(card_status_t state);
+    void DumpSsrRecovery(int fd) { ssr_recovery_.Dump(fd); }
+    void EnsureEffectLibs();
+    void GetEffectLibFns(offload_effects_start_output *effect_start,
+                         offload_effects_stop_output *effect_stop,
+                         visualizer_hal_start_output *visualizer_start,
+                         visualizer_hal_stop_output *visualizer_stop);
+    void WaitMicCharacteristics();
 protected:
     AudioDevice() {}
     std::shared_ptr<AudioVoice> VoiceInit();
@@ -235,21 +288,93 @@ protected:
     static std::shared_ptr<audio_hw_device_t> device_;
     std::vector<std::shared_ptr<StreamOutPrimary>> stream_out_list_;
     std::vector<std::shared_ptr<StreamInPrimary>> stream_in_list_;
-    std::mutex out_list_mutex;
-    std::mutex in_list_mutex;
-    std::mutex patch_map_mutex;
+    AudioMutex out_list_mutex{"out_list_mutex"};
+    AudioMutex in_list_mutex{"in_list_mutex"};
+    AudioMutex patch_map_mutex{"patch_map_mutex"};
     static btsco_lc3_cfg_t btsco_lc3_cfg;
     bool bt_lc3_speech_enabled;
-    void *offload_effects_lib_;
+    void *offload_effects_lib_ = nullptr;
     offload_effects_start_output fnp_offload_effect_start_output_ = nullptr;
     offload_effects_stop_output fnp_offload_effect_stop_output_ = nullptr;
     bool is_charging_;
-    void *visualizer_lib_;
+    void *visualizer_lib_ = nullptr;
     visualizer_hal_start_output fnp_visualizer_start_output_ = nullptr;
     visualizer_hal_stop_output fnp_visualizer_stop_output_ = nullptr;
     std::map<audio_devices_t, pal_device_id_t> android_device_map_;
     std::map<audio_patch_handle_t, AudioPatch*> patch_map_;
+    /* patches audio policy sends after a device (dis)connection */
+    RouteBatch route_batch_;
     int add_input_headset_if_usb_out_headset(int *device_count,  pal_device_id_t** pal_device_ids, bool conn_state);
+    static int QueryUsbCapability(int card_id, int device_num, bool is_playback,
+                                  usb_dev_cap_t *cap);
+    std::mutex usb_cap_mutex_;
+    /* keyed by card, device and direction, filled at connect, dropped at disconnect;
+     * only available capabilities are kept */
+    std::map<std::tuple<int, int, bool>, usb_dev_cap_t> usb_cap_cache_;
+
+    uint64_t init_start_ns_ = 0;
+    std::mutex init_stage_mutex_;
+    std::vector<init_stage_t> init_stages_;
+    std::thread mic_xml_thread_;
+    std::mutex mic_xml_mutex_;
+    void RecordInitStage(const char *name, uint64_t start_ns, bool async);
+    SsrRecovery ssr_recovery_;
+    std::atomic<bool> effect_libs_loaded_{false};
+    std::once_flag effect_libs_once_;
+    void LoadEffectLibs();
+    void InitPerfLockOpts();
+    void InitBatteryListener();
+    void InitMicCharacteristics();
+
+    typedef int (AudioDevice::*SetParamHandler)(struct str_parms *parms);
+    typedef int (AudioDevice::*GetParamHandler)(struct str_parms *query,
+                                                struct str_parms *reply);
+    typedef struct set_param_handler_t {
+        const char *name;
+        SetParamHandler fn;
+    } set_param_handler_t;
+    typedef struct get_param_handler_t {
+        const char *name;
+        GetParamHandler fn;
+    } get_param_handler_t;
+    static const set_param_handler_t set_param_handlers_[];
+    static const get_param_handler_t get_param_handlers_[];
+    std::vector<param_key_t> set_param_keys_;  /* sorted by key */
+    std::vector<param_key_t> get_param_keys_;
+    std::unique_ptr<param_stats_t[]> set_param_stats_;
+    std::unique_ptr<param_stats_t[]> get_param_stats_;
+    void RegisterParamHandlers();
+    int SetHacParam(struct str_parms *parms);
+    int SetScreenStateParam(struct str_parms *parms);
+    int SetUhqaParam(struct str_parms *parms);
+    int SetDeviceConnectParam(struct str_parms *parms);
+    int SetRotationParam(struct str_parms *parms);
+    int SetSpkrFtmParam(struct str_parms *parms);
+    int SetSpkrVValidationParam(struct str_parms *parms);
+    int SetSpkrCalParam(struct str_parms *parms);
+    int SetDeviceDisconnectParam(struct str_parms *parms);
+    int SetA2dpReconfigParam(struct str_parms *parms);
+    int SetA2dpSuspendedParam(struct str_parms *parms);
+    int SetTwsChannelConfigParam(struct str_parms *parms);
+    int SetLeaMonoParam(struct str_parms *parms);
+    int SetBtScoParam(struct str_parms *parms);
+    int SetBtScoWbParam(struct str_parms *parms);
+    int SetBtSwbParam(struct str_parms *parms);
+    int SetBtBleParam(struct str_parms *parms);
+    int SetBtNrecParam(struct str_parms *parms);
+    int SetLc3CfgParam(struct str_parms *parms);
+    int SetLc3CommitParam(struct str_parms *parms);
+    int SetWfdChannelCapParam(struct str_parms *parms);
+    int SetHapticsVolumeParam(struct str_parms *parms);
+    int SetHapticsIntensityParam(struct str_parms *parms);
+    int SetA2dpCaptureSuspendParam(struct str_parms *parms);
+    int SetLogLevelParam(struct str_parms *parms);
+    int SetLatencyProbeParam(struct str_parms *parms);
+    int GetA2dpReconfigSupportedParam(struct str_parms *query, struct str_parms *reply);
+    int GetA2dpSuspendedParam(struct str_parms *query, struct str_parms *reply);
+    int GetSpkrFtmParam(struct str_parms *query, struct str_parms *reply);
+    int GetSpkrCalParam(struct str_parms *query, struct str_parms *reply);
+    int GetLatencyProbeParam(struct str_parms *query, struct str_parms *reply);
 };
 
 static inline uint32_t lcm(uint32_t num1, uint32_t num2)
@@ -0,0 +1,228 @@
+/*
+ * Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+#define LOG_TAG "AHAL: AudioMutex"
+
+#include "AudioCommon.h"
+#include "AudioMutex.h"
+
+#ifdef AHAL_MUTEX_PROFILING
+
+#include <dlfcn.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+#include <new>
+#include <vector>
+
+#define AUDIO_MUTEX_MAX_NAMES 64
+#define AUDIO_MUTEX_DUMP_TOP 10
+
+static std::mutex registry_mutex;
+static audio_mutex_stats_t *registry[AUDIO_MUTEX_MAX_NAMES];
+static int nr_registered;
+static audio_mutex_stats_t overflow_stats;
+
+static inline uint64_t audio_mutex_now() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static inline void audio_mutex_max(std::atomic<uint64_t>& max, uint64_t val) {
+    uint64_t cur = max.load(std::memory_order_relaxed);
+
+    while (val > cur && !max.compare_exchange_weak(cur, val, std::memory_order_relaxed))
+        ;
+}
+
+/* the stats of one name are never freed, instances come and go with streams */
+static audio_mutex_stats_t *audio_mutex_register(const char *name, bool copy_name) {
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    audio_mutex_stats_t *stats;
+
+    for (int i = 0; i < nr_registered; i++) {
+        if (!strcmp(registry[i]->name, name))
+            return registry[i];
+    }
+    if (nr_registered == AUDIO_MUTEX_MAX_NAMES)
+        goto overflow;
+    stats = new (std::nothrow) audio_mutex_stats_t();
+    if (!stats)
+        goto overflow;
+    /* a name from an effect library must outlive the library */
+    stats->name = copy_name ? strdup(name) : name;
+    if (!stats->name) {
+        delete stats;
+        goto overflow;
+    }
+    registry[nr_registered++] = stats;
+    return stats;
+
+overflow:
+    overflow_stats.name = "(other)";
+    return &overflow_stats;
+}
+
+/* one wait behind another holder, charged to the site that held the lock */
+static void audio_mutex_contended(audio_mutex_stats_t *stats, void *blocker, uint64_t wait) {
+    stats->contended.fetch_add(1, std::memory_order_relaxed);
+    stats->wait_ns.fetch_add(wait, std::memory_order_relaxed);
+    audio_mutex_max(stats->max_wait_ns, wait);
+
+    std::lock_guard<std::mutex> lock(stats->sites_mutex);
+    audio_mutex_site_t *slot = nullptr;
+
+    for (int i = 0; i < AUDIO_MUTEX_SITES; i++) {
+        audio_mutex_site_t *s = &stats->sites[i];
+
+        if (s->pc == blocker || !s->pc) {
+            slot = s;
+            break;
+        }
+        if (!slot || s->wait_ns < slot->wait_ns)
+            slot = s;
+    }
+    /* an unseen site evicts the one that caused the least waiting */
+    if (slot->pc != blocker) {
+        slot->pc = blocker;
+        slot->wait_ns = 0;
+    }
+    slot->wait_ns += wait;
+}
+
+static void audio_mutex_released(audio_mutex_stats_t *stats, uint64_t hold) {
+    stats->hold_ns.fetch_add(hold, std::memory_order_relaxed);
+    audio_mutex_max(stats->max_hold_ns, hold);
+}
+
+AudioMutex::AudioMutex(const char *name) : stats_(audio_mutex_register(name, false)) {}
+
+void AudioMutex::Acquired(void *pc, uint64_t now) {
+    owner_pc_ = pc;
+    acquired_ns_ = now;
+    stats_->acquired.fetch_add(1, std::memory_order_relaxed);
+}
+
+void AudioMutex::lock() {
+    void *pc = __builtin_return_address(0);
+    void *blocker;
+    uint64_t start;
+    uint64_t now;
+    uint64_t wait;
+
+    if (mutex_.try_lock()) {
+        Acquired(pc, audio_mutex_now());
+        return;
+    }
+
+    /* unlocked read, only names the likely holder */
+    blocker = owner_pc_;
+    start = audio_mutex_now();
+    mutex_.lock();
+    now = audio_mutex_now();
+    wait = now - start;
+    Acquired(pc, now);
+    audio_mutex_contended(stats_, blocker, wait);
+}
+
+bool AudioMutex::try_lock() {
+    if (!mutex_.try_lock())
+        return false;
+    Acquired(__builtin_return_address(0), audio_mutex_now());
+    return true;
+}
+
+void AudioMutex::unlock() {
+    audio_mutex_released(stats_, audio_mutex_now() - acquired_ns_);
+    mutex_.unlock();
+}
+
+/* the effect library times its own pthread lock and reports here */
+__attribute__ ((visibility ("default")))
+void *audio_hw_mutex_stats(const char *name) {
+    return name ? audio_mutex_register(name, true) : nullptr;
+}
+
+__attribute__ ((visibility ("default")))
+void audio_hw_mutex_acquired(void *stats, int contended, void *blocker, uint64_t wait_ns) {
+    audio_mutex_stats_t *s = (audio_mutex_stats_t *)stats;
+
+    s->acquired.fetch_add(1, std::memory_order_relaxed);
+    if (contended)
+        audio_mutex_contended(s, blocker, wait_ns);
+}
+
+__attribute__ ((visibility ("default")))
+void audio_hw_mutex_released(void *stats, uint64_t hold_ns) {
+    audio_mutex_released((audio_mutex_stats_t *)stats, hold_ns);
+}
+
+void AudioMutex::SetEffectHooks(offload_effects_bundle_hal_set_mutex_hooks set_hooks) {
+    if (set_hooks)
+        set_hooks(audio_hw_mutex_stats, audio_hw_mutex_acquired, audio_hw_mutex_released);
+}
+
+static void audio_mutex_print_site(int fd, void *pc) {
+    Dl_info info;
+
+    if (pc && dladdr(pc, &info) && info.dli_fname) {
+        const char *lib = strrchr(info.dli_fname, '/');
+
+        dprintf(fd, "%s+%#" PRIxPTR "%s%s", lib ? lib + 1 : info.dli_fname,
+                (uintptr_t)pc - (uintptr_t)info.dli_fbase,
+                info.dli_sname ? " " : "", info.dli_sname ? info.dli_sname : "");
+    } else {
+        dprintf(fd, "%p", pc);
+    }
+}
+
+void AudioMutex::Dump(int fd) {
+    std::vector<audio_mutex_stats_t *> locks;
+
+    {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+
+        locks.assign(registry, registry + nr_registered);
+        if (overflow_stats.name)
+            locks.push_back(&overflow_stats);
+    }
+    std::sort(locks.begin(), locks.end(),
+              [](audio_mutex_stats_t *a, audio_mutex_stats_t *b) {
+                  return a->wait_ns.load(std::memory_order_relaxed) >
+                         b->wait_ns.load(std::memory_order_relaxed);
+              });
+
+    dprintf(fd, "Lock contention (name: acquired, contended, wait total/max ms, "
+                "hold mean/max us):\n");
+    for (size_t i = 0; i < locks.size() && i < AUDIO_MUTEX_DUMP_TOP; i++) {
+        audio_mutex_stats_t *s = locks[i];
+        uint64_t acquired = s->acquired.load(std::memory_order_relaxed);
+
+        if (!acquired)
+            continue;
+        dprintf(fd, "  %s: %" PRIu64 ", %" PRIu64 ", %.3f/%.3f, %" PRIu64 "/%" PRIu64 "\n",
+                s->name, acquired, s->contended.load(std::memory_order_relaxed),
+                s->wait_ns.load(std::memory_order_relaxed) / 1000000.0,
+                s->max_wait_ns.load(std::memory_order_relaxed) / 1000000.0,
+                s->hold_ns.load(std::memory_order_relaxed) / acquired / 1000,
+                s->max_hold_ns.load(std::memory_order_relaxed) / 1000);
+
+        std::lock_guard<std::mutex> lock(s->sites_mutex);
+        for (int j = 0; j < AUDIO_MUTEX_SITES; j++) {
+            if (!s->sites[j].wait_ns)
+                continue;
+            dprintf(fd, "    held by ");
+            audio_mutex_print_site(fd, s->sites[j].pc);
+            dprintf(fd, ": %.3f ms waited\n", s->sites[j].wait_ns / 1000000.0);
+        }
+    }
+}
+
+#endif
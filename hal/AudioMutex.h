@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+#ifndef ANDROID_HARDWARE_AHAL_AUDIO_MUTEX_H_
+#define ANDROID_HARDWARE_AHAL_AUDIO_MUTEX_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <mutex>
+
+#define AUDIO_MUTEX_SITES 4     /* blocking owner sites kept per lock */
+
+typedef struct audio_mutex_site {
+    void *pc;
+    uint64_t wait_ns;           /* time others waited while this site held it */
+} audio_mutex_site_t;
+
+/* shared by every lock created with the same name */
+typedef struct audio_mutex_stats {
+    const char *name;
+    std::atomic<uint64_t> acquired;
+    std::atomic<uint64_t> contended;
+    std::atomic<uint64_t> wait_ns;
+    std::atomic<uint64_t> max_wait_ns;
+    std::atomic<uint64_t> hold_ns;
+    std::atomic<uint64_t> max_hold_ns;
+    std::mutex sites_mutex;
+    audio_mutex_site_t sites[AUDIO_MUTEX_SITES];
+} audio_mutex_stats_t;
+
+/*
+ * C entry points for the effect libraries, whose pthread locks are timed by
+ * audio-effects/post_proc/effect_mutex.h and added to the same dump. Only
+ * exported with AHAL_MUTEX_PROFILING, the libraries keep plain locks when
+ * the symbols are missing.
+ */
+extern "C" typedef void *(*audio_hw_mutex_stats_t)(const char *name);
+extern "C" typedef void (*audio_hw_mutex_acquired_t)(void *stats, int contended,
+                                                     void *blocker, uint64_t wait_ns);
+extern "C" typedef void (*audio_hw_mutex_released_t)(void *stats, uint64_t hold_ns);
+extern "C" typedef void (*offload_effects_bundle_hal_set_mutex_hooks)(audio_hw_mutex_stats_t,
+                                                                     audio_hw_mutex_acquired_t,
+                                                                     audio_hw_mutex_released_t);
+
+#ifdef AHAL_MUTEX_PROFILING
+
+/*
+ * std::mutex drop-in that records how long callers wait for it, how long
+ * it is held and which call site held it while others waited. Stats are
+ * kept per lock name, so all stream_mutex_ instances add up to one line
+ * of the dump.
+ *
+ * Only built for userdebug/eng or with AUDIO_FEATURE_ENABLED_MUTEX_PROFILING,
+ * otherwise AudioMutex is a plain std::mutex.
+ */
+class AudioMutex {
+public:
+    explicit AudioMutex(const char *name);
+    AudioMutex(const AudioMutex&) = delete;
+    AudioMutex& operator=(const AudioMutex&) = delete;
+
+    void lock() __attribute__((noinline));
+    bool try_lock() __attribute__((noinline));
+    void unlock();
+
+    static void Dump(int fd);
+
+    /* hands the C entry points to the offload effects bundle */
+    static void SetEffectHooks(offload_effects_bundle_hal_set_mutex_hooks set_hooks);
+
+private:
+    void Acquired(void *pc, uint64_t now);
+
+    std::mutex mutex_;
+    audio_mutex_stats_t *stats_;
+    void *owner_pc_ = nullptr;
+    uint64_t acquired_ns_ = 0;
+};
+
+extern "C" void *audio_hw_mutex_stats(const char *name);
+extern "C" void audio_hw_mutex_acquired(void *stats, int contended, void *blocker,
+                                        uint64_t wait_ns);
+extern "C" void audio_hw_mutex_released(void *stats, uint64_t hold_ns);
+
+#else
+
+class AudioMutex : public std::mutex {
+public:
+    explicit AudioMutex(const char *name) { (void)name; }
+
+    static void Dump(int fd) { (void)fd; }
+
+    static void SetEffectHooks(offload_effects_bundle_hal_set_mutex_hooks set_hooks) {
+        (void)set_hooks;
+    }
+};
+
+#endif
+
+#endif  // ANDROID_HARDWARE_AHAL_AUDIO_MUTEX_H_
@@ -70,12 +70,20 @@
 
 #include "AudioDevice.h"
 #include "AudioStream.h"
+#include "MetadataAggregator.h"
+#include "BufferPolicy.h"
+#include "AudioTrace.h"
+#include "CallRecorder.h"
+#include "LatencyProbe.h"
+#include "PerfLockPolicy.h"
+#include "ThreadPolicy.h"
 
 #include <log/log.h>
 #include <utils/Trace.h>
 #include <cutils/properties.h>
 #include <inttypes.h>
 
+#include <algorithm>
 #include <chrono>
 #include <thread>
 
@@ -94,8 +102,8 @@
 #define AFE_PROXY_RECORD_PERIOD_SIZE  768
 
 static bool karaoke = false;
-std::mutex StreamOutPrimary::sourceMetadata_mutex_;
-std::mutex StreamInPrimary::sinkMetadata_mutex_;
+AudioMutex StreamOutPrimary::sourceMetadata_mutex_("sourceMetadata_mutex_");
+AudioMutex StreamInPrimary::sinkMetadata_mutex_("sinkMetadata_mutex_");
 
 static bool is_pcm_format(audio_format_t format)
 {
@@ -150,17 +158,29 @@ static void setup_hdr_usecase(struct pal_device* palInDevice) {
 
 /*
 * Scope based implementation of acquiring/releasing PerfLock.
+* PerfLockPolicy decides whether the op boosts and learns from its latency.
 */
 class AutoPerfLock {
 public :
-    AutoPerfLock() {
+    AutoPerfLock(int usecase, perf_lock_op_t op) :
+        usecase_((audio_usecase_t)usecase), op_(op), start_ns_(perf_lock_time_ns()) {
         std::shared_ptr<AudioDevice> adevice = AudioDevice::GetInstance();
+        int duration = 0;
+
         if (adevice) {
             adevice->adev_perf_mutex.lock();
-            ++adevice->perf_lock_acquire_cnt;
-            if (adevice->perf_lock_acquire_cnt == 1)
-                AudioExtn::audio_extn_perf_lock_acquire(&adevice->perf_lock_handle, 0,
-                        adevice->perf_lock_opts, adevice->perf_lock_opts_size);
+            acquired_ = PerfLockPolicy::ShouldBoost(usecase_, op_, &duration);
+            if (acquired_) {
+                ++adevice->perf_lock_acquire_cnt;
+                if (adevice->perf_lock_acquire_cnt == 1)
+                    AudioExtn::audio_extn_perf_lock_acquire(&adevice->perf_lock_handle,
+                            duration, adevice->perf_lock_opts, adevice->perf_lock_opts_size);
+                StreamCounters::PerfLocksHeld(adevice->perf_lock_acquire_cnt);
+            }
+            /* only a boost this op took and the perf HAL granted counts as boosted */
+            boosted_ = acquired_ && adevice->perf_lock_handle > 0;
+            /* an unboosted op running under another op's boost says nothing either way */
+            shared_ = !acquired_ && adevice->perf_lock_acquire_cnt > 0;
             AHAL_DBG("(Acquired) perf_lock_handle: 0x%x, count: %d",
                     adevice->perf_lock_handle, adevice->perf_lock_acquire_cnt);
             adevice->adev_perf_mutex.unlock();
@@ -170,11 +190,17 @@ public :
     ~AutoPerfLock() {
         std::shared_ptr<AudioDevice> adevice = AudioDevice::GetInstance();
         if (adevice) {
+            if (!shared_)
+                PerfLockPolicy::Record(usecase_, op_, boosted_,
+                                       perf_lock_time_ns() - start_ns_);
+            if (!acquired_)
+                return;
             adevice->adev_perf_mutex.lock();
             AHAL_DBG("(release) perf_lock_handle: 0x%x, count: %d",
                     adevice->perf_lock_handle, adevice->perf_lock_acquire_cnt);
             if (adevice->perf_lock_acquire_cnt > 0)
                 --adevice->perf_lock_acquire_cnt;
+            StreamCounters::PerfLocksHeld(adevice->perf_lock_acquire_cnt);
             if (adevice->perf_lock_acquire_cnt == 0) {
                 AHAL_DBG("Releasing perf_lock_handle: 0x%x", adevice->perf_lock_handle);
                 AudioExtn::audio_extn_perf_lock_release(&adevice->perf_lock_handle);
@@ -182,6 +208,21 @@ public :
             adevice->adev_perf_mutex.unlock();
         }
     }
+
+private:
+    static uint64_t perf_lock_time_ns() {
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    }
+
+    audio_usecase_t usecase_;
+    perf_lock_op_t op_;
+    uint64_t start_ns_;
+    bool acquired_ = false;
+    bool boosted_ = false;
+    bool shared_ = false;
 };
 
 void StreamOutPrimary::GetStreamHandle(audio_stream_out** stream) {
@@ -214,6 +255,13 @@ int StreamPrimary::GetUseCase()
     return usecase_;
 }
 
+void StreamPrimary::MarkClosed()
+{
+    stream_mutex_.lock();
+    closed_ = true;
+    stream_mutex_.unlock();
+}
+
 bool StreamPrimary::GetSupportedConfig(bool isOutStream,
         struct str_parms *query,
         struct str_parms *reply)
@@ -349,7 +397,7 @@ static int32_t pal_callback(pal_stream_handle_t *stream_handle,
     {
         case PAL_STREAM_CBK_EVENT_WRITE_READY:
         {
-            std::lock_guard<std::mutex> write_guard (astream_out->write_wait_mutex_);
+            std::lock_guard<AudioMutex> write_guard (astream_out->write_wait_mutex_);
             astream_out->write_ready_ = true;
             AHAL_VERBOSE("received WRITE_READY event");
             (astream_out->write_condition_).notify_all();
@@ -359,7 +407,7 @@ static int32_t pal_callback(pal_stream_handle_t *stream_handle,
 
     case PAL_STREAM_CBK_EVENT_DRAIN_READY:
         {
-            std::lock_guard<std::mutex> drain_guard (astream_out->drain_wait_mutex_);
+            std::lock_guard<AudioMutex> drain_guard (astream_out->drain_wait_mutex_);
             astream_out->drain_ready_ = true;
             astream_out->sendGaplessMetadata = false;
             AHAL_DBG("received DRAIN_READY event");
@@ -369,7 +417,7 @@ static int32_t pal_callback(pal_stream_handle_t *stream_handle,
         break;
     case PAL_STREAM_CBK_EVENT_PARTIAL_DRAIN_READY:
         {
-            std::lock_guard<std::mutex> drain_guard (astream_out->drain_wait_mutex_);
+            std::lock_guard<AudioMutex> drain_guard (astream_out->drain_wait_mutex_);
             astream_out->drain_ready_ = true;
             astream_out->sendGaplessMetadata = true;
             AHAL_DBG("received PARTIAL DRAIN_READY event");
@@ -591,7 +639,8 @@ static int astream_pause(struct audio_stream_out *stream)
     }
 
     AHAL_DBG("pause");
-    return astream_out->Pause();
+    AutoCallRecord rec(CALL_OUT_PAUSE, astream_out->GetHandle());
+    return rec.SetRet(astream_out->Pause());
 }
 
 static int astream_resume(struct audio_stream_out *stream)
@@ -610,7 +659,8 @@ static int astream_resume(struct audio_stream_out *stream)
         return -EINVAL;
     }
 
-    return astream_out->Resume();
+    AutoCallRecord rec(CALL_OUT_RESUME, astream_out->GetHandle());
+    return rec.SetRet(astream_out->Resume());
 }
 
 static int astream_flush(struct audio_stream_out *stream)
@@ -629,7 +679,8 @@ static int astream_flush(struct audio_stream_out *stream)
         return -EINVAL;
     }
 
-    return astream_out->Flush();
+    AutoCallRecord rec(CALL_OUT_FLUSH, astream_out->GetHandle());
+    return rec.SetRet(astream_out->Flush());
 }
 
 static int astream_drain(struct audio_stream_out *stream, audio_drain_type_t type)
@@ -648,7 +699,9 @@ static int astream_drain(struct audio_stream_out *stream, audio_drain_type_t typ
         return -EINVAL;
     }
 
-    return astream_out->Drain(type);
+    int32_t rec_type = type;
+    AutoCallRecord rec(CALL_OUT_DRAIN, astream_out->GetHandle(), &rec_type, sizeof(rec_type));
+    return rec.SetRet(astream_out->Drain(type));
 }
 
 static int astream_set_callback(struct audio_stream_out *stream, stream_callback_t callback, void *cookie)
@@ -694,7 +747,8 @@ static int astream_out_standby(struct audio_stream *stream) {
           astream_out->GetUseCase(), use_case_table[astream_out->GetUseCase()]);
 
     if (astream_out) {
-        ret = astream_out->Standby();
+        AutoCallRecord rec(CALL_OUT_STANDBY, astream_out->GetHandle());
+        ret = rec.SetRet(astream_out->Standby());
     } else {
         AHAL_ERR("unable to get audio stream");
         ret = -EINVAL;
@@ -740,6 +794,7 @@ static uint32_t astream_get_latency(const struct audio_stream_out *stream) {
     int trial = 0;
     char value[PROPERTY_VALUE_MAX] = {0};
     int low_latency_period_size = LOW_LATENCY_PLAYBACK_PERIOD_SIZE;
+    std::set<audio_devices_t> devices;
 
     if (adevice) {
         astream_out = adevice->OutGetStream((audio_stream_t*)stream);
@@ -747,6 +802,7 @@ static uint32_t astream_get_latency(const struct audio_stream_out *stream) {
         AHAL_ERR("unable to get audio device");
         return -EINVAL;
     }
+    devices = astream_out->GetDevices();
 
     switch (astream_out->GetUseCase()) {
     case USECASE_AUDIO_PLAYBACK_OFFLOAD:
@@ -765,16 +821,24 @@ static uint32_t astream_get_latency(const struct audio_stream_out *stream) {
         latency += StreamOutPrimary::GetRenderLatency(astream_out->flags_) / 1000;
         break;
     case USECASE_AUDIO_PLAYBACK_DEEP_BUFFER:
-        latency = DEEP_BUFFER_OUTPUT_PERIOD_DURATION * DEEP_BUFFER_PLAYBACK_PERIOD_COUNT;
+        latency = BufferPolicy::PeriodSize(USECASE_AUDIO_PLAYBACK_DEEP_BUFFER,
+                                           DEEP_BUFFER_PLAYBACK_PERIOD_SIZE) *
+                  BufferPolicy::PeriodCount(USECASE_AUDIO_PLAYBACK_DEEP_BUFFER, devices,
+                                            DEEP_BUFFER_PLAYBACK_PERIOD_COUNT) *
+                  1000 / DEFAULT_OUTPUT_SAMPLING_RATE;
         latency += StreamOutPrimary::GetRenderLatency(astream_out->flags_) / 1000;
         break;
     case USECASE_AUDIO_PLAYBACK_LOW_LATENCY:
+        low_latency_period_size = BufferPolicy::PeriodSize(USECASE_AUDIO_PLAYBACK_LOW_LATENCY,
+                                                           LOW_LATENCY_PLAYBACK_PERIOD_SIZE);
         if (property_get("vendor.audio_hal.period_size", value, NULL) > 0) {
             trial = atoi(value);
             if (astream_out->period_size_is_plausible_for_low_latency(trial))
                 low_latency_period_size = trial;
         }
-        latency = (LOW_LATENCY_PLAYBACK_PERIOD_COUNT * low_latency_period_size * 1000)/ (astream_out->GetSampleRate());
+        latency = (BufferPolicy::PeriodCount(USECASE_AUDIO_PLAYBACK_LOW_LATENCY, devices,
+                                             LOW_LATENCY_PLAYBACK_PERIOD_COUNT) *
+                   low_latency_period_size * 1000)/ (astream_out->GetSampleRate());
         latency += StreamOutPrimary::GetRenderLatency(astream_out->flags_) / 1000;
         break;
     case USECASE_AUDIO_PLAYBACK_WITH_HAPTICS:
@@ -782,7 +846,11 @@ static uint32_t astream_get_latency(const struct audio_stream_out *stream) {
         latency += StreamOutPrimary::GetRenderLatency(astream_out->flags_) / 1000;
         break;
     case USECASE_AUDIO_PLAYBACK_SPATIAL:
-        latency = SPATIAL_AUDIO_OUTPUT_PERIOD_DURATION * SPATIAL_PLAYBACK_PERIOD_COUNT;
+        latency = BufferPolicy::PeriodSize(USECASE_AUDIO_PLAYBACK_SPATIAL,
+                                           SPATIAL_PLAYBACK_PERIOD_SIZE) *
+                  BufferPolicy::PeriodCount(USECASE_AUDIO_PLAYBACK_SPATIAL, devices,
+                                            SPATIAL_PLAYBACK_PERIOD_COUNT) *
+                  1000 / DEFAULT_OUTPUT_SAMPLING_RATE;
         latency += StreamOutPrimary::GetRenderLatency(astream_out->flags_) / 1000;
         break;
     case USECASE_AUDIO_PLAYBACK_VOIP:
@@ -814,6 +882,8 @@ static uint32_t astream_get_latency(const struct audio_stream_out *stream) {
         latency += param_bt_a2dp_ptr->latency;
     }
 exit:
+    /* a measured output latency replaces the estimate, BT included */
+    latency = LatencyProbe::Adjust(astream_out->GetUseCase(), devices, latency);
     AHAL_VERBOSE("Latency %d", latency);
     return latency;
 }
@@ -929,17 +999,21 @@ static int astream_out_set_parameters(struct audio_stream *stream,
     AHAL_DBG("enter: usecase(%d: %s) kvpairs: %s",
              astream_out->GetUseCase(), use_case_table[astream_out->GetUseCase()], kvpairs);
 
-    parms = str_parms_create_str(kvpairs);
-    if (!parms) {
-       ret = -EINVAL;
-       goto exit;
-    }
+    {
+        AutoCallRecord rec(CALL_OUT_SET_PARAMS, astream_out->GetHandle(), kvpairs,
+                           kvpairs ? strlen(kvpairs) : 0);
 
+        parms = str_parms_create_str(kvpairs);
+        if (!parms) {
+           ret = rec.SetRet(-EINVAL);
+           goto exit;
+        }
 
-    ret = astream_out->SetParameters(parms);
-    if (ret) {
-        AHAL_ERR("Stream SetParameters Error (%x)", ret);
-        goto exit;
+        ret = rec.SetRet(astream_out->SetParameters(parms));
+        if (ret) {
+            AHAL_ERR("Stream SetParameters Error (%x)", ret);
+            goto exit;
+        }
     }
 exit:
     if (parms)
@@ -1034,7 +1108,11 @@ static int astream_out_set_volume(struct audio_stream_out *stream,
     }
 
     if (astream_out) {
-        return astream_out->SetVolume(left, right);
+        float rec_vol[2] = {left, right};
+        AutoCallRecord rec(CALL_OUT_SET_VOLUME, astream_out->GetHandle(), rec_vol,
+                           sizeof(rec_vol));
+
+        return rec.SetRet(astream_out->SetVolume(left, right));
     } else {
         AHAL_ERR("unable to get audio stream");
         return -EINVAL;
@@ -1155,7 +1233,11 @@ static ssize_t in_read(struct audio_stream_in *stream, void *buffer,
     }
 
     if (astream_in) {
-        return astream_in->read(buffer, bytes);
+        uint32_t rec_bytes = bytes;
+        AutoCallRecord rec(CALL_IN_READ, astream_in->GetHandle(), &rec_bytes,
+                           sizeof(rec_bytes));
+
+        return rec.SetRet(astream_in->read(buffer, bytes));
     } else {
         AHAL_ERR("unable to get audio stream");
         return -EINVAL;
@@ -1178,7 +1260,11 @@ static ssize_t out_write(struct audio_stream_out *stream, const void *buffer,
     }
 
     if (astream_out) {
-        return astream_out->write(buffer, bytes);
+        uint32_t rec_bytes = bytes;
+        AutoCallRecord rec(CALL_OUT_WRITE, astream_out->GetHandle(), &rec_bytes,
+                           sizeof(rec_bytes));
+
+        return rec.SetRet(astream_out->write(buffer, bytes));
     } else {
         AHAL_ERR("unable to get audio stream");
         return -EINVAL;
@@ -1683,7 +1769,8 @@ static int astream_in_standby(struct audio_stream *stream) {
           astream_in->GetUseCase(), use_case_table[astream_in->GetUseCase()]);
 
     if (astream_in) {
-        ret = astream_in->Standby();
+        AutoCallRecord rec(CALL_IN_STANDBY, astream_in->GetHandle());
+        ret = rec.SetRet(astream_in->Standby());
     } else {
         AHAL_ERR("unable to get audio stream");
         ret = -EINVAL;
@@ -1714,7 +1801,10 @@ static int astream_in_set_parameters(struct audio_stream *stream, const char *kv
     }
 
     if (astream_in) {
-        return astream_in->SetParameters(kvpairs);
+        AutoCallRecord rec(CALL_IN_SET_PARAMS, astream_in->GetHandle(), kvpairs,
+                           strlen(kvpairs));
+
+        return rec.SetRet(astream_in->SetParameters(kvpairs));
     }
 
 error:
@@ -2032,6 +2122,7 @@ int StreamOutPrimary::GetMmapPosition(struct audio_mmap_position *position)
     }
     position->position_frames = pal_mmap_pos.position_frames;
     position->time_nanoseconds = pal_mmap_pos.time_nanoseconds;
+    mmapPosition_.Update(position);
 
 #if 0
     /** Check if persist vendor property is available */
@@ -2090,6 +2181,9 @@ int StreamOutPrimary::CreateMmapBuffer(int32_t min_size_frames,
     info->burst_size_frames = palMmapBuf.burst_size_frames;
     info->flags = (audio_mmap_buffer_flag) AUDIO_MMAP_APPLICATION_SHAREABLE;
     mmap_shared_memory_fd = info->shared_memory_fd;
+    mmapPosition_.Configure(true, config_.sample_rate,
+            audio_bytes_per_frame(audio_channel_count_from_out_mask(config_.channel_mask),
+                                  config_.format), info);
 
     stream_mutex_.unlock();
     return ret;
@@ -2107,6 +2201,8 @@ int StreamOutPrimary::Stop() {
         if (ret == 0) {
             stream_started_ = false;
             stream_paused_ = false;
+            mmapPosition_.LogStats("mmap playback");
+            mmapPosition_.Reset();
         }
     }
     stream_mutex_.unlock();
@@ -2122,6 +2218,7 @@ int StreamOutPrimary::Start() {
     if (usecase_ == USECASE_AUDIO_PLAYBACK_MMAP &&
             pal_stream_handle_ && !stream_started_) {
 
+        mmapPosition_.Reset();
         ret = pal_stream_start(pal_stream_handle_);
         if (ret == 0)
             stream_started_ = true;
@@ -2213,6 +2310,8 @@ int StreamOutPrimary::Flush() {
             AHAL_INFO("called in invalid state (stream not paused)" );
         }
         mBytesWritten = 0;
+        mSessionBaseBytes = 0;
+        counters_.Reset();
     }
     sendGaplessMetadata = true;
     stream_mutex_.unlock();
@@ -2258,9 +2357,38 @@ void StreamOutPrimary::UpdatemCachedPosition(uint64_t val)
     mCachedPosition = val;
 }
 
+/*
+ * PCM streams are reopened and started right away so audio resumes before
+ * the client's next write. Offload and mmap clients rebuild their tracks
+ * on error, for them closing the dead handle is enough.
+ */
+int StreamOutPrimary::Recover() {
+    int ret = 0;
+
+    AHAL_DBG("Enter: usecase(%d: %s)", GetUseCase(), use_case_table[GetUseCase()]);
+    ret = Standby();
+    if (ret)
+        AHAL_ERR("standby failed %d", ret);
+
+    if (CheckOffloadEffectsType(streamAttributes_.type) ||
+        (flags_ & AUDIO_OUTPUT_FLAG_MMAP_NOIRQ) ||
+        usecase_ == USECASE_AUDIO_PLAYBACK_WITH_HAPTICS)
+        goto exit;
+
+    stream_mutex_.lock();
+    if (!closed_)
+        ret = configurePalOutputStream();
+    stream_mutex_.unlock();
+
+exit:
+    AHAL_DBG("Exit ret: %d", ret);
+    return ret;
+}
+
 int StreamOutPrimary::Standby() {
     int ret = 0;
 
+    AHAL_TRACE(AHAL_EVT_OUT_STANDBY, handle_);
     AHAL_DBG("Enter");
     stream_mutex_.lock();
     if (pal_stream_handle_) {
@@ -2296,6 +2424,12 @@ int StreamOutPrimary::Standby() {
     stream_started_ = false;
     stream_paused_ = false;
     sendGaplessMetadata = true;
+    mSessionBaseBytes = mBytesWritten;
+    counters_.Reset();
+    if (usecase_ == USECASE_AUDIO_PLAYBACK_MMAP) {
+        mmapPosition_.LogStats("mmap playback");
+        mmapPosition_.Reset();
+    }
     if (CheckOffloadEffectsType(streamAttributes_.type)) {
         ret = StopOffloadEffects(handle_, pal_stream_handle_);
         ret = StopOffloadVisualizer(handle_, pal_stream_handle_);
@@ -2303,9 +2437,11 @@ int StreamOutPrimary::Standby() {
 
     if (pal_stream_handle_) {
         ret = pal_stream_close(pal_stream_handle_);
+        StreamCounters::PalSessionClosed();
         pal_stream_handle_ = NULL;
         if (usecase_ == USECASE_AUDIO_PLAYBACK_WITH_HAPTICS && pal_haptics_stream_handle) {
             ret = pal_stream_close(pal_haptics_stream_handle);
+            StreamCounters::PalSessionClosed();
             pal_haptics_stream_handle = NULL;
             if (hapticBuffer) {
                 free (hapticBuffer);
@@ -2346,14 +2482,17 @@ exit:
     return ret;
 }
 
+std::set<audio_devices_t> StreamOutPrimary::GetDevices() {
+    std::lock_guard<AudioMutex> lock(stream_mutex_);
+    return mAndroidOutDevices;
+}
+
 int StreamOutPrimary::RouteStream(const std::set<audio_devices_t>& new_devices, bool force_device_switch __unused) {
     int ret = 0, noPalDevices = 0;
     bool skipDeviceSet = false;
     pal_device_id_t * deviceId = nullptr;
     struct pal_device* deviceIdConfigs = nullptr;
-    pal_param_device_capability_t *device_cap_query = nullptr;
-    size_t payload_size = 0;
-    dynamic_media_config_t dynamic_media_config;
+    usb_dev_cap_t usb_cap;
     std::shared_ptr<AudioDevice> adevice = AudioDevice::GetInstance();
 
     bool isHifiFilterEnabled = false;
@@ -2363,6 +2502,8 @@ int StreamOutPrimary::RouteStream(const std::set<audio_devices_t>& new_devices,
     pal_param_bta2dp_t *param_bt_a2dp_ptr = nullptr;
     size_t bt_param_size = 0;
 
+    AHAL_TRACE(AHAL_EVT_OUT_ROUTE, handle_, (int32_t)new_devices.size(),
+               new_devices.empty() ? 0 : (int32_t)*new_devices.begin());
     stream_mutex_.lock();
     if (!mInitialized) {
         AHAL_ERR("Not initialized, returning error");
@@ -2380,26 +2521,29 @@ int StreamOutPrimary::RouteStream(const std::set<audio_devices_t>& new_devices,
     if (!AudioExtn::audio_devices_empty(new_devices)) {
         // re-allocate mPalOutDevice and mPalOutDeviceIds
         if (new_devices.size() != mAndroidOutDevices.size()) {
-            deviceId = (pal_device_id_t*) realloc(mPalOutDeviceIds,
-                    new_devices.size() * sizeof(pal_device_id_t));
-            deviceIdConfigs = (struct pal_device*) realloc(mPalOutDevice,
-                    new_devices.size() * sizeof(struct pal_device));
-            if (!deviceId || !deviceIdConfigs) {
-                AHAL_ERR("Failed to allocate PalOutDeviceIds or deviceIdConfigs!");
-                if (deviceId)
-                    mPalOutDeviceIds = deviceId;
-                if (deviceIdConfigs)
-                    mPalOutDevice = deviceIdConfigs;
-                ret = -ENOMEM;
-                goto done;
+            /* only grow past the slots allocated at open */
+            if (new_devices.size() > mPalOutDeviceCap) {
+                deviceId = (pal_device_id_t*) realloc(mPalOutDeviceIds,
+                        new_devices.size() * sizeof(pal_device_id_t));
+                deviceIdConfigs = (struct pal_device*) realloc(mPalOutDevice,
+                        new_devices.size() * sizeof(struct pal_device));
+                if (!deviceId || !deviceIdConfigs) {
+                    AHAL_ERR("Failed to allocate PalOutDeviceIds or deviceIdConfigs!");
+                    if (deviceId)
+                        mPalOutDeviceIds = deviceId;
+                    if (deviceIdConfigs)
+                        mPalOutDevice = deviceIdConfigs;
+                    ret = -ENOMEM;
+                    goto done;
+                }
+                mPalOutDeviceIds = deviceId;
+                mPalOutDevice = deviceIdConfigs;
+                mPalOutDeviceCap = new_devices.size();
             }
 
             // init deviceId and deviceIdConfigs
-            memset(deviceId, 0, new_devices.size() * sizeof(pal_device_id_t));
-            memset(deviceIdConfigs, 0, new_devices.size() * sizeof(struct pal_device));
-
-            mPalOutDeviceIds = deviceId;
-            mPalOutDevice = deviceIdConfigs;
+            memset(mPalOutDeviceIds, 0, new_devices.size() * sizeof(pal_device_id_t));
+            memset(mPalOutDevice, 0, new_devices.size() * sizeof(struct pal_device));
         }
 
         noPalDevices = getPalDeviceIds(new_devices, mPalOutDeviceIds);
@@ -2414,14 +2558,6 @@ int StreamOutPrimary::RouteStream(const std::set<audio_devices_t>& new_devices,
             goto done;
         }
 
-        device_cap_query = (pal_param_device_capability_t *)
-                malloc(sizeof(pal_param_device_capability_t));
-        if (!device_cap_query) {
-                AHAL_ERR("Failed to allocate device_cap_query!");
-                ret = -ENOMEM;
-                goto done;
-        }
-
         ret = pal_get_param(PAL_PARAM_ID_HIFI_PCM_FILTER,
                             (void **)&payload_hifiFilter, &param_size, nullptr);
 
@@ -2441,18 +2577,13 @@ int StreamOutPrimary::RouteStream(const std::set<audio_devices_t>& new_devices,
             mPalOutDevice[i].config.bit_width = CODEC_BACKEND_DEFAULT_BIT_WIDTH;
             mPalOutDevice[i].config.ch_info = {0, {0}};
             mPalOutDevice[i].config.aud_fmt_id = PAL_AUDIO_FMT_PCM_S16_LE;
-            if (((mPalOutDeviceIds[i] == PAL_DEVICE_OUT_USB_DEVICE) ||
-               (mPalOutDeviceIds[i] == PAL_DEVICE_OUT_USB_HEADSET)) && device_cap_query) {
+            if ((mPalOutDeviceIds[i] == PAL_DEVICE_OUT_USB_DEVICE) ||
+               (mPalOutDeviceIds[i] == PAL_DEVICE_OUT_USB_HEADSET)) {
 
                 mPalOutDevice[i].address.card_id = adevice->usb_card_id_;
                 mPalOutDevice[i].address.device_num = adevice->usb_dev_num_;
-                device_cap_query->id = mPalOutDeviceIds[i];
-                device_cap_query->addr.card_id = adevice->usb_card_id_;
-                device_cap_query->addr.device_num = adevice->usb_dev_num_;
-                device_cap_query->config = &dynamic_media_config;
-                device_cap_query->is_playback = true;
-                ret = pal_get_param(PAL_PARAM_ID_DEVICE_CAPABILITY,(void **)&device_cap_query,
-                        &payload_size, nullptr);
+                ret = adevice->GetUsbCapability(adevice->usb_card_id_,
+                        adevice->usb_dev_num_, true, &usb_cap);
 
                 if (ret<0){
                     AHAL_ERR("Error usb device is not connected");
@@ -2541,10 +2672,6 @@ int StreamOutPrimary::RouteStream(const std::set<audio_devices_t>& new_devices,
     }
 
 done:
-    if (device_cap_query) {
-        free(device_cap_query);
-        device_cap_query = NULL;
-    }
     stream_mutex_.unlock();
     AHAL_DBG("exit %d", ret);
     return ret;
@@ -2599,26 +2726,153 @@ error:
     return ret;
 }
 
+/*
+ * Volume changes landing right after one another are folded into the last
+ * one, sent once the window has passed. PCM streams written through the
+ * HAL get frequent writes and send it from write(). Offload writes can be
+ * a buffer of several hundred ms apart, so a timer sends it there.
+ */
+bool StreamOutPrimary::CanCoalesceVolume() {
+    switch (streamAttributes_.type) {
+    case PAL_STREAM_DEEP_BUFFER:
+    case PAL_STREAM_LOW_LATENCY:
+    case PAL_STREAM_SPATIAL_AUDIO:
+    case PAL_STREAM_COMPRESSED:
+    case PAL_STREAM_PCM_OFFLOAD:
+        break;
+    default:
+        return false;
+    }
+
+    return std::chrono::steady_clock::now() - volumeAppliedAt_ <
+           std::chrono::milliseconds(VOLUME_COALESCE_WINDOW_MS);
+}
+
+int StreamOutPrimary::ApplyVolume() {
+    int ret = 0;
+
+    /* without a session the cached volume goes out at the next open */
+    volumePending_ = false;
+    if (!pal_stream_handle_ || !volume_)
+        return 0;
+
+    ret = pal_stream_set_volume(pal_stream_handle_, volume_);
+    if (ret)
+        AHAL_ERR("Pal Stream volume Error (%x)", ret);
+    volumeAppliedAt_ = std::chrono::steady_clock::now();
+    return ret;
+}
+
+/*
+ * One timer thread serves the coalesced volume of every offload stream. It
+ * flushes under its own lock, which a closing stream takes to leave the
+ * schedule, so a stream is never flushed after it went away. Streams are
+ * locked after the timer, never the other way round. A stream keeps its
+ * entry until it closes, idle at time_point::max(), so later volume
+ * changes do not allocate.
+ */
+struct VolumeFlushTimer {
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::thread thread;
+    std::map<StreamOutPrimary *, std::chrono::steady_clock::time_point> due;
+    bool exit = false;
+
+    static constexpr std::chrono::steady_clock::time_point kIdle =
+            std::chrono::steady_clock::time_point::max();
+
+    ~VolumeFlushTimer() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            exit = true;
+        }
+        cv.notify_all();
+        if (thread.joinable())
+            thread.join();
+    }
+};
+
+static VolumeFlushTimer volumeTimer;
+
+void StreamOutPrimary::VolumeTimerLoop() {
+    std::chrono::steady_clock::time_point now;
+
+    ThreadPolicy::Apply(AHAL_THREAD_TIMER);
+    std::unique_lock<std::mutex> lock(volumeTimer.mutex);
+
+    while (!volumeTimer.exit) {
+        auto next = std::min_element(volumeTimer.due.begin(), volumeTimer.due.end(),
+                [](const auto& a, const auto& b) { return a.second < b.second; });
+        if (next == volumeTimer.due.end() || next->second == VolumeFlushTimer::kIdle) {
+            volumeTimer.cv.wait(lock);
+            continue;
+        }
+        now = std::chrono::steady_clock::now();
+        if (now < next->second) {
+            volumeTimer.cv.wait_until(lock, next->second);
+            continue;
+        }
+        ThreadPolicy::RecordWakeup(AHAL_THREAD_TIMER,
+                std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        now - next->second).count());
+
+        StreamOutPrimary *out = next->first;
+        out->stream_mutex_.lock();
+        out->FlushPendingVolume();
+        /* a change applied meanwhile restarted the window */
+        next->second = out->volumePending_ ?
+                out->volumeAppliedAt_ + std::chrono::milliseconds(VOLUME_COALESCE_WINDOW_MS) :
+                VolumeFlushTimer::kIdle;
+        out->stream_mutex_.unlock();
+    }
+}
+
+bool StreamOutPrimary::ScheduleVolumeFlush(std::chrono::steady_clock::time_point when) {
+    std::lock_guard<std::mutex> lock(volumeTimer.mutex);
+
+    if (!volumeTimer.thread.joinable()) {
+        try {
+            volumeTimer.thread = std::thread(&StreamOutPrimary::VolumeTimerLoop);
+        } catch (const std::exception& e) {
+            return false;
+        }
+    }
+    volumeTimer.due[this] = when;
+    volumeTimer.cv.notify_all();
+    return true;
+}
+
+void StreamOutPrimary::FlushPendingVolume() {
+    if (!volumePending_)
+        return;
+    if (std::chrono::steady_clock::now() - volumeAppliedAt_ <
+        std::chrono::milliseconds(VOLUME_COALESCE_WINDOW_MS))
+        return;
+    ApplyVolume();
+}
+
 int StreamOutPrimary::SetVolume(float left , float right) {
     int ret = 0;
+    bool scheduleFlush = false;
+    std::chrono::steady_clock::time_point flushAt;
 
     AHAL_DBG("Enter: left %f, right %f for usecase(%d: %s)", left, right, GetUseCase(), use_case_table[GetUseCase()]);
 
+    AHAL_TRACE(AHAL_EVT_OUT_VOLUME, handle_, (int32_t)(left * 1000), (int32_t)(right * 1000));
     stream_mutex_.lock();
-    /* free previously cached volume if any */
-    if (volume_) {
-        free(volume_);
-        volume_ = NULL;
+    if (volume_ && left == volumeLeft_ && right == volumeRight_) {
+        AHAL_VERBOSE("volume unchanged");
+        goto done;
     }
+    volumeLeft_ = left;
+    volumeRight_ = right;
+    counters_.Set(STREAM_COUNTER_VOLUME, (int64_t)(left * 1000));
+
+    /* volume is cached in place, no allocation on the volume ramp path */
+    volume_ = (struct pal_volume_data *)volume_buf_;
+    memset(volume_buf_, 0, sizeof(volume_buf_));
 
     if (audio_channel_count_from_out_mask(config_.channel_mask) == 1) {
-        volume_ = (struct pal_volume_data *)calloc(1, sizeof(struct pal_volume_data)
-                +sizeof(struct pal_channel_vol_kv));
-        if (!volume_) {
-            AHAL_ERR("Failed to allocate mem for volume_");
-            ret = -ENOMEM;
-            goto done;
-        }
         volume_->no_of_volpair = 1;
         volume_->volume_pair[0].channel_mask = 0x03;
 
@@ -2629,13 +2883,6 @@ int StreamOutPrimary::SetVolume(float left , float right) {
         else
             volume_->volume_pair[0].vol = (left + right)/2.0;
     } else {
-        volume_ = (struct pal_volume_data *)calloc(1, sizeof(struct pal_volume_data)
-                    +sizeof(struct pal_channel_vol_kv) * 2);
-        if (!volume_) {
-            AHAL_ERR("Failed to allocate mem for volume_");
-            ret = -ENOMEM;
-            goto done;
-        }
         volume_->no_of_volpair = 2;
         volume_->volume_pair[0].channel_mask = 0x01;
         volume_->volume_pair[0].vol = left;
@@ -2644,15 +2891,36 @@ int StreamOutPrimary::SetVolume(float left , float right) {
     }
 
     /* if stream is not opened already cache the volume and set on open */
-    if (pal_stream_handle_) {
-        ret = pal_stream_set_volume(pal_stream_handle_, volume_);
-        if (ret) {
-            AHAL_ERR("Pal Stream volume Error (%x)", ret);
+    if (!pal_stream_handle_)
+        goto done;
+
+    /* software volume keeps PAL at unity and ramps in write() */
+    if (swVolume_) {
+        volumeRamp_.SetTarget(left, right);
+        goto done;
+    }
+
+    if (CanCoalesceVolume()) {
+        volumePending_ = true;
+        if (CheckOffloadEffectsType(streamAttributes_.type)) {
+            flushAt = volumeAppliedAt_ + std::chrono::milliseconds(VOLUME_COALESCE_WINDOW_MS);
+            scheduleFlush = true;
         }
+        goto done;
     }
 
+    ret = ApplyVolume();
+
 done:
     stream_mutex_.unlock();
+    /* the timer locks streams after itself, so it is kicked unlocked */
+    if (scheduleFlush && !ScheduleVolumeFlush(flushAt)) {
+        AHAL_WARN("no volume timer, send now");
+        stream_mutex_.lock();
+        if (volumePending_)
+            ret = ApplyVolume();
+        stream_mutex_.unlock();
+    }
     AHAL_DBG("Exit ret: %d", ret);
     return ret;
 }
@@ -2865,8 +3133,11 @@ bool StreamOutPrimary:: period_size_is_plausible_for_low_latency(int period_size
 uint32_t StreamOutPrimary::GetBufferSizeForLowLatency() {
     int trial = 0;
     char value[PROPERTY_VALUE_MAX] = {0};
-    int configured_low_latency_period_size = LOW_LATENCY_PLAYBACK_PERIOD_SIZE;
+    int configured_low_latency_period_size =
+        BufferPolicy::PeriodSize(USECASE_AUDIO_PLAYBACK_LOW_LATENCY,
+                                 LOW_LATENCY_PLAYBACK_PERIOD_SIZE);
 
+    /* the property still wins over the platform policy */
     if (property_get("vendor.audio_hal.period_size", value, NULL) > 0) {
         trial = atoi(value);
         if (period_size_is_plausible_for_low_latency(trial))
@@ -2901,12 +3172,14 @@ uint32_t StreamOutPrimary::GetBufferSize() {
                     audio_channel_count_from_out_mask(config_.channel_mask),
                     config_.format);
     } else if (streamAttributes_.type == PAL_STREAM_DEEP_BUFFER) {
-        return DEEP_BUFFER_PLAYBACK_PERIOD_SIZE *
+        return BufferPolicy::PeriodSize(USECASE_AUDIO_PLAYBACK_DEEP_BUFFER,
+                                        DEEP_BUFFER_PLAYBACK_PERIOD_SIZE) *
             audio_bytes_per_frame(
                     audio_channel_count_from_out_mask(config_.channel_mask),
                     config_.format);
     } else if (streamAttributes_.type == PAL_STREAM_SPATIAL_AUDIO) {
-        return SPATIAL_PLAYBACK_PERIOD_SIZE *
+        return BufferPolicy::PeriodSize(USECASE_AUDIO_PLAYBACK_SPATIAL,
+                                        SPATIAL_PLAYBACK_PERIOD_SIZE) *
             audio_bytes_per_frame(
                     audio_channel_count_from_out_mask(config_.channel_mask),
                     config_.format);
@@ -2923,9 +3196,7 @@ int StreamOutPrimary::Open() {
     uint32_t outBufCount = NO_OF_BUF;
     struct pal_buffer_config outBufCfg = {0, 0, 0};
 
-    pal_param_device_capability_t *device_cap_query = NULL;
-    size_t payload_size = 0;
-    dynamic_media_config_t dynamic_media_config;
+    usb_dev_cap_t usb_cap;
     std::shared_ptr<AudioDevice> adevice = AudioDevice::GetInstance();
 
     bool isHifiFilterEnabled = false;
@@ -2935,6 +3206,7 @@ int StreamOutPrimary::Open() {
     pal_param_bta2dp_t *param_bt_a2dp_ptr = nullptr;
     size_t bt_param_size = 0;
 
+    AHAL_TRACE(AHAL_EVT_OUT_OPEN, handle_, usecase_);
     AHAL_INFO("Enter: OutPrimary usecase(%d: %s)", GetUseCase(), use_case_table[GetUseCase()]);
 
     if (!mInitialized) {
@@ -3037,18 +3309,11 @@ int StreamOutPrimary::Open() {
                 sizeof(mPalOutDevice->custom_config.custom_key));
     }
 
-    device_cap_query = (pal_param_device_capability_t *)malloc(sizeof(pal_param_device_capability_t));
-
     if ((mPalOutDevice->id == PAL_DEVICE_OUT_USB_DEVICE || mPalOutDevice->id ==
-        PAL_DEVICE_OUT_USB_HEADSET) && device_cap_query && adevice) {
+        PAL_DEVICE_OUT_USB_HEADSET) && adevice) {
 
-        device_cap_query->id = mPalOutDevice->id;
-        device_cap_query->addr.card_id = adevice->usb_card_id_;
-        device_cap_query->addr.device_num = adevice->usb_dev_num_;
-        device_cap_query->config = &dynamic_media_config;
-        device_cap_query->is_playback = true;
-        ret = pal_get_param(PAL_PARAM_ID_DEVICE_CAPABILITY,(void **)&device_cap_query,
-                &payload_size, nullptr);
+        ret = adevice->GetUsbCapability(adevice->usb_card_id_,
+                adevice->usb_dev_num_, true, &usb_cap);
 
         if (ret<0) {
             AHAL_DBG("Error usb device is not connected");
@@ -3108,14 +3373,47 @@ int StreamOutPrimary::Open() {
         ret = -EINVAL;
         goto error_open;
     }
+    StreamCounters::PalSessionOpened();
+
+    /*
+     * Software volume is opt-in and only for PCM written through the HAL,
+     * offload is scaled by the DSP and mmap never goes through write().
+     */
+    swVolume_ = false;
+    if (property_get_bool("vendor.audio.volume.sw_ramp", false) &&
+        !CheckOffloadEffectsType(streamAttributes_.type) &&
+        !(flags_ & AUDIO_OUTPUT_FLAG_MMAP_NOIRQ) &&
+        usecase_ != USECASE_AUDIO_PLAYBACK_WITH_HAPTICS &&
+        !volumeRamp_.Configure(halInputFormat,
+                               audio_channel_count_from_out_mask(config_.channel_mask),
+                               config_.sample_rate,
+                               property_get_int32("vendor.audio.volume.ramp_ms",
+                                                  VOLUME_RAMP_DEFAULT_MS)))
+        swVolume_ = true;
+
+    if (swVolume_)
+        volumeRampBuf_.resize(StreamOutPrimary::GetBufferSize());
 
     /* set cached volume if any, dont return failure back up */
-    if (volume_) {
-        AHAL_DBG("set cached volume (%f)", volume_->volume_pair[0].vol);
-        ret = pal_stream_set_volume(pal_stream_handle_, volume_);
+    if (swVolume_) {
+        alignas(struct pal_volume_data) uint8_t buf[sizeof(volume_buf_)] = {0};
+        struct pal_volume_data *unity = (struct pal_volume_data *)buf;
+
+        /* the first buffer after open starts at the cached volume */
+        volumeRamp_.Reset(volume_ ? volumeLeft_ : 1.0f,
+                          volume_ ? volumeRight_ : 1.0f);
+        unity->no_of_volpair = 1;
+        unity->volume_pair[0].channel_mask = 0x03;
+        unity->volume_pair[0].vol = 1.0f;
+        ret = pal_stream_set_volume(pal_stream_handle_, unity);
         if (ret) {
             AHAL_ERR("Pal Stream volume Error (%x)", ret);
         }
+    } else {
+        if (volume_) {
+            AHAL_DBG("set cached volume (%f)", volume_->volume_pair[0].vol);
+            ret = ApplyVolume();
+        }
     }
 
     if (usecase_ == USECASE_AUDIO_PLAYBACK_WITH_HAPTICS) {
@@ -3153,6 +3451,8 @@ int StreamOutPrimary::Open() {
                                    &pal_haptics_stream_handle);
             if (ret)
                 AHAL_ERR("Pal Haptics Stream Open Error (%x)", ret);
+            else
+                StreamCounters::PalSessionOpened();
         } else {
             AHAL_ERR("Failed to allocate memory for hapticsDevice");
         }
@@ -3225,6 +3525,10 @@ int StreamOutPrimary::Open() {
         outBufCount = VOIP_PERIOD_COUNT_DEFAULT;
     else if (usecase_ == USECASE_AUDIO_PLAYBACK_SPATIAL)
         outBufCount = SPATIAL_PLAYBACK_PERIOD_COUNT;
+    /* in call music keeps its own count, the policy is for media playback */
+    if (streamAttributes_.type != PAL_STREAM_VOICE_CALL_MUSIC)
+        outBufCount = BufferPolicy::PeriodCount((audio_usecase_t)usecase_, mAndroidOutDevices,
+                                                outBufCount);
 
     if (halInputFormat != halOutputFormat) {
         convertBuffer = realloc(convertBuffer, outBufSize);
@@ -3265,10 +3569,6 @@ int StreamOutPrimary::Open() {
     }
 
 error_open:
-    if (device_cap_query) {
-        free(device_cap_query);
-        device_cap_query = NULL;
-    }
     AHAL_DBG("Exit ret: %d", ret);
     return ret;
 }
@@ -3452,7 +3752,7 @@ ssize_t StreamOutPrimary::onWriteError(size_t bytes, ssize_t ret) {
 ssize_t StreamOutPrimary::configurePalOutputStream() {
     ssize_t ret = 0;
     if (!pal_stream_handle_) {
-        AutoPerfLock perfLock;
+        AutoPerfLock perfLock(usecase_, PERF_LOCK_OP_OPEN);
         ATRACE_BEGIN("hal:open_output");
         ret = Open();
         ATRACE_END();
@@ -3463,19 +3763,21 @@ ssize_t StreamOutPrimary::configurePalOutputStream() {
     }
 
     if (!stream_started_) {
-        AutoPerfLock perfLock;
+        AutoPerfLock perfLock(usecase_, PERF_LOCK_OP_START);
 
         ATRACE_BEGIN("hal: pal_stream_start");
         ret = pal_stream_start(pal_stream_handle_);
         if (ret) {
             AHAL_ERR("failed to start stream. ret=%d", ret);
             pal_stream_close(pal_stream_handle_);
+            StreamCounters::PalSessionClosed();
             pal_stream_handle_ = NULL;
             ATRACE_END();
             if (usecase_ == USECASE_AUDIO_PLAYBACK_WITH_HAPTICS &&
                 pal_haptics_stream_handle) {
                 AHAL_DBG("Close haptics stream");
                 pal_stream_close(pal_haptics_stream_handle);
+                StreamCounters::PalSessionClosed();
                 pal_haptics_stream_handle = NULL;
             }
             return -EINVAL;
@@ -3492,6 +3794,7 @@ ssize_t StreamOutPrimary::configurePalOutputStream() {
                 AHAL_ERR("failed to start haptics stream. ret=%d", ret);
                 ATRACE_END();
                 pal_stream_close(pal_haptics_stream_handle);
+                StreamCounters::PalSessionClosed();
                 pal_haptics_stream_handle = NULL;
                 return -EINVAL;
             }
@@ -3584,7 +3887,9 @@ ssize_t StreamOutPrimary::write(const void *buffer, size_t bytes)
     uint32_t byteWidth = 0;
     uint32_t sampleRate = 0;
     uint32_t channelCount = 0;
+    uint64_t counters_start = StreamCounters::Enabled() ? StreamCounters::Now() : 0;
 
+    AHAL_TRACE(AHAL_EVT_OUT_WRITE, handle_, (int32_t)bytes);
     AHAL_VERBOSE("handle_ %x bytes:(%zu)", handle_, bytes);
 
     stream_mutex_.lock();
@@ -3592,6 +3897,38 @@ ssize_t StreamOutPrimary::write(const void *buffer, size_t bytes)
     if (ret < 0)
         goto exit;
 
+    FlushPendingVolume();
+    if (swVolume_ && !volumeRamp_.IsBypass()) {
+        size_t frame_size = audio_bytes_per_frame(
+                audio_channel_count_from_out_mask(config_.channel_mask),
+                halInputFormat);
+
+        if (frame_size) {
+            /* sized at open, the framework writes what does not fit next */
+            if (bytes > volumeRampBuf_.size()) {
+                bytes = volumeRampBuf_.size() / frame_size * frame_size;
+                palBuffer.size = bytes;
+            }
+            volumeRamp_.Process(buffer, volumeRampBuf_.data(), bytes / frame_size);
+            buffer = volumeRampBuf_.data();
+            palBuffer.buffer = (uint8_t *)buffer;
+        }
+    }
+
+    if (LatencyProbe::Active() && halInputFormat == AUDIO_FORMAT_PCM_16_BIT &&
+        LatencyProbe::WantsWrite(this)) {
+        uint32_t channels = audio_channel_count_from_out_mask(config_.channel_mask);
+
+        /* the burst goes into a copy, the client's buffer is const */
+        if (probeBuf_.size() < bytes)
+            probeBuf_.resize(bytes);
+        memcpy(probeBuf_.data(), buffer, bytes);
+        LatencyProbe::OnWrite(this, usecase_, mAndroidOutDevices, (int16_t *)probeBuf_.data(),
+                              bytes / (channels * sizeof(int16_t)), channels);
+        buffer = probeBuf_.data();
+        palBuffer.buffer = (uint8_t *)buffer;
+    }
+
     /* If reconfiguration has not finished before ringtone stream
      * start on combo device with BLE, we are not sending write to PAL,
      * instead we are sleeping here for pcm data duration and returning
@@ -3609,7 +3946,7 @@ ssize_t StreamOutPrimary::write(const void *buffer, size_t bytes)
 
         if (is_usage_ringtone && isDeviceAvailable(PAL_DEVICE_OUT_BLUETOOTH_BLE)) {
             bt_param_size = 0;
-            std::unique_lock<std::mutex> guard(reconfig_wait_mutex_);
+            std::unique_lock<AudioMutex> guard(reconfig_wait_mutex_);
 
             pal_param_bta2dp_t param_bt_a2dp;
             param_bt_a2dp_ptr = &param_bt_a2dp;
@@ -3674,12 +4011,56 @@ exit:
     } else {
         mBytesWritten = UINT64_MAX;
     }
+    if (counters_start && ret >= 0)
+        UpdateWriteCounters(bytes, counters_start);
     stream_mutex_.unlock();
     clock_gettime(CLOCK_MONOTONIC, &writeAt);
 
     return (ret < 0 ? onWriteError(bytes, ret) : ret);
 }
 
+/*
+ * The fill level is what was written since the session started minus the
+ * DSP position. A buffer that finds less than itself queued ahead of the DSP
+ * arrived after the DSP ran dry, which is counted as an xrun; this is an
+ * estimate, PAL does not report underruns to the HAL.
+ */
+void StreamOutPrimary::UpdateWriteCounters(size_t bytes, uint64_t start_ns) {
+    size_t frame_size = audio_bytes_per_frame(
+            audio_channel_count_from_out_mask(config_.channel_mask), config_.format);
+    pal_session_time tstamp;
+    uint64_t written_frames;
+    uint64_t dsp_frames;
+    int64_t fill;
+
+    counters_.Set(STREAM_COUNTER_IO_US, (StreamCounters::Now() - start_ns) / 1000);
+    if (!frame_size)
+        return;
+    counters_.Set(STREAM_COUNTER_FRAMES, mBytesWritten / frame_size);
+
+    /* compressed and mmap positions are not in frames of this stream */
+    if (!pal_stream_handle_ || !stream_started_ || !audio_is_linear_pcm(config_.format) ||
+        usecase_ == USECASE_AUDIO_PLAYBACK_MMAP)
+        return;
+    if (pal_get_timestamp(pal_stream_handle_, &tstamp))
+        return;
+
+    dsp_frames = (uint64_t)tstamp.session_time.value_msw << 32 | tstamp.session_time.value_lsw;
+    dsp_frames = dsp_frames / 1000 * streamAttributes_.out_media_config.sample_rate / 1000;
+    written_frames = (mBytesWritten - mSessionBaseBytes) / frame_size;
+    fill = (int64_t)written_frames - (int64_t)dsp_frames;
+
+    /* nothing is counted until the DSP has started to consume */
+    if (counters_.last_dsp_frames_) {
+        if (dsp_frames >= counters_.last_dsp_frames_)
+            counters_.Set(STREAM_COUNTER_DSP_DELTA, dsp_frames - counters_.last_dsp_frames_);
+        if (fill < (int64_t)(bytes / frame_size))
+            counters_.Set(STREAM_COUNTER_XRUNS, ++counters_.xruns_);
+    }
+    counters_.last_dsp_frames_ = dsp_frames;
+    counters_.Set(STREAM_COUNTER_FILL, fill);
+}
+
 bool StreamOutPrimary::CheckOffloadEffectsType(pal_stream_type_t pal_stream_type) {
     if (pal_stream_type == PAL_STREAM_COMPRESSED  ||
         pal_stream_type == PAL_STREAM_PCM_OFFLOAD) {
@@ -3689,10 +4070,23 @@ bool StreamOutPrimary::CheckOffloadEffectsType(pal_stream_type_t pal_stream_type
     return false;
 }
 
+/* effect libraries are loaded by the first offload stream to start */
+void StreamOutPrimary::LoadOffloadEffectFns() {
+    if (fnp_offload_effect_start_output_ && fnp_visualizer_start_output_)
+        return;
+
+    AudioDevice::GetInstance()->GetEffectLibFns(&fnp_offload_effect_start_output_,
+                                                &fnp_offload_effect_stop_output_,
+                                                &fnp_visualizer_start_output_,
+                                                &fnp_visualizer_stop_output_);
+}
+
 int StreamOutPrimary::StartOffloadEffects(
                                     audio_io_handle_t ioHandle,
                                     pal_stream_handle_t* pal_stream_handle) {
     int ret  = 0;
+
+    LoadOffloadEffectFns();
     if (fnp_offload_effect_start_output_) {
         ret = fnp_offload_effect_start_output_(ioHandle, pal_stream_handle);
         if (ret) {
@@ -3728,6 +4122,8 @@ int StreamOutPrimary::StartOffloadVisualizer(
                                     audio_io_handle_t ioHandle,
                                     pal_stream_handle_t* pal_stream_handle) {
     int ret  = 0;
+
+    LoadOffloadEffectFns();
     if (fnp_visualizer_start_output_) {
         ret = fnp_visualizer_start_output_(ioHandle, pal_stream_handle);
         if (ret) {
@@ -3758,53 +4154,50 @@ int StreamOutPrimary::StopOffloadVisualizer(
     return ret;
 }
 
-int StreamOutPrimary::SetAggregateSourceMetadata(bool voice_active) {
-    ssize_t track_count_total = 0;
-    std::vector<playback_track_metadata_t> total_tracks;
+static int send_source_metadata(const std::vector<MetadataAggregator::track_key_t>& keys) {
+    std::vector<playback_track_metadata_t> tracks(keys.size());
     source_metadata_t btSourceMetadata;
-    int32_t ret = 0;
 
-    std::shared_ptr<AudioDevice> adevice = AudioDevice::GetInstance();
+    for (size_t i = 0; i < keys.size(); i++) {
+        tracks[i].usage = (audio_usage_t)keys[i].first;
+        tracks[i].content_type = (audio_content_type_t)keys[i].second;
+        AHAL_DBG("Aggregated Source metadata usage:%d content_type:%d",
+            tracks[i].usage, tracks[i].content_type);
+    }
+    btSourceMetadata.track_count = tracks.size();
+    btSourceMetadata.tracks = tracks.data();
+
+    // pass the metadata to PAL
+    return pal_set_param(PAL_PARAM_ID_SET_SOURCE_METADATA,
+        (void*)&btSourceMetadata, 0);
+}
+
+static MetadataAggregator sourceMetadataAggregator("source", send_source_metadata);
+
+/*
+ * Only this stream's tracks are folded into the aggregate, PAL is updated
+ * when the aggregate of all stream o/ps actually changes.
+ */
+int StreamOutPrimary::SetAggregateSourceMetadata(bool voice_active) {
+    std::vector<MetadataAggregator::track_key_t> tracks;
+
+    for (ssize_t i = 0; i < btSourceMetadata.track_count; i++)
+        tracks.push_back({btSourceMetadata.tracks[i].usage,
+                          btSourceMetadata.tracks[i].content_type});
 
     /* During an active voice call, if new media/game session is launched APM sends
      * source metadata to AHAL, in that case don't send it
      * to BT as it may be misinterpreted as reconfig.
      */
-    if (!voice_active) {
-        //Get stream o/p list
-        std::vector<std::shared_ptr<StreamOutPrimary>> astream_out_list = adevice->OutGetBLEStreamOutputs();
-        for (int i = 0; i < astream_out_list.size(); i++) {
-            //total tracks on stream o/ps
-            track_count_total += astream_out_list[i]->btSourceMetadata.track_count;
-        }
-
-        total_tracks.resize(track_count_total);
-        btSourceMetadata.track_count = track_count_total;
-        btSourceMetadata.tracks = total_tracks.data();
-
-        //Get the metadata of all tracks on different stream o/ps
-        for (int i = 0; i < astream_out_list.size(); i++) {
-            struct playback_track_metadata* track = astream_out_list[i]->btSourceMetadata.tracks;
-            ssize_t track_count = astream_out_list[i]->btSourceMetadata.track_count;
-            while (track_count && track) {
-                btSourceMetadata.tracks->usage = track->usage;
-                btSourceMetadata.tracks->content_type = track->content_type;
-                AHAL_DBG("Aggregated Source metadata usage:%d content_type:%d",
-                    btSourceMetadata.tracks->usage,
-                    btSourceMetadata.tracks->content_type);
-                --track_count;
-                ++track;
-                ++btSourceMetadata.tracks;
-            }
-        }
-        btSourceMetadata.tracks = total_tracks.data();
+    return sourceMetadataAggregator.Update(this, tracks, !voice_active);
+}
 
-        // pass the metadata to PAL
-        ret = pal_set_param(PAL_PARAM_ID_SET_SOURCE_METADATA,
-            (void*)&btSourceMetadata, 0);
-    }
+int StreamOutPrimary::FlushAggregateSourceMetadata() {
+    return sourceMetadataAggregator.Flush();
+}
 
-    return ret;
+void StreamOutPrimary::CancelAggregateSourceMetadata() {
+    sourceMetadataAggregator.CancelPending();
 }
 
 StreamOutPrimary::StreamOutPrimary(
@@ -3824,6 +4217,7 @@ StreamOutPrimary::StreamOutPrimary(
 {
     stream_ = std::shared_ptr<audio_stream_out> (new audio_stream_out());
     std::shared_ptr<AudioDevice> adevice = AudioDevice::GetInstance();
+    counters_.Init(true, handle);
     mInitialized = false;
     pal_stream_handle_ = nullptr;
     pal_haptics_stream_handle = nullptr;
@@ -3866,15 +4260,16 @@ StreamOutPrimary::StreamOutPrimary(
             AHAL_ERR("Failed to allocate mem for dynamic_media_config");
             goto error;
         }
-        size_t payload_size = 0;
+        usb_dev_cap_t usb_cap;
         device_cap_query_->id = PAL_DEVICE_OUT_USB_DEVICE;
         device_cap_query_->addr.card_id = adevice->usb_card_id_;
         device_cap_query_->addr.device_num = adevice->usb_dev_num_;
         device_cap_query_->config = dynamic_media_config;
         device_cap_query_->is_playback = true;
-        ret = pal_get_param(PAL_PARAM_ID_DEVICE_CAPABILITY,
-                            (void **)&device_cap_query_,
-                            &payload_size, nullptr);
+        ret = adevice->GetUsbCapability(adevice->usb_card_id_,
+                adevice->usb_dev_num_, true, &usb_cap);
+        if (!ret)
+            memcpy(dynamic_media_config, &usb_cap.config, sizeof(dynamic_media_config_t));
         if (ret < 0) {
             AHAL_ERR("Error usb device is not connected");
             free(dynamic_media_config);
@@ -3884,9 +4279,9 @@ StreamOutPrimary::StreamOutPrimary(
         }
         if (!config->sample_rate || !config->format || !config->channel_mask) {
             if (dynamic_media_config) {
-                config->sample_rate = dynamic_media_config->sample_rate[0];
-                config->channel_mask = (audio_channel_mask_t) dynamic_media_config->mask[0];
-                config->format = (audio_format_t)dynamic_media_config->format[0];
+                config->sample_rate = usb_cap.sample_rate;
+                config->channel_mask = usb_cap.channel_mask;
+                config->format = usb_cap.format;
             }
             if (config->sample_rate == 0)
                 config->sample_rate = DEFAULT_OUTPUT_SAMPLING_RATE;
@@ -3935,7 +4330,8 @@ StreamOutPrimary::StreamOutPrimary(
         mAndroidOutDevices.insert(AUDIO_DEVICE_OUT_DEFAULT);
     AHAL_DBG("No of Android devices %zu", mAndroidOutDevices.size());
 
-    mPalOutDeviceIds = (pal_device_id_t*) calloc(mAndroidOutDevices.size(), sizeof(pal_device_id_t));
+    mPalOutDeviceCap = std::max(mAndroidOutDevices.size(), (size_t)STREAM_PAL_DEVICE_CAPACITY);
+    mPalOutDeviceIds = (pal_device_id_t*) calloc(mPalOutDeviceCap, sizeof(pal_device_id_t));
     if (!mPalOutDeviceIds) {
            goto error;
     }
@@ -3946,7 +4342,7 @@ StreamOutPrimary::StreamOutPrimary(
         goto error;
     }
 
-    mPalOutDevice = (struct pal_device*) calloc(mAndroidOutDevices.size(), sizeof(struct pal_device));
+    mPalOutDevice = (struct pal_device*) calloc(mPalOutDeviceCap, sizeof(struct pal_device));
     if (!mPalOutDevice) {
         goto error;
     }
@@ -4016,6 +4412,12 @@ error:
 }
 
 StreamOutPrimary::~StreamOutPrimary() {
+    sourceMetadataAggregator.Remove(this);
+    {
+        /* waits out a flush of this stream in progress */
+        std::lock_guard<std::mutex> lock(volumeTimer.mutex);
+        volumeTimer.due.erase(this);
+    }
     AHAL_DBG("close stream, handle(%x), pal_stream_handle (%p)",
           handle_, pal_stream_handle_);
 
@@ -4027,11 +4429,13 @@ StreamOutPrimary::~StreamOutPrimary() {
         }
 
         pal_stream_close(pal_stream_handle_);
+        StreamCounters::PalSessionClosed();
         pal_stream_handle_ = nullptr;
     }
 
     if (pal_haptics_stream_handle) {
         pal_stream_close(pal_haptics_stream_handle);
+        StreamCounters::PalSessionClosed();
         pal_haptics_stream_handle = NULL;
         if (hapticBuffer) {
             free (hapticBuffer);
@@ -4094,8 +4498,11 @@ int StreamInPrimary::Stop() {
             pal_stream_handle_ && stream_started_) {
 
         ret = pal_stream_stop(pal_stream_handle_);
-        if (ret == 0)
+        if (ret == 0) {
             stream_started_ = false;
+            mmapPosition_.LogStats("mmap capture");
+            mmapPosition_.Reset();
+        }
     }
     stream_mutex_.unlock();
     return ret;
@@ -4109,6 +4516,7 @@ int StreamInPrimary::Start() {
     if (usecase_ == USECASE_AUDIO_RECORD_MMAP &&
             pal_stream_handle_ && !stream_started_) {
 
+        mmapPosition_.Reset();
         ret = pal_stream_start(pal_stream_handle_);
         if (ret == 0)
             stream_started_ = true;
@@ -4152,6 +4560,9 @@ int StreamInPrimary::CreateMmapBuffer(int32_t min_size_frames,
     info->burst_size_frames = palMmapBuf.burst_size_frames;
     info->flags = (audio_mmap_buffer_flag)palMmapBuf.flags;
     mmap_shared_memory_fd = info->shared_memory_fd;
+    mmapPosition_.Configure(false, config_.sample_rate,
+            audio_bytes_per_frame(audio_channel_count_from_in_mask(config_.channel_mask),
+                                  config_.format), info);
 
     stream_mutex_.unlock();
     return ret;
@@ -4177,15 +4588,40 @@ int StreamInPrimary::GetMmapPosition(struct audio_mmap_position *position)
     }
     position->position_frames = pal_mmap_pos.position_frames;
     position->time_nanoseconds = pal_mmap_pos.time_nanoseconds;
+    mmapPosition_.Update(position);
 
     stream_mutex_.unlock();
     return 0;
 }
 
+/* capture is reopened here and started by the next read, which also
+ * brings back effects and mic mute */
+int StreamInPrimary::Recover() {
+    int ret = 0;
+
+    AHAL_DBG("Enter: usecase(%d: %s)", GetUseCase(), use_case_table[GetUseCase()]);
+    ret = Standby();
+    if (ret)
+        AHAL_ERR("standby failed %d", ret);
+
+    if (is_st_session || (flags_ & AUDIO_INPUT_FLAG_MMAP_NOIRQ))
+        goto exit;
+
+    stream_mutex_.lock();
+    if (!pal_stream_handle_ && !closed_)
+        ret = Open();
+    stream_mutex_.unlock();
+
+exit:
+    AHAL_DBG("Exit ret: %d", ret);
+    return ret;
+}
+
 int StreamInPrimary::Standby() {
     int ret = 0;
     std::shared_ptr<AudioDevice> adevice = AudioDevice::GetInstance();
 
+    AHAL_TRACE(AHAL_EVT_IN_STANDBY, handle_);
     AHAL_DBG("Enter");
     stream_mutex_.lock();
     if (pal_stream_handle_) {
@@ -4201,9 +4637,15 @@ int StreamInPrimary::Standby() {
     }
     effects_applied_ = true;
     stream_started_ = false;
+    counters_.Reset();
+    if (usecase_ == USECASE_AUDIO_RECORD_MMAP) {
+        mmapPosition_.LogStats("mmap capture");
+        mmapPosition_.Reset();
+    }
 
     if (pal_stream_handle_ && !is_st_session) {
         ret = pal_stream_close(pal_stream_handle_);
+        StreamCounters::PalSessionClosed();
         pal_stream_handle_ = NULL;
     }
 
@@ -4314,32 +4756,28 @@ exit:
        effects_applied_ = false;
     } else
        effects_applied_ = true;
+    counters_.Set(STREAM_COUNTER_EFFECTS, (int)isECEnabled + (int)isNSEnabled);
 
     return 0;
 }
 
 
 int StreamInPrimary::SetGain(float gain) {
-    struct pal_volume_data* volume;
+    alignas(struct pal_volume_data) uint8_t volume_buf[sizeof(struct pal_volume_data) +
+            sizeof(struct pal_channel_vol_kv)];
+    struct pal_volume_data* volume = (struct pal_volume_data*)volume_buf;
     int ret = 0;
 
     AHAL_DBG("Enter");
     stream_mutex_.lock();
-    volume = (struct pal_volume_data*)malloc(sizeof(uint32_t)
-                +sizeof(struct pal_channel_vol_kv));
-    if (!volume) {
-        AHAL_ERR("Failed to allocate mem for volume");
-        ret = -ENOMEM;
-        goto done;
-    }
     volume->no_of_volpair = 1;
     volume->volume_pair[0].channel_mask = 0x03;
     volume->volume_pair[0].vol = gain;
+    counters_.Set(STREAM_COUNTER_VOLUME, (int64_t)(gain * 1000));
     if (pal_stream_handle_) {
         ret = pal_stream_set_volume(pal_stream_handle_, volume);
     }
 
-    free(volume);
     if (ret) {
         AHAL_ERR("Pal Stream volume Error (%x)", ret);
     }
@@ -4350,50 +4788,48 @@ done:
     return ret;
 }
 
-int StreamInPrimary::SetAggregateSinkMetadata(bool voice_active) {
-    ssize_t track_count_total = 0;
-    std::vector<record_track_metadata_t> total_tracks;
+static int send_sink_metadata(const std::vector<MetadataAggregator::track_key_t>& keys) {
+    std::vector<record_track_metadata_t> tracks(keys.size());
     sink_metadata_t btSinkMetadata;
-    int32_t ret = 0;
 
-    std::shared_ptr<AudioDevice> adevice = AudioDevice::GetInstance();
+    for (size_t i = 0; i < keys.size(); i++) {
+        tracks[i].source = (audio_source_t)keys[i].first;
+        AHAL_DBG("Aggregated Sink metadata source:%d", tracks[i].source);
+    }
+    btSinkMetadata.track_count = tracks.size();
+    btSinkMetadata.tracks = tracks.data();
+
+    // pass the metadata to PAL
+    return pal_set_param(PAL_PARAM_ID_SET_SINK_METADATA,
+        (void*)&btSinkMetadata, 0);
+}
+
+static MetadataAggregator sinkMetadataAggregator("sink", send_sink_metadata);
+
+int StreamInPrimary::SetAggregateSinkMetadata(bool voice_active) {
+    std::vector<MetadataAggregator::track_key_t> tracks;
+
+    for (ssize_t i = 0; i < btSinkMetadata.track_count; i++)
+        tracks.push_back({btSinkMetadata.tracks[i].source, 0});
 
     /* During an active voice call, if new record/vbc session is launched APM sends
      * sink metadata to AHAL, in that case don't send it
      * to BT as it may be misinterpreted as reconfig.
      */
-    if (!voice_active) {
-        //Get stream i/p list
-        std::vector<std::shared_ptr<StreamInPrimary>> astream_in_list = adevice->InGetBLEStreamInputs();
-        for (int i = 0; i < astream_in_list.size(); i++) {
-            //total tracks on stream i/ps
-            track_count_total += astream_in_list[i]->btSinkMetadata.track_count;
-        }
-
-        total_tracks.resize(track_count_total);
-        btSinkMetadata.track_count = track_count_total;
-        btSinkMetadata.tracks = total_tracks.data();
+    return sinkMetadataAggregator.Update(this, tracks, !voice_active);
+}
 
-        //Get the metadata of all tracks on different stream i/ps
-        for (int i = 0; i < astream_in_list.size(); i++) {
-            struct record_track_metadata* track = astream_in_list[i]->btSinkMetadata.tracks;
-            ssize_t track_count = astream_in_list[i]->btSinkMetadata.track_count;
-            while (track_count && track) {
-                btSinkMetadata.tracks->source = track->source;
-                AHAL_DBG("Aggregated Sink metadata source:%d", btSinkMetadata.tracks->source);
-                --track_count;
-                ++track;
-                ++btSinkMetadata.tracks;
-            }
-        }
-        btSinkMetadata.tracks = total_tracks.data();
+int StreamInPrimary::FlushAggregateSinkMetadata() {
+    return sinkMetadataAggregator.Flush();
+}
 
-        // pass the metadata to PAL
-        ret = pal_set_param(PAL_PARAM_ID_SET_SINK_METADATA,
-            (void*)&btSinkMetadata, 0);
-    }
+void StreamInPrimary::CancelAggregateSinkMetadata() {
+    sinkMetadataAggregator.CancelPending();
+}
 
-    return ret;
+std::set<audio_devices_t> StreamInPrimary::GetDevices() {
+    std::lock_guard<AudioMutex> lock(stream_mutex_);
+    return mAndroidInDevices;
 }
 
 int StreamInPrimary::RouteStream(const std::set<audio_devices_t>& new_devices, bool force_device_switch) {
@@ -4402,15 +4838,15 @@ int StreamInPrimary::RouteStream(const std::set<audio_devices_t>& new_devices, b
     bool skipDeviceSet = false;
     pal_device_id_t * deviceId = nullptr;
     struct pal_device* deviceIdConfigs = nullptr;
-    pal_param_device_capability_t *device_cap_query = nullptr;
-    size_t payload_size = 0;
-    dynamic_media_config_t dynamic_media_config;
+    usb_dev_cap_t usb_cap;
     struct pal_channel_info ch_info = {0, {0}};
     std::shared_ptr<AudioDevice> adevice = AudioDevice::GetInstance();
 
     pal_param_bta2dp_t *param_bt_a2dp_ptr = nullptr;
     size_t bt_param_size = 0;
 
+    AHAL_TRACE(AHAL_EVT_IN_ROUTE, handle_, (int32_t)new_devices.size(),
+               new_devices.empty() ? 0 : (int32_t)*new_devices.begin());
     AHAL_INFO("Enter: InPrimary usecase(%d: %s)", GetUseCase(), use_case_table[GetUseCase()]);
 
     stream_mutex_.lock();
@@ -4440,26 +4876,29 @@ int StreamInPrimary::RouteStream(const std::set<audio_devices_t>& new_devices, b
             && ((mAndroidInDevices != new_devices) || force_device_switch)) {
         //re-allocate mPalInDevice and mPalInDeviceIds
         if (new_devices.size() != mAndroidInDevices.size()) {
-            deviceId = (pal_device_id_t*) realloc(mPalInDeviceIds,
-                    new_devices.size() * sizeof(pal_device_id_t));
-            deviceIdConfigs = (struct pal_device*) realloc(mPalInDevice,
-                    new_devices.size() * sizeof(struct pal_device));
-            if (!deviceId || !deviceIdConfigs) {
-                AHAL_ERR("Failed to allocate PalOutDeviceIds or deviceIdConfigs!");
-                if (deviceId)
-                    mPalInDeviceIds = deviceId;
-                if (deviceIdConfigs)
-                    mPalInDevice = deviceIdConfigs;
-                ret = -ENOMEM;
-                goto done;
+            /* only grow past the slots allocated at open */
+            if (new_devices.size() > mPalInDeviceCap) {
+                deviceId = (pal_device_id_t*) realloc(mPalInDeviceIds,
+                        new_devices.size() * sizeof(pal_device_id_t));
+                deviceIdConfigs = (struct pal_device*) realloc(mPalInDevice,
+                        new_devices.size() * sizeof(struct pal_device));
+                if (!deviceId || !deviceIdConfigs) {
+                    AHAL_ERR("Failed to allocate PalOutDeviceIds or deviceIdConfigs!");
+                    if (deviceId)
+                        mPalInDeviceIds = deviceId;
+                    if (deviceIdConfigs)
+                        mPalInDevice = deviceIdConfigs;
+                    ret = -ENOMEM;
+                    goto done;
+                }
+                mPalInDeviceIds = deviceId;
+                mPalInDevice = deviceIdConfigs;
+                mPalInDeviceCap = new_devices.size();
             }
 
             // init deviceId and deviceIdConfigs
-            memset(deviceId, 0, new_devices.size() * sizeof(pal_device_id_t));
-            memset(deviceIdConfigs, 0, new_devices.size() * sizeof(struct pal_device));
-
-            mPalInDeviceIds = deviceId;
-            mPalInDevice = deviceIdConfigs;
+            memset(mPalInDeviceIds, 0, new_devices.size() * sizeof(pal_device_id_t));
+            memset(mPalInDevice, 0, new_devices.size() * sizeof(struct pal_device));
         }
         noPalDevices = getPalDeviceIds(new_devices, mPalInDeviceIds);
         AHAL_DBG("noPalDevices: %d , new_devices: %zu",
@@ -4471,14 +4910,6 @@ int StreamInPrimary::RouteStream(const std::set<audio_devices_t>& new_devices, b
             goto done;
         }
 
-        device_cap_query = (pal_param_device_capability_t *)
-                malloc(sizeof(pal_param_device_capability_t));
-        if (!device_cap_query) {
-                AHAL_ERR("Failed to allocate device_cap_query!");
-                ret = -ENOMEM;
-                goto done;
-        }
-
         for (int i = 0; i < noPalDevices; i++) {
             /*Skip device set for targets that do not support Handset profile for VoIP call*/
             if (noHandsetSupport && (mPalInDevice[i].id == PAL_DEVICE_IN_SPEAKER_MIC &&
@@ -4489,18 +4920,13 @@ int StreamInPrimary::RouteStream(const std::set<audio_devices_t>& new_devices, b
                 AHAL_DBG("Skip pal_stream_set_device as the stream is already on speaker");
             }
             mPalInDevice[i].id = mPalInDeviceIds[i];
-            if (((mPalInDeviceIds[i] == PAL_DEVICE_IN_USB_DEVICE) ||
-               (mPalInDeviceIds[i] == PAL_DEVICE_IN_USB_HEADSET)) && device_cap_query) {
+            if ((mPalInDeviceIds[i] == PAL_DEVICE_IN_USB_DEVICE) ||
+               (mPalInDeviceIds[i] == PAL_DEVICE_IN_USB_HEADSET)) {
 
                 mPalInDevice[i].address.card_id = adevice->usb_card_id_;
                 mPalInDevice[i].address.device_num = adevice->usb_dev_num_;
-                device_cap_query->id = mPalInDeviceIds[i];
-                device_cap_query->addr.card_id = adevice->usb_card_id_;
-                device_cap_query->addr.device_num = adevice->usb_dev_num_;
-                device_cap_query->config = &dynamic_media_config;
-                device_cap_query->is_playback = true;
-                ret = pal_get_param(PAL_PARAM_ID_DEVICE_CAPABILITY,(void **)&device_cap_query,
-                        &payload_size, nullptr);
+                ret = adevice->GetUsbCapability(adevice->usb_card_id_,
+                        adevice->usb_dev_num_, true, &usb_cap);
 
                 if (ret<0) {
                     AHAL_ERR("Error usb device is not connected");
@@ -4564,10 +4990,6 @@ int StreamInPrimary::RouteStream(const std::set<audio_devices_t>& new_devices, b
     }
 
 done:
-    if (device_cap_query) {
-        free(device_cap_query);
-        device_cap_query = NULL;
-    }
     stream_mutex_.unlock();
     AHAL_DBG("exit %d", ret);
     return ret;
@@ -4635,14 +5057,13 @@ int StreamInPrimary::Open() {
     uint32_t inBufCount = NO_OF_BUF;
     struct pal_buffer_config inBufCfg = {0, 0, 0};
     void *handle = nullptr;
-    pal_param_device_capability_t *device_cap_query = NULL;
-    size_t payload_size = 0;
-    dynamic_media_config_t dynamic_media_config;
+    usb_dev_cap_t usb_cap;
     std::shared_ptr<AudioDevice> adevice = AudioDevice::GetInstance();
 
     pal_param_bta2dp_t *param_bt_a2dp_ptr = nullptr;
     size_t bt_param_size = 0;
 
+    AHAL_TRACE(AHAL_EVT_IN_OPEN, handle_, usecase_);
     AHAL_INFO("Enter: InPrimary usecase(%d: %s)", GetUseCase(), use_case_table[GetUseCase()]);
     if (!mInitialized) {
         AHAL_ERR("Not initialized, returning error");
@@ -4772,18 +5193,11 @@ int StreamInPrimary::Open() {
             streamAttributes_.info.opt_stream_info.tx_proxy_type = PAL_STREAM_PROXY_TX_TELEPHONY_RX;
     }
 
-    device_cap_query = (pal_param_device_capability_t *)malloc(sizeof(pal_param_device_capability_t));
-
     if ((mPalInDevice->id == PAL_DEVICE_IN_USB_DEVICE || mPalInDevice->id ==
-        PAL_DEVICE_IN_USB_HEADSET) && device_cap_query && adevice) {
+        PAL_DEVICE_IN_USB_HEADSET) && adevice) {
 
-        device_cap_query->id = mPalInDevice->id;
-        device_cap_query->addr.card_id = adevice->usb_card_id_;
-        device_cap_query->addr.device_num = adevice->usb_dev_num_;
-        device_cap_query->config = &dynamic_media_config;
-        device_cap_query->is_playback = true;
-        ret = pal_get_param(PAL_PARAM_ID_DEVICE_CAPABILITY,(void **)&device_cap_query,
-                &payload_size, nullptr);
+        ret = adevice->GetUsbCapability(adevice->usb_card_id_,
+                adevice->usb_dev_num_, true, &usb_cap);
 
          if (ret<0) {
              AHAL_DBG("Error usb device is not connected");
@@ -4829,6 +5243,7 @@ int StreamInPrimary::Open() {
         ret = -EINVAL;
         goto exit;
     }
+    StreamCounters::PalSessionOpened();
 
     // TODO configure this for any audio format
     //PAL input compressed stream is used only for compress capture 
@@ -4908,6 +5323,8 @@ set_buff_size:
 
     if (usecase_ == USECASE_AUDIO_RECORD_VOIP)
         inBufCount = VOIP_PERIOD_COUNT_DEFAULT;
+    inBufCount = BufferPolicy::PeriodCount((audio_usecase_t)usecase_, mAndroidInDevices,
+                                           inBufCount);
 
     if (!handle) {
         inBufCfg.buf_size = inBufSize;
@@ -4923,10 +5340,6 @@ set_buff_size:
     fragment_size_ = inBufSize;
 
 exit:
-    if (device_cap_query) {
-        free(device_cap_query);
-        device_cap_query = NULL;
-    }
     AHAL_DBG("Exit ret: %d", ret);
     return ret;
 }
@@ -5072,11 +5485,14 @@ ssize_t StreamInPrimary::read(const void *buffer, size_t bytes) {
     palBuffer.size = bytes;
     palBuffer.offset = 0;
     std::shared_ptr<AudioDevice> adevice = AudioDevice::GetInstance();
+    uint64_t counters_start = StreamCounters::Enabled() ? StreamCounters::Now() : 0;
+    size_t frame_size;
+    AHAL_TRACE(AHAL_EVT_IN_READ, handle_, (int32_t)bytes);
     AHAL_VERBOSE("requested bytes: %zu", bytes);
 
     stream_mutex_.lock();
     if (!pal_stream_handle_) {
-        AutoPerfLock perfLock;
+        AutoPerfLock perfLock(usecase_, PERF_LOCK_OP_OPEN);
         ret = Open();
         if (ret < 0)
             goto exit;
@@ -5117,11 +5533,12 @@ ssize_t StreamInPrimary::read(const void *buffer, size_t bytes) {
     }
 
     if (!stream_started_) {
-        AutoPerfLock perfLock;
+        AutoPerfLock perfLock(usecase_, PERF_LOCK_OP_START);
         ret = pal_stream_start(pal_stream_handle_);
         if (ret) {
             AHAL_ERR("failed to start stream. ret=%d", ret);
             pal_stream_close(pal_stream_handle_);
+            StreamCounters::PalSessionClosed();
             pal_stream_handle_ = NULL;
             goto exit;
         }
@@ -5172,6 +5589,22 @@ exit:
     } else {
         mBytesRead = UINT64_MAX;
     }
+    if (LatencyProbe::Active() && ret >= 0 && !is_st_session &&
+        config_.format == AUDIO_FORMAT_PCM_16_BIT) {
+        uint32_t channels = audio_channel_count_from_in_mask(config_.channel_mask);
+        size_t frames = bytes / (channels * sizeof(int16_t));
+
+        /* the burst is timed from the newest sample, the buffer itself is already counted */
+        LatencyProbe::OnRead(this, mAndroidInDevices, (const int16_t *)buffer, frames, channels,
+                             config_.sample_rate, GetSourceLatency(flags_));
+    }
+    if (counters_start) {
+        counters_.Set(STREAM_COUNTER_IO_US, (StreamCounters::Now() - counters_start) / 1000);
+        frame_size = audio_bytes_per_frame(
+                audio_channel_count_from_in_mask(config_.channel_mask), config_.format);
+        if (frame_size)
+            counters_.Set(STREAM_COUNTER_FRAMES, mBytesRead / frame_size);
+    }
     stream_mutex_.unlock();
     clock_gettime(CLOCK_MONOTONIC, &readAt);
     if (usecase_ == USECASE_AUDIO_RECORD_COMPRESS && ret <= 0) {
@@ -5225,6 +5658,7 @@ StreamInPrimary::StreamInPrimary(audio_io_handle_t handle,
     stream_ = std::shared_ptr<audio_stream_in> (new audio_stream_in());
     std::shared_ptr<AudioDevice> adevice = AudioDevice::GetInstance();
     pal_stream_handle_ = NULL;
+    counters_.Init(false, handle);
     mInitialized = false;
     int noPalDevices = 0;
     int ret = 0;
@@ -5257,15 +5691,16 @@ StreamInPrimary::StreamInPrimary(audio_io_handle_t handle,
             AHAL_ERR("Failed to allocate mem for dynamic_media_config");
             goto error;
         }
-        size_t payload_size = 0;
+        usb_dev_cap_t usb_cap;
         device_cap_query_->id = PAL_DEVICE_IN_USB_HEADSET;
         device_cap_query_->addr.card_id = adevice->usb_card_id_;
         device_cap_query_->addr.device_num = adevice->usb_dev_num_;
         device_cap_query_->config = dynamic_media_config;
         device_cap_query_->is_playback = false;
-        ret = pal_get_param(PAL_PARAM_ID_DEVICE_CAPABILITY,
-                            (void **)&device_cap_query_,
-                            &payload_size, nullptr);
+        ret = adevice->GetUsbCapability(adevice->usb_card_id_,
+                adevice->usb_dev_num_, false, &usb_cap);
+        if (!ret)
+            memcpy(dynamic_media_config, &usb_cap.config, sizeof(dynamic_media_config_t));
         if (ret < 0) {
             AHAL_ERR("Error usb device is not connected");
             free(dynamic_media_config);
@@ -5275,12 +5710,11 @@ StreamInPrimary::StreamInPrimary(audio_io_handle_t handle,
         }
         if (dynamic_media_config) {
             AHAL_DBG("usb fs=%d format=%d mask=%x",
-                dynamic_media_config->sample_rate[0],
-                dynamic_media_config->format[0], dynamic_media_config->mask[0]);
+                usb_cap.sample_rate, usb_cap.format, usb_cap.channel_mask);
             if (!config->sample_rate) {
-                config->sample_rate = dynamic_media_config->sample_rate[0];
-                config->channel_mask = (audio_channel_mask_t) dynamic_media_config->mask[0];
-                config->format = (audio_format_t)dynamic_media_config->format[0];
+                config->sample_rate = usb_cap.sample_rate;
+                config->channel_mask = usb_cap.channel_mask;
+                config->format = usb_cap.format;
                 memcpy(&config_, config, sizeof(struct audio_config));
             }
         }
@@ -5347,7 +5781,8 @@ StreamInPrimary::StreamInPrimary(audio_io_handle_t handle,
         mAndroidInDevices.insert(AUDIO_DEVICE_IN_DEFAULT);
 
     AHAL_DBG("No of devices %zu", mAndroidInDevices.size());
-    mPalInDeviceIds = (pal_device_id_t*) calloc(mAndroidInDevices.size(), sizeof(pal_device_id_t));
+    mPalInDeviceCap = std::max(mAndroidInDevices.size(), (size_t)STREAM_PAL_DEVICE_CAPACITY);
+    mPalInDeviceIds = (pal_device_id_t*) calloc(mPalInDeviceCap, sizeof(pal_device_id_t));
     if (!mPalInDeviceIds) {
         goto error;
     }
@@ -5357,7 +5792,7 @@ StreamInPrimary::StreamInPrimary(audio_io_handle_t handle,
         AHAL_ERR("mismatched pal %d and hal devices %zu", noPalDevices, mAndroidInDevices.size());
         goto error;
     }
-    mPalInDevice = (struct pal_device*) calloc(mAndroidInDevices.size(), sizeof(struct pal_device));
+    mPalInDevice = (struct pal_device*) calloc(mPalInDeviceCap, sizeof(struct pal_device));
     if (!mPalInDevice) {
         goto error;
     }
@@ -5429,11 +5864,13 @@ error:
 }
 
 StreamInPrimary::~StreamInPrimary() {
+    sinkMetadataAggregator.Remove(this);
     stream_mutex_.lock();
     if (pal_stream_handle_ && !is_st_session) {
         AHAL_DBG("close stream, pal_stream_handle (%p)",
              pal_stream_handle_);
         pal_stream_close(pal_stream_handle_);
+        StreamCounters::PalSessionClosed();
         pal_stream_handle_ = NULL;
     }
     if (mPalInDeviceIds) {
@@ -5458,15 +5895,13 @@ StreamPrimary::StreamPrimary(audio_io_handle_t handle,
 {
     memset(&streamAttributes_, 0, sizeof(streamAttributes_));
     memset(&address_, 0, sizeof(address_));
+    memset(volume_buf_, 0, sizeof(volume_buf_));
     AHAL_DBG("handle: %d channel_mask: %d ", handle_, config_.channel_mask);
 }
 
 StreamPrimary::~StreamPrimary(void)
 {
-    if (volume_) {
-        free(volume_);
-        volume_ = NULL;
-    }
+    volume_ = NULL;
     if (device_cap_query_) {
         if (device_cap_query_->config) {
             free(device_cap_query_->config);
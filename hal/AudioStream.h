@@ -66,14 +66,22 @@
 #include <stdlib.h>
 #include <unistd.h>
 
+#include <chrono>
+#include <condition_variable>
 #include <set>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include <cutils/properties.h>
 #include <hardware/audio.h>
 #include <system/audio.h>
 
+#include "AudioMutex.h"
+#include "MmapPosition.h"
 #include "PalDefs.h"
+#include "StreamCounters.h"
+#include "VolumeRamp.h"
 #include <audio_extn/AudioExtn.h>
 #include <mutex>
 #include <map>
@@ -111,6 +119,8 @@
 #define ULL_PERIOD_SIZE (DEFAULT_OUTPUT_SAMPLING_RATE / 1000) /** 1ms; frames */
 #define ULL_PERIOD_COUNT_DEFAULT 512
 #define ULL_PERIOD_MULTIPLIER 3
+#define STREAM_VOLUME_MAX_PAIRS 2
+#define STREAM_PAL_DEVICE_CAPACITY 4 /** device slots allocated at open */
 #define BUF_SIZE_PLAYBACK 960
 #define BUF_SIZE_CAPTURE 960
 #define NO_OF_BUF 4
@@ -136,6 +146,8 @@
 #define DIV_ROUND_UP(x, y) (((x) + (y) - 1)/(y))
 #define ALIGN(x, y) ((y) * DIV_ROUND_UP((x), (y)))
 
+/* the host test build points these at a stub library */
+#ifndef OFFLOAD_EFFECTS_BUNDLE_LIBRARY_PATH
 #if LINUX_ENABLED
 #ifdef __LP64__
 #define OFFLOAD_EFFECTS_BUNDLE_LIBRARY_PATH "/usr/lib64/libqcompostprocbundle.so"
@@ -153,6 +165,7 @@
 #define VISUALIZER_LIBRARY_PATH "/vendor/lib/soundfx/libqcomvisualizer.so"
 #endif
 #endif
+#endif
 
 #define AUDIO_PARAMETER_KEY_CAMERA_FACING "cameraFacing"
 #define AUDIO_PARAMETER_VALUE_FRONT "front"
@@ -497,12 +510,12 @@ public:
     int getPalDeviceIds(const std::set<audio_devices_t> &halDeviceIds, pal_device_id_t* palOutDeviceIds);
     audio_io_handle_t GetHandle();
     int             GetUseCase();
-    std::mutex write_wait_mutex_;
-    std::condition_variable write_condition_;
-    std::mutex stream_mutex_;
+    AudioMutex write_wait_mutex_{"write_wait_mutex_"};
+    std::condition_variable_any write_condition_;
+    AudioMutex stream_mutex_{"stream_mutex_"};
     bool write_ready_;
-    std::mutex drain_wait_mutex_;
-    std::condition_variable drain_condition_;
+    AudioMutex drain_wait_mutex_{"drain_wait_mutex_"};
+    std::condition_variable_any drain_condition_;
     bool drain_ready_;
     stream_callback_t client_callback;
     void *client_cookie;
@@ -513,6 +526,14 @@ public:
     bool GetSupportedConfig(bool isOutStream,
                             struct str_parms *query, struct str_parms *reply);
     virtual int RouteStream(const std::set<audio_devices_t>&, bool force_device_switch = false) = 0;
+    virtual std::set<audio_devices_t> GetDevices() = 0;
+    virtual int Standby() = 0;
+    /* reopens the stream after a DSP restart, routing and volume are kept */
+    virtual int Recover() = 0;
+    /* unlocked snapshot, only a hint for SSR recovery */
+    bool IsStarted() { return stream_started_; }
+    /* the framework closed the stream, Recover() leaves it closed */
+    void MarkClosed();
 protected:
     struct pal_stream_attributes streamAttributes_;
     pal_stream_handle_t*      pal_stream_handle_;
@@ -522,21 +543,36 @@ protected:
     char                      address_[AUDIO_DEVICE_MAX_ADDRESS_LEN];
     bool                      stream_started_ = false;
     bool                      stream_paused_ = false;
+    bool                      closed_ = false;      /* guarded by stream_mutex_ */
     int usecase_;
-    struct pal_volume_data *volume_; /* used to cache volume */
+    struct pal_volume_data *volume_; /* used to cache volume, points to volume_buf_ */
+    alignas(struct pal_volume_data) uint8_t volume_buf_[sizeof(struct pal_volume_data) +
+            STREAM_VOLUME_MAX_PAIRS * sizeof(struct pal_channel_vol_kv)];
     std::map <audio_devices_t, pal_device_id_t> mAndroidDeviceMap;
     int mmap_shared_memory_fd;
     pal_param_device_capability_t *device_cap_query_;
+    StreamCounters counters_;
+    MmapPosition mmapPosition_;
 };
 
 class StreamOutPrimary : public StreamPrimary {
 private:
     // Helper function for write to open pal stream & configure.
     ssize_t configurePalOutputStream();
+    // Helpers for the volume engine, called with stream_mutex_ held.
+    int ApplyVolume();
+    bool CanCoalesceVolume();
+    void FlushPendingVolume();
+    // Shared offload volume timer, see AudioStream.cpp; without stream_mutex_.
+    bool ScheduleVolumeFlush(std::chrono::steady_clock::time_point when);
+    static void VolumeTimerLoop();
     //Helper method to standby streams upon write failures and sleep for buffer duration.
     ssize_t onWriteError(size_t bytes, ssize_t ret);
+    // Publishes the ATRACE counter tracks of a write, called with stream_mutex_ held.
+    void UpdateWriteCounters(size_t bytes, uint64_t start_ns);
     struct pal_device* mPalOutDevice;
     pal_device_id_t* mPalOutDeviceIds;
+    size_t mPalOutDeviceCap = 0;
     std::set<audio_devices_t> mAndroidOutDevices;
     bool mInitialized;
 
@@ -556,6 +592,7 @@ public:
     bool isCompressMetadataAvail = false;
     void UpdatemCachedPosition(uint64_t val);
     int Standby();
+    int Recover();
     int SetVolume(float left, float right);
     uint64_t GetFramesWritten(struct timespec *timestamp);
     int SetParameters(struct str_parms *parms);
@@ -577,6 +614,7 @@ public:
     int StartOffloadEffects(audio_io_handle_t, pal_stream_handle_t*);
     int StopOffloadEffects(audio_io_handle_t, pal_stream_handle_t*);
     bool CheckOffloadEffectsType(pal_stream_type_t pal_stream_type);
+    void LoadOffloadEffectFns();
     int StartOffloadVisualizer(audio_io_handle_t, pal_stream_handle_t*);
     int StopOffloadVisualizer(audio_io_handle_t, pal_stream_handle_t*);
     audio_output_flags_t flags_;
@@ -584,12 +622,15 @@ public:
     int GetMmapPosition(struct audio_mmap_position *position);
     bool isDeviceAvailable(pal_device_id_t deviceId);
     int RouteStream(const std::set<audio_devices_t>&, bool force_device_switch = false);
+    std::set<audio_devices_t> GetDevices();
     ssize_t splitAndWriteAudioHapticsStream(const void *buffer, size_t bytes);
     bool period_size_is_plausible_for_low_latency(int period_size);
     source_metadata_t btSourceMetadata;
     std::vector<playback_track_metadata_t> tracks;
     int SetAggregateSourceMetadata(bool voice_active);
-    static std::mutex sourceMetadata_mutex_;
+    static int FlushAggregateSourceMetadata();
+    static void CancelAggregateSourceMetadata();
+    static AudioMutex sourceMetadata_mutex_;
 protected:
     struct timespec writeAt;
     int get_compressed_buffer_size();
@@ -606,6 +647,7 @@ protected:
     uint16_t mchannels;
     std::shared_ptr<audio_stream_out>   stream_;
     uint64_t mBytesWritten; /* total bytes written, not cleared when entering standby */
+    uint64_t mSessionBaseBytes = 0; /* mBytesWritten when the PAL session was (re)started */
     uint64_t mCachedPosition = 0; /* cache pcm offload position when entering standby */
     offload_effects_start_output fnp_offload_effect_start_output_ = nullptr;
     offload_effects_stop_output fnp_offload_effect_stop_output_ = nullptr;
@@ -619,6 +661,15 @@ protected:
     struct pal_device* hapticsDevice;
     uint8_t* hapticBuffer;
     size_t hapticsBufSize;
+    //Volume engine
+    VolumeRamp volumeRamp_;
+    bool swVolume_ = false;
+    bool volumePending_ = false;
+    float volumeLeft_ = -1.0f;
+    float volumeRight_ = -1.0f;
+    std::chrono::steady_clock::time_point volumeAppliedAt_;
+    std::vector<uint8_t> volumeRampBuf_;    /* one buffer, sized at open */
+    std::vector<uint8_t> probeBuf_;     /* write() copy carrying a latency probe burst */
 
     int FillHalFnPtrs();
     friend class AudioDevice;
@@ -629,6 +680,7 @@ class StreamInPrimary : public StreamPrimary{
 private:
      struct pal_device* mPalInDevice;
      pal_device_id_t* mPalInDeviceIds;
+     size_t mPalInDeviceCap = 0;
      std::set<audio_devices_t> mAndroidInDevices;
      bool mInitialized;
     //Helper method to standby streams upon read failures and sleep for buffer duration.
@@ -643,6 +695,7 @@ public:
 
     ~StreamInPrimary();
     int Standby();
+    int Recover();
     int SetGain(float gain);
     void GetStreamHandle(audio_stream_in** stream);
     int Open();
@@ -664,13 +717,16 @@ public:
     int GetMmapPosition(struct audio_mmap_position *position);
     bool isDeviceAvailable(pal_device_id_t deviceId);
     int RouteStream(const std::set<audio_devices_t>& new_devices, bool force_device_switch = false);
+    std::set<audio_devices_t> GetDevices();
     int64_t GetSourceLatency(audio_input_flags_t halStreamFlags);
     uint64_t GetFramesRead(int64_t *time);
     int GetPalDeviceIds(pal_device_id_t *palDevIds, int *numPalDevs);
     sink_metadata_t btSinkMetadata;
     std::vector<record_track_metadata_t> tracks;
     int SetAggregateSinkMetadata(bool voice_active);
-    static std::mutex sinkMetadata_mutex_;
+    static int FlushAggregateSinkMetadata();
+    static void CancelAggregateSinkMetadata();
+    static AudioMutex sinkMetadata_mutex_;
 protected:
     struct timespec readAt;
     uint32_t fragments_ = 0;
@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+#define LOG_TAG "AHAL: AudioTrace"
+
+#include "AudioCommon.h"
+#include "AudioTrace.h"
+
+#include <inttypes.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <mutex>
+#include <new>
+#include <vector>
+
+#include <cutils/properties.h>
+
+#define AUDIO_TRACE_DUMP_MAX 512
+
+static const char * const event_names[AHAL_EVT_MAX] = {
+    [AHAL_EVT_OUT_OPEN] = "out_open",          /* handle usecase */
+    [AHAL_EVT_OUT_WRITE] = "out_write",        /* handle bytes */
+    [AHAL_EVT_OUT_STANDBY] = "out_standby",    /* handle */
+    [AHAL_EVT_OUT_ROUTE] = "out_route",        /* handle ndevices device */
+    [AHAL_EVT_OUT_VOLUME] = "out_volume",      /* handle left*1000 right*1000 */
+    [AHAL_EVT_IN_OPEN] = "in_open",
+    [AHAL_EVT_IN_READ] = "in_read",
+    [AHAL_EVT_IN_STANDBY] = "in_standby",
+    [AHAL_EVT_IN_ROUTE] = "in_route",
+    [AHAL_EVT_SET_PARAMS] = "set_params",      /* handler mask low, high */
+    [AHAL_EVT_SSR] = "ssr",                    /* card state */
+};
+
+std::atomic<bool> AudioTrace::enabled_(true);
+
+static std::mutex rings_mutex;
+static audio_trace_ring_t *rings[AUDIO_TRACE_MAX_RINGS];
+static std::atomic<int> nr_rings(0);
+
+/* hands the ring back when the thread exits, its entries stay for dump */
+struct audio_trace_owner {
+    audio_trace_ring_t *ring = nullptr;
+    bool failed = false;
+
+    ~audio_trace_owner() {
+        if (ring)
+            ring->tid.store(0, std::memory_order_release);
+    }
+};
+
+static thread_local audio_trace_owner trace_owner;
+
+audio_trace_ring_t *AudioTrace::GetRing() {
+    audio_trace_ring_t *ring = nullptr;
+    int n;
+
+    if (trace_owner.ring || trace_owner.failed)
+        return trace_owner.ring;
+
+    std::lock_guard<std::mutex> lock(rings_mutex);
+    n = nr_rings.load(std::memory_order_relaxed);
+    for (int i = 0; i < n; i++) {
+        if (!rings[i]->tid.load(std::memory_order_acquire)) {
+            ring = rings[i];
+            break;
+        }
+    }
+    if (!ring && n < AUDIO_TRACE_MAX_RINGS) {
+        ring = new (std::nothrow) audio_trace_ring_t();
+        if (ring) {
+            rings[n] = ring;
+            nr_rings.store(n + 1, std::memory_order_release);
+        }
+    }
+    if (!ring) {
+        trace_owner.failed = true;
+        return nullptr;
+    }
+    ring->tid.store(gettid(), std::memory_order_relaxed);
+    trace_owner.ring = ring;
+    return ring;
+}
+
+void AudioTrace::Init() {
+    enabled_.store(property_get_bool("vendor.audio.trace.enable", true),
+                   std::memory_order_relaxed);
+}
+
+void AudioTrace::Dump(int fd) {
+    std::vector<audio_trace_entry_t> entries;
+    int n = nr_rings.load(std::memory_order_acquire);
+    size_t first;
+
+    for (int i = 0; i < n; i++) {
+        audio_trace_ring_t *ring = rings[i];
+        uint64_t head = ring->head.load(std::memory_order_acquire);
+        uint64_t start = head > AUDIO_TRACE_RING_SIZE ? head - AUDIO_TRACE_RING_SIZE : 0;
+
+        /* the owner may overwrite the oldest entries while we copy, that is fine here */
+        for (uint64_t j = start; j < head; j++)
+            entries.push_back(ring->entries[j & (AUDIO_TRACE_RING_SIZE - 1)]);
+    }
+    if (entries.empty())
+        return;
+
+    std::sort(entries.begin(), entries.end(),
+              [](const audio_trace_entry_t& a, const audio_trace_entry_t& b) {
+                  return a.ts_ns < b.ts_ns;
+              });
+    first = entries.size() > AUDIO_TRACE_DUMP_MAX ? entries.size() - AUDIO_TRACE_DUMP_MAX : 0;
+
+    dprintf(fd, "HAL trace (%zu of %zu events, ms before last):\n",
+            entries.size() - first, entries.size());
+    for (size_t i = first; i < entries.size(); i++) {
+        const audio_trace_entry_t& e = entries[i];
+
+        dprintf(fd, "  %10.3f %6d %-12s %d %d %d\n",
+                (entries.back().ts_ns - e.ts_ns) / 1000000.0, e.tid,
+                e.event < AHAL_EVT_MAX ? event_names[e.event] : "?",
+                e.args[0], e.args[1], e.args[2]);
+    }
+}
@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+#ifndef ANDROID_HARDWARE_AHAL_AUDIO_TRACE_H_
+#define ANDROID_HARDWARE_AHAL_AUDIO_TRACE_H_
+
+#include <stdint.h>
+#include <time.h>
+
+#include <atomic>
+
+#define AUDIO_TRACE_RING_SIZE 256   /* entries per thread, power of two */
+#define AUDIO_TRACE_MAX_RINGS 64
+
+typedef enum {
+    AHAL_EVT_OUT_OPEN = 0,
+    AHAL_EVT_OUT_WRITE,
+    AHAL_EVT_OUT_STANDBY,
+    AHAL_EVT_OUT_ROUTE,
+    AHAL_EVT_OUT_VOLUME,
+    AHAL_EVT_IN_OPEN,
+    AHAL_EVT_IN_READ,
+    AHAL_EVT_IN_STANDBY,
+    AHAL_EVT_IN_ROUTE,
+    AHAL_EVT_SET_PARAMS,
+    AHAL_EVT_SSR,
+    AHAL_EVT_MAX,
+} audio_trace_event_t;
+
+typedef struct audio_trace_entry {
+    uint64_t ts_ns;
+    int32_t tid;
+    uint32_t event;
+    int32_t args[3];
+    int32_t reserved;
+} audio_trace_entry_t;
+
+/* one writer, the owning thread; dump reads it without locking */
+typedef struct audio_trace_ring {
+    std::atomic<uint64_t> head;
+    std::atomic<int32_t> tid;     /* 0 once the thread exited, ring can be reused */
+    audio_trace_entry_t entries[AUDIO_TRACE_RING_SIZE];
+} audio_trace_ring_t;
+
+/*
+ * Always-on binary event trace.
+ *
+ * Every thread that records gets its own ring, so recording is a
+ * timestamp and a few stores with no lock and no formatting. The rings
+ * are only decoded by Dump, merged by timestamp, which is where the event
+ * names come in. A ring outlives its thread until another thread picks
+ * it up, so the last events of a dead thread still show in dump.
+ *
+ * vendor.audio.trace.enable=false turns recording off.
+ */
+class AudioTrace {
+public:
+    static inline void Record(audio_trace_event_t event, int32_t a0 = 0,
+                              int32_t a1 = 0, int32_t a2 = 0) {
+        audio_trace_ring_t *ring;
+        audio_trace_entry_t *entry;
+        struct timespec ts;
+        uint64_t head;
+
+        if (!enabled_.load(std::memory_order_relaxed))
+            return;
+        ring = GetRing();
+        if (!ring)
+            return;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        head = ring->head.load(std::memory_order_relaxed);
+        entry = &ring->entries[head & (AUDIO_TRACE_RING_SIZE - 1)];
+        entry->ts_ns = (uint64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+        entry->tid = ring->tid.load(std::memory_order_relaxed);
+        entry->event = event;
+        entry->args[0] = a0;
+        entry->args[1] = a1;
+        entry->args[2] = a2;
+        ring->head.store(head + 1, std::memory_order_release);
+    }
+
+    static void Init();
+    static void Dump(int fd);
+
+private:
+    static audio_trace_ring_t *GetRing();
+
+    static std::atomic<bool> enabled_;
+};
+
+#define AHAL_TRACE(event, ...) AudioTrace::Record(event, ##__VA_ARGS__)
+
+#endif  // ANDROID_HARDWARE_AHAL_AUDIO_TRACE_H_
@@ -481,7 +481,7 @@ int AudioVoice::RouteStream(const std::set<audio_devices_t>& rx_devices) {
                 (pal_voice_tx_device_id_ == PAL_DEVICE_IN_BLUETOOTH_BLE)) {
                 pal_param_bta2dp_t param_bt_a2dp;
                 do {
-                    std::unique_lock<std::mutex> guard(reconfig_wait_mutex_);
+                    std::unique_lock<AudioMutex> guard(reconfig_wait_mutex_);
                     param_bt_a2dp_ptr = &param_bt_a2dp;
                     param_bt_a2dp_ptr->dev_id = PAL_DEVICE_OUT_BLUETOOTH_BLE;
 
@@ -510,7 +510,7 @@ int AudioVoice::RouteStream(const std::set<audio_devices_t>& rx_devices) {
             }
 
             // dont start the call, if suspend is in progress for BLE
-            std::unique_lock<std::mutex> guard(reconfig_wait_mutex_);
+            std::unique_lock<AudioMutex> guard(reconfig_wait_mutex_);
             ret = VoiceSetDevice(&voice_.session[i]);
             if (ret)
                 AHAL_ERR("Device switch failed for session[%d]", i);
@@ -596,7 +596,7 @@ int AudioVoice::UpdateCalls(voice_session_t *pSession) {
                         (pal_voice_tx_device_id_ == PAL_DEVICE_IN_BLUETOOTH_BLE)) {
                         pal_param_bta2dp_t param_bt_a2dp;
                         do {
-                            std::unique_lock<std::mutex> guard(reconfig_wait_mutex_);
+                            std::unique_lock<AudioMutex> guard(reconfig_wait_mutex_);
                             param_bt_a2dp_ptr = &param_bt_a2dp;
                             param_bt_a2dp_ptr->dev_id = PAL_DEVICE_OUT_BLUETOOTH_BLE;
 
@@ -626,7 +626,7 @@ int AudioVoice::UpdateCalls(voice_session_t *pSession) {
                     }
 
                     // dont start the call, if suspend is in progress for BLE
-                    std::unique_lock<std::mutex> guard(reconfig_wait_mutex_);
+                    std::unique_lock<AudioMutex> guard(reconfig_wait_mutex_);
 
                     ret = VoiceStart(session);
                     if (ret < 0) {
@@ -686,6 +686,25 @@ int AudioVoice::StopCall() {
     return ret;
 }
 
+/* after a DSP restart the call handles are dead, reopen every active call */
+int AudioVoice::RestartCalls() {
+    int i, ret = 0;
+
+    AHAL_DBG("Enter");
+    voice_mutex_.lock();
+    for (i = 0; i < max_voice_sessions_; i++) {
+        if (!IsCallActive(&voice_.session[i]))
+            continue;
+        VoiceStop(&voice_.session[i]);
+        ret = VoiceStart(&voice_.session[i]);
+        if (ret < 0)
+            AHAL_ERR("failed to restart call vsid:%x", voice_.session[i].vsid);
+    }
+    voice_mutex_.unlock();
+    AHAL_DBG("Exit ret: %d", ret);
+    return ret;
+}
+
 bool AudioVoice::IsCallActive(AudioVoice::voice_session_t *pSession) {
 
     return (pSession->state.current_ != CALL_INACTIVE) ? true : false;
@@ -848,6 +867,7 @@ int AudioVoice::VoiceStart(voice_session_t *session) {
         ret = -EINVAL;
         goto error_open;
     }
+    StreamCounters::PalSessionOpened();
 
     /*apply cached voice effects features*/
     if (session->slow_talk) {
@@ -922,6 +942,7 @@ int AudioVoice::VoiceStart(voice_session_t *session) {
    if (ret) {
        AHAL_ERR("Pal Stream Start Error (%x)", ret);
        ret = pal_stream_close(session->pal_voice_handle);
+       StreamCounters::PalSessionClosed();
        if (ret)
            AHAL_ERR("Pal Stream close failed %x", ret);
            session->pal_voice_handle = NULL;
@@ -985,6 +1006,7 @@ int AudioVoice::VoiceStop(voice_session_t *session) {
         if (ret)
             AHAL_ERR("Pal Stream stop failed %x", ret);
         ret = pal_stream_close(session->pal_voice_handle);
+        StreamCounters::PalSessionClosed();
         if (ret)
             AHAL_ERR("Pal Stream close failed %x", ret);
         session->pal_voice_handle = NULL;
@@ -1219,6 +1241,10 @@ void AudioVoice::updateVoiceMetadataForBT(bool call_active)
     sink_metadata_t btSinkMetadata;
 
     if (call_active) {
+        /* the call owns BT metadata now, drop any stream update still queued */
+        StreamOutPrimary::CancelAggregateSourceMetadata();
+        StreamInPrimary::CancelAggregateSinkMetadata();
+
         btSourceMetadata.track_count = track_count;
         btSourceMetadata.tracks = Sourcetracks.data();
 
@@ -1245,21 +1271,17 @@ void AudioVoice::updateVoiceMetadataForBT(bool call_active)
          * and sink metadata separately to BT.
          */
         if (stream_out_primary_) {
-            stream_out_primary_->sourceMetadata_mutex_.lock();
-            ret = stream_out_primary_->SetAggregateSourceMetadata(false);
+            ret = StreamOutPrimary::FlushAggregateSourceMetadata();
             if (ret != 0) {
                 AHAL_ERR("Set PAL_PARAM_ID_SET_SOURCE_METADATA for %d failed", ret);
             }
-            stream_out_primary_->sourceMetadata_mutex_.unlock();
         }
 
         if (stream_in_primary_) {
-            stream_in_primary_->sinkMetadata_mutex_.lock();
-            ret = stream_in_primary_->SetAggregateSinkMetadata(false);
+            ret = StreamInPrimary::FlushAggregateSinkMetadata();
             if (ret != 0) {
                 AHAL_ERR("Set PAL_PARAM_ID_SET_SINK_METADATA for %d failed", ret);
             }
-            stream_in_primary_->sinkMetadata_mutex_.unlock();
         }
     }
 }
@@ -96,7 +96,7 @@ public:
     bool get_voice_call_state(audio_mode_t *mode);
     bool is_valid_vsid(uint32_t vsid);
     int max_voice_sessions_;
-    std::mutex voice_mutex_;
+    AudioMutex voice_mutex_{"voice_mutex_"};
     int SetMode(const audio_mode_t mode);
     int VoiceStart(voice_session_t *session);
     int VoiceStop(voice_session_t *session);
@@ -112,6 +112,7 @@ public:
     bool IsAnyCallActive();
     void updateVoiceMetadataForBT(bool call_active);
     int StopCall();
+    int RestartCalls();
     AudioVoice();
     ~AudioVoice();
     pal_device_id_t pal_voice_tx_device_id_ = PAL_DEVICE_NONE;
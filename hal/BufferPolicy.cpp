@@ -0,0 +1,204 @@
+/*
+ * Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+#define LOG_TAG "AHAL: BufferPolicy"
+
+#include "AudioCommon.h"
+#include "BufferPolicy.h"
+
+#include <expat.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BUFFER_POLICY_READ_SIZE 1024
+
+std::once_flag BufferPolicy::load_once_;
+buffer_policy_t BufferPolicy::table_[AUDIO_USECASE_MAX][BUFFER_POLICY_DEVICE_MAX];
+
+static const char * const device_class_names[BUFFER_POLICY_DEVICE_MAX] = {
+    [BUFFER_POLICY_DEVICE_DEFAULT] = "default",
+    [BUFFER_POLICY_DEVICE_BLUETOOTH] = "bluetooth",
+    [BUFFER_POLICY_DEVICE_USB] = "usb",
+    [BUFFER_POLICY_DEVICE_HDMI] = "hdmi",
+};
+
+static int usecase_from_name(const char *name) {
+    for (int i = 0; i < AUDIO_USECASE_MAX; i++) {
+        if (use_case_table[i] && !strcmp(use_case_table[i], name))
+            return i;
+    }
+    return -1;
+}
+
+static int device_class_from_name(const char *name) {
+    for (int i = 0; i < BUFFER_POLICY_DEVICE_MAX; i++) {
+        if (!strcmp(device_class_names[i], name))
+            return i;
+    }
+    return -1;
+}
+
+/* the usecases whose buffer size is read from the policy */
+static bool period_size_applies(int usecase) {
+    return usecase == USECASE_AUDIO_PLAYBACK_DEEP_BUFFER ||
+           usecase == USECASE_AUDIO_PLAYBACK_LOW_LATENCY ||
+           usecase == USECASE_AUDIO_PLAYBACK_SPATIAL;
+}
+
+static void buffer_policy_start_tag(void *userdata, const XML_Char *tag_name,
+                                    const XML_Char **attr) {
+    buffer_policy_t (*table)[BUFFER_POLICY_DEVICE_MAX] =
+        (buffer_policy_t (*)[BUFFER_POLICY_DEVICE_MAX])userdata;
+    int usecase = -1;
+    int device = BUFFER_POLICY_DEVICE_DEFAULT;
+    uint32_t period_size = 0;
+    uint32_t period_count = 0;
+
+    if (strcmp(tag_name, "usecase"))
+        return;
+
+    for (int i = 0; attr[i] && attr[i + 1]; i += 2) {
+        if (!strcmp(attr[i], "name"))
+            usecase = usecase_from_name(attr[i + 1]);
+        else if (!strcmp(attr[i], "device"))
+            device = device_class_from_name(attr[i + 1]);
+        else if (!strcmp(attr[i], "period_size"))
+            period_size = strtoul(attr[i + 1], NULL, 0);
+        else if (!strcmp(attr[i], "period_count"))
+            period_count = strtoul(attr[i + 1], NULL, 0);
+    }
+
+    if (usecase < 0 || device < 0) {
+        AHAL_ERR("ignoring unknown usecase or device in buffer policy");
+        return;
+    }
+
+    if (period_size && !period_size_applies(usecase)) {
+        AHAL_ERR("%s: period_size is not configurable, ignored", use_case_table[usecase]);
+        period_size = 0;
+    }
+    if (period_size && device != BUFFER_POLICY_DEVICE_DEFAULT) {
+        AHAL_ERR("%s/%s: period_size cannot follow the device, ignored",
+                 use_case_table[usecase], device_class_names[device]);
+        period_size = 0;
+    }
+    if (period_size && (period_size < BUFFER_POLICY_PERIOD_SIZE_MIN ||
+                        period_size > BUFFER_POLICY_PERIOD_SIZE_MAX)) {
+        AHAL_ERR("%s/%s: period_size %u out of [%u, %u], using the default",
+                 use_case_table[usecase], device_class_names[device], period_size,
+                 BUFFER_POLICY_PERIOD_SIZE_MIN, BUFFER_POLICY_PERIOD_SIZE_MAX);
+        period_size = 0;
+    }
+    if (period_count && (period_count < BUFFER_POLICY_PERIOD_COUNT_MIN ||
+                         period_count > BUFFER_POLICY_PERIOD_COUNT_MAX)) {
+        AHAL_ERR("%s/%s: period_count %u out of [%u, %u], using the default",
+                 use_case_table[usecase], device_class_names[device], period_count,
+                 BUFFER_POLICY_PERIOD_COUNT_MIN, BUFFER_POLICY_PERIOD_COUNT_MAX);
+        period_count = 0;
+    }
+
+    if (period_size)
+        table[usecase][device].period_size = period_size;
+    if (period_count)
+        table[usecase][device].period_count = period_count;
+    AHAL_DBG("%s/%s: period_size %u period_count %u", use_case_table[usecase],
+             device_class_names[device], table[usecase][device].period_size,
+             table[usecase][device].period_count);
+}
+
+void BufferPolicy::Load() {
+    XML_Parser parser;
+    FILE *file = NULL;
+    void *buf = NULL;
+    int bytes_read;
+
+    file = fopen(BUFFER_POLICY_XML_FILE, "r");
+    if (!file) {
+        AHAL_DBG("no %s, using built in buffer sizes", BUFFER_POLICY_XML_FILE);
+        return;
+    }
+
+    parser = XML_ParserCreate(NULL);
+    if (!parser) {
+        AHAL_ERR("Failed to create XML parser");
+        goto closeFile;
+    }
+    XML_SetUserData(parser, table_);
+    XML_SetElementHandler(parser, buffer_policy_start_tag, NULL);
+
+    while (1) {
+        buf = XML_GetBuffer(parser, BUFFER_POLICY_READ_SIZE);
+        if (buf == NULL) {
+            AHAL_ERR("XML_Getbuffer failed");
+            goto reset;
+        }
+
+        bytes_read = fread(buf, 1, BUFFER_POLICY_READ_SIZE, file);
+        if (XML_ParseBuffer(parser, bytes_read, bytes_read == 0) == XML_STATUS_ERROR) {
+            AHAL_ERR("XML ParseBuffer failed for %s", BUFFER_POLICY_XML_FILE);
+            goto reset;
+        }
+        if (bytes_read == 0)
+            break;
+    }
+    goto freeParser;
+
+reset:
+    /* a half read policy is worse than none */
+    memset(table_, 0, sizeof(table_));
+freeParser:
+    XML_ParserFree(parser);
+closeFile:
+    fclose(file);
+}
+
+buffer_policy_device_t BufferPolicy::GetDeviceClass(const std::set<audio_devices_t>& devices) {
+    for (auto device : devices) {
+        if (audio_is_bluetooth_out_sco_device(device) ||
+            audio_is_a2dp_out_device(device) ||
+            audio_is_ble_out_device(device) ||
+            audio_is_bluetooth_in_sco_device(device) ||
+            audio_is_ble_in_device(device))
+            return BUFFER_POLICY_DEVICE_BLUETOOTH;
+        if (audio_is_usb_out_device(device) || audio_is_usb_in_device(device))
+            return BUFFER_POLICY_DEVICE_USB;
+        if (device == AUDIO_DEVICE_OUT_AUX_DIGITAL || device == AUDIO_DEVICE_OUT_HDMI_ARC ||
+            device == AUDIO_DEVICE_OUT_HDMI_EARC)
+            return BUFFER_POLICY_DEVICE_HDMI;
+    }
+    return BUFFER_POLICY_DEVICE_DEFAULT;
+}
+
+const buffer_policy_t *BufferPolicy::Lookup(audio_usecase_t usecase,
+                                            buffer_policy_device_t device, bool size) {
+    const buffer_policy_t *policy = NULL;
+
+    std::call_once(load_once_, Load);
+    if (usecase < 0 || usecase >= AUDIO_USECASE_MAX)
+        return NULL;
+
+    policy = &table_[usecase][device];
+    if (size ? policy->period_size : policy->period_count)
+        return policy;
+    policy = &table_[usecase][BUFFER_POLICY_DEVICE_DEFAULT];
+    if (size ? policy->period_size : policy->period_count)
+        return policy;
+    return NULL;
+}
+
+uint32_t BufferPolicy::PeriodSize(audio_usecase_t usecase, uint32_t def) {
+    const buffer_policy_t *policy = Lookup(usecase, BUFFER_POLICY_DEVICE_DEFAULT, true);
+
+    return policy ? policy->period_size : def;
+}
+
+uint32_t BufferPolicy::PeriodCount(audio_usecase_t usecase,
+                                   const std::set<audio_devices_t>& devices,
+                                   uint32_t def) {
+    const buffer_policy_t *policy = Lookup(usecase, GetDeviceClass(devices), false);
+
+    return policy ? policy->period_count : def;
+}
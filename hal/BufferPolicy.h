@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+#ifndef ANDROID_HARDWARE_AHAL_BUFFER_POLICY_H_
+#define ANDROID_HARDWARE_AHAL_BUFFER_POLICY_H_
+
+#include <stdint.h>
+
+#include <mutex>
+#include <set>
+
+#include <system/audio.h>
+
+#include "AudioStream.h"
+
+#ifndef BUFFER_POLICY_XML_FILE
+#define BUFFER_POLICY_XML_FILE "/vendor/etc/audio_hal_buffer_policy.xml"
+#endif
+
+/* values outside these are ignored, the built in default stays */
+#define BUFFER_POLICY_PERIOD_SIZE_MIN 32        /* frames */
+#define BUFFER_POLICY_PERIOD_SIZE_MAX 8192
+#define BUFFER_POLICY_PERIOD_COUNT_MIN 2
+#define BUFFER_POLICY_PERIOD_COUNT_MAX 512      /* MMAP_PERIOD_COUNT_MAX */
+
+typedef enum {
+    BUFFER_POLICY_DEVICE_DEFAULT = 0,
+    BUFFER_POLICY_DEVICE_BLUETOOTH,
+    BUFFER_POLICY_DEVICE_USB,
+    BUFFER_POLICY_DEVICE_HDMI,
+    BUFFER_POLICY_DEVICE_MAX,
+} buffer_policy_device_t;
+
+/* zero means the platform did not say, use the built in default */
+typedef struct buffer_policy_t {
+    uint32_t period_size;   /* frames */
+    uint32_t period_count;
+} buffer_policy_t;
+
+/*
+ * Per platform buffer geometry, read once from
+ * audio_hal_buffer_policy.xml:
+ *
+ *   <buffer_policy>
+ *       <usecase name="low-latency-playback" period_size="240" period_count="2"/>
+ *       <usecase name="low-latency-playback" device="bluetooth" period_count="4"/>
+ *   </buffer_policy>
+ *
+ * Usecase names are the ones in use_case_table. An entry for a device
+ * class wins over the default entry of the same usecase, a missing
+ * attribute falls back to the default entry and then to the defines in
+ * AudioStream.h.
+ *
+ * period_count is read for every usecase, period_size only for the
+ * deep buffer, low latency and spatial playback usecases, the others
+ * derive their size from the stream config and an entry for them is
+ * rejected. Out of range values are rejected as well, with an error.
+ *
+ * period_size is only taken from default entries. AudioFlinger sizes its
+ * buffer from get_buffer_size once, at open, so a size that followed the
+ * route would stop matching it after a BT or USB switch.
+ */
+class BufferPolicy {
+public:
+    static uint32_t PeriodSize(audio_usecase_t usecase, uint32_t def);
+    static uint32_t PeriodCount(audio_usecase_t usecase,
+                                const std::set<audio_devices_t>& devices,
+                                uint32_t def);
+
+private:
+    static void Load();
+    static const buffer_policy_t *Lookup(audio_usecase_t usecase,
+                                         buffer_policy_device_t device, bool size);
+    static buffer_policy_device_t GetDeviceClass(const std::set<audio_devices_t>& devices);
+
+    static std::once_flag load_once_;
+    static buffer_policy_t table_[AUDIO_USECASE_MAX][BUFFER_POLICY_DEVICE_MAX];
+};
+
+#endif  // ANDROID_HARDWARE_AHAL_BUFFER_POLICY_H_
@@ -0,0 +1,194 @@
+/*
+ * Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+#define LOG_TAG "AHAL: CallRecorder"
+
+#include "AudioCommon.h"
+#include "CallRecorder.h"
+#include "ThreadPolicy.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <cutils/properties.h>
+
+#define CALL_RECORD_DEFAULT_PATH "/data/vendor/audio/ahal_calls.bin"
+#define CALL_RECORD_DEFAULT_MAX_MB 64
+#define CALL_RECORD_FLUSH_BYTES (64 * 1024)
+#define CALL_RECORD_FLUSH_PERIOD_MS 1000
+
+std::atomic<bool> CallRecorder::enabled_(false);
+std::atomic<uint64_t> CallRecorder::seq_(0);
+
+static std::mutex record_mutex;
+static std::condition_variable record_cv;
+static std::vector<uint8_t> record_buf;
+static bool record_writer_running;
+static int record_fd = -1;
+static uint64_t record_base_ns;
+static uint64_t record_max_bytes;
+static uint64_t record_bytes;        /* accepted, buffered or written */
+static uint64_t record_count;
+static uint64_t record_dropped;
+static uint64_t record_truncated;
+
+void CallRecorder::Init() {
+    char path[PROPERTY_VALUE_MAX];
+    call_record_header_t hdr;
+    struct timespec ts;
+
+    if (!property_get_bool("vendor.audio.call_record.enable", false))
+        return;
+
+    property_get("vendor.audio.call_record.path", path, CALL_RECORD_DEFAULT_PATH);
+    record_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0640);
+    if (record_fd < 0) {
+        AHAL_ERR("cannot open %s: %s", path, strerror(errno));
+        return;
+    }
+
+    record_base_ns = Now();
+    clock_gettime(CLOCK_REALTIME, &ts);
+    hdr.magic = CALL_RECORD_MAGIC;
+    hdr.version = CALL_RECORD_VERSION;
+    hdr.record_size = sizeof(call_record_t);
+    hdr.start_realtime_ns = (uint64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    if (write(record_fd, &hdr, sizeof(hdr)) != sizeof(hdr)) {
+        AHAL_ERR("cannot write %s: %s", path, strerror(errno));
+        close(record_fd);
+        record_fd = -1;
+        return;
+    }
+    record_max_bytes = (uint64_t)property_get_int32("vendor.audio.call_record.max_mb",
+                                                    CALL_RECORD_DEFAULT_MAX_MB) << 20;
+    record_buf.reserve(2 * CALL_RECORD_FLUSH_BYTES);
+
+    try {
+        std::thread writer(WriterLoop);
+
+        writer.detach();
+        record_writer_running = true;
+    } catch (const std::exception& e) {
+        AHAL_ERR("no writer thread (%s), flushing from callers", e.what());
+    }
+
+    AHAL_INFO("recording HAL calls to %s", path);
+    enabled_.store(true, std::memory_order_relaxed);
+}
+
+/* called with record_mutex held */
+void CallRecorder::Flush() {
+    const uint8_t *p = record_buf.data();
+    size_t left = record_buf.size();
+
+    while (left) {
+        ssize_t n = write(record_fd, p, left);
+
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            AHAL_ERR("write failed: %s, recording stopped", strerror(errno));
+            enabled_.store(false, std::memory_order_relaxed);
+            break;
+        }
+        p += n;
+        left -= n;
+    }
+    record_buf.clear();
+}
+
+void CallRecorder::WriterLoop() {
+    std::vector<uint8_t> pending;
+
+    ThreadPolicy::Apply(AHAL_THREAD_WORKER);
+    for (;;) {
+        std::unique_lock<std::mutex> lock(record_mutex);
+
+        record_cv.wait_for(lock, std::chrono::milliseconds(CALL_RECORD_FLUSH_PERIOD_MS),
+                           [] { return record_buf.size() >= CALL_RECORD_FLUSH_BYTES; });
+        if (record_buf.empty())
+            continue;
+        /* write outside the lock so callers keep appending */
+        pending.swap(record_buf);
+        lock.unlock();
+
+        for (size_t off = 0; off < pending.size();) {
+            ssize_t n = write(record_fd, pending.data() + off, pending.size() - off);
+
+            if (n < 0) {
+                if (errno == EINTR)
+                    continue;
+                AHAL_ERR("write failed: %s, recording stopped", strerror(errno));
+                enabled_.store(false, std::memory_order_relaxed);
+                return;
+            }
+            off += n;
+        }
+        pending.clear();
+    }
+}
+
+void CallRecorder::Record(call_record_type_t type, int32_t handle, uint64_t seq,
+                          uint64_t start_ns, int32_t ret, const void *payload,
+                          size_t payload_len) {
+    call_record_t rec;
+    uint64_t now = Now();
+
+    if (!Enabled())
+        return;
+
+    payload_len = payload ? payload_len : 0;
+    rec.seq = seq;
+    rec.start_ns = start_ns > record_base_ns ? start_ns - record_base_ns : 0;
+    rec.duration_ns = (uint32_t)std::min<uint64_t>(now - start_ns, UINT32_MAX);
+    rec.type = type;
+    rec.full_len = (uint32_t)std::min<size_t>(payload_len, UINT32_MAX);
+    rec.flags = payload_len > CALL_RECORD_MAX_PAYLOAD ? CALL_RECORD_FLAG_TRUNCATED : 0;
+    payload_len = std::min<size_t>(payload_len, CALL_RECORD_MAX_PAYLOAD);
+    rec.payload_len = payload_len;
+    rec.handle = handle;
+    rec.ret = ret;
+
+    std::lock_guard<std::mutex> lock(record_mutex);
+    if (record_bytes + sizeof(rec) + payload_len > record_max_bytes) {
+        if (!record_dropped++)
+            AHAL_WARN("recording reached its %" PRIu64 " MB limit", record_max_bytes >> 20);
+        return;
+    }
+    record_buf.insert(record_buf.end(), (const uint8_t *)&rec, (const uint8_t *)(&rec + 1));
+    if (payload_len)
+        record_buf.insert(record_buf.end(), (const uint8_t *)payload,
+                          (const uint8_t *)payload + payload_len);
+    record_bytes += sizeof(rec) + payload_len;
+    record_count++;
+    if (rec.flags & CALL_RECORD_FLAG_TRUNCATED)
+        record_truncated++;
+
+    if (record_buf.size() >= CALL_RECORD_FLUSH_BYTES) {
+        if (record_writer_running)
+            record_cv.notify_one();
+        else
+            Flush();
+    }
+}
+
+void CallRecorder::Dump(int fd) {
+    if (!Enabled() && !record_count)
+        return;
+
+    std::lock_guard<std::mutex> lock(record_mutex);
+    dprintf(fd, "Call recorder: %s, %" PRIu64 " calls, %" PRIu64 " KB, %" PRIu64 " dropped, "
+            "%" PRIu64 " truncated\n", Enabled() ? "on" : "stopped", record_count,
+            record_bytes >> 10, record_dropped, record_truncated);
+}
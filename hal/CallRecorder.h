@@ -0,0 +1,156 @@
+/*
+ * Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+#ifndef ANDROID_HARDWARE_AHAL_CALL_RECORDER_H_
+#define ANDROID_HARDWARE_AHAL_CALL_RECORDER_H_
+
+#include <stdint.h>
+#include <time.h>
+
+#include <atomic>
+
+/*
+ * File layout, shared with the replay tool:
+ *   call_record_header_t
+ *   call_record_t + payload_len bytes of payload, repeated
+ * Payloads hold the call arguments that matter for replay, sample data
+ * is never recorded.
+ */
+#define CALL_RECORD_MAGIC 0x52434841   /* "AHCR" */
+#define CALL_RECORD_VERSION 2
+
+typedef enum {
+    CALL_ADEV_OPEN_OUTPUT = 0,   /* call_record_open_t, handle = io handle */
+    CALL_ADEV_CLOSE_OUTPUT,
+    CALL_ADEV_OPEN_INPUT,        /* call_record_open_t */
+    CALL_ADEV_CLOSE_INPUT,
+    CALL_ADEV_SET_PARAMS,        /* kvpairs, not terminated */
+    CALL_ADEV_SET_MODE,          /* int32_t mode */
+    CALL_ADEV_SET_MIC_MUTE,      /* int32_t state */
+    CALL_ADEV_SET_VOICE_VOLUME,  /* float */
+    CALL_ADEV_CREATE_PATCH,      /* call_record_patch_t, handle = patch handle */
+    CALL_ADEV_RELEASE_PATCH,
+    CALL_OUT_WRITE,              /* uint32_t bytes */
+    CALL_OUT_STANDBY,
+    CALL_OUT_SET_PARAMS,         /* kvpairs */
+    CALL_OUT_SET_VOLUME,         /* float left, right */
+    CALL_OUT_PAUSE,
+    CALL_OUT_RESUME,
+    CALL_OUT_FLUSH,
+    CALL_OUT_DRAIN,              /* int32_t type */
+    CALL_IN_READ,                /* uint32_t bytes */
+    CALL_IN_STANDBY,
+    CALL_IN_SET_PARAMS,          /* kvpairs */
+    CALL_MAX,
+} call_record_type_t;
+
+typedef struct __attribute__((packed)) call_record_header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t record_size;        /* sizeof(call_record_t) */
+    uint64_t start_realtime_ns;  /* wall clock of start_ns 0 */
+} call_record_header_t;
+
+typedef struct __attribute__((packed)) call_record {
+    uint64_t seq;                /* order the calls started in, across all threads */
+    uint64_t start_ns;           /* since the recording started */
+    uint32_t duration_ns;
+    uint16_t type;
+    uint16_t flags;              /* CALL_RECORD_FLAG_* */
+    uint32_t full_len;           /* payload length of the call */
+    uint16_t payload_len;        /* bytes recorded, at most CALL_RECORD_MAX_PAYLOAD */
+    int32_t handle;
+    int32_t ret;
+} call_record_t;
+
+#define CALL_RECORD_FLAG_TRUNCATED 0x1   /* payload_len < full_len */
+
+typedef struct __attribute__((packed)) call_record_open {
+    uint32_t devices;
+    uint32_t flags;
+    uint32_t sample_rate;
+    uint32_t channel_mask;
+    uint32_t format;
+    uint32_t source;
+    char address[];              /* rest of the payload, not terminated */
+} call_record_open_t;
+
+typedef struct __attribute__((packed)) call_record_patch {
+    int32_t handle_in;           /* *handle on entry, not NONE for an update */
+    uint32_t num_sources;
+    uint32_t num_sinks;
+    /* followed by num_sources + num_sinks struct audio_port_config */
+} call_record_patch_t;
+
+#define CALL_RECORD_MAX_PAYLOAD 4096
+
+/*
+ * Opt-in recorder of the HAL entry points, for replaying field traffic
+ * offline with hal_replay and the PAL simulator.
+ *
+ * Records are appended to a memory buffer under a short lock and a
+ * writer thread moves them to the file, so the calling audio threads
+ * never wait on storage. Recording stops once the file reaches its size
+ * limit.
+ *
+ *   vendor.audio.call_record.enable   off by default
+ *   vendor.audio.call_record.path     /data/vendor/audio/ahal_calls.bin
+ *   vendor.audio.call_record.max_mb   64
+ */
+class CallRecorder {
+public:
+    static inline bool Enabled() { return enabled_.load(std::memory_order_relaxed); }
+    static inline uint64_t Now() {
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    }
+    static inline uint64_t NextSeq() { return seq_.fetch_add(1, std::memory_order_relaxed); }
+    static void Record(call_record_type_t type, int32_t handle, uint64_t seq, uint64_t start_ns,
+                       int32_t ret, const void *payload, size_t payload_len);
+
+    static void Init();
+    static void Dump(int fd);
+
+private:
+    static void WriterLoop();
+    static void Flush();
+
+    static std::atomic<bool> enabled_;
+    static std::atomic<uint64_t> seq_;
+};
+
+/* records the call when it goes out of scope, with the time it took */
+class AutoCallRecord {
+public:
+    AutoCallRecord(call_record_type_t type, int32_t handle,
+                   const void *payload = nullptr, size_t payload_len = 0) :
+        type_(type), handle_(handle), ret_(0), payload_(payload), payload_len_(payload_len),
+        start_ns_(CallRecorder::Enabled() ? CallRecorder::Now() : 0),
+        seq_(start_ns_ ? CallRecorder::NextSeq() : 0) {}
+    ~AutoCallRecord() {
+        if (start_ns_)
+            CallRecorder::Record(type_, handle_, seq_, start_ns_, ret_, payload_, payload_len_);
+    }
+    bool Active() const { return start_ns_ != 0; }
+    int SetRet(int ret) { ret_ = ret; return ret; }
+    void SetHandle(int32_t handle) { handle_ = handle; }
+    void SetPayload(const void *payload, size_t payload_len) {
+        payload_ = payload;
+        payload_len_ = payload_len;
+    }
+
+private:
+    call_record_type_t type_;
+    int32_t handle_;
+    int32_t ret_;
+    const void *payload_;
+    size_t payload_len_;
+    uint64_t start_ns_;
+    uint64_t seq_;
+};
+
+#endif  // ANDROID_HARDWARE_AHAL_CALL_RECORDER_H_
@@ -0,0 +1,356 @@
+/*
+ * Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+#define LOG_TAG "AHAL: LatencyProbe"
+
+#include "AudioCommon.h"
+#include "LatencyProbe.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#define PROBE_MLS_LEN 127           /* one period of a 7 bit LFSR */
+#define PROBE_AMPLITUDE 16384       /* -6 dBFS */
+#define PROBE_INTERVAL_MS 300       /* room for the previous burst to die out */
+#define PROBE_TIMEOUT_MS 1000
+#define PROBE_MAX_BURSTS 100
+#define PROBE_MIN_HITS 3            /* needed before a result is applied */
+#define PROBE_THRESHOLD 0.5         /* normalized correlation of a hit */
+
+typedef struct probe_result {
+    int usecase;
+    std::string out_devices;
+    std::string in_devices;
+    uint32_t bursts;
+    uint32_t hits;
+    double min_ms;
+    double median_ms;
+    double max_ms;
+    double jitter_ms;               /* standard deviation */
+    double capture_ms;              /* source latency of the capture, 0 if unknown */
+    bool applied;
+} probe_result_t;
+
+std::atomic<bool> LatencyProbe::active_(false);
+
+static std::mutex probe_mutex;
+static int8_t probe_mls[PROBE_MLS_LEN];
+static int bursts_total;
+static int bursts_left;
+static const void *out_owner;
+static const void *in_owner;
+static int out_usecase;
+static std::string out_devices;
+static std::string in_devices;
+static int64_t in_latency_us;
+static size_t burst_cursor;         /* burst samples written so far, 0 when idle */
+static bool in_flight;
+static uint64_t emit_ns;
+static uint64_t next_emit_ns;
+static std::vector<float> in_hist;
+static std::vector<double> run_ms;
+static std::map<std::string, probe_result_t> probe_results;
+static std::map<std::string, uint32_t> probe_output_ms;
+static std::atomic<bool> probe_applied(false);
+static probe_result_t last_result;
+static bool have_last_result;
+
+static uint64_t probe_now_ns() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static std::string probe_devices_str(const std::set<audio_devices_t>& devices) {
+    std::string str;
+    char dev[16];
+
+    for (auto d : devices) {
+        snprintf(dev, sizeof(dev), "%s%#x", str.empty() ? "" : "+", d);
+        str += dev;
+    }
+    return str.empty() ? "none" : str;
+}
+
+static std::string probe_output_key(int usecase, const std::string& devices) {
+    return std::to_string(usecase) + "/" + devices;
+}
+
+static void probe_init_mls() {
+    uint32_t lfsr = 0x7f;
+
+    for (int i = 0; i < PROBE_MLS_LEN; i++) {
+        uint32_t bit = ((lfsr >> 6) ^ (lfsr >> 5)) & 1;
+
+        probe_mls[i] = (lfsr & 1) ? 1 : -1;
+        lfsr = ((lfsr << 1) | bit) & 0x7f;
+    }
+}
+
+static void probe_reset_run() {
+    bursts_total = 0;
+    bursts_left = 0;
+    out_owner = nullptr;
+    in_owner = nullptr;
+    burst_cursor = 0;
+    in_flight = false;
+    in_hist.clear();
+    run_ms.clear();
+}
+
+/* called with probe_mutex held once the last burst was found or lost */
+static void probe_finish() {
+    probe_result_t r = {};
+    double sum = 0;
+    double var = 0;
+    size_t n = run_ms.size();
+
+    r.usecase = out_usecase;
+    r.out_devices = out_devices;
+    r.in_devices = in_devices;
+    r.bursts = bursts_total;
+    r.hits = n;
+    r.capture_ms = in_latency_us / 1000.0;
+    if (n) {
+        std::sort(run_ms.begin(), run_ms.end());
+        for (double ms : run_ms)
+            sum += ms;
+        for (double ms : run_ms)
+            var += (ms - sum / n) * (ms - sum / n);
+        r.min_ms = run_ms.front();
+        r.max_ms = run_ms.back();
+        r.median_ms = run_ms[n / 2];
+        r.jitter_ms = sqrt(var / n);
+    }
+    /*
+     * A route that loses most bursts is not trusted, and without the
+     * capture side latency the round trip says nothing about the output.
+     */
+    if (n >= PROBE_MIN_HITS && n * 2 >= (size_t)bursts_total && r.capture_ms > 0 &&
+        r.median_ms > r.capture_ms) {
+        probe_output_ms[probe_output_key(out_usecase, out_devices)] =
+                (uint32_t)lround(r.median_ms - r.capture_ms);
+        probe_applied = true;
+        r.applied = true;
+    }
+
+    AHAL_INFO("usecase %d out %s in %s: %u/%u hits, round trip %.2f ms (%.2f..%.2f), "
+              "jitter %.2f ms, capture %.2f ms%s", r.usecase, r.out_devices.c_str(),
+              r.in_devices.c_str(), r.hits, r.bursts, r.median_ms, r.min_ms, r.max_ms,
+              r.jitter_ms, r.capture_ms, r.applied ? ", applied" : "");
+    probe_results[r.out_devices + " -> " + r.in_devices + " uc " + std::to_string(r.usecase)] = r;
+    last_result = r;
+    have_last_result = true;
+    probe_reset_run();
+}
+
+/* called with probe_mutex held, true once the run is over */
+static bool probe_check_timeout(uint64_t now) {
+    if (in_flight && !burst_cursor && now - emit_ns > PROBE_TIMEOUT_MS * 1000000ULL) {
+        AHAL_DBG("burst %d lost", bursts_total - bursts_left);
+        in_flight = false;
+        in_hist.clear();
+        next_emit_ns = now;
+    }
+    if (!in_flight && !burst_cursor && !bursts_left && bursts_total) {
+        probe_finish();
+        return true;
+    }
+    return false;
+}
+
+int LatencyProbe::SetParam(const char *value) {
+    std::lock_guard<std::mutex> lock(probe_mutex);
+    int bursts;
+
+    if (!strcmp(value, "clear")) {
+        probe_results.clear();
+        probe_output_ms.clear();
+        probe_applied = false;
+        have_last_result = false;
+        AHAL_INFO("results cleared");
+        return 0;
+    }
+
+    bursts = atoi(value);
+    probe_reset_run();
+    if (bursts <= 0) {
+        active_ = false;
+        return 0;
+    }
+    if (!probe_mls[0])
+        probe_init_mls();
+    bursts_total = bursts_left = std::min(bursts, PROBE_MAX_BURSTS);
+    next_emit_ns = probe_now_ns();
+    active_ = true;
+    AHAL_INFO("measuring %d bursts", bursts_total);
+    return 0;
+}
+
+void LatencyProbe::GetParam(char *reply, size_t len) {
+    std::lock_guard<std::mutex> lock(probe_mutex);
+    const probe_result_t *r = &last_result;
+
+    if (Active()) {
+        snprintf(reply, len, "state:running,burst:%d,bursts:%d,hits:%zu",
+                 bursts_total - bursts_left, bursts_total, run_ms.size());
+    } else if (have_last_result) {
+        snprintf(reply, len, "state:done,rt_ms:%.2f,min_ms:%.2f,max_ms:%.2f,jitter_ms:%.2f,"
+                 "capture_ms:%.2f,hits:%u,bursts:%u,applied:%d", r->median_ms, r->min_ms,
+                 r->max_ms, r->jitter_ms, r->capture_ms, r->hits, r->bursts, r->applied);
+    } else {
+        snprintf(reply, len, "state:idle");
+    }
+}
+
+bool LatencyProbe::WantsWrite(const void *stream) {
+    std::lock_guard<std::mutex> lock(probe_mutex);
+    uint64_t now = probe_now_ns();
+
+    if (probe_check_timeout(now))
+        active_ = false;
+    if (!Active() || (out_owner && out_owner != stream))
+        return false;
+    if (burst_cursor)
+        return true;
+    /* no point in a burst before someone listens for it */
+    return in_owner && !in_flight && bursts_left > 0 && now >= next_emit_ns;
+}
+
+void LatencyProbe::OnWrite(const void *stream, int usecase,
+                           const std::set<audio_devices_t>& devices,
+                           int16_t *buf, size_t frames, uint32_t channels) {
+    std::lock_guard<std::mutex> lock(probe_mutex);
+    size_t n;
+
+    if (!Active() || (out_owner && out_owner != stream) || !channels)
+        return;
+    if (!burst_cursor) {
+        if (in_flight || bursts_left <= 0)
+            return;
+        out_owner = stream;
+        out_usecase = usecase;
+        out_devices = probe_devices_str(devices);
+        emit_ns = probe_now_ns();
+        in_flight = true;
+        bursts_left--;
+        in_hist.clear();
+    }
+
+    n = std::min(frames, (size_t)PROBE_MLS_LEN - burst_cursor);
+    for (size_t i = 0; i < n; i++) {
+        for (uint32_t c = 0; c < channels; c++)
+            buf[i * channels + c] = probe_mls[burst_cursor + i] * PROBE_AMPLITUDE;
+    }
+    burst_cursor = (burst_cursor + n) % PROBE_MLS_LEN;
+}
+
+void LatencyProbe::OnRead(const void *stream, const std::set<audio_devices_t>& devices,
+                          const int16_t *buf, size_t frames, uint32_t channels, uint32_t rate,
+                          int64_t source_latency_us) {
+    std::lock_guard<std::mutex> lock(probe_mutex);
+    uint64_t now = probe_now_ns();
+    double best = 0;
+    size_t best_lag = 0;
+    double energy = 0;
+
+    if (!Active() || (in_owner && in_owner != stream) || !channels || !rate)
+        return;
+    if (!in_owner) {
+        in_owner = stream;
+        in_devices = probe_devices_str(devices);
+        in_latency_us = source_latency_us;
+    }
+    if (!in_flight) {
+        if (probe_check_timeout(now))
+            active_ = false;
+        return;
+    }
+
+    for (size_t i = 0; i < frames; i++)
+        in_hist.push_back(buf[i * channels]);
+    if (in_hist.size() < PROBE_MLS_LEN)
+        return;
+
+    for (size_t i = 0; i < PROBE_MLS_LEN; i++)
+        energy += in_hist[i] * in_hist[i];
+    for (size_t lag = 0; lag + PROBE_MLS_LEN <= in_hist.size(); lag++) {
+        double corr = 0;
+
+        if (lag) {
+            energy += in_hist[lag + PROBE_MLS_LEN - 1] * in_hist[lag + PROBE_MLS_LEN - 1] -
+                      in_hist[lag - 1] * in_hist[lag - 1];
+        }
+        if (energy <= 0)
+            continue;
+        for (size_t i = 0; i < PROBE_MLS_LEN; i++)
+            corr += in_hist[lag + i] * probe_mls[i];
+        corr /= sqrt(energy * PROBE_MLS_LEN);
+        if (fabs(corr) > best) {
+            best = fabs(corr);
+            best_lag = lag;
+        }
+    }
+
+    if (best >= PROBE_THRESHOLD) {
+        /* the newest sample was captured now, count back to the burst start */
+        uint64_t detect_ns = now - (uint64_t)(in_hist.size() - best_lag) * 1000000000ULL / rate;
+
+        if (detect_ns > emit_ns) {
+            run_ms.push_back((detect_ns - emit_ns) / 1000000.0);
+            AHAL_DBG("burst %d: %.2f ms, correlation %.2f", bursts_total - bursts_left,
+                     run_ms.back(), best);
+            in_flight = false;
+            in_hist.clear();
+            next_emit_ns = now + PROBE_INTERVAL_MS * 1000000ULL;
+            if (probe_check_timeout(now))
+                active_ = false;
+            return;
+        }
+    }
+    /* keep what a burst straddling into the next buffer needs */
+    if (in_hist.size() >= PROBE_MLS_LEN)
+        in_hist.erase(in_hist.begin(), in_hist.end() - (PROBE_MLS_LEN - 1));
+    if (probe_check_timeout(now))
+        active_ = false;
+}
+
+uint32_t LatencyProbe::Adjust(int usecase, const std::set<audio_devices_t>& devices,
+                              uint32_t latency_ms) {
+    if (!probe_applied.load(std::memory_order_relaxed))
+        return latency_ms;
+
+    std::lock_guard<std::mutex> lock(probe_mutex);
+    auto it = probe_output_ms.find(probe_output_key(usecase, probe_devices_str(devices)));
+
+    return it != probe_output_ms.end() ? it->second : latency_ms;
+}
+
+void LatencyProbe::Dump(int fd) {
+    std::lock_guard<std::mutex> lock(probe_mutex);
+
+    if (probe_results.empty() && !Active())
+        return;
+    dprintf(fd, "Latency probe%s (route: hits/bursts, round trip median min..max ms, "
+                "jitter ms, capture latency ms):\n",
+            Active() ? " (running)" : "");
+    for (auto& it : probe_results) {
+        const probe_result_t *r = &it.second;
+
+        dprintf(fd, "  %s: %u/%u, %.2f %.2f..%.2f, %.2f, %.2f%s\n", it.first.c_str(), r->hits,
+                r->bursts, r->median_ms, r->min_ms, r->max_ms, r->jitter_ms, r->capture_ms,
+                r->applied ? ", output latency applied" : "");
+    }
+}
@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+#ifndef ANDROID_HARDWARE_AHAL_LATENCY_PROBE_H_
+#define ANDROID_HARDWARE_AHAL_LATENCY_PROBE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <set>
+
+#include <system/audio.h>
+
+/*
+ * Round trip latency measurement of the running routes.
+ *
+ * set_parameters "latency_probe=<bursts>" arms a run: the first 16 bit PCM
+ * output to write gets a 127 sample MLS burst at the start of a buffer,
+ * the first 16 bit PCM capture looks for it by cross correlation, and the
+ * time from the write() of the burst to the read() that returned it is
+ * one round trip. "latency_probe=0" stops a run, "latency_probe=clear"
+ * drops all results.
+ *
+ * The path back to capture is up to the tester: an acoustic path, the
+ * AFE proxy or a hardware loopback. The round trip includes the capture
+ * path, so a finished run with enough hits only replaces the output
+ * latency reported for that usecase and device when the capture stream
+ * knows its source latency, and then by the round trip minus that.
+ * Otherwise the result is only reported, in dumpsys and in
+ * get_parameters "latency_probe".
+ */
+class LatencyProbe {
+public:
+    static inline bool Active() { return active_.load(std::memory_order_relaxed); }
+
+    /* latency_probe=<value> */
+    static int SetParam(const char *value);
+    static void GetParam(char *reply, size_t len);
+
+    /* playback, true when this write should carry (part of) a burst */
+    static bool WantsWrite(const void *stream);
+    /* overwrites the start of buf, called with the stream lock held */
+    static void OnWrite(const void *stream, int usecase, const std::set<audio_devices_t>& devices,
+                        int16_t *buf, size_t frames, uint32_t channels);
+    /* capture, called after every read with the stream lock held */
+    static void OnRead(const void *stream, const std::set<audio_devices_t>& devices,
+                       const int16_t *buf, size_t frames, uint32_t channels, uint32_t rate,
+                       int64_t source_latency_us);
+
+    /* output latency to report for usecase on devices, latency_ms if never measured */
+    static uint32_t Adjust(int usecase, const std::set<audio_devices_t>& devices,
+                           uint32_t latency_ms);
+
+    static void Dump(int fd);
+
+private:
+    static std::atomic<bool> active_;
+};
+
+#endif  // ANDROID_HARDWARE_AHAL_LATENCY_PROBE_H_
@@ -0,0 +1,152 @@
+/*
+ * Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+#define LOG_TAG "AHAL: MetadataAggregator"
+
+#include "AudioCommon.h"
+#include "MetadataAggregator.h"
+#include "ThreadPolicy.h"
+
+#include <cutils/properties.h>
+
+MetadataAggregator::MetadataAggregator(const char *name, send_fn_t send) :
+    name_(name),
+    send_(send),
+    debounce_(property_get_int32("vendor.audio.bt.metadata_debounce_ms",
+                                 METADATA_DEBOUNCE_DEFAULT_MS)) {
+}
+
+MetadataAggregator::~MetadataAggregator() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        exit_ = true;
+    }
+    timer_cv_.notify_all();
+    if (timer_.joinable())
+        timer_.join();
+}
+
+/* PAL only counts as having the aggregate once it accepted it */
+int MetadataAggregator::SendLocked() {
+    std::vector<track_key_t> tracks;
+    int ret;
+
+    for (auto& count : counts_)
+        tracks.insert(tracks.end(), count.second, count.first);
+
+    AHAL_DBG("%s: %zu tracks", name_, tracks.size());
+    attempt_at_ = std::chrono::steady_clock::now();
+    ret = send_(tracks);
+    if (ret) {
+        AHAL_ERR("%s: metadata update failed %d, retry in %lld ms", name_, ret,
+                 (long long)debounce_.count());
+        failed_ = true;
+        pending_ = true;
+        KickTimerLocked();
+        return ret;
+    }
+    sent_ = counts_;
+    sent_at_ = attempt_at_;
+    failed_ = false;
+    pending_ = false;
+    return 0;
+}
+
+bool MetadataAggregator::KickTimerLocked() {
+    if (!timer_.joinable()) {
+        try {
+            timer_ = std::thread(&MetadataAggregator::TimerLoop, this);
+        } catch (const std::exception& e) {
+            return false;
+        }
+    }
+    timer_cv_.notify_all();
+    return true;
+}
+
+void MetadataAggregator::TimerLoop() {
+    std::chrono::steady_clock::time_point deadline;
+
+    ThreadPolicy::Apply(AHAL_THREAD_TIMER);
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    while (!exit_) {
+        if (!pending_) {
+            timer_cv_.wait(lock);
+            continue;
+        }
+        /* a failed send is retried one debounce window after the attempt */
+        deadline = attempt_at_ + debounce_;
+        if (timer_cv_.wait_until(lock, deadline) != std::cv_status::timeout)
+            continue;
+        ThreadPolicy::RecordWakeup(AHAL_THREAD_TIMER,
+                std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - deadline).count());
+        /* SendLocked() leaves pending_ set when PAL refused the update */
+        if (pending_ && (failed_ || counts_ != sent_))
+            SendLocked();
+        else
+            pending_ = false;
+    }
+}
+
+int MetadataAggregator::Update(const void *stream,
+                               const std::vector<track_key_t>& tracks, bool send) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& prev = streams_[stream];
+
+    if (prev != tracks) {
+        for (auto& track : prev) {
+            auto it = counts_.find(track);
+            if (it != counts_.end() && !--it->second)
+                counts_.erase(it);
+        }
+        for (auto& track : tracks)
+            counts_[track]++;
+        prev = tracks;
+    }
+
+    if (!send || (counts_ == sent_ && !failed_))
+        return 0;
+
+    if (std::chrono::steady_clock::now() - sent_at_ >= debounce_)
+        return SendLocked();
+
+    /* churn, let the timer send whatever the aggregate is when it settles */
+    pending_ = true;
+    if (!KickTimerLocked()) {
+        AHAL_WARN("%s: no debounce thread, send now", name_);
+        return SendLocked();
+    }
+    return 0;
+}
+
+void MetadataAggregator::Remove(const void *stream) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto entry = streams_.find(stream);
+
+    if (entry == streams_.end())
+        return;
+
+    for (auto& track : entry->second) {
+        auto it = counts_.find(track);
+        if (it != counts_.end() && !--it->second)
+            counts_.erase(it);
+    }
+    streams_.erase(entry);
+}
+
+int MetadataAggregator::Flush() {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    return SendLocked();
+}
+
+void MetadataAggregator::CancelPending() {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    pending_ = false;
+    failed_ = false;
+}
@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+#ifndef ANDROID_HARDWARE_AHAL_METADATA_AGGREGATOR_H_
+#define ANDROID_HARDWARE_AHAL_METADATA_AGGREGATOR_H_
+
+#include <stdint.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#define METADATA_DEBOUNCE_DEFAULT_MS 50
+
+/*
+ * Keeps the Bluetooth source or sink metadata of all streams as one
+ * aggregate, updated by per-stream deltas instead of walking every stream.
+ *
+ * A track is reduced to the fields BT looks at (usage and content type
+ * for playback, source for capture) and the aggregate is a count per
+ * track key. PAL only hears about it when the counts change. The first
+ * change after a quiet period is sent right away, changes within the
+ * debounce window after that are folded into one trailing update. An
+ * update PAL refuses is not taken as sent, the timer retries it one
+ * debounce window later until PAL takes it or a call cancels it.
+ */
+class MetadataAggregator {
+public:
+    typedef std::pair<uint32_t, uint32_t> track_key_t;
+    typedef std::function<int(const std::vector<track_key_t>&)> send_fn_t;
+
+    MetadataAggregator(const char *name, send_fn_t send);
+    ~MetadataAggregator();
+    MetadataAggregator(const MetadataAggregator&) = delete;
+    MetadataAggregator& operator=(const MetadataAggregator&) = delete;
+
+    /* replaces the tracks of one stream, send false only records them */
+    int Update(const void *stream, const std::vector<track_key_t>& tracks, bool send);
+    /* drops a closed stream, PAL hears about it with the next update */
+    void Remove(const void *stream);
+    /* sends the aggregate now, even if PAL already has it */
+    int Flush();
+    /* drops a trailing update, used while a call owns the BT metadata */
+    void CancelPending();
+
+private:
+    int SendLocked();
+    bool KickTimerLocked();
+    void TimerLoop();
+
+    const char *name_;
+    send_fn_t send_;
+    std::mutex mutex_;
+    std::map<const void*, std::vector<track_key_t>> streams_;
+    std::map<track_key_t, uint32_t> counts_;
+    std::map<track_key_t, uint32_t> sent_;      /* what PAL accepted last */
+    std::chrono::steady_clock::time_point sent_at_;
+    std::chrono::steady_clock::time_point attempt_at_;
+    bool failed_ = false;       /* last send refused, PAL may hold anything */
+    std::chrono::milliseconds debounce_;
+
+    std::thread timer_;
+    std::condition_variable timer_cv_;
+    bool pending_ = false;
+    bool exit_ = false;
+};
+
+#endif  // ANDROID_HARDWARE_AHAL_METADATA_AGGREGATOR_H_
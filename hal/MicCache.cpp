@@ -0,0 +1,155 @@
+/*
+ * Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+#define LOG_TAG "AHAL: MicCache"
+
+#include "AudioCommon.h"
+#include "MicCache.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string>
+
+uint64_t MicCacheHash(const void *data, size_t len)
+{
+    const uint8_t *p = (const uint8_t *)data;
+    uint64_t hash = 0xcbf29ce484222325ULL;
+
+    for (size_t i = 0; i < len; i++) {
+        hash ^= p[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+int MicCacheFingerprint(const char *xml_path, size_t payload_size, mic_cache_header_t *hdr)
+{
+    struct stat st;
+    void *addr = MAP_FAILED;
+    int fd = -1;
+    int ret = 0;
+
+    memset(hdr, 0, sizeof(*hdr));
+    fd = open(xml_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -errno;
+
+    if (fstat(fd, &st) || st.st_size <= 0) {
+        ret = -EIO;
+        goto done;
+    }
+
+    addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr == MAP_FAILED) {
+        ret = -errno;
+        goto done;
+    }
+
+    hdr->magic = MIC_CACHE_MAGIC;
+    hdr->version = MIC_CACHE_VERSION;
+    hdr->payload_size = payload_size;
+    hdr->xml_mtime_sec = st.st_mtim.tv_sec;
+    hdr->xml_mtime_nsec = st.st_mtim.tv_nsec;
+    hdr->xml_size = st.st_size;
+    hdr->xml_hash = MicCacheHash(addr, st.st_size);
+    munmap(addr, st.st_size);
+
+done:
+    close(fd);
+    return ret;
+}
+
+int MicCacheLoad(const char *cache_path, const mic_cache_header_t *expected,
+                 void *payload, size_t size)
+{
+    struct stat st;
+    const mic_cache_header_t *hdr = NULL;
+    const uint8_t *image = NULL;
+    void *addr = MAP_FAILED;
+    size_t file_size = sizeof(mic_cache_header_t) + size;
+    int fd = -1;
+    int ret = -EINVAL;
+
+    if (expected->payload_size != size)
+        return -EINVAL;
+
+    fd = open(cache_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -errno;
+
+    if (fstat(fd, &st) || (size_t)st.st_size != file_size)
+        goto done;
+
+    addr = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr == MAP_FAILED) {
+        ret = -errno;
+        goto done;
+    }
+
+    hdr = (const mic_cache_header_t *)addr;
+    image = (const uint8_t *)addr + sizeof(*hdr);
+    if (hdr->magic != expected->magic ||
+        hdr->version != expected->version ||
+        hdr->payload_size != expected->payload_size ||
+        hdr->xml_mtime_sec != expected->xml_mtime_sec ||
+        hdr->xml_mtime_nsec != expected->xml_mtime_nsec ||
+        hdr->xml_size != expected->xml_size ||
+        hdr->xml_hash != expected->xml_hash ||
+        hdr->payload_hash != MicCacheHash(image, size)) {
+        AHAL_DBG("stale microphone cache");
+        goto unmap;
+    }
+
+    memcpy(payload, image, size);
+    ret = 0;
+
+unmap:
+    munmap(addr, file_size);
+done:
+    close(fd);
+    return ret;
+}
+
+int MicCacheStore(const char *cache_path, mic_cache_header_t *hdr,
+                  const void *payload, size_t size)
+{
+    std::string tmp = std::string(cache_path) + ".tmp";
+    int fd = -1;
+    int ret = 0;
+
+    hdr->payload_size = size;
+    hdr->payload_hash = MicCacheHash(payload, size);
+
+    fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0640);
+    if (fd < 0) {
+        ret = -errno;
+        AHAL_DBG("cannot create %s, errno %d", tmp.c_str(), errno);
+        return ret;
+    }
+
+    if (write(fd, hdr, sizeof(*hdr)) != sizeof(*hdr) ||
+        write(fd, payload, size) != (ssize_t)size ||
+        fsync(fd)) {
+        ret = errno ? -errno : -EIO;
+        AHAL_ERR("failed to write microphone cache, errno %d", errno);
+        close(fd);
+        unlink(tmp.c_str());
+        return ret;
+    }
+    close(fd);
+
+    /* readers only ever see a complete file */
+    if (rename(tmp.c_str(), cache_path)) {
+        ret = -errno;
+        AHAL_ERR("failed to install microphone cache, errno %d", errno);
+        unlink(tmp.c_str());
+    }
+    return ret;
+}
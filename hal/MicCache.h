@@ -0,0 +1,44 @@
+/*
+ * Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+#ifndef ANDROID_HARDWARE_AHAL_MIC_CACHE_H_
+#define ANDROID_HARDWARE_AHAL_MIC_CACHE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MIC_CACHE_MAGIC   0x43494d41  /* "AMIC" */
+#define MIC_CACHE_VERSION 1
+
+/*
+ * The parsed microphone tables are cached as a flat image so later boots
+ * skip expat. The image is only trusted if it was built from an XML with
+ * the same mtime, size and content hash, by a HAL with the same table
+ * layout.
+ */
+typedef struct mic_cache_header_t {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t payload_size;
+    uint32_t reserved;
+    int64_t xml_mtime_sec;
+    int64_t xml_mtime_nsec;
+    uint64_t xml_size;
+    uint64_t xml_hash;
+    uint64_t payload_hash;
+} mic_cache_header_t;
+
+/* FNV-1a, only guards against stale or torn files */
+uint64_t MicCacheHash(const void *data, size_t len);
+/* header a cache built from xml_path would carry, payload hash left 0 */
+int MicCacheFingerprint(const char *xml_path, size_t payload_size, mic_cache_header_t *hdr);
+/* fills payload from cache_path if it matches expected, -EINVAL if stale */
+int MicCacheLoad(const char *cache_path, const mic_cache_header_t *expected,
+                 void *payload, size_t size);
+/* writes hdr and payload through a temp file renamed into place */
+int MicCacheStore(const char *cache_path, mic_cache_header_t *hdr,
+                  const void *payload, size_t size);
+
+#endif  // ANDROID_HARDWARE_AHAL_MIC_CACHE_H_
@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+#define LOG_TAG "AHAL: MmapPosition"
+
+#include "AudioCommon.h"
+#include "MmapPosition.h"
+
+#include <inttypes.h>
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include <cutils/properties.h>
+
+void MmapPosition::Configure(bool output, uint32_t sample_rate, uint32_t frame_size,
+                             const struct audio_mmap_buffer_info *info) {
+    enabled_ = property_get_bool("vendor.audio.mmap.position_filter", true) &&
+               sample_rate && info->burst_size_frames > 0;
+    sample_rate_ = sample_rate;
+    burst_frames_ = info->burst_size_frames;
+    nominal_rate_ = sample_rate / 1e9;
+    Reset();
+
+    if (output && info->shared_memory_address && info->buffer_size_frames > 0 && frame_size)
+        memset(info->shared_memory_address, 0, (size_t)info->buffer_size_frames * frame_size);
+
+    AHAL_DBG("rate %u, buffer %d frames, burst %d frames, filter %s", sample_rate,
+             info->buffer_size_frames, info->burst_size_frames, enabled_ ? "on" : "off");
+}
+
+void MmapPosition::Reset() {
+    locked_ = false;
+    rate_ = nominal_rate_;
+    base_frames_ = 0;
+    base_ns_ = 0;
+    last_frames_ = 0;
+    last_ns_ = 0;
+    updates_ = 0;
+    aligned_ = 0;
+    resyncs_ = 0;
+    max_raw_error_ = 0;
+    max_correction_ = 0;
+}
+
+void MmapPosition::Update(struct audio_mmap_position *position) {
+    int64_t raw_frames = position->position_frames;
+    int64_t now_ns = position->time_nanoseconds;
+    double bound = burst_frames_;
+    double predicted, error;
+    int64_t frames;
+
+    /* no timestamp until the DSP has moved */
+    if (!enabled_ || now_ns <= 0)
+        return;
+
+    updates_++;
+    if (raw_frames % burst_frames_ == 0)
+        aligned_++;
+
+    if (locked_) {
+        if (now_ns <= base_ns_) {
+            /* nothing newer than the last report */
+            position->position_frames = (int32_t)last_frames_;
+            position->time_nanoseconds = last_ns_;
+            return;
+        }
+
+        predicted = base_frames_ + (now_ns - base_ns_) * rate_;
+        error = raw_frames - predicted;
+        if (fabs(error) > 2 * bound) {
+            AHAL_DBG("resync: PAL %" PRId64 " expected %.0f", raw_frames, predicted);
+            resyncs_++;
+            locked_ = false;
+            if (raw_frames < last_frames_)
+                last_frames_ = 0;
+        } else {
+            max_raw_error_ = std::max(max_raw_error_, fabs(error));
+            rate_ += kRateGain * error / (now_ns - base_ns_);
+            rate_ = std::min(std::max(rate_, nominal_rate_ * (1 - kMaxDriftPpm / 1e6)),
+                             nominal_rate_ * (1 + kMaxDriftPpm / 1e6));
+            base_frames_ = predicted + kPhaseGain * error;
+            base_ns_ = now_ns;
+        }
+    }
+
+    if (!locked_) {
+        locked_ = true;
+        rate_ = nominal_rate_;
+        base_frames_ = raw_frames;
+        base_ns_ = now_ns;
+    }
+
+    /*
+     * Never ahead of PAL: a capture client would read frames the DSP has
+     * not written yet, a playback client overwrite frames not yet read.
+     */
+    frames = llround(std::min(std::max(base_frames_, raw_frames - bound), (double)raw_frames));
+    frames = std::max(frames, last_frames_);
+    now_ns = std::max(now_ns, last_ns_);
+    max_correction_ = std::max(max_correction_, fabs((double)(frames - raw_frames)));
+
+    last_frames_ = frames;
+    last_ns_ = now_ns;
+    position->position_frames = (int32_t)frames;
+    position->time_nanoseconds = now_ns;
+}
+
+void MmapPosition::LogStats(const char *tag) {
+    if (!enabled_ || !updates_)
+        return;
+
+    AHAL_INFO("%s: %u positions, %u%% burst aligned, %u resyncs, jitter %.0f us, "
+              "max correction %.0f us", tag, updates_,
+              aligned_ * 100 / updates_, resyncs_, max_raw_error_ * 1e6 / sample_rate_,
+              max_correction_ * 1e6 / sample_rate_);
+}
@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+#ifndef ANDROID_HARDWARE_AHAL_MMAP_POSITION_H_
+#define ANDROID_HARDWARE_AHAL_MMAP_POSITION_H_
+
+#include <stdint.h>
+
+#include <system/audio.h>
+
+/*
+ * Position service of an MMAP stream. PAL reports the DMA position with
+ * the time it was read, which moves in DSP bursts and carries the latency
+ * of the query itself; AAudio derives its write-ahead from the jitter it
+ * sees, so every burst of jitter is a burst of latency.
+ *
+ * Positions go through a second order delay locked loop running at the
+ * nominal rate: the estimate is monotonic in frames and time, follows the
+ * DSP clock drift and stays up to one burst behind what PAL reported, never
+ * ahead of it. A jump larger than two bursts (xrun, DSP restart) resyncs
+ * the loop.
+ *
+ * Configure() also fills a new playback buffer with silence, so the start
+ * threshold the DSP fetches before the client's first burst lands plays
+ * silence instead of whatever the memory held.
+ */
+class MmapPosition {
+public:
+    void Configure(bool output, uint32_t sample_rate, uint32_t frame_size,
+                   const struct audio_mmap_buffer_info *info);
+    /* on start, stop and standby */
+    void Reset();
+    /* filters a PAL position in place */
+    void Update(struct audio_mmap_position *position);
+    /* jitter and burst alignment since the last Reset() */
+    void LogStats(const char *tag);
+
+private:
+    /* ~32 updates to settle; positions are burst quantized, so slow beats tight */
+    static constexpr double kPhaseGain = 1.0 / 32;
+    static constexpr double kRateGain = kPhaseGain * kPhaseGain / 16;
+    static constexpr double kMaxDriftPpm = 500.0;
+
+    bool enabled_ = false;
+    uint32_t sample_rate_ = 0;
+    int32_t burst_frames_ = 0;
+    double nominal_rate_ = 0;       /* frames per ns */
+
+    bool locked_ = false;
+    double rate_ = 0;
+    double base_frames_ = 0;
+    int64_t base_ns_ = 0;
+    int64_t last_frames_ = 0;
+    int64_t last_ns_ = 0;
+
+    uint32_t updates_ = 0;
+    uint32_t aligned_ = 0;
+    uint32_t resyncs_ = 0;
+    double max_raw_error_ = 0;      /* frames */
+    double max_correction_ = 0;     /* frames */
+};
+
+#endif  // ANDROID_HARDWARE_AHAL_MMAP_POSITION_H_
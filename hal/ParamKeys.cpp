@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+#include "ParamKeys.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+/* compare the first len chars of key against a NUL terminated table key */
+static int param_key_cmp(const char *key, size_t len, const char *entry)
+{
+    int ret = strncmp(key, entry, len);
+
+    if (ret == 0 && entry[len] != '\0')
+        ret = -1;
+    return ret;
+}
+
+void SortParamKeys(std::vector<param_key_t>& keys) {
+    std::stable_sort(keys.begin(), keys.end(), [](const param_key_t& a, const param_key_t& b) {
+        return strcmp(a.key, b.key) < 0;
+    });
+}
+
+uint64_t MatchParamKeys(const std::vector<param_key_t>& keys, const char *kvpairs) {
+    uint64_t mask = 0;
+    const char *pair = kvpairs;
+
+    while (pair && *pair) {
+        const char *next = strchr(pair, ';');
+        size_t len = next ? (size_t)(next - pair) : strlen(pair);
+        const char *eq = (const char *)memchr(pair, '=', len);
+        size_t key_len = eq ? (size_t)(eq - pair) : len;
+        size_t lo = 0, hi = keys.size();
+
+        while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+            if (param_key_cmp(pair, key_len, keys[mid].key) > 0)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        for (; lo < keys.size() && !param_key_cmp(pair, key_len, keys[lo].key); lo++)
+            mask |= 1ULL << keys[lo].handler;
+
+        pair = next ? next + 1 : NULL;
+    }
+
+    return mask;
+}
@@ -0,0 +1,31 @@
+/*
+ * Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+#ifndef ANDROID_HARDWARE_AHAL_PARAM_KEYS_H_
+#define ANDROID_HARDWARE_AHAL_PARAM_KEYS_H_
+
+#include <stdint.h>
+
+#include <vector>
+
+/* parameter key owned by a SetParameters/GetParameters handler */
+typedef struct param_key_t {
+    const char *key;
+    uint32_t handler;
+} param_key_t;
+
+/*
+ * Sorts keys for MatchParamKeys(). A key may be owned by several handlers;
+ * they keep their table order.
+ */
+void SortParamKeys(std::vector<param_key_t>& keys);
+
+/*
+ * Bit mask of the handlers whose keys appear in kvpairs. The string is
+ * walked once and every key is binary searched, no str_parms lookups.
+ */
+uint64_t MatchParamKeys(const std::vector<param_key_t>& keys, const char *kvpairs);
+
+#endif  // ANDROID_HARDWARE_AHAL_PARAM_KEYS_H_
@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+#define LOG_TAG "AHAL: PerfLockPolicy"
+
+#include "AudioCommon.h"
+#include "PerfLockPolicy.h"
+
+#include <algorithm>
+#include <inttypes.h>
+#include <stdio.h>
+
+#include <cutils/properties.h>
+
+static const char * const op_names[PERF_LOCK_OP_MAX] = {"open", "start"};
+
+std::mutex PerfLockPolicy::mutex_;
+perf_lock_stats_t PerfLockPolicy::stats_[AUDIO_USECASE_MAX][PERF_LOCK_OP_MAX];
+
+static bool perf_lock_adaptive() {
+    static bool adaptive = property_get_bool("vendor.audio.perf_lock.adaptive", true);
+
+    return adaptive;
+}
+
+bool PerfLockPolicy::ShouldBoost(audio_usecase_t usecase, perf_lock_op_t op,
+                                 int *duration_ms) {
+    perf_lock_stats_t *s;
+    bool boost;
+
+    *duration_ms = 0;
+    if (!perf_lock_adaptive() || usecase < 0 || usecase >= AUDIO_USECASE_MAX ||
+        op >= PERF_LOCK_OP_MAX)
+        return true;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    s = &stats_[usecase][op];
+    s->ops++;
+
+    if (s->samples[0] < PERF_LOCK_PROBE_SAMPLES || s->samples[1] < PERF_LOCK_PROBE_SAMPLES)
+        boost = s->samples[1] <= s->samples[0];
+    else if (!(s->ops % PERF_LOCK_REPROBE_INTERVAL))
+        boost = !s->boost;
+    else
+        boost = s->boost;
+
+    /* only bound the lock once there is a boosted latency to go by */
+    if (boost && s->samples[1])
+        *duration_ms = std::min<int64_t>(PERF_LOCK_MAX_DURATION_MS,
+                                         s->mean_ns[1] * 2 / 1000000 + 1);
+    /* the lock is released when the op ends, so it would be held about that long */
+    if (!boost) {
+        s->skipped++;
+        s->avoided_ns += s->mean_ns[1];
+    }
+    return boost;
+}
+
+void PerfLockPolicy::Record(audio_usecase_t usecase, perf_lock_op_t op, bool boosted,
+                            uint64_t latency_ns) {
+    perf_lock_stats_t *s;
+    int64_t gain;
+    bool boost;
+
+    if (!perf_lock_adaptive() || usecase < 0 || usecase >= AUDIO_USECASE_MAX ||
+        op >= PERF_LOCK_OP_MAX)
+        return;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    s = &stats_[usecase][op];
+
+    if (!s->samples[boosted])
+        s->mean_ns[boosted] = latency_ns;
+    else
+        s->mean_ns[boosted] += ((int64_t)latency_ns - s->mean_ns[boosted]) / 8;
+    s->samples[boosted]++;
+
+    if (s->samples[0] < PERF_LOCK_PROBE_SAMPLES || s->samples[1] < PERF_LOCK_PROBE_SAMPLES)
+        return;
+
+    gain = s->mean_ns[0] - s->mean_ns[1];
+    boost = gain > s->mean_ns[0] * PERF_LOCK_MIN_GAIN_PCT / 100 && gain > PERF_LOCK_MIN_GAIN_NS;
+    if (boost != s->boost)
+        AHAL_DBG("%s %s: %s boost, %" PRId64 " us vs %" PRId64 " us unboosted",
+                 use_case_table[usecase], op_names[op], boost ? "keep" : "drop",
+                 s->mean_ns[1] / 1000, s->mean_ns[0] / 1000);
+    s->boost = boost;
+}
+
+void PerfLockPolicy::Dump(int fd) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint32_t skipped = 0;
+    uint64_t avoided_ns = 0;
+
+    if (!perf_lock_adaptive()) {
+        dprintf(fd, "Perf lock: fixed boost\n");
+        return;
+    }
+    dprintf(fd, "Perf lock (usecase op: decision, boosted/unboosted us, ops, skipped):\n");
+    for (int uc = 0; uc < AUDIO_USECASE_MAX; uc++) {
+        for (int op = 0; op < PERF_LOCK_OP_MAX; op++) {
+            perf_lock_stats_t *s = &stats_[uc][op];
+
+            if (!s->ops)
+                continue;
+            dprintf(fd, "  %s %s: %s, %" PRId64 "/%" PRId64 ", %u, %u\n",
+                    use_case_table[uc] ? use_case_table[uc] : "?", op_names[op],
+                    s->samples[0] < PERF_LOCK_PROBE_SAMPLES ||
+                    s->samples[1] < PERF_LOCK_PROBE_SAMPLES ? "probing" :
+                    s->boost ? "boost" : "none",
+                    s->mean_ns[1] / 1000, s->mean_ns[0] / 1000, s->ops, s->skipped);
+            skipped += s->skipped;
+            avoided_ns += s->avoided_ns;
+        }
+    }
+    dprintf(fd, "  %u boosts skipped, about %" PRIu64 " ms of boost hold avoided\n",
+            skipped, avoided_ns / 1000000);
+}
@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+#ifndef ANDROID_HARDWARE_AHAL_PERF_LOCK_POLICY_H_
+#define ANDROID_HARDWARE_AHAL_PERF_LOCK_POLICY_H_
+
+#include <stdint.h>
+
+#include <mutex>
+
+#include "AudioStream.h"
+
+#define PERF_LOCK_PROBE_SAMPLES 4      /* per arm before deciding */
+#define PERF_LOCK_REPROBE_INTERVAL 64  /* ops between probes of the other arm */
+#define PERF_LOCK_MIN_GAIN_PCT 10
+#define PERF_LOCK_MIN_GAIN_NS 2000000LL
+#define PERF_LOCK_MAX_DURATION_MS 1000
+
+typedef enum {
+    PERF_LOCK_OP_OPEN = 0,
+    PERF_LOCK_OP_START,
+    PERF_LOCK_OP_MAX,
+} perf_lock_op_t;
+
+typedef struct perf_lock_stats {
+    uint32_t samples[2];    /* [0] unboosted, [1] boosted */
+    int64_t mean_ns[2];     /* moving average of the op latency */
+    uint32_t ops;
+    uint32_t skipped;       /* ops that ran without the boost */
+    uint64_t avoided_ns;    /* boost hold time avoided, by the boosted mean */
+    bool boost;
+} perf_lock_stats_t;
+
+/*
+ * Decides per usecase and per operation whether stream open and start
+ * take the perf lock.
+ *
+ * Each usecase starts by timing a few ops with and without the boost.
+ * Once both sides have samples the boost is kept only if it makes the
+ * op at least PERF_LOCK_MIN_GAIN_PCT and PERF_LOCK_MIN_GAIN_NS faster,
+ * and it is held no longer than twice the boosted latency. Every
+ * PERF_LOCK_REPROBE_INTERVAL ops the other choice is sampled again so
+ * the decision follows load and thermal changes.
+ *
+ * Only an op that took the boost itself counts as boosted. An op left
+ * unboosted while another op held the lock is not recorded at all.
+ *
+ * vendor.audio.perf_lock.adaptive=false keeps the old fixed boost.
+ */
+class PerfLockPolicy {
+public:
+    /* returns true and the lock duration in ms if the op should boost */
+    static bool ShouldBoost(audio_usecase_t usecase, perf_lock_op_t op, int *duration_ms);
+    static void Record(audio_usecase_t usecase, perf_lock_op_t op, bool boosted,
+                       uint64_t latency_ns);
+    static void Dump(int fd);
+
+private:
+    static std::mutex mutex_;
+    static perf_lock_stats_t stats_[AUDIO_USECASE_MAX][PERF_LOCK_OP_MAX];
+};
+
+#endif  // ANDROID_HARDWARE_AHAL_PERF_LOCK_POLICY_H_
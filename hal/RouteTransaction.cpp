@@ -0,0 +1,299 @@
+/*
+ * Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+#define LOG_TAG "AHAL: RouteTransaction"
+#define ATRACE_TAG (ATRACE_TAG_AUDIO|ATRACE_TAG_HAL)
+
+#include "AudioCommon.h"
+
+#include "AudioDevice.h"
+#include "RouteTransaction.h"
+#include "ThreadPolicy.h"
+
+#include <map>
+#include <thread>
+#include <utils/Trace.h>
+
+#include <audio_extn/AudioExtn.h>
+
+int RouteTransaction::AddStream(std::shared_ptr<StreamPrimary> stream,
+                                const std::set<audio_devices_t>& devices,
+                                bool force_device_switch) {
+    if (committed_) {
+        AHAL_ERR("transaction already committed");
+        return -EINVAL;
+    }
+
+    if (!stream) {
+        AHAL_ERR("invalid stream");
+        return -EINVAL;
+    }
+
+    for (auto& entry : entries_) {
+        if (entry.stream == stream) {
+            entry.devices = devices;
+            entry.force_device_switch |= force_device_switch;
+            return 0;
+        }
+    }
+
+    entries_.push_back({stream, devices, stream->GetDevices(),
+                        force_device_switch, false, 0});
+    return 0;
+}
+
+int RouteTransaction::AddVoice(std::shared_ptr<AudioVoice> voice,
+                               const std::set<audio_devices_t>& rx_devices) {
+    if (committed_) {
+        AHAL_ERR("transaction already committed");
+        return -EINVAL;
+    }
+
+    if (!voice) {
+        AHAL_ERR("invalid voice");
+        return -EINVAL;
+    }
+
+    voice_ = voice;
+    voice_devices_ = rx_devices;
+    if (voice->stream_out_primary_)
+        voice_prev_devices_ = voice->stream_out_primary_->GetDevices();
+    return 0;
+}
+
+void RouteTransaction::Validate() {
+    std::shared_ptr<AudioDevice> adevice = AudioDevice::GetInstance();
+    std::vector<pal_device_id_t> pal_device_ids;
+    int count = 0;
+
+    /*
+     * RouteStream copes with devices PAL has no mapping for, so these are only
+     * logged to make a routing problem easier to find, never rejected.
+     */
+    for (auto& entry : entries_) {
+        bool is_output =
+            std::dynamic_pointer_cast<StreamOutPrimary>(entry.stream) != nullptr;
+
+        if (AudioExtn::audio_devices_empty(entry.devices) ||
+            AudioExtn::audio_devices_cmp(entry.devices, AUDIO_DEVICE_NONE))
+            continue;
+
+        for (auto device : entry.devices) {
+            if (is_output ? !audio_is_output_device(device) :
+                            !audio_is_input_device(device))
+                AHAL_WARN("device 0x%x does not match stream %d direction",
+                          device, entry.stream->GetHandle());
+        }
+
+        pal_device_ids.assign(entry.devices.size(), PAL_DEVICE_NONE);
+        count = adevice->GetPalDeviceIds(entry.devices, pal_device_ids.data());
+        if (count != entry.devices.size())
+            AHAL_WARN("device count mismatch for stream %d, expected %zu got %d",
+                      entry.stream->GetHandle(), entry.devices.size(), count);
+        for (auto id : pal_device_ids) {
+            if (id == PAL_DEVICE_NONE) {
+                AHAL_WARN("no PAL device for 0x%x on stream %d",
+                          AudioExtn::get_device_types(entry.devices),
+                          entry.stream->GetHandle());
+                break;
+            }
+        }
+    }
+}
+
+void RouteTransaction::ApplyGroup(const std::vector<route_entry_t*>& group) {
+    for (auto entry : group) {
+        entry->ret = entry->stream->RouteStream(entry->devices,
+                                                entry->force_device_switch);
+        entry->applied = true;
+        if (entry->ret) {
+            AHAL_ERR("routing stream %d to 0x%x failed %d",
+                     entry->stream->GetHandle(),
+                     AudioExtn::get_device_types(entry->devices), entry->ret);
+            break;
+        }
+    }
+}
+
+int RouteTransaction::ApplyStreams() {
+    std::map<std::set<audio_devices_t>, std::vector<route_entry_t*>> groups;
+    std::vector<std::thread> workers;
+    bool parallel = property_get_bool("vendor.audio.route.parallel", false);
+
+    for (auto& entry : entries_)
+        groups[entry.devices].push_back(&entry);
+
+    /* the last group runs on the calling thread */
+    for (auto it = groups.begin(); it != groups.end(); it++) {
+        if (!parallel || std::next(it) == groups.end()) {
+            ApplyGroup(it->second);
+            continue;
+        }
+        try {
+            workers.emplace_back(ApplyGroup, it->second);
+        } catch (const std::exception& e) {
+            AHAL_WARN("failed to start routing thread, route inline");
+            ApplyGroup(it->second);
+        }
+    }
+    for (auto& worker : workers)
+        worker.join();
+
+    for (auto& entry : entries_) {
+        if (entry.ret)
+            return entry.ret;
+    }
+    return 0;
+}
+
+void RouteTransaction::Rollback() {
+    for (auto& entry : entries_) {
+        if (!entry.applied || entry.prev_devices.empty())
+            continue;
+        if (entry.stream->RouteStream(entry.prev_devices, true))
+            AHAL_ERR("failed to restore stream %d to 0x%x",
+                     entry.stream->GetHandle(),
+                     AudioExtn::get_device_types(entry.prev_devices));
+        entry.applied = false;
+    }
+
+    /* voice follows the primary output, restore it after the streams */
+    if (voice_applied_ && !voice_prev_devices_.empty()) {
+        if (voice_->RouteStream(voice_prev_devices_))
+            AHAL_ERR("failed to restore voice to 0x%x",
+                     AudioExtn::get_device_types(voice_prev_devices_));
+    }
+    voice_applied_ = false;
+}
+
+int RouteTransaction::Commit() {
+    int voice_ret = 0;
+    int ret = 0;
+
+    if (committed_) {
+        AHAL_ERR("transaction already committed");
+        return -EINVAL;
+    }
+    committed_ = true;
+
+    ATRACE_BEGIN("RouteTransaction::Commit");
+    AHAL_DBG("enter: %zu streams, voice %d", entries_.size(), voice_ != nullptr);
+
+    Validate();
+
+    /* a failed voice switch must not keep media on the old device */
+    if (voice_) {
+        voice_ret = voice_->RouteStream(voice_devices_);
+        voice_applied_ = !voice_ret;
+        if (voice_ret)
+            AHAL_ERR("voice routing to 0x%x failed %d",
+                     AudioExtn::get_device_types(voice_devices_), voice_ret);
+    }
+
+    ret = ApplyStreams();
+    if (ret)
+        Rollback();
+
+    AHAL_DBG("exit: ret %d voice %d", ret, voice_ret);
+    ATRACE_END();
+    return ret ? ret : voice_ret;
+}
+
+RouteBatch::RouteBatch() :
+    window_(property_get_int32("vendor.audio.route.batch_ms", ROUTE_BATCH_WINDOW_MS)) {
+}
+
+RouteBatch::~RouteBatch() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        exit_ = true;
+    }
+    timer_cv_.notify_all();
+    if (timer_.joinable())
+        timer_.join();
+}
+
+void RouteBatch::Open() {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (window_.count() <= 0 || open_)
+        return;
+
+    if (!timer_.joinable()) {
+        try {
+            timer_ = std::thread(&RouteBatch::TimerLoop, this);
+        } catch (const std::exception& e) {
+            AHAL_WARN("no batch timer, route patches one by one");
+            return;
+        }
+    }
+    open_ = true;
+    opened_at_ = std::chrono::steady_clock::now();
+    /* policy may open outputs for the new device before its first patch */
+    deadline_ = opened_at_ + std::chrono::milliseconds(ROUTE_BATCH_MAX_MS);
+    timer_cv_.notify_all();
+}
+
+bool RouteBatch::Add(std::shared_ptr<StreamPrimary> stream,
+                     const std::set<audio_devices_t>& devices,
+                     std::shared_ptr<AudioVoice> voice) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (!open_)
+        return false;
+
+    if (!pending_)
+        pending_ = std::make_unique<RouteTransaction>();
+    if (voice)
+        pending_->AddVoice(voice, devices);
+    pending_->AddStream(stream, devices);
+
+    /* wait for the rest of the decision, but not past the cap */
+    deadline_ = std::min(std::chrono::steady_clock::now() + window_,
+                         opened_at_ + std::chrono::milliseconds(ROUTE_BATCH_MAX_MS));
+    timer_cv_.notify_all();
+    return true;
+}
+
+int RouteBatch::Flush() {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    return FlushLocked();
+}
+
+/*
+ * Commits under the batch lock, so a patch for a queued stream that comes
+ * in meanwhile is routed after the batch and not overtaken by it.
+ */
+int RouteBatch::FlushLocked() {
+    std::unique_ptr<RouteTransaction> route = std::move(pending_);
+    int ret = 0;
+
+    open_ = false;
+    if (!route || route->Empty())
+        return 0;
+
+    ret = route->Commit();
+    if (ret)
+        AHAL_ERR("batched routing failed %d, queued patches stay on their old devices",
+                 ret);
+    return ret;
+}
+
+void RouteBatch::TimerLoop() {
+    ThreadPolicy::Apply(AHAL_THREAD_TIMER);
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    while (!exit_) {
+        if (!open_) {
+            timer_cv_.wait(lock);
+            continue;
+        }
+        /* Add() may have moved the deadline while this waited */
+        timer_cv_.wait_until(lock, deadline_);
+        if (open_ && std::chrono::steady_clock::now() >= deadline_)
+            FlushLocked();
+    }
+}
@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+#ifndef ANDROID_HARDWARE_AHAL_ROUTE_TRANSACTION_H_
+#define ANDROID_HARDWARE_AHAL_ROUTE_TRANSACTION_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "AudioStream.h"
+#include "AudioVoice.h"
+
+/*
+ * Collects the stream and voice device changes that come out of one routing
+ * decision and applies them together.
+ *
+ * Callers add everything one decision moves. For CreateAudioPatch that is
+ * the patch's stream and, for playback, voice, and after a device
+ * connection change every patch audio policy sends for it (see RouteBatch);
+ * the HDR record switch adds every input stream it forces onto a new device.
+ *
+ * Commit() logs devices PAL cannot map, routes voice, then the streams,
+ * one after the other. With vendor.audio.route.parallel set, streams going
+ * to different device sets are switched from parallel threads instead;
+ * that is off until it is shown to shorten a switch on target, PAL
+ * serialises streams sharing a backend anyway. A failed voice switch is reported
+ * but the streams are still routed. If a stream fails, the streams already
+ * applied and a voice route switched by this transaction go back to the
+ * devices they had when they were added, so either everything lands or
+ * nothing does.
+ */
+class RouteTransaction {
+public:
+    RouteTransaction() = default;
+    RouteTransaction(const RouteTransaction&) = delete;
+    RouteTransaction& operator=(const RouteTransaction&) = delete;
+
+    /* a stream added twice keeps the last devices */
+    int AddStream(std::shared_ptr<StreamPrimary> stream,
+                  const std::set<audio_devices_t>& devices,
+                  bool force_device_switch = false);
+    int AddVoice(std::shared_ptr<AudioVoice> voice,
+                 const std::set<audio_devices_t>& rx_devices);
+    int Commit();
+    bool Empty() const { return entries_.empty() && !voice_; }
+
+private:
+    struct route_entry_t {
+        std::shared_ptr<StreamPrimary> stream;
+        std::set<audio_devices_t> devices;
+        std::set<audio_devices_t> prev_devices;
+        bool force_device_switch;
+        bool applied;
+        int ret;
+    };
+
+    void Validate();
+    static void ApplyGroup(const std::vector<route_entry_t*>& group);
+    int ApplyStreams();
+    void Rollback();
+
+    std::vector<route_entry_t> entries_;
+    std::shared_ptr<AudioVoice> voice_;
+    std::set<audio_devices_t> voice_devices_;
+    std::set<audio_devices_t> voice_prev_devices_;
+    bool voice_applied_ = false;
+    bool committed_ = false;
+};
+
+#define ROUTE_BATCH_WINDOW_MS 20
+#define ROUTE_BATCH_MAX_MS 100
+
+/*
+ * Audio policy answers a device connection change with one patch per
+ * stream it moves, each a separate CreateAudioPatch. Open() starts a batch
+ * at the connection change; the patches that follow are queued in one
+ * RouteTransaction and committed together once no patch came for
+ * vendor.audio.route.batch_ms (ROUTE_BATCH_WINDOW_MS, 0 turns batching
+ * off), and at the latest ROUTE_BATCH_MAX_MS after the batch opened. A
+ * batch no patch arrives for closes at that cap with nothing to do.
+ *
+ * A queued patch is reported as created, the stream keeps playing on its
+ * old devices until the commit. If the commit fails everything queued goes
+ * back to where it was, which is logged since the patches cannot fail any
+ * more. Flush() commits early, for a patch release or a stream close that
+ * has to see the queued routes applied first.
+ */
+class RouteBatch {
+public:
+    RouteBatch();
+    ~RouteBatch();
+    RouteBatch(const RouteBatch&) = delete;
+    RouteBatch& operator=(const RouteBatch&) = delete;
+
+    void Open();
+    /* false when no batch is open, the caller routes the stream itself */
+    bool Add(std::shared_ptr<StreamPrimary> stream,
+             const std::set<audio_devices_t>& devices,
+             std::shared_ptr<AudioVoice> voice);
+    int Flush();
+
+private:
+    int FlushLocked();
+    void TimerLoop();
+
+    std::mutex mutex_;
+    std::condition_variable timer_cv_;
+    std::thread timer_;
+    std::unique_ptr<RouteTransaction> pending_;
+    std::chrono::milliseconds window_;
+    std::chrono::steady_clock::time_point opened_at_;
+    std::chrono::steady_clock::time_point deadline_;
+    bool open_ = false;
+    bool exit_ = false;
+};
+
+#endif  // ANDROID_HARDWARE_AHAL_ROUTE_TRANSACTION_H_
@@ -0,0 +1,157 @@
+/*
+ * Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+#define LOG_TAG "AHAL: SsrRecovery"
+#define ATRACE_TAG (ATRACE_TAG_AUDIO|ATRACE_TAG_HAL)
+
+#include "AudioCommon.h"
+
+#include "AudioDevice.h"
+#include "SsrRecovery.h"
+#include "ThreadPolicy.h"
+
+#include <algorithm>
+#include <atomic>
+#include <inttypes.h>
+#include <time.h>
+#include <utils/Trace.h>
+
+static uint64_t ssr_time_ns()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+SsrRecovery::~SsrRecovery() {
+    std::lock_guard<std::mutex> lock(worker_mutex_);
+
+    if (worker_.joinable())
+        worker_.join();
+}
+
+void SsrRecovery::OnOffline(std::vector<std::shared_ptr<StreamPrimary>> streams) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    offline_ns_ = ssr_time_ns();
+    streams_.clear();
+    for (auto& stream : streams) {
+        if (stream->IsStarted())
+            streams_.push_back(stream);
+    }
+    AHAL_INFO("sound card offline, %zu active streams", streams_.size());
+}
+
+/* called on the PAL callback thread, which must not wait for a recovery */
+void SsrRecovery::OnOnline(std::shared_ptr<AudioVoice> voice) {
+    std::lock_guard<std::mutex> worker_lock(worker_mutex_);
+    std::vector<std::shared_ptr<StreamPrimary>> streams;
+    uint64_t online_ns = ssr_time_ns();
+    /* a previous recovery still running is joined by the new worker */
+    auto prev = std::make_shared<std::thread>(std::move(worker_));
+
+    mutex_.lock();
+    streams.swap(streams_);
+    mutex_.unlock();
+
+    try {
+        worker_ = std::thread([this, prev, voice, streams, online_ns] {
+            if (prev->joinable())
+                prev->join();
+            Recover(voice, streams, online_ns);
+        });
+    } catch (const std::exception& e) {
+        /* keep the previous worker for the destructor to join */
+        worker_ = std::move(*prev);
+        AHAL_ERR("failed to start recovery thread, streams recover on next write");
+    }
+}
+
+void SsrRecovery::Recover(std::shared_ptr<AudioVoice> voice,
+                          std::vector<std::shared_ptr<StreamPrimary>> streams,
+                          uint64_t online_ns) {
+    std::vector<std::thread> workers;
+    std::atomic<size_t> next(0);
+    std::atomic<uint32_t> recovered(0);
+    std::atomic<uint32_t> failed(0);
+    uint64_t voice_ns = 0;
+    uint64_t done_ns = 0;
+    size_t nr_workers = property_get_int32("vendor.audio.ssr.workers",
+                                           SSR_RECOVERY_DEFAULT_WORKERS);
+
+    ThreadPolicy::Apply(AHAL_THREAD_WORKER);
+    ATRACE_BEGIN("SsrRecovery::Recover");
+
+    /* calls matter most, bring them back before anything else */
+    if (voice && voice->IsAnyCallActive()) {
+        voice->RestartCalls();
+        voice_ns = ssr_time_ns() - online_ns;
+    }
+
+    auto work = [&]() {
+        size_t i;
+
+        while ((i = next.fetch_add(1)) < streams.size()) {
+            if (AudioDevice::sndCardState == CARD_STATUS_OFFLINE) {
+                AHAL_WARN("sound card went offline again, stop recovery");
+                break;
+            }
+            /* closed by the framework while the card was offline */
+            if (!AudioDevice::GetInstance()->IsStreamOpen(streams[i])) {
+                AHAL_DBG("stream %d closed, not recovered", streams[i]->GetHandle());
+                continue;
+            }
+            if (streams[i]->Recover()) {
+                AHAL_ERR("failed to recover stream %d", streams[i]->GetHandle());
+                failed++;
+            } else {
+                recovered++;
+            }
+        }
+    };
+
+    nr_workers = std::max<size_t>(1, std::min(nr_workers, streams.size()));
+    for (size_t i = 1; i < nr_workers; i++) {
+        try {
+            workers.emplace_back([&work] {
+                ThreadPolicy::Apply(AHAL_THREAD_WORKER);
+                work();
+            });
+        } catch (const std::exception& e) {
+            AHAL_WARN("recovery worker %zu not started", i);
+            break;
+        }
+    }
+    work();
+    for (auto& worker : workers)
+        worker.join();
+
+    done_ns = ssr_time_ns();
+    ATRACE_END();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    count_++;
+    recovered_ = recovered;
+    failed_ = failed;
+    voice_ns_ = voice_ns;
+    recovery_ns_ = done_ns - online_ns;
+    outage_ns_ = offline_ns_ ? done_ns - offline_ns_ : 0;
+    AHAL_INFO("recovered %u streams, %u failed, in %" PRIu64 " ms, %" PRIu64
+              " ms since card went offline", recovered_, failed_,
+              recovery_ns_ / 1000000, outage_ns_ / 1000000);
+}
+
+void SsrRecovery::Dump(int fd) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (!count_)
+        return;
+
+    dprintf(fd, "SSR recoveries: %u\n", count_);
+    dprintf(fd, "  last: %u streams recovered, %u failed\n", recovered_, failed_);
+    dprintf(fd, "  voice(ms) %" PRIu64 " recovery(ms) %" PRIu64 " outage(ms) %" PRIu64 "\n",
+            voice_ns_ / 1000000, recovery_ns_ / 1000000, outage_ns_ / 1000000);
+}
@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+#ifndef ANDROID_HARDWARE_AHAL_SSR_RECOVERY_H_
+#define ANDROID_HARDWARE_AHAL_SSR_RECOVERY_H_
+
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "AudioStream.h"
+#include "AudioVoice.h"
+
+#define SSR_RECOVERY_DEFAULT_WORKERS 4
+
+/*
+ * Brings audio back after a DSP subsystem restart.
+ *
+ * When the sound card goes offline the streams that were running are
+ * remembered. When it comes back, voice calls are restarted first, then
+ * the remembered streams are reopened from a small pool of worker
+ * threads. The streams keep their own devices, volume, effects and
+ * metadata, so reopening them restores that state. Recovery runs on its
+ * own thread, never on the PAL callback thread, which does not wait for
+ * an earlier recovery either: the new worker joins the one it replaces.
+ * Streams closed while the card was offline are left closed.
+ */
+class SsrRecovery {
+public:
+    SsrRecovery() = default;
+    ~SsrRecovery();
+    SsrRecovery(const SsrRecovery&) = delete;
+    SsrRecovery& operator=(const SsrRecovery&) = delete;
+
+    void OnOffline(std::vector<std::shared_ptr<StreamPrimary>> streams);
+    void OnOnline(std::shared_ptr<AudioVoice> voice);
+    void Dump(int fd);
+
+private:
+    void Recover(std::shared_ptr<AudioVoice> voice,
+                 std::vector<std::shared_ptr<StreamPrimary>> streams,
+                 uint64_t online_ns);
+
+    std::mutex worker_mutex_;    /* guards worker_ */
+    std::thread worker_;         /* latest recovery, joins the one before it */
+    std::mutex mutex_;           /* guards the snapshot and stats below */
+    std::vector<std::shared_ptr<StreamPrimary>> streams_;
+    uint64_t offline_ns_ = 0;
+    /* last recovery, for dump */
+    uint32_t count_ = 0;
+    uint32_t recovered_ = 0;
+    uint32_t failed_ = 0;
+    uint64_t voice_ns_ = 0;
+    uint64_t recovery_ns_ = 0;  /* card online to all streams reopened */
+    uint64_t outage_ns_ = 0;    /* card offline to all streams reopened */
+};
+
+#endif  // ANDROID_HARDWARE_AHAL_SSR_RECOVERY_H_
@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+#define LOG_TAG "AHAL: StreamCounters"
+#define ATRACE_TAG (ATRACE_TAG_AUDIO | ATRACE_TAG_HAL)
+
+#include "AudioCommon.h"
+#include "StreamCounters.h"
+
+#include <stdio.h>
+#include <time.h>
+
+#include <cutils/trace.h>
+
+static const char * const counter_names[STREAM_COUNTER_MAX] = {
+    [STREAM_COUNTER_FILL] = "fill",
+    [STREAM_COUNTER_FRAMES] = "frames",
+    [STREAM_COUNTER_DSP_DELTA] = "dsp_delta",
+    [STREAM_COUNTER_IO_US] = "io_us",
+    [STREAM_COUNTER_XRUNS] = "xruns",
+    [STREAM_COUNTER_VOLUME] = "volume",
+    [STREAM_COUNTER_EFFECTS] = "effects",
+};
+
+std::atomic<int32_t> StreamCounters::pal_sessions_(0);
+
+void StreamCounters::Init(bool output, audio_io_handle_t handle) {
+    for (int i = 0; i < STREAM_COUNTER_MAX; i++)
+        snprintf(names_[i], sizeof(names_[i]), "ahal.%s%d.%s", output ? "out" : "in",
+                 handle, counter_names[i]);
+}
+
+bool StreamCounters::Enabled() {
+    return ATRACE_ENABLED();
+}
+
+uint64_t StreamCounters::Now() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+void StreamCounters::Set(stream_counter_t counter, int64_t value) {
+    if (counter < STREAM_COUNTER_MAX && names_[counter][0])
+        ATRACE_INT64(names_[counter], value);
+}
+
+void StreamCounters::Reset() {
+    last_dsp_frames_ = 0;
+    if (!Enabled())
+        return;
+    Set(STREAM_COUNTER_FILL, 0);
+    Set(STREAM_COUNTER_DSP_DELTA, 0);
+    Set(STREAM_COUNTER_IO_US, 0);
+}
+
+void StreamCounters::PalSessionOpened() {
+    ATRACE_INT("ahal.pal_sessions", pal_sessions_.fetch_add(1) + 1);
+}
+
+void StreamCounters::PalSessionClosed() {
+    ATRACE_INT("ahal.pal_sessions", pal_sessions_.fetch_sub(1) - 1);
+}
+
+void StreamCounters::PerfLocksHeld(int count) {
+    ATRACE_INT("ahal.perf_locks", count);
+}
@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+#ifndef ANDROID_HARDWARE_AHAL_STREAM_COUNTERS_H_
+#define ANDROID_HARDWARE_AHAL_STREAM_COUNTERS_H_
+
+#include <stdint.h>
+
+#include <atomic>
+
+#include <system/audio.h>
+
+typedef enum {
+    STREAM_COUNTER_FILL = 0,     /* frames queued ahead of the DSP */
+    STREAM_COUNTER_FRAMES,       /* frames written or read so far */
+    STREAM_COUNTER_DSP_DELTA,    /* DSP frames since the previous buffer */
+    STREAM_COUNTER_IO_US,        /* duration of the last write or read */
+    STREAM_COUNTER_XRUNS,        /* DSP caught up with the HAL, or capture overflowed */
+    STREAM_COUNTER_VOLUME,       /* left volume x1000 */
+    STREAM_COUNTER_EFFECTS,      /* HAL applied effects, EC and NS on capture */
+    STREAM_COUNTER_MAX,
+} stream_counter_t;
+
+#define STREAM_COUNTER_NAME_LEN 32
+
+/*
+ * ATRACE counter tracks of one stream, named ahal.<out|in><handle>.<counter>
+ * so Perfetto shows a track per stream next to its slices.
+ *
+ * The counters cost nothing while audio tracing is off; callers check
+ * Enabled() before computing anything that needs a PAL query.
+ */
+class StreamCounters {
+public:
+    void Init(bool output, audio_io_handle_t handle);
+    void Set(stream_counter_t counter, int64_t value);
+    /* drops the tracks to zero, for standby and close */
+    void Reset();
+
+    static bool Enabled();
+    static uint64_t Now();
+    static void PalSessionOpened();
+    static void PalSessionClosed();
+    static void PerfLocksHeld(int count);
+
+    uint32_t xruns_ = 0;
+    uint64_t last_dsp_frames_ = 0;
+
+private:
+    char names_[STREAM_COUNTER_MAX][STREAM_COUNTER_NAME_LEN] = {};
+
+    static std::atomic<int32_t> pal_sessions_;
+};
+
+#endif  // ANDROID_HARDWARE_AHAL_STREAM_COUNTERS_H_
@@ -0,0 +1,169 @@
+/*
+ * Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+#define LOG_TAG "AHAL: ThreadPolicy"
+
+#include "AudioCommon.h"
+#include "ThreadPolicy.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <cutils/properties.h>
+#ifndef LINUX_ENABLED
+#include <processgroup/sched_policy.h>
+#endif
+#include <system/thread_defs.h>
+
+typedef struct thread_class_default {
+    const char *name;
+    bool fifo;
+    int prio;
+} thread_class_default_t;
+
+static const thread_class_default_t class_defaults[AHAL_THREAD_CLASS_MAX] = {
+    [AHAL_THREAD_VISUALIZER] = {"visualizer", true, 1},
+    [AHAL_THREAD_TIMER] = {"timer", false, ANDROID_PRIORITY_AUDIO},
+    [AHAL_THREAD_WORKER] = {"worker", false, ANDROID_PRIORITY_AUDIO},
+};
+
+/* upper bounds in us, the last bucket takes the rest */
+static const uint32_t hist_bounds_us[THREAD_POLICY_HIST_BUCKETS - 1] = {
+    100, 500, 1000, 2000, 5000, 10000,
+};
+
+static const char * const applied_names[] = {"none", "fifo", "other", "fallback"};
+
+std::atomic<uint32_t> ThreadPolicy::applied_[AHAL_THREAD_CLASS_MAX];
+std::atomic<uint32_t> ThreadPolicy::threads_[AHAL_THREAD_CLASS_MAX];
+std::atomic<uint32_t> ThreadPolicy::hist_[AHAL_THREAD_CLASS_MAX][THREAD_POLICY_HIST_BUCKETS];
+std::atomic<uint64_t> ThreadPolicy::max_late_ns_[AHAL_THREAD_CLASS_MAX];
+
+int ThreadPolicy::SetAffinity(const char *name, const char *cpus) {
+    cpu_set_t allowed;
+    cpu_set_t wanted;
+    unsigned long long mask = strtoull(cpus, NULL, 16);
+    int ret = 0;
+
+    if (!mask)
+        return -EINVAL;
+
+    /* stay inside the cpuset cgroup the HAL was put in */
+    if (sched_getaffinity(0, sizeof(allowed), &allowed)) {
+        ret = -errno;
+        AHAL_WARN("%s: sched_getaffinity failed %d", name, ret);
+        return ret;
+    }
+    CPU_ZERO(&wanted);
+    for (int cpu = 0; cpu < 64 && cpu < CPU_SETSIZE; cpu++) {
+        if ((mask & (1ULL << cpu)) && CPU_ISSET(cpu, &allowed))
+            CPU_SET(cpu, &wanted);
+    }
+    if (!CPU_COUNT(&wanted)) {
+        AHAL_WARN("%s: cpus %s outside the allowed set, affinity unchanged", name, cpus);
+        return -EINVAL;
+    }
+    if (sched_setaffinity(0, sizeof(wanted), &wanted)) {
+        ret = -errno;
+        AHAL_WARN("%s: sched_setaffinity %s failed %d", name, cpus, ret);
+    }
+    return ret;
+}
+
+void ThreadPolicy::Apply(ahal_thread_class_t cls) {
+    const thread_class_default_t *def;
+    char prop[PROPERTY_KEY_MAX];
+    char value[PROPERTY_VALUE_MAX];
+    struct sched_param param;
+    bool fifo;
+    int prio;
+    applied_t applied;
+
+    if (cls < 0 || cls >= AHAL_THREAD_CLASS_MAX)
+        return;
+    def = &class_defaults[cls];
+
+    snprintf(prop, sizeof(prop), "vendor.audio.thread.%s.sched", def->name);
+    fifo = def->fifo;
+    if (property_get(prop, value, NULL) > 0)
+        fifo = !strcmp(value, "fifo");
+    snprintf(prop, sizeof(prop), "vendor.audio.thread.%s.prio", def->name);
+    if (fifo == def->fifo)
+        prio = property_get_int32(prop, def->prio);
+    else
+        prio = property_get_int32(prop, fifo ? 1 : ANDROID_PRIORITY_AUDIO);
+
+    if (fifo) {
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = prio;
+        if (!sched_setscheduler(0, SCHED_FIFO, &param)) {
+            applied = APPLIED_FIFO;
+        } else {
+            AHAL_WARN("%s: SCHED_FIFO %d refused %d, falling back", def->name, prio, -errno);
+#ifndef LINUX_ENABLED
+            set_sched_policy(0, SP_FOREGROUND);
+#endif
+            setpriority(PRIO_PROCESS, 0, ANDROID_PRIORITY_URGENT_AUDIO);
+            applied = APPLIED_FALLBACK;
+        }
+    } else {
+        if (setpriority(PRIO_PROCESS, 0, prio))
+            AHAL_WARN("%s: setpriority %d failed %d", def->name, prio, -errno);
+        applied = APPLIED_OTHER;
+    }
+
+    snprintf(prop, sizeof(prop), "vendor.audio.thread.%s.cpus", def->name);
+    if (property_get(prop, value, NULL) > 0)
+        SetAffinity(def->name, value);
+
+    applied_[cls].store(applied, std::memory_order_relaxed);
+    threads_[cls]++;
+    AHAL_DBG("%s: tid %d %s prio %d", def->name, gettid(), applied_names[applied], prio);
+}
+
+void ThreadPolicy::RecordWakeup(ahal_thread_class_t cls, uint64_t late_ns) {
+    uint64_t max;
+    int i;
+
+    if (cls < 0 || cls >= AHAL_THREAD_CLASS_MAX)
+        return;
+
+    for (i = 0; i < THREAD_POLICY_HIST_BUCKETS - 1; i++) {
+        if (late_ns < (uint64_t)hist_bounds_us[i] * 1000)
+            break;
+    }
+    hist_[cls][i].fetch_add(1, std::memory_order_relaxed);
+
+    max = max_late_ns_[cls].load(std::memory_order_relaxed);
+    while (late_ns > max &&
+           !max_late_ns_[cls].compare_exchange_weak(max, late_ns, std::memory_order_relaxed));
+}
+
+void ThreadPolicy::VisualizerThreadStart() {
+    Apply(AHAL_THREAD_VISUALIZER);
+}
+
+void ThreadPolicy::VisualizerThreadWakeup(uint64_t late_ns) {
+    RecordWakeup(AHAL_THREAD_VISUALIZER, late_ns);
+}
+
+void ThreadPolicy::Dump(int fd) {
+    dprintf(fd, "HAL threads (wakeup latency <100us <500us <1ms <2ms <5ms <10ms >=10ms, max):\n");
+    for (int cls = 0; cls < AHAL_THREAD_CLASS_MAX; cls++) {
+        if (!threads_[cls])
+            continue;
+        dprintf(fd, "  %-10s %u threads, %-8s", class_defaults[cls].name,
+                threads_[cls].load(), applied_names[applied_[cls].load()]);
+        for (int i = 0; i < THREAD_POLICY_HIST_BUCKETS; i++)
+            dprintf(fd, " %u", hist_[cls][i].load());
+        dprintf(fd, ", %" PRIu64 " us\n", max_late_ns_[cls].load() / 1000);
+    }
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+#ifndef ANDROID_HARDWARE_AHAL_THREAD_POLICY_H_
+#define ANDROID_HARDWARE_AHAL_THREAD_POLICY_H_
+
+#include <stdint.h>
+
+#include <atomic>
+
+typedef enum {
+    AHAL_THREAD_VISUALIZER = 0,  /* offload visualizer capture */
+    AHAL_THREAD_TIMER,           /* BT metadata debounce, offload volume, route batch */
+    AHAL_THREAD_WORKER,          /* SSR recovery, init helpers */
+    AHAL_THREAD_CLASS_MAX,
+} ahal_thread_class_t;
+
+/* hooks handed to the visualizer library, which has no HAL symbols */
+extern "C" typedef void (*visualizer_hal_thread_start_t)(void);
+extern "C" typedef void (*visualizer_hal_thread_wakeup_t)(uint64_t late_ns);
+extern "C" typedef void (*visualizer_hal_set_thread_hooks)(visualizer_hal_thread_start_t,
+                                                           visualizer_hal_thread_wakeup_t);
+
+#define THREAD_POLICY_HIST_BUCKETS 7
+
+/*
+ * Scheduling policy of the threads the HAL creates, per thread class.
+ *
+ * Each class reads vendor.audio.thread.<class>.sched ("fifo" or "other"),
+ * .prio (RT priority for fifo, nice value for other) and .cpus (affinity
+ * mask, hex). The mask is intersected with the cpuset the HAL already
+ * runs in. When SCHED_FIFO is refused, for instance because the rtprio
+ * rlimit or the cgroup has no RT budget, the thread falls back to the
+ * foreground group at urgent audio nice.
+ *
+ * Threads that wait for a deadline report how late they woke up, the
+ * histogram per class is part of adev_dump.
+ */
+class ThreadPolicy {
+public:
+    /* called by the thread itself once it starts */
+    static void Apply(ahal_thread_class_t cls);
+    static void RecordWakeup(ahal_thread_class_t cls, uint64_t late_ns);
+    static void Dump(int fd);
+    /* calling thread onto the cpus of a hex mask that are allowed, -EINVAL if none is */
+    static int SetAffinity(const char *name, const char *cpus);
+
+    static void VisualizerThreadStart();
+    static void VisualizerThreadWakeup(uint64_t late_ns);
+
+private:
+    typedef enum {
+        APPLIED_NONE = 0,
+        APPLIED_FIFO,
+        APPLIED_OTHER,
+        APPLIED_FALLBACK,
+    } applied_t;
+
+    static std::atomic<uint32_t> applied_[AHAL_THREAD_CLASS_MAX];
+    static std::atomic<uint32_t> threads_[AHAL_THREAD_CLASS_MAX];
+    static std::atomic<uint32_t> hist_[AHAL_THREAD_CLASS_MAX][THREAD_POLICY_HIST_BUCKETS];
+    static std::atomic<uint64_t> max_late_ns_[AHAL_THREAD_CLASS_MAX];
+};
+
+#endif  // ANDROID_HARDWARE_AHAL_THREAD_POLICY_H_
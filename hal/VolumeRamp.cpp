@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+#define LOG_TAG "AHAL: VolumeRamp"
+
+#include "AudioCommon.h"
+#include "VolumeRamp.h"
+
+#include <errno.h>
+
+int VolumeRamp::Configure(audio_format_t format, uint32_t channels,
+                          uint32_t sample_rate, uint32_t ramp_ms) {
+    switch (format) {
+    case AUDIO_FORMAT_PCM_16_BIT:
+    case AUDIO_FORMAT_PCM_32_BIT:
+    case AUDIO_FORMAT_PCM_FLOAT:
+        break;
+    default:
+        AHAL_DBG("no software volume for format %#x", format);
+        return -EINVAL;
+    }
+
+    if (!channels || !sample_rate) {
+        AHAL_ERR("invalid channels %u or sample rate %u", channels, sample_rate);
+        return -EINVAL;
+    }
+
+    format_ = format;
+    channels_ = channels;
+    ramp_frames_ = (uint64_t)sample_rate * ramp_ms / 1000;
+    remaining_ = 0;
+    for (int i = 0; i < kMaxGains; i++) {
+        current_[i] = target_[i];
+        step_[i] = 0.0f;
+    }
+    return 0;
+}
+
+void VolumeRamp::SetTarget(float left, float right) {
+    target_[0] = left;
+    target_[1] = right;
+    target_[2] = (left + right) / 2.0f;
+
+    if (!ramp_frames_) {
+        Reset(left, right);
+        return;
+    }
+
+    /* restart from the current point so a ramp in progress has no step */
+    for (int i = 0; i < kMaxGains; i++)
+        step_[i] = (target_[i] - current_[i]) / ramp_frames_;
+    remaining_ = ramp_frames_;
+}
+
+void VolumeRamp::Reset(float left, float right) {
+    target_[0] = current_[0] = left;
+    target_[1] = current_[1] = right;
+    target_[2] = current_[2] = (left + right) / 2.0f;
+    for (int i = 0; i < kMaxGains; i++)
+        step_[i] = 0.0f;
+    remaining_ = 0;
+}
+
+bool VolumeRamp::IsBypass() const {
+    if (remaining_)
+        return false;
+    for (int i = 0; i < kMaxGains; i++) {
+        if (current_[i] != 1.0f)
+            return false;
+    }
+    return true;
+}
+
+template <typename T>
+static inline T scale_sample(T s, float gain);
+
+template <>
+inline int16_t scale_sample<int16_t>(int16_t s, float gain) {
+    int32_t v = (int32_t)(s * gain);
+
+    if (v > INT16_MAX)
+        v = INT16_MAX;
+    else if (v < INT16_MIN)
+        v = INT16_MIN;
+    return (int16_t)v;
+}
+
+template <>
+inline int32_t scale_sample<int32_t>(int32_t s, float gain) {
+    int64_t v = (int64_t)((double)s * gain);
+
+    if (v > INT32_MAX)
+        v = INT32_MAX;
+    else if (v < INT32_MIN)
+        v = INT32_MIN;
+    return (int32_t)v;
+}
+
+template <>
+inline float scale_sample<float>(float s, float gain) {
+    return s * gain;
+}
+
+template <typename T>
+static void ramp_process(const T *in, T *out, size_t frames, uint32_t channels,
+                         float *current, const float *target, const float *step,
+                         uint32_t *remaining) {
+    /* mono takes the average, see SetVolume */
+    const int left = channels == 1 ? 2 : 0;
+    const int right = 1;
+
+    for (size_t f = 0; f < frames; f++) {
+        if (*remaining) {
+            for (int i = 0; i < 3; i++)
+                current[i] += step[i];
+            if (!--(*remaining)) {
+                for (int i = 0; i < 3; i++)
+                    current[i] = target[i];
+            }
+        }
+
+        *out++ = scale_sample(*in++, current[left]);
+        if (channels == 1)
+            continue;
+        *out++ = scale_sample(*in++, current[right]);
+        for (uint32_t c = 2; c < channels; c++)
+            *out++ = scale_sample(*in++, current[2]);
+    }
+}
+
+void VolumeRamp::Process(const void *in, void *out, size_t frames) {
+    switch (format_) {
+    case AUDIO_FORMAT_PCM_16_BIT:
+        ramp_process((const int16_t *)in, (int16_t *)out, frames, channels_,
+                     current_, target_, step_, &remaining_);
+        break;
+    case AUDIO_FORMAT_PCM_32_BIT:
+        ramp_process((const int32_t *)in, (int32_t *)out, frames, channels_,
+                     current_, target_, step_, &remaining_);
+        break;
+    case AUDIO_FORMAT_PCM_FLOAT:
+        ramp_process((const float *)in, (float *)out, frames, channels_,
+                     current_, target_, step_, &remaining_);
+        break;
+    default:
+        break;
+    }
+}
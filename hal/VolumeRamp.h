@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+#ifndef ANDROID_HARDWARE_AHAL_VOLUME_RAMP_H_
+#define ANDROID_HARDWARE_AHAL_VOLUME_RAMP_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <system/audio.h>
+
+#define VOLUME_RAMP_DEFAULT_MS    20
+#define VOLUME_COALESCE_WINDOW_MS 10
+
+/*
+ * Sample accurate software volume for PCM streams written through the
+ * HAL. A new target is reached linearly over the ramp period, per frame,
+ * starting from wherever the previous ramp got to. Channel 0 follows the
+ * left volume, channel 1 the right one and any other channel the average.
+ */
+class VolumeRamp {
+public:
+    VolumeRamp() = default;
+
+    /* returns -EINVAL for formats it cannot scale */
+    int Configure(audio_format_t format, uint32_t channels,
+                  uint32_t sample_rate, uint32_t ramp_ms);
+    void SetTarget(float left, float right);
+    void Reset(float left, float right);
+    /* nothing to do: no ramp running and the gain is unity */
+    bool IsBypass() const;
+    /* in and out may alias */
+    void Process(const void *in, void *out, size_t frames);
+
+private:
+    static constexpr int kMaxGains = 3;  /* left, right, others */
+
+    audio_format_t format_ = AUDIO_FORMAT_INVALID;
+    uint32_t channels_ = 0;
+    uint32_t ramp_frames_ = 0;
+    uint32_t remaining_ = 0;
+    float current_[kMaxGains] = {1.0f, 1.0f, 1.0f};
+    float target_[kMaxGains] = {1.0f, 1.0f, 1.0f};
+    float step_[kMaxGains] = {0.0f, 0.0f, 0.0f};
+};
+
+#endif  // ANDROID_HARDWARE_AHAL_VOLUME_RAMP_H_
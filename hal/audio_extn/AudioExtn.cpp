@@ -80,7 +80,7 @@ static bool battery_listener_enabled;
 static void *batt_listener_lib_handle;
 static bool audio_extn_kpi_optimize_feature_enabled = false;
 //TODO make this mutex part of class
-std::mutex reconfig_wait_mutex_;
+AudioMutex reconfig_wait_mutex_{"reconfig_wait_mutex_"};
 std::mutex AudioExtn::sLock;
 
 std::atomic<bool> AudioExtn::sServicesRegistered = false;
@@ -548,7 +548,7 @@ static int reconfig_cb (tSESSION_TYPE session_type, int state)
          * If reconfiguration is in complete state, we do a2dp resume.
          */
         if ((tRECONFIG_STATE)state == SESSION_SUSPEND) {
-            std::unique_lock<std::mutex> guard(reconfig_wait_mutex_);
+            std::unique_lock<AudioMutex> guard(reconfig_wait_mutex_);
             param_bt_a2dp.a2dp_suspended = true;
             param_bt_a2dp.dev_id = PAL_DEVICE_OUT_BLUETOOTH_BLE;
 
@@ -563,7 +563,7 @@ static int reconfig_cb (tSESSION_TYPE session_type, int state)
         }
     } else if (session_type == LE_AUDIO_HARDWARE_OFFLOAD_DECODING_DATAPATH) {
         if ((tRECONFIG_STATE)state == SESSION_SUSPEND) {
-            std::unique_lock<std::mutex> guard(reconfig_wait_mutex_);
+            std::unique_lock<AudioMutex> guard(reconfig_wait_mutex_);
             param_bt_a2dp.a2dp_capture_suspended = true;
             param_bt_a2dp.dev_id = PAL_DEVICE_IN_BLUETOOTH_BLE;
 
@@ -694,8 +694,6 @@ int AudioExtn::karaoke_open(pal_device_id_t device_out, pal_stream_callback pal_
     struct pal_device pal_devs[num_pal_devs];
     karaoke_stream_handle = NULL;
     pal_device_id_t device_in;
-    dynamic_media_config_t dynamic_media_config;
-    size_t payload_size = 0;
 
     // Configuring Hostless Loopback
     if (device_out == PAL_DEVICE_OUT_WIRED_HEADSET)
@@ -721,32 +719,16 @@ int AudioExtn::karaoke_open(pal_device_id_t device_out, pal_stream_callback pal_
         pal_devs[i].id = i ? device_in : device_out;
         if (device_out == PAL_DEVICE_OUT_USB_HEADSET || device_in == PAL_DEVICE_IN_USB_HEADSET) {
             //Configure USB Digital Headset parameters
-            pal_param_device_capability_t *device_cap_query = (pal_param_device_capability_t *)
-                                                       malloc(sizeof(pal_param_device_capability_t));
-            if (!device_cap_query) {
-                AHAL_ERR("Failed to allocate mem for device_cap_query");
-                return 0;
-            }
+            usb_dev_cap_t usb_cap = {};
 
-            if (pal_devs[i].id == PAL_DEVICE_OUT_USB_HEADSET) {
-                device_cap_query->id = PAL_DEVICE_OUT_USB_DEVICE;
-                device_cap_query->is_playback = true;
-            } else {
-                device_cap_query->id = PAL_DEVICE_IN_USB_DEVICE;
-                device_cap_query->is_playback = false;
-            }
-            device_cap_query->addr.card_id = adevice->usb_card_id_;
-            device_cap_query->addr.device_num = adevice->usb_dev_num_;
-            device_cap_query->config = &dynamic_media_config;
-            pal_get_param(PAL_PARAM_ID_DEVICE_CAPABILITY,
-                                 (void **)&device_cap_query,
-                                 &payload_size, nullptr);
+            adevice->GetUsbCapability(adevice->usb_card_id_, adevice->usb_dev_num_,
+                                      pal_devs[i].id == PAL_DEVICE_OUT_USB_HEADSET,
+                                      &usb_cap);
             pal_devs[i].address.card_id = adevice->usb_card_id_;
             pal_devs[i].address.device_num = adevice->usb_dev_num_;
-            pal_devs[i].config.sample_rate = dynamic_media_config.sample_rate[0];
+            pal_devs[i].config.sample_rate = usb_cap.sample_rate;
             pal_devs[i].config.ch_info = ch_info;
-            pal_devs[i].config.aud_fmt_id = (pal_audio_fmt_t)dynamic_media_config.format[0];
-            free(device_cap_query);
+            pal_devs[i].config.aud_fmt_id = (pal_audio_fmt_t)usb_cap.format;
         } else {
             pal_devs[i].config.sample_rate = DEFAULT_OUTPUT_SAMPLING_RATE;
             pal_devs[i].config.bit_width = CODEC_BACKEND_DEFAULT_BIT_WIDTH;
@@ -866,6 +848,11 @@ void AudioExtn::audio_extn_kpi_optimize_feature_init(bool is_feature_enabled)
     AHAL_DBG("---- Feature KPI_OPTIMIZE is %s ----", is_feature_enabled? "ENABLED": " NOT ENABLED");
 }
 
+/* the host build finds the perf HAL of libpal_sim without the property */
+#ifndef PERF_LOCK_DEFAULT_LIBRARY
+#define PERF_LOCK_DEFAULT_LIBRARY NULL
+#endif
+
 typedef int (*perf_lock_acquire_t)(int, int, int*, int);
 typedef int (*perf_lock_release_t)(int);
 
@@ -885,7 +872,7 @@ int AudioExtn::audio_extn_perf_lock_init(void)
 
     if (qcopt_handle == NULL) {
         if (property_get("ro.vendor.extension_library",
-                         opt_lib_path, NULL) <= 0) {
+                         opt_lib_path, PERF_LOCK_DEFAULT_LIBRARY) <= 0) {
             AHAL_ERR("Failed getting perf property");
             ret = -EINVAL;
             goto err;
@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+#include <stdlib.h>
+
+#include <new>
+
+#include "AllocCount.h"
+
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t nmemb, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+}
+
+/* plain TLS, a thread_local with a constructor could allocate itself */
+static __thread uint32_t alloc_scopes;
+static __thread uint64_t alloc_count;
+
+static inline void alloc_counted() {
+    if (alloc_scopes)
+        alloc_count++;
+}
+
+extern "C" void *malloc(size_t size) {
+    alloc_counted();
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t nmemb, size_t size) {
+    alloc_counted();
+    return __libc_calloc(nmemb, size);
+}
+
+extern "C" void *realloc(void *ptr, size_t size) {
+    alloc_counted();
+    return __libc_realloc(ptr, size);
+}
+
+/* counted through malloc() */
+void *operator new(size_t size) {
+    void *p = malloc(size ? size : 1);
+
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void *operator new[](size_t size) {
+    return operator new(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t&) noexcept {
+    return malloc(size ? size : 1);
+}
+
+void *operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return malloc(size ? size : 1);
+}
+
+void operator delete(void *p) noexcept {
+    free(p);
+}
+
+void operator delete[](void *p) noexcept {
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept {
+    free(p);
+}
+
+AllocScope::AllocScope() : start_(alloc_count) {
+    alloc_scopes++;
+}
+
+AllocScope::~AllocScope() {
+    alloc_scopes--;
+}
+
+uint64_t AllocScope::Count() const {
+    return alloc_count - start_;
+}
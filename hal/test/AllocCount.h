@@ -0,0 +1,31 @@
+/*
+ * Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+#ifndef ANDROID_HARDWARE_AHAL_ALLOC_COUNT_H_
+#define ANDROID_HARDWARE_AHAL_ALLOC_COUNT_H_
+
+#include <stdint.h>
+
+/*
+ * Counts the heap allocations the calling thread makes while an AllocScope
+ * is alive. Linking AllocCount.cpp interposes malloc, calloc, realloc and
+ * the global operator new for the whole process, the HAL and libpal_sim
+ * loaded into it included. Other threads are never counted, so timers and
+ * simulator callbacks running meanwhile do not disturb a test.
+ */
+class AllocScope {
+public:
+    AllocScope();
+    ~AllocScope();
+    AllocScope(const AllocScope&) = delete;
+    AllocScope& operator=(const AllocScope&) = delete;
+
+    uint64_t Count() const;
+
+private:
+    uint64_t start_;
+};
+
+#endif  // ANDROID_HARDWARE_AHAL_ALLOC_COUNT_H_
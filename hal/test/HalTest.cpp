@@ -0,0 +1,9 @@
+/*
+ * Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+#include "HalTest.h"
+
+void *HalTest::lib_;
+audio_hw_device_t *HalTest::adev_;
@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+#ifndef ANDROID_HARDWARE_AHAL_HAL_TEST_H_
+#define ANDROID_HARDWARE_AHAL_HAL_TEST_H_
+
+#include <dlfcn.h>
+
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <hardware/audio.h>
+#include <hardware/hardware.h>
+
+#include "PalSim.h"
+
+#ifndef HAL_TEST_LIB
+#define HAL_TEST_LIB "audio.primary.default.so"
+#endif
+
+/*
+ * Loads the host build of the HAL, which runs on top of libpal_sim, and
+ * opens the audio device once per test suite. The HAL keeps a single
+ * AudioDevice, so suites share it and have to close what they open.
+ */
+class HalTest : public ::testing::Test {
+protected:
+    static void SetUpTestSuite() {
+        struct hw_module_t *module;
+
+        lib_ = dlopen(HAL_TEST_LIB, RTLD_NOW | RTLD_GLOBAL);
+        ASSERT_NE(nullptr, lib_) << dlerror();
+        module = (struct hw_module_t *)dlsym(lib_, HAL_MODULE_INFO_SYM_AS_STR);
+        ASSERT_NE(nullptr, module);
+        ASSERT_EQ(0, module->methods->open(module, AUDIO_HARDWARE_INTERFACE,
+                                           (struct hw_device_t **)&adev_));
+    }
+
+    static void TearDownTestSuite() {
+        if (adev_)
+            adev_->common.close(&adev_->common);
+        adev_ = nullptr;
+    }
+
+    void SetUp() override {
+        ASSERT_NE(nullptr, adev_);
+        pal_sim_clear_faults();
+    }
+
+    static struct audio_stream_out *OpenOutput(audio_io_handle_t handle,
+            audio_devices_t device = AUDIO_DEVICE_OUT_SPEAKER,
+            audio_output_flags_t flags = AUDIO_OUTPUT_FLAG_PRIMARY,
+            uint32_t rate = 48000, uint32_t channels = 2) {
+        struct audio_config config = AUDIO_CONFIG_INITIALIZER;
+        struct audio_stream_out *out = nullptr;
+
+        config.sample_rate = rate;
+        config.format = AUDIO_FORMAT_PCM_16_BIT;
+        config.channel_mask = audio_channel_out_mask_from_count(channels);
+        if (adev_->open_output_stream(adev_, handle, device, flags, &config, &out, ""))
+            return nullptr;
+        return out;
+    }
+
+    static struct audio_stream_in *OpenInput(audio_io_handle_t handle,
+            audio_devices_t device = AUDIO_DEVICE_IN_BUILTIN_MIC,
+            audio_source_t source = AUDIO_SOURCE_MIC,
+            uint32_t rate = 48000, uint32_t channels = 2) {
+        struct audio_config config = AUDIO_CONFIG_INITIALIZER;
+        struct audio_stream_in *in = nullptr;
+
+        config.sample_rate = rate;
+        config.format = AUDIO_FORMAT_PCM_16_BIT;
+        config.channel_mask = audio_channel_in_mask_from_count(channels);
+        if (adev_->open_input_stream(adev_, handle, device, &config, &in,
+                                     AUDIO_INPUT_FLAG_NONE, "", source))
+            return nullptr;
+        return in;
+    }
+
+    /* writes count buffers of silence, returns the first error */
+    static ssize_t WriteSilence(struct audio_stream_out *out, int count) {
+        size_t bytes = out->common.get_buffer_size(&out->common);
+        std::vector<uint8_t> buf(bytes, 0);
+
+        for (int i = 0; i < count; i++) {
+            ssize_t ret = out->write(out, buf.data(), bytes);
+
+            if (ret < 0)
+                return ret;
+        }
+        return (ssize_t)bytes;
+    }
+
+    /* routes an output to devices through an audio patch, like audio policy */
+    static int Route(audio_io_handle_t handle, const std::vector<audio_devices_t>& devices,
+                     audio_patch_handle_t *patch) {
+        struct audio_port_config source = {};
+        std::vector<struct audio_port_config> sinks(devices.size());
+
+        source.role = AUDIO_PORT_ROLE_SOURCE;
+        source.type = AUDIO_PORT_TYPE_MIX;
+        source.ext.mix.handle = handle;
+        for (size_t i = 0; i < devices.size(); i++) {
+            sinks[i].role = AUDIO_PORT_ROLE_SINK;
+            sinks[i].type = AUDIO_PORT_TYPE_DEVICE;
+            sinks[i].ext.device.type = devices[i];
+        }
+        return adev_->create_audio_patch(adev_, 1, &source, sinks.size(), sinks.data(), patch);
+    }
+
+    static void *lib_;
+    static audio_hw_device_t *adev_;
+};
+
+#endif  // ANDROID_HARDWARE_AHAL_HAL_TEST_H_
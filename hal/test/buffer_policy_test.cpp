@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+#include <stdio.h>
+
+#include <gtest/gtest.h>
+
+#include "BufferPolicy.h"
+
+/* the policy is read once per process, so one file holds every case */
+static const char policy_xml[] =
+    "<buffer_policy>\n"
+    "    <usecase name=\"low-latency-playback\" period_size=\"192\"/>\n"
+    "    <usecase name=\"low-latency-playback\" device=\"usb\" period_size=\"96\" period_count=\"3\"/>\n"
+    "    <usecase name=\"deep-buffer-playback\" period_size=\"960\" period_count=\"3\"/>\n"
+    "    <usecase name=\"deep-buffer-playback\" device=\"bluetooth\" period_count=\"4\"/>\n"
+    "    <usecase name=\"audio-playback-voip\" period_size=\"480\" period_count=\"4\"/>\n"
+    "    <usecase name=\"spatial-audio-playback\" period_size=\"100000\" period_count=\"1\"/>\n"
+    "    <usecase name=\"audio-record\" period_count=\"1000\"/>\n"
+    "    <usecase name=\"no-such-usecase\" period_count=\"8\"/>\n"
+    "</buffer_policy>\n";
+
+class PolicyFile : public ::testing::Environment {
+public:
+    void SetUp() override {
+        FILE *file = fopen(BUFFER_POLICY_XML_FILE, "w");
+
+        ASSERT_NE(nullptr, file) << BUFFER_POLICY_XML_FILE;
+        fputs(policy_xml, file);
+        fclose(file);
+    }
+    void TearDown() override {
+        remove(BUFFER_POLICY_XML_FILE);
+    }
+};
+
+static ::testing::Environment *const policy_file =
+        ::testing::AddGlobalTestEnvironment(new PolicyFile);
+
+static const std::set<audio_devices_t> speaker = {AUDIO_DEVICE_OUT_SPEAKER};
+static const std::set<audio_devices_t> a2dp = {AUDIO_DEVICE_OUT_BLUETOOTH_A2DP};
+static const std::set<audio_devices_t> usb = {AUDIO_DEVICE_OUT_USB_HEADSET};
+
+TEST(BufferPolicy, DefaultEntryApplies) {
+    EXPECT_EQ(192u, BufferPolicy::PeriodSize(USECASE_AUDIO_PLAYBACK_LOW_LATENCY, 240));
+    EXPECT_EQ(960u, BufferPolicy::PeriodSize(USECASE_AUDIO_PLAYBACK_DEEP_BUFFER, 1920));
+    EXPECT_EQ(3u, BufferPolicy::PeriodCount(USECASE_AUDIO_PLAYBACK_DEEP_BUFFER, speaker, 2));
+}
+
+TEST(BufferPolicy, DeviceClassEntryWins) {
+    EXPECT_EQ(4u, BufferPolicy::PeriodCount(USECASE_AUDIO_PLAYBACK_DEEP_BUFFER, a2dp, 2));
+}
+
+TEST(BufferPolicy, MissingAttributeFallsBackToDefaultEntry) {
+    EXPECT_EQ(3u, BufferPolicy::PeriodCount(USECASE_AUDIO_PLAYBACK_DEEP_BUFFER, usb, 2));
+    EXPECT_EQ(2u, BufferPolicy::PeriodCount(USECASE_AUDIO_PLAYBACK_LOW_LATENCY, speaker, 2));
+}
+
+/* the framework keeps the size it read at open, whatever the route */
+TEST(BufferPolicy, DeviceClassEntryKeepsThePeriodSize) {
+    EXPECT_EQ(192u, BufferPolicy::PeriodSize(USECASE_AUDIO_PLAYBACK_LOW_LATENCY, 240));
+    /* the count of the same entry is still taken */
+    EXPECT_EQ(3u, BufferPolicy::PeriodCount(USECASE_AUDIO_PLAYBACK_LOW_LATENCY, usb, 2));
+    EXPECT_EQ(2u, BufferPolicy::PeriodCount(USECASE_AUDIO_PLAYBACK_LOW_LATENCY, speaker, 2));
+}
+
+TEST(BufferPolicy, PeriodSizeOnlyForUsecasesThatReadIt) {
+    EXPECT_EQ(320u, BufferPolicy::PeriodSize(USECASE_AUDIO_PLAYBACK_VOIP, 320));
+    /* the count of the same entry is still taken */
+    EXPECT_EQ(4u, BufferPolicy::PeriodCount(USECASE_AUDIO_PLAYBACK_VOIP, speaker, 2));
+}
+
+TEST(BufferPolicy, OutOfRangeKeepsTheDefault) {
+    EXPECT_EQ(480u, BufferPolicy::PeriodSize(USECASE_AUDIO_PLAYBACK_SPATIAL, 480));
+    EXPECT_EQ(2u, BufferPolicy::PeriodCount(USECASE_AUDIO_PLAYBACK_SPATIAL, speaker, 2));
+    EXPECT_EQ(4u, BufferPolicy::PeriodCount(USECASE_AUDIO_RECORD, speaker, 4));
+}
+
+TEST(BufferPolicy, UnlistedUsecaseKeepsTheDefault) {
+    EXPECT_EQ(2u, BufferPolicy::PeriodCount(USECASE_AUDIO_PLAYBACK_OFFLOAD2, speaker, 2));
+    EXPECT_EQ(4u, BufferPolicy::PeriodCount((audio_usecase_t)-1, speaker, 4));
+}
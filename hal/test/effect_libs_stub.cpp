@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+/*
+ * Stands in for both the offload effects bundle and the visualizer in the
+ * host build, whose HAL dlopens this library from the build tree. It only
+ * counts how often it is loaded and called, hal_effect_libs_test reads the
+ * counters back through effect_libs_stub_count().
+ */
+
+#include <string.h>
+
+#include <stdint.h>
+
+#include <atomic>
+
+/* same ABI as audio_io_handle_t and pal_stream_handle_t, without their headers */
+typedef int stub_io_handle_t;
+typedef void stub_stream_handle_t;
+
+static std::atomic<int> loads;
+static std::atomic<int> effect_starts;
+static std::atomic<int> effect_stops;
+static std::atomic<int> visualizer_starts;
+static std::atomic<int> visualizer_stops;
+static std::atomic<int> thread_hooks;
+
+__attribute__((constructor)) static void effect_libs_stub_load()
+{
+    loads++;
+}
+
+extern "C" {
+
+int offload_effects_bundle_hal_start_output(stub_io_handle_t output,
+                                            stub_stream_handle_t *pal_stream_handle)
+{
+    effect_starts++;
+    return 0;
+}
+
+int offload_effects_bundle_hal_stop_output(stub_io_handle_t output,
+                                           stub_stream_handle_t *pal_stream_handle)
+{
+    effect_stops++;
+    return 0;
+}
+
+int visualizer_hal_start_output(stub_io_handle_t output,
+                                stub_stream_handle_t *pal_stream_handle)
+{
+    visualizer_starts++;
+    return 0;
+}
+
+int visualizer_hal_stop_output(stub_io_handle_t output,
+                               stub_stream_handle_t *pal_stream_handle)
+{
+    visualizer_stops++;
+    return 0;
+}
+
+void visualizer_hal_set_thread_hooks(void (*start)(void), void (*wakeup)(uint64_t))
+{
+    thread_hooks++;
+}
+
+int effect_libs_stub_count(const char *what)
+{
+    if (!strcmp(what, "loads"))
+        return loads;
+    if (!strcmp(what, "effect_starts"))
+        return effect_starts;
+    if (!strcmp(what, "effect_stops"))
+        return effect_stops;
+    if (!strcmp(what, "visualizer_starts"))
+        return visualizer_starts;
+    if (!strcmp(what, "visualizer_stops"))
+        return visualizer_stops;
+    if (!strcmp(what, "thread_hooks"))
+        return thread_hooks;
+    return -1;
+}
+
+}
@@ -0,0 +1,212 @@
+/*
+ * Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+/*
+ * Cost of the per-buffer paths of the HAL, on the host build over
+ * libpal_sim. The simulator runs free, so a write never waits for the
+ * stream clock and what is measured is the HAL plus the simulator's
+ * bookkeeping, which stays the same from one HAL change to the next.
+ */
+
+#include <dlfcn.h>
+#include <stdio.h>
+
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <hardware/audio.h>
+#include <hardware/hardware.h>
+
+#include "PalSim.h"
+
+#ifndef HAL_TEST_LIB
+#define HAL_TEST_LIB "audio.primary.default.so"
+#endif
+
+static audio_hw_device_t *adev;
+
+static struct audio_stream_out *OpenOutput(audio_io_handle_t handle, audio_output_flags_t flags,
+        audio_format_t format = AUDIO_FORMAT_PCM_16_BIT,
+        audio_channel_mask_t channels = AUDIO_CHANNEL_OUT_STEREO) {
+    struct audio_config config = AUDIO_CONFIG_INITIALIZER;
+    struct audio_stream_out *out = nullptr;
+
+    config.sample_rate = 48000;
+    config.format = format;
+    config.channel_mask = channels;
+    if (adev->open_output_stream(adev, handle, AUDIO_DEVICE_OUT_SPEAKER, flags, &config,
+                                 &out, ""))
+        return nullptr;
+    return out;
+}
+
+static void CloseOutput(struct audio_stream_out *out) {
+    out->common.standby(&out->common);
+    adev->close_output_stream(adev, out);
+}
+
+/* opens an output and starts it with a first buffer */
+static struct audio_stream_out *StartOutput(benchmark::State& state, audio_io_handle_t handle,
+        audio_output_flags_t flags, audio_format_t format, audio_channel_mask_t channels,
+        std::vector<uint8_t>& buf) {
+    struct audio_stream_out *out = OpenOutput(handle, flags, format, channels);
+
+    if (!out) {
+        state.SkipWithError("open_output_stream failed");
+        return nullptr;
+    }
+    buf.assign(out->common.get_buffer_size(&out->common), 0);
+    if (out->write(out, buf.data(), buf.size()) < 0) {
+        state.SkipWithError("first write failed");
+        CloseOutput(out);
+        return nullptr;
+    }
+    return out;
+}
+
+static void BM_OutWrite(benchmark::State& state, audio_output_flags_t flags,
+                        audio_format_t format, audio_channel_mask_t channels) {
+    std::vector<uint8_t> buf;
+    struct audio_stream_out *out = StartOutput(state, 101, flags, format, channels, buf);
+
+    if (!out)
+        return;
+    for (auto _ : state) {
+        if (out->write(out, buf.data(), buf.size()) < 0) {
+            state.SkipWithError("write failed");
+            break;
+        }
+    }
+    state.SetBytesProcessed(state.iterations() * buf.size());
+    CloseOutput(out);
+}
+BENCHMARK_CAPTURE(BM_OutWrite, pcm16, AUDIO_OUTPUT_FLAG_DEEP_BUFFER,
+                  AUDIO_FORMAT_PCM_16_BIT, AUDIO_CHANNEL_OUT_STEREO);
+/* float is converted to 32 bit before PAL */
+BENCHMARK_CAPTURE(BM_OutWrite, float_convert, AUDIO_OUTPUT_FLAG_DEEP_BUFFER,
+                  AUDIO_FORMAT_PCM_FLOAT, AUDIO_CHANNEL_OUT_STEREO);
+/* haptic channels are split off into a second PAL stream */
+BENCHMARK_CAPTURE(BM_OutWrite, haptics, AUDIO_OUTPUT_FLAG_NONE, AUDIO_FORMAT_PCM_16_BIT,
+                  (audio_channel_mask_t)(AUDIO_CHANNEL_OUT_STEREO | AUDIO_CHANNEL_OUT_HAPTIC_A));
+
+/* GetFramesWritten for deep buffer, GetFrames from the PAL timestamp for offload */
+static void BM_PresentationPosition(benchmark::State& state, audio_output_flags_t flags) {
+    std::vector<uint8_t> buf;
+    struct audio_stream_out *out = StartOutput(state, 102, flags, AUDIO_FORMAT_PCM_16_BIT,
+                                               AUDIO_CHANNEL_OUT_STEREO, buf);
+    struct timespec ts;
+    uint64_t frames;
+
+    if (!out)
+        return;
+    for (auto _ : state) {
+        if (out->get_presentation_position(out, &frames, &ts)) {
+            state.SkipWithError("get_presentation_position failed");
+            break;
+        }
+        benchmark::DoNotOptimize(frames);
+    }
+    CloseOutput(out);
+}
+BENCHMARK_CAPTURE(BM_PresentationPosition, deep_buffer, AUDIO_OUTPUT_FLAG_DEEP_BUFFER);
+BENCHMARK_CAPTURE(BM_PresentationPosition, pcm_offload, AUDIO_OUTPUT_FLAG_DIRECT);
+
+static void BM_RenderPosition(benchmark::State& state, audio_output_flags_t flags) {
+    std::vector<uint8_t> buf;
+    struct audio_stream_out *out = StartOutput(state, 103, flags, AUDIO_FORMAT_PCM_16_BIT,
+                                               AUDIO_CHANNEL_OUT_STEREO, buf);
+    uint32_t frames;
+
+    if (!out)
+        return;
+    for (auto _ : state) {
+        out->get_render_position(out, &frames);
+        benchmark::DoNotOptimize(frames);
+    }
+    CloseOutput(out);
+}
+BENCHMARK_CAPTURE(BM_RenderPosition, deep_buffer, AUDIO_OUTPUT_FLAG_DEEP_BUFFER);
+BENCHMARK_CAPTURE(BM_RenderPosition, pcm_offload, AUDIO_OUTPUT_FLAG_DIRECT);
+
+/*
+ * Every stream call looks its stream up in the device's output list. The
+ * stream asked for is the last one opened, the worst case of the scan.
+ */
+static void BM_OutLookup(benchmark::State& state) {
+    std::vector<struct audio_stream_out *> outs;
+
+    for (int i = 0; i < state.range(0); i++) {
+        struct audio_stream_out *out = OpenOutput(200 + i, AUDIO_OUTPUT_FLAG_PRIMARY);
+
+        if (!out) {
+            state.SkipWithError("open_output_stream failed");
+            break;
+        }
+        outs.push_back(out);
+    }
+    if ((int)outs.size() == state.range(0)) {
+        struct audio_stream *last = &outs.back()->common;
+
+        for (auto _ : state)
+            benchmark::DoNotOptimize(last->get_sample_rate(last));
+    }
+    for (struct audio_stream_out *out : outs)
+        adev->close_output_stream(adev, out);
+}
+BENCHMARK(BM_OutLookup)->RangeMultiplier(2)->Range(1, 16);
+
+static void BM_SetParameters(benchmark::State& state, const char *kvpairs) {
+    for (auto _ : state) {
+        if (adev->set_parameters(adev, kvpairs)) {
+            state.SkipWithError("set_parameters failed");
+            break;
+        }
+    }
+}
+BENCHMARK_CAPTURE(BM_SetParameters, one_key, "screen_state=on");
+BENCHMARK_CAPTURE(BM_SetParameters, three_keys,
+                  "screen_state=on;rotation=90;A2dpSuspended=false");
+BENCHMARK_CAPTURE(BM_SetParameters, unknown_key, "no_such_key=1");
+
+static void BM_OutSetParameters(benchmark::State& state, const char *kvpairs) {
+    struct audio_stream_out *out = OpenOutput(104, AUDIO_OUTPUT_FLAG_PRIMARY);
+
+    if (!out) {
+        state.SkipWithError("open_output_stream failed");
+        return;
+    }
+    for (auto _ : state)
+        benchmark::DoNotOptimize(out->common.set_parameters(&out->common, kvpairs));
+    adev->close_output_stream(adev, out);
+}
+BENCHMARK_CAPTURE(BM_OutSetParameters, routing, "routing=2");
+BENCHMARK_CAPTURE(BM_OutSetParameters, unknown_key, "no_such_key=1");
+
+int main(int argc, char **argv) {
+    struct hw_module_t *module;
+    void *lib;
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+        return 1;
+
+    lib = dlopen(HAL_TEST_LIB, RTLD_NOW | RTLD_GLOBAL);
+    if (!lib) {
+        fprintf(stderr, "%s\n", dlerror());
+        return 1;
+    }
+    module = (struct hw_module_t *)dlsym(lib, HAL_MODULE_INFO_SYM_AS_STR);
+    if (!module || module->methods->open(module, AUDIO_HARDWARE_INTERFACE,
+                                         (struct hw_device_t **)&adev)) {
+        fprintf(stderr, "cannot open the audio device of %s\n", HAL_TEST_LIB);
+        return 1;
+    }
+    pal_sim_set_realtime(false);
+
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    adev->common.close(&adev->common);
+    return 0;
+}
@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+#include <thread>
+#include <vector>
+
+#include "HalTest.h"
+
+#ifndef EFFECT_LIBS_STUB
+#define EFFECT_LIBS_STUB "libeffect_libs_stub.so"
+#endif
+
+/*
+ * The host HAL is built with both effect library paths pointing at
+ * libeffect_libs_stub, so whether and how often the HAL loaded them is
+ * visible from here.
+ */
+class HalEffectLibsTest : public HalTest {
+protected:
+    static bool Loaded() {
+        void *lib = dlopen(EFFECT_LIBS_STUB, RTLD_NOW | RTLD_NOLOAD);
+
+        if (lib)
+            dlclose(lib);
+        return lib != nullptr;
+    }
+
+    static int Count(const char *what) {
+        void *lib = dlopen(EFFECT_LIBS_STUB, RTLD_NOW | RTLD_NOLOAD);
+        int (*count)(const char *);
+        int ret = -1;
+
+        if (!lib)
+            return 0;
+        count = (int (*)(const char *))dlsym(lib, "effect_libs_stub_count");
+        if (count)
+            ret = count(what);
+        dlclose(lib);
+        return ret;
+    }
+
+    /* PCM on a direct output is PCM offload, which runs the offload effects */
+    static struct audio_stream_out *OpenOffload(audio_io_handle_t handle) {
+        return OpenOutput(handle, AUDIO_DEVICE_OUT_SPEAKER, AUDIO_OUTPUT_FLAG_DIRECT);
+    }
+};
+
+/* runs first, the device suite is already open but no stream has started */
+TEST_F(HalEffectLibsTest, LoadedByFirstOffloadStart) {
+    struct audio_stream_out *primary = OpenOutput(41);
+    struct audio_stream_out *offload;
+
+    EXPECT_FALSE(Loaded()) << "effect libraries loaded at device open";
+
+    ASSERT_NE(nullptr, primary);
+    ASSERT_GT(WriteSilence(primary, 2), 0);
+    EXPECT_FALSE(Loaded()) << "effect libraries loaded by a non offload stream";
+    primary->common.standby(&primary->common);
+    adev_->close_output_stream(adev_, primary);
+
+    offload = OpenOffload(42);
+    ASSERT_NE(nullptr, offload);
+    EXPECT_FALSE(Loaded()) << "effect libraries loaded at offload open";
+    ASSERT_GT(WriteSilence(offload, 2), 0);
+    ASSERT_TRUE(Loaded());
+    EXPECT_EQ(1, Count("loads"));
+    EXPECT_EQ(1, Count("effect_starts"));
+    EXPECT_EQ(1, Count("visualizer_starts"));
+    EXPECT_EQ(1, Count("thread_hooks"));
+
+    offload->common.standby(&offload->common);
+    EXPECT_EQ(1, Count("effect_stops"));
+    EXPECT_EQ(1, Count("visualizer_stops"));
+    adev_->close_output_stream(adev_, offload);
+}
+
+TEST_F(HalEffectLibsTest, ConcurrentStartsLoadOnce) {
+    const int n = 4;
+    std::vector<struct audio_stream_out *> outs;
+    std::vector<std::thread> writers;
+    int starts = Count("effect_starts");
+
+    for (int i = 0; i < n; i++) {
+        outs.push_back(OpenOffload(43 + i));
+        ASSERT_NE(nullptr, outs.back());
+    }
+    for (auto out : outs)
+        writers.emplace_back([out] { EXPECT_GT(WriteSilence(out, 2), 0); });
+    for (auto& t : writers)
+        t.join();
+
+    EXPECT_EQ(1, Count("loads"));
+    EXPECT_EQ(1, Count("thread_hooks"));
+    EXPECT_EQ(starts + n, Count("effect_starts"));
+
+    for (auto out : outs) {
+        out->common.standby(&out->common);
+        adev_->close_output_stream(adev_, out);
+    }
+}
@@ -0,0 +1,245 @@
+/*
+ * Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <hardware/audio.h>
+#include <hardware/hardware.h>
+
+#ifndef HAL_TEST_LIB
+#define HAL_TEST_LIB "audio.primary.default.so"
+#endif
+#ifndef MIC_CHARACTERISTICS_CACHE_FILE
+#define MIC_CHARACTERISTICS_CACHE_FILE "microphone_characteristics.bin"
+#endif
+
+/*
+ * The HAL reads the microphone XML once per process, so every case here
+ * boots it in a forked child: load the HAL, open the device and an input,
+ * and hand get_microphones and get_active_microphones back over a pipe.
+ * The host HAL reads configs/taro/microphone_characteristics.xml and caches
+ * it at MIC_CHARACTERISTICS_CACHE_FILE.
+ */
+struct mic_snapshot_t {
+    int ret;
+    size_t count;
+    struct audio_microphone_characteristic_t mics[AUDIO_MICROPHONE_MAX_COUNT];
+    size_t active_count;
+    struct audio_microphone_characteristic_t active[AUDIO_MICROPHONE_MAX_COUNT];
+};
+
+static void BootChild(int fd) {
+    struct hw_module_t *module;
+    audio_hw_device_t *adev = nullptr;
+    struct audio_stream_in *in = nullptr;
+    struct audio_config config = AUDIO_CONFIG_INITIALIZER;
+    static mic_snapshot_t snap;
+    void *lib = dlopen(HAL_TEST_LIB, RTLD_NOW | RTLD_GLOBAL);
+
+    if (!lib)
+        _exit(2);
+    module = (struct hw_module_t *)dlsym(lib, HAL_MODULE_INFO_SYM_AS_STR);
+    if (!module || module->methods->open(module, AUDIO_HARDWARE_INTERFACE,
+                                         (struct hw_device_t **)&adev))
+        _exit(3);
+
+    snap.count = AUDIO_MICROPHONE_MAX_COUNT;
+    snap.ret = adev->get_microphones(adev, snap.mics, &snap.count);
+
+    config.sample_rate = 48000;
+    config.format = AUDIO_FORMAT_PCM_16_BIT;
+    config.channel_mask = AUDIO_CHANNEL_IN_STEREO;
+    if (adev->open_input_stream(adev, 1, AUDIO_DEVICE_IN_BUILTIN_MIC, &config, &in,
+                                AUDIO_INPUT_FLAG_NONE, "", AUDIO_SOURCE_MIC))
+        _exit(4);
+    snap.active_count = AUDIO_MICROPHONE_MAX_COUNT;
+    if (in->get_active_microphones(in, snap.active, &snap.active_count))
+        _exit(5);
+    adev->close_input_stream(adev, in);
+
+    if (write(fd, &snap, sizeof(snap)) != sizeof(snap))
+        _exit(6);
+    _exit(0);
+}
+
+class HalMicTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        unlink(MIC_CHARACTERISTICS_CACHE_FILE);
+    }
+
+    void TearDown() override {
+        unlink(MIC_CHARACTERISTICS_CACHE_FILE);
+    }
+
+    static void Boot(mic_snapshot_t *snap) {
+        int fds[2];
+        int status = 0;
+        size_t got = 0;
+        ssize_t n;
+        pid_t pid;
+
+        ASSERT_EQ(0, pipe(fds));
+        pid = fork();
+        ASSERT_LE(0, pid);
+        if (pid == 0) {
+            close(fds[0]);
+            BootChild(fds[1]);
+        }
+        close(fds[1]);
+        while (got < sizeof(*snap) &&
+               (n = read(fds[0], (uint8_t *)snap + got, sizeof(*snap) - got)) > 0)
+            got += n;
+        close(fds[0]);
+        ASSERT_EQ(pid, waitpid(pid, &status, 0));
+        ASSERT_TRUE(WIFEXITED(status));
+        ASSERT_EQ(0, WEXITSTATUS(status));
+        ASSERT_EQ(sizeof(*snap), got);
+        ASSERT_EQ(0, snap->ret);
+    }
+
+    static bool CacheStat(struct stat *st) {
+        return stat(MIC_CHARACTERISTICS_CACHE_FILE, st) == 0;
+    }
+
+    static std::vector<uint8_t> ReadCache() {
+        std::vector<uint8_t> data;
+        FILE *f = fopen(MIC_CHARACTERISTICS_CACHE_FILE, "rb");
+        int c;
+
+        if (!f)
+            return data;
+        while ((c = fgetc(f)) != EOF)
+            data.push_back((uint8_t)c);
+        fclose(f);
+        return data;
+    }
+
+    static void WriteCache(const std::vector<uint8_t>& data, size_t len) {
+        FILE *f = fopen(MIC_CHARACTERISTICS_CACHE_FILE, "wb");
+
+        ASSERT_NE(nullptr, f);
+        ASSERT_EQ(len, fwrite(data.data(), 1, len, f));
+        fclose(f);
+    }
+
+    /* a cache file the HAL replaced after failing to load it */
+    static bool Rewritten(const struct stat& before) {
+        struct stat after;
+
+        return CacheStat(&after) &&
+               (after.st_ino != before.st_ino ||
+                after.st_mtim.tv_sec != before.st_mtim.tv_sec ||
+                after.st_mtim.tv_nsec != before.st_mtim.tv_nsec);
+    }
+};
+
+static void ExpectSameMic(const struct audio_microphone_characteristic_t& a,
+                          const struct audio_microphone_characteristic_t& b) {
+    EXPECT_STREQ(a.device_id, b.device_id);
+    EXPECT_EQ(a.id, b.id);
+    EXPECT_EQ(a.device, b.device);
+    EXPECT_STREQ(a.address, b.address);
+    for (int ch = 0; ch < AUDIO_CHANNEL_COUNT_MAX; ch++)
+        EXPECT_EQ(a.channel_mapping[ch], b.channel_mapping[ch]) << "channel " << ch;
+    EXPECT_EQ(a.location, b.location);
+    EXPECT_EQ(a.group, b.group);
+    EXPECT_EQ(a.index_in_the_group, b.index_in_the_group);
+    EXPECT_EQ(a.sensitivity, b.sensitivity);
+    EXPECT_EQ(a.max_spl, b.max_spl);
+    EXPECT_EQ(a.min_spl, b.min_spl);
+    EXPECT_EQ(a.directionality, b.directionality);
+    ASSERT_EQ(a.num_frequency_responses, b.num_frequency_responses);
+    for (unsigned int i = 0; i < a.num_frequency_responses; i++) {
+        EXPECT_EQ(a.frequency_responses[0][i], b.frequency_responses[0][i]) << "frequency " << i;
+        EXPECT_EQ(a.frequency_responses[1][i], b.frequency_responses[1][i]) << "response " << i;
+    }
+    EXPECT_EQ(a.geometric_location.x, b.geometric_location.x);
+    EXPECT_EQ(a.geometric_location.y, b.geometric_location.y);
+    EXPECT_EQ(a.geometric_location.z, b.geometric_location.z);
+    EXPECT_EQ(a.orientation.x, b.orientation.x);
+    EXPECT_EQ(a.orientation.y, b.orientation.y);
+    EXPECT_EQ(a.orientation.z, b.orientation.z);
+}
+
+static void ExpectSameSnapshot(const mic_snapshot_t& a, const mic_snapshot_t& b) {
+    ASSERT_EQ(a.count, b.count);
+    for (size_t i = 0; i < a.count; i++) {
+        SCOPED_TRACE("microphone " + std::to_string(i));
+        ExpectSameMic(a.mics[i], b.mics[i]);
+    }
+    ASSERT_EQ(a.active_count, b.active_count);
+    for (size_t i = 0; i < a.active_count; i++) {
+        SCOPED_TRACE("active microphone " + std::to_string(i));
+        ExpectSameMic(a.active[i], b.active[i]);
+    }
+}
+
+TEST_F(HalMicTest, CacheMatchesExpat) {
+    mic_snapshot_t parsed, cached;
+    struct stat st;
+
+    ASSERT_NO_FATAL_FAILURE(Boot(&parsed));
+    ASSERT_TRUE(CacheStat(&st)) << "expat parse did not store a cache";
+    /* configs/taro declares four microphones */
+    ASSERT_EQ(4u, parsed.count);
+    EXPECT_LT(0u, parsed.active_count);
+
+    ASSERT_NO_FATAL_FAILURE(Boot(&cached));
+    EXPECT_FALSE(Rewritten(st)) << "second boot parsed the XML instead of the cache";
+    ExpectSameSnapshot(parsed, cached);
+}
+
+TEST_F(HalMicTest, TruncatedCacheFallsBackToExpat) {
+    mic_snapshot_t parsed, reparsed;
+    std::vector<uint8_t> image;
+    struct stat st;
+
+    ASSERT_NO_FATAL_FAILURE(Boot(&parsed));
+    image = ReadCache();
+    ASSERT_FALSE(image.empty());
+
+    for (size_t len : {(size_t)0, (size_t)16, image.size() / 2, image.size() - 1}) {
+        SCOPED_TRACE("length " + std::to_string(len));
+        ASSERT_NO_FATAL_FAILURE(WriteCache(image, len));
+        ASSERT_TRUE(CacheStat(&st));
+        ASSERT_NO_FATAL_FAILURE(Boot(&reparsed));
+        EXPECT_TRUE(Rewritten(st)) << "truncated cache was not replaced";
+        EXPECT_EQ(image.size(), ReadCache().size());
+        ExpectSameSnapshot(parsed, reparsed);
+    }
+}
+
+TEST_F(HalMicTest, CorruptCacheFallsBackToExpat) {
+    mic_snapshot_t parsed, reparsed;
+    std::vector<uint8_t> image, damaged;
+    struct stat st;
+
+    ASSERT_NO_FATAL_FAILURE(Boot(&parsed));
+    image = ReadCache();
+    ASSERT_FALSE(image.empty());
+
+    /* the magic, the XML hash in the header, and the tables themselves */
+    for (size_t off : {(size_t)0, (size_t)40, image.size() / 2, image.size() - 1}) {
+        SCOPED_TRACE("offset " + std::to_string(off));
+        damaged = image;
+        damaged[off] ^= 0x5a;
+        ASSERT_NO_FATAL_FAILURE(WriteCache(damaged, damaged.size()));
+        ASSERT_TRUE(CacheStat(&st));
+        ASSERT_NO_FATAL_FAILURE(Boot(&reparsed));
+        EXPECT_TRUE(Rewritten(st)) << "corrupt cache was not replaced";
+        EXPECT_EQ(image.size(), ReadCache().size());
+        ExpectSameSnapshot(parsed, reparsed);
+    }
+}
@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+#include <stdlib.h>
+
+#include <string>
+
+#include "HalTest.h"
+
+class HalParamsTest : public HalTest {
+protected:
+    std::string Get(const char *keys) {
+        char *reply = adev_->get_parameters(adev_, keys);
+        std::string s = reply ? reply : "";
+
+        free(reply);
+        return s;
+    }
+};
+
+TEST_F(HalParamsTest, SetRoutesToItsHandler) {
+    /* A2dpSuspended goes to PAL and comes back through the get handler */
+    EXPECT_EQ(0, adev_->set_parameters(adev_, "A2dpSuspended=true"));
+    EXPECT_NE(std::string::npos, Get("A2dpSuspended").find("A2dpSuspended=1"));
+    EXPECT_EQ(0, adev_->set_parameters(adev_, "A2dpSuspended=false"));
+    EXPECT_NE(std::string::npos, Get("A2dpSuspended").find("A2dpSuspended=0"));
+}
+
+TEST_F(HalParamsTest, SeveralKeysInOneCall) {
+    EXPECT_EQ(0, adev_->set_parameters(adev_, "screen_state=on;A2dpSuspended=true;rotation=90"));
+    EXPECT_NE(std::string::npos, Get("A2dpSuspended").find("A2dpSuspended=1"));
+    EXPECT_EQ(0, adev_->set_parameters(adev_, "A2dpSuspended=false"));
+}
+
+TEST_F(HalParamsTest, UnknownAndMalformedKeysAreIgnored) {
+    EXPECT_EQ(0, adev_->set_parameters(adev_, "no_such_key=1"));
+    EXPECT_EQ(0, adev_->set_parameters(adev_, "A2dpSuspendedX=true;;="));
+    EXPECT_EQ(0, adev_->set_parameters(adev_, ""));
+    EXPECT_EQ(std::string::npos, Get("no_such_key").find("no_such_key"));
+}
+
+TEST_F(HalParamsTest, GetAnswersOnlyWhatWasAsked) {
+    std::string reply = Get("A2dpSuspended");
+
+    EXPECT_NE(std::string::npos, reply.find("A2dpSuspended"));
+    EXPECT_EQ(std::string::npos, reply.find("isReconfigA2dpSupported"));
+}
@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+#include "HalTest.h"
+
+#define PROBE_CYCLES 10     /* PERF_LOCK_PROBE_SAMPLES per arm, and some */
+#define DECIDED_CYCLES 8
+
+/*
+ * The host HAL takes its perf locks from libpal_sim, which makes the
+ * injected open and start delays shorter while a lock is held. Each
+ * cycle opens and starts the stream once, then puts it in standby.
+ */
+class HalPerfLockTest : public HalTest {
+protected:
+    void TearDown() override {
+        pal_sim_set_delay_us(PAL_SIM_OP_OPEN, 0);
+        pal_sim_set_delay_us(PAL_SIM_OP_START, 0);
+        pal_sim_set_perf_boost(0);
+    }
+
+    static pal_sim_perf_stats_t PerfStats() {
+        pal_sim_perf_stats_t stats;
+
+        pal_sim_get_perf_stats(&stats);
+        return stats;
+    }
+
+    static void Cycle(struct audio_stream_out *out, int count) {
+        for (int i = 0; i < count; i++) {
+            ASSERT_GT(WriteSilence(out, 1), 0);
+            ASSERT_EQ(0, out->common.standby(&out->common));
+        }
+    }
+
+    static void SlowBringUp(uint32_t boost_pct) {
+        pal_sim_set_delay_us(PAL_SIM_OP_OPEN, 20000);
+        pal_sim_set_delay_us(PAL_SIM_OP_START, 20000);
+        pal_sim_set_perf_boost(boost_pct);
+    }
+};
+
+TEST_F(HalPerfLockTest, BoostKeptWhenItShortensBringUp) {
+    struct audio_stream_out *out = OpenOutput(61, AUDIO_DEVICE_OUT_SPEAKER,
+                                              AUDIO_OUTPUT_FLAG_DEEP_BUFFER);
+    uint64_t acquires;
+
+    ASSERT_NE(nullptr, out);
+    SlowBringUp(75);
+    Cycle(out, PROBE_CYCLES);
+    ASSERT_GT(PerfStats().acquires, 0u) << "perf HAL of libpal_sim not in use";
+
+    acquires = PerfStats().acquires;
+    Cycle(out, DECIDED_CYCLES);
+    /* open and start both boost */
+    EXPECT_EQ(acquires + 2 * DECIDED_CYCLES, PerfStats().acquires);
+    EXPECT_EQ(0u, PerfStats().held);
+    /* bounded by the boosted latency instead of the fixed second */
+    EXPECT_GT(PerfStats().last_duration_ms, 0);
+    EXPECT_LT(PerfStats().last_duration_ms, 1000);
+
+    adev_->close_output_stream(adev_, out);
+}
+
+TEST_F(HalPerfLockTest, BoostDroppedWhenItDoesNotHelp) {
+    struct audio_stream_out *out = OpenOutput(62);
+    uint64_t acquires;
+
+    ASSERT_NE(nullptr, out);
+    SlowBringUp(0);
+    Cycle(out, PROBE_CYCLES);
+
+    acquires = PerfStats().acquires;
+    Cycle(out, DECIDED_CYCLES);
+    EXPECT_EQ(acquires, PerfStats().acquires);
+    EXPECT_EQ(0u, PerfStats().held);
+
+    adev_->close_output_stream(adev_, out);
+}
@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+#include <errno.h>
+
+#include <chrono>
+#include <thread>
+
+#include "HalTest.h"
+#include "PalDefs.h"
+
+/* the default vendor.audio.route.batch_ms, with margin */
+#define BATCH_SETTLE_MS 150
+
+class HalRouteTest : public HalTest {
+protected:
+    void SetUp() override {
+        HalTest::SetUp();
+        out1_ = OpenOutput(41);
+        out2_ = OpenOutput(42);
+        ASSERT_NE(nullptr, out1_);
+        ASSERT_NE(nullptr, out2_);
+        /* started streams, so routing reaches pal_stream_set_device */
+        ASSERT_GT(WriteSilence(out1_, 2), 0);
+        ASSERT_GT(WriteSilence(out2_, 2), 0);
+        ASSERT_EQ(2u, pal_sim_streams_on(PAL_DEVICE_OUT_SPEAKER));
+    }
+
+    void TearDown() override {
+        adev_->set_parameters(adev_, "disconnect=4");
+        /* releasing commits what the disconnect batch may hold */
+        if (patch1_ != AUDIO_PATCH_HANDLE_NONE)
+            adev_->release_audio_patch(adev_, patch1_);
+        if (patch2_ != AUDIO_PATCH_HANDLE_NONE)
+            adev_->release_audio_patch(adev_, patch2_);
+        if (out1_)
+            adev_->close_output_stream(adev_, out1_);
+        if (out2_)
+            adev_->close_output_stream(adev_, out2_);
+    }
+
+    static void Settle() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(BATCH_SETTLE_MS));
+    }
+
+    struct audio_stream_out *out1_ = nullptr;
+    struct audio_stream_out *out2_ = nullptr;
+    audio_patch_handle_t patch1_ = AUDIO_PATCH_HANDLE_NONE;
+    audio_patch_handle_t patch2_ = AUDIO_PATCH_HANDLE_NONE;
+};
+
+TEST_F(HalRouteTest, PatchWithoutConnectionChangeRoutesAtOnce) {
+    EXPECT_EQ(0, Route(41, {AUDIO_DEVICE_OUT_WIRED_HEADPHONE}, &patch1_));
+    EXPECT_EQ(1u, pal_sim_streams_on(PAL_DEVICE_OUT_WIRED_HEADPHONE));
+}
+
+TEST_F(HalRouteTest, PatchesAfterConnectAreCommittedTogether) {
+    EXPECT_EQ(0, adev_->set_parameters(adev_, "connect=4"));
+    EXPECT_EQ(0, Route(41, {AUDIO_DEVICE_OUT_WIRED_HEADSET}, &patch1_));
+    EXPECT_EQ(0, Route(42, {AUDIO_DEVICE_OUT_WIRED_HEADSET}, &patch2_));
+    /* queued, both still play on the speaker */
+    EXPECT_EQ(2u, pal_sim_streams_on(PAL_DEVICE_OUT_SPEAKER));
+
+    Settle();
+    EXPECT_EQ(2u, pal_sim_streams_on(PAL_DEVICE_OUT_WIRED_HEADSET));
+    EXPECT_EQ(0u, pal_sim_streams_on(PAL_DEVICE_OUT_SPEAKER));
+    EXPECT_GT(WriteSilence(out1_, 2), 0);
+    EXPECT_GT(WriteSilence(out2_, 2), 0);
+}
+
+TEST_F(HalRouteTest, FailedStreamRollsTheBatchBack) {
+    EXPECT_EQ(0, adev_->set_parameters(adev_, "connect=4"));
+    /* the first stream switches, the second one fails */
+    pal_sim_fail_once(PAL_SIM_OP_SET_DEVICE, 2, -EIO);
+    EXPECT_EQ(0, Route(41, {AUDIO_DEVICE_OUT_WIRED_HEADSET}, &patch1_));
+    EXPECT_EQ(0, Route(42, {AUDIO_DEVICE_OUT_WIRED_HEADSET}, &patch2_));
+
+    Settle();
+    EXPECT_EQ(2u, pal_sim_streams_on(PAL_DEVICE_OUT_SPEAKER));
+    EXPECT_EQ(0u, pal_sim_streams_on(PAL_DEVICE_OUT_WIRED_HEADSET));
+    EXPECT_GT(WriteSilence(out1_, 2), 0);
+    EXPECT_GT(WriteSilence(out2_, 2), 0);
+}
+
+TEST_F(HalRouteTest, ReleaseCommitsTheQueuedRoutesFirst) {
+    EXPECT_EQ(0, adev_->set_parameters(adev_, "connect=4"));
+    EXPECT_EQ(0, Route(41, {AUDIO_DEVICE_OUT_WIRED_HEADSET}, &patch1_));
+    EXPECT_EQ(0, Route(42, {AUDIO_DEVICE_OUT_WIRED_HEADSET}, &patch2_));
+
+    EXPECT_EQ(0, adev_->release_audio_patch(adev_, patch1_));
+    patch1_ = AUDIO_PATCH_HANDLE_NONE;
+    /* out2 has its queued route without waiting for the batch window */
+    EXPECT_GE(pal_sim_streams_on(PAL_DEVICE_OUT_WIRED_HEADSET), 1u);
+}
@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+#include <errno.h>
+
+#include <vector>
+
+#include "HalTest.h"
+
+class HalSmokeTest : public HalTest {};
+
+TEST_F(HalSmokeTest, DeviceIsUp) {
+    EXPECT_EQ(0, adev_->init_check(adev_));
+    EXPECT_EQ(0, adev_->set_mode(adev_, AUDIO_MODE_NORMAL));
+}
+
+TEST_F(HalSmokeTest, OutputOpenWriteClose) {
+    struct audio_stream_out *out = OpenOutput(11);
+    pal_sim_stats_t before, after;
+    uint64_t frames = 0;
+    struct timespec ts;
+
+    ASSERT_NE(nullptr, out);
+    EXPECT_GT(out->common.get_buffer_size(&out->common), 0u);
+
+    pal_sim_get_stats(&before);
+    EXPECT_GT(WriteSilence(out, 20), 0);
+    pal_sim_get_stats(&after);
+    EXPECT_EQ(before.opens + 1, after.opens);
+    EXPECT_GE(after.writes - before.writes, 20u);
+
+    EXPECT_EQ(0, out->get_presentation_position(out, &frames, &ts));
+    EXPECT_GT(frames, 0u);
+
+    EXPECT_EQ(0, out->common.standby(&out->common));
+    adev_->close_output_stream(adev_, out);
+}
+
+TEST_F(HalSmokeTest, InputOpenReadClose) {
+    struct audio_stream_in *in = OpenInput(12);
+    size_t bytes;
+
+    ASSERT_NE(nullptr, in);
+    bytes = in->common.get_buffer_size(&in->common);
+    ASSERT_GT(bytes, 0u);
+
+    std::vector<uint8_t> buf(bytes);
+    for (int i = 0; i < 10; i++)
+        ASSERT_EQ((ssize_t)bytes, in->read(in, buf.data(), bytes));
+
+    EXPECT_EQ(0, in->common.standby(&in->common));
+    adev_->close_input_stream(adev_, in);
+}
+
+TEST_F(HalSmokeTest, WriteRecoversFromPalFault) {
+    struct audio_stream_out *out = OpenOutput(13);
+    pal_sim_stats_t before, after;
+
+    ASSERT_NE(nullptr, out);
+    ASSERT_GT(WriteSilence(out, 2), 0);
+
+    /* a PCM write error puts the stream in standby and is not reported */
+    pal_sim_get_stats(&before);
+    pal_sim_set_fault(PAL_SIM_OP_WRITE, 1.0, -EIO);
+    EXPECT_GT(WriteSilence(out, 1), 0);
+    pal_sim_clear_faults();
+
+    /* the next write opens a new PAL session */
+    EXPECT_GT(WriteSilence(out, 5), 0);
+    pal_sim_get_stats(&after);
+    EXPECT_EQ(before.faults + 1, after.faults);
+    EXPECT_EQ(before.opens + 1, after.opens);
+    adev_->close_output_stream(adev_, out);
+}
@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+#include <chrono>
+#include <thread>
+
+#include "HalTest.h"
+
+class HalSsrTest : public HalTest {
+protected:
+    void TearDown() override {
+        pal_sim_set_delay_us(PAL_SIM_OP_OPEN, 0);
+    }
+
+    static uint64_t PalOpens() {
+        pal_sim_stats_t stats;
+
+        pal_sim_get_stats(&stats);
+        return stats.opens;
+    }
+
+    /* recovery runs on its own thread, poll for the stream to be reopened */
+    static bool WaitOpens(uint64_t opens, int timeout_ms) {
+        for (int waited = 0; waited < timeout_ms; waited += 10) {
+            if (PalOpens() >= opens)
+                return true;
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        return PalOpens() >= opens;
+    }
+};
+
+TEST_F(HalSsrTest, ActiveOutputIsReopened) {
+    struct audio_stream_out *out = OpenOutput(51);
+    uint64_t opens;
+
+    ASSERT_NE(nullptr, out);
+    ASSERT_GT(WriteSilence(out, 2), 0);
+    opens = PalOpens();
+
+    pal_sim_trigger_ssr(50);
+    EXPECT_TRUE(WaitOpens(opens + 1, 2000)) << "stream not reopened after SSR";
+    EXPECT_GT(WriteSilence(out, 2), 0);
+
+    out->common.standby(&out->common);
+    adev_->close_output_stream(adev_, out);
+}
+
+TEST_F(HalSsrTest, StreamInStandbyIsNotReopened) {
+    struct audio_stream_out *out = OpenOutput(52);
+    uint64_t opens;
+
+    ASSERT_NE(nullptr, out);
+    ASSERT_GT(WriteSilence(out, 2), 0);
+    out->common.standby(&out->common);
+    opens = PalOpens();
+
+    pal_sim_trigger_ssr(20);
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    EXPECT_EQ(opens, PalOpens());
+
+    adev_->close_output_stream(adev_, out);
+}
+
+TEST_F(HalSsrTest, StreamClosedWhileOfflineStaysClosed) {
+    struct audio_stream_out *out = OpenOutput(53);
+    uint64_t opens;
+
+    ASSERT_NE(nullptr, out);
+    ASSERT_GT(WriteSilence(out, 2), 0);
+    opens = PalOpens();
+
+    pal_sim_trigger_ssr(200);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    out->common.standby(&out->common);
+    adev_->close_output_stream(adev_, out);
+
+    /* the recovery snapshot still holds the stream, it must not reopen it */
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    EXPECT_EQ(opens, PalOpens());
+}
+
+/*
+ * A second SSR while the first recovery is still reopening streams: the
+ * online callback must not wait for that recovery, and both complete.
+ */
+TEST_F(HalSsrTest, BackToBackSsrRecovers) {
+    struct audio_stream_out *out = OpenOutput(54);
+    uint64_t opens;
+
+    ASSERT_NE(nullptr, out);
+    ASSERT_GT(WriteSilence(out, 2), 0);
+    opens = PalOpens();
+
+    pal_sim_set_delay_us(PAL_SIM_OP_OPEN, 300000);
+    pal_sim_trigger_ssr(10);
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    pal_sim_trigger_ssr(10);
+    EXPECT_TRUE(WaitOpens(opens + 1, 3000));
+    pal_sim_set_delay_us(PAL_SIM_OP_OPEN, 0);
+
+    /* let the second recovery finish before writing */
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    EXPECT_GT(WriteSilence(out, 2), 0);
+
+    out->common.standby(&out->common);
+    adev_->close_output_stream(adev_, out);
+}
@@ -0,0 +1,218 @@
+/*
+ * Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "AllocCount.h"
+#include "HalTest.h"
+
+class HalVolumeTest : public HalTest {
+protected:
+    static std::vector<float> PalVolume() {
+        std::vector<float> vol(8);
+
+        vol.resize(std::min<uint32_t>(pal_sim_get_volume(vol.data(), vol.size()), vol.size()));
+        return vol;
+    }
+
+    static uint64_t PalVolumeCalls() {
+        pal_sim_stats_t stats;
+
+        pal_sim_get_stats(&stats);
+        return stats.volumes;
+    }
+};
+
+TEST_F(HalVolumeTest, CachedVolumeIsAppliedAtStart) {
+    struct audio_stream_out *out = OpenOutput(21);
+
+    ASSERT_NE(nullptr, out);
+    EXPECT_EQ(0, out->set_volume(out, 0.5f, 0.25f));
+    ASSERT_GT(WriteSilence(out, 2), 0);
+    EXPECT_EQ(std::vector<float>({0.5f, 0.25f}), PalVolume());
+
+    out->common.standby(&out->common);
+    adev_->close_output_stream(adev_, out);
+}
+
+TEST_F(HalVolumeTest, UnchangedVolumeDoesNotReachPal) {
+    struct audio_stream_out *out = OpenOutput(22);
+    uint64_t calls;
+
+    ASSERT_NE(nullptr, out);
+    EXPECT_EQ(0, out->set_volume(out, 0.75f, 0.75f));
+    ASSERT_GT(WriteSilence(out, 2), 0);
+
+    calls = PalVolumeCalls();
+    for (int i = 0; i < 10; i++)
+        EXPECT_EQ(0, out->set_volume(out, 0.75f, 0.75f));
+    EXPECT_EQ(calls, PalVolumeCalls());
+
+    out->common.standby(&out->common);
+    adev_->close_output_stream(adev_, out);
+}
+
+TEST_F(HalVolumeTest, LastOfAVolumeBurstWins) {
+    struct audio_stream_out *out = OpenOutput(23);
+    uint64_t calls;
+
+    ASSERT_NE(nullptr, out);
+    ASSERT_GT(WriteSilence(out, 2), 0);
+
+    /* a fade from the framework, one step per millisecond */
+    calls = PalVolumeCalls();
+    for (int i = 1; i <= 20; i++) {
+        EXPECT_EQ(0, out->set_volume(out, i / 20.0f, i / 40.0f));
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    /* what is still pending goes out with a write after the window */
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    ASSERT_GT(WriteSilence(out, 2), 0);
+
+    EXPECT_EQ(std::vector<float>({1.0f, 0.5f}), PalVolume());
+    EXPECT_LT(PalVolumeCalls() - calls, 20u) << "steps were not coalesced";
+
+    out->common.standby(&out->common);
+    adev_->close_output_stream(adev_, out);
+}
+
+TEST_F(HalVolumeTest, SetVolumeDoesNotAllocate) {
+    struct audio_stream_out *out = OpenOutput(28);
+    uint64_t allocs;
+    int ret;
+
+    ASSERT_NE(nullptr, out);
+    /* cached before start, then applied or coalesced once started */
+    for (int i = 1; i <= 5; i++) {
+        {
+            AllocScope scope;
+
+            ret = out->set_volume(out, i / 10.0f, i / 10.0f);
+            allocs = scope.Count();
+        }
+        EXPECT_EQ(0, ret);
+        EXPECT_EQ(0u, allocs) << "cached volume " << i;
+    }
+    ASSERT_GT(WriteSilence(out, 2), 0);
+
+    for (int i = 1; i <= 20; i++) {
+        {
+            AllocScope scope;
+
+            ret = out->set_volume(out, i / 20.0f, i / 40.0f);
+            allocs = scope.Count();
+        }
+        EXPECT_EQ(0, ret);
+        EXPECT_EQ(0u, allocs) << "volume step " << i;
+        std::this_thread::sleep_for(std::chrono::milliseconds(i % 2 ? 1 : 15));
+    }
+
+    out->common.standby(&out->common);
+    adev_->close_output_stream(adev_, out);
+}
+
+TEST_F(HalVolumeTest, OffloadBurstIsSentWithoutAWrite) {
+    struct audio_stream_out *out = OpenOutput(27, AUDIO_DEVICE_OUT_SPEAKER,
+                                              AUDIO_OUTPUT_FLAG_DIRECT);
+    uint64_t calls;
+
+    ASSERT_NE(nullptr, out);
+    ASSERT_GT(WriteSilence(out, 1), 0);
+
+    calls = PalVolumeCalls();
+    for (int i = 1; i <= 20; i++) {
+        EXPECT_EQ(0, out->set_volume(out, i / 20.0f, i / 20.0f));
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    /* no write follows, the last step still has to land */
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    EXPECT_EQ(std::vector<float>({1.0f, 1.0f}), PalVolume());
+    EXPECT_LT(PalVolumeCalls() - calls, 20u) << "steps were not coalesced";
+
+    out->common.standby(&out->common);
+    adev_->close_output_stream(adev_, out);
+}
+
+TEST_F(HalVolumeTest, OffloadStreamsShareTheTimer) {
+    struct audio_stream_out *a = OpenOutput(29, AUDIO_DEVICE_OUT_SPEAKER,
+                                            AUDIO_OUTPUT_FLAG_DIRECT);
+    struct audio_stream_out *b = OpenOutput(30, AUDIO_DEVICE_OUT_SPEAKER,
+                                            AUDIO_OUTPUT_FLAG_DIRECT);
+
+    ASSERT_NE(nullptr, a);
+    ASSERT_NE(nullptr, b);
+    ASSERT_GT(WriteSilence(a, 1), 0);
+    ASSERT_GT(WriteSilence(b, 1), 0);
+
+    /* both get a pending step, a closes before the timer gets to it */
+    EXPECT_EQ(0, a->set_volume(a, 0.1f, 0.1f));
+    EXPECT_EQ(0, b->set_volume(b, 0.1f, 0.1f));
+    EXPECT_EQ(0, a->set_volume(a, 0.2f, 0.2f));
+    EXPECT_EQ(0, b->set_volume(b, 0.3f, 0.3f));
+    a->common.standby(&a->common);
+    adev_->close_output_stream(adev_, a);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    EXPECT_EQ(std::vector<float>({0.3f, 0.3f}), PalVolume());
+
+    b->common.standby(&b->common);
+    adev_->close_output_stream(adev_, b);
+}
+
+TEST_F(HalVolumeTest, MonoOutputSendsOnePair) {
+    struct audio_stream_out *out = OpenOutput(24, AUDIO_DEVICE_OUT_SPEAKER,
+                                              AUDIO_OUTPUT_FLAG_PRIMARY, 48000, 1);
+
+    ASSERT_NE(nullptr, out);
+    EXPECT_EQ(0, out->set_volume(out, 0.5f, 0.5f));
+    ASSERT_GT(WriteSilence(out, 2), 0);
+    EXPECT_EQ(std::vector<float>({0.5f}), PalVolume());
+
+    out->common.standby(&out->common);
+    adev_->close_output_stream(adev_, out);
+}
+
+TEST_F(HalVolumeTest, InputGainIsOnePair) {
+    struct audio_stream_in *in = OpenInput(25);
+    std::vector<uint8_t> buf;
+
+    ASSERT_NE(nullptr, in);
+    buf.resize(in->common.get_buffer_size(&in->common));
+    ASSERT_EQ((ssize_t)buf.size(), in->read(in, buf.data(), buf.size()));
+
+    EXPECT_EQ(0, in->set_gain(in, 0.3f));
+    EXPECT_EQ(std::vector<float>({0.3f}), PalVolume());
+
+    in->common.standby(&in->common);
+    adev_->close_input_stream(adev_, in);
+}
+
+TEST_F(HalVolumeTest, RoutingPastTheOpenSlotsKeepsVolume) {
+    struct audio_stream_out *out = OpenOutput(26);
+    audio_patch_handle_t patch = AUDIO_PATCH_HANDLE_NONE;
+
+    ASSERT_NE(nullptr, out);
+    EXPECT_EQ(0, out->set_volume(out, 0.5f, 0.5f));
+    ASSERT_GT(WriteSilence(out, 2), 0);
+
+    /* grow and shrink the device list around the slots allocated at open */
+    EXPECT_EQ(0, Route(26, {AUDIO_DEVICE_OUT_SPEAKER, AUDIO_DEVICE_OUT_WIRED_HEADPHONE}, &patch));
+    ASSERT_GT(WriteSilence(out, 2), 0);
+    EXPECT_EQ(0, Route(26, {AUDIO_DEVICE_OUT_SPEAKER, AUDIO_DEVICE_OUT_WIRED_HEADPHONE,
+                            AUDIO_DEVICE_OUT_LINE, AUDIO_DEVICE_OUT_EARPIECE,
+                            AUDIO_DEVICE_OUT_AUX_LINE}, &patch));
+    ASSERT_GT(WriteSilence(out, 2), 0);
+    EXPECT_EQ(0, Route(26, {AUDIO_DEVICE_OUT_SPEAKER}, &patch));
+    ASSERT_GT(WriteSilence(out, 2), 0);
+    EXPECT_EQ(std::vector<float>({0.5f, 0.5f}), PalVolume());
+
+    EXPECT_EQ(0, adev_->release_audio_patch(adev_, patch));
+    out->common.standby(&out->common);
+    adev_->close_output_stream(adev_, out);
+}
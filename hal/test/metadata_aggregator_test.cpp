@@ -0,0 +1,136 @@
+/*
+ * Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+#include <errno.h>
+
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "MetadataAggregator.h"
+
+typedef std::vector<MetadataAggregator::track_key_t> tracks_t;
+
+/* stands in for PAL, refuses the next fail_ updates */
+class FakePal {
+public:
+    int Send(const tracks_t& tracks) {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        calls_++;
+        if (fail_) {
+            fail_--;
+            return -EIO;
+        }
+        accepted_.push_back(tracks);
+        return 0;
+    }
+
+    void Fail(int count) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        fail_ = count;
+    }
+
+    int Calls() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return calls_;
+    }
+
+    std::vector<tracks_t> Accepted() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return accepted_;
+    }
+
+private:
+    std::mutex mutex_;
+    int fail_ = 0;
+    int calls_ = 0;
+    std::vector<tracks_t> accepted_;
+};
+
+class MetadataAggregatorTest : public ::testing::Test {
+protected:
+    MetadataAggregatorTest() :
+        agg_("test", [this](const tracks_t& tracks) { return pal_.Send(tracks); }) {}
+
+    /* past the debounce window, so the next change is sent right away */
+    static void Settle() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(3 * METADATA_DEBOUNCE_DEFAULT_MS));
+    }
+
+    FakePal pal_;
+    MetadataAggregator agg_;
+    int s1_, s2_;
+    const MetadataAggregator::track_key_t music_{1, 2};
+    const MetadataAggregator::track_key_t game_{14, 2};
+};
+
+TEST_F(MetadataAggregatorTest, FirstChangeIsSentRightAway) {
+    EXPECT_EQ(0, agg_.Update(&s1_, {music_}, true));
+    ASSERT_EQ(1u, pal_.Accepted().size());
+    EXPECT_EQ(tracks_t({music_}), pal_.Accepted()[0]);
+}
+
+TEST_F(MetadataAggregatorTest, UnchangedAggregateIsNotResent) {
+    EXPECT_EQ(0, agg_.Update(&s1_, {music_}, true));
+    Settle();
+    EXPECT_EQ(0, agg_.Update(&s1_, {music_}, true));
+    EXPECT_EQ(1, pal_.Calls());
+}
+
+TEST_F(MetadataAggregatorTest, ChurnFoldsIntoOneTrailingUpdate) {
+    EXPECT_EQ(0, agg_.Update(&s1_, {music_}, true));
+    EXPECT_EQ(0, agg_.Update(&s2_, {game_}, true));
+    EXPECT_EQ(0, agg_.Update(&s2_, {game_, game_}, true));
+    EXPECT_EQ(1, pal_.Calls());
+
+    Settle();
+    ASSERT_EQ(2u, pal_.Accepted().size());
+    EXPECT_EQ(tracks_t({music_, game_, game_}), pal_.Accepted()[1]);
+}
+
+TEST_F(MetadataAggregatorTest, RefusedUpdateIsRetried) {
+    pal_.Fail(2);
+    EXPECT_EQ(-EIO, agg_.Update(&s1_, {music_}, true));
+
+    /* one retry per debounce window, the second one goes through */
+    std::this_thread::sleep_for(std::chrono::milliseconds(5 * METADATA_DEBOUNCE_DEFAULT_MS));
+    EXPECT_EQ(3, pal_.Calls());
+    ASSERT_EQ(1u, pal_.Accepted().size());
+    EXPECT_EQ(tracks_t({music_}), pal_.Accepted()[0]);
+}
+
+TEST_F(MetadataAggregatorTest, RefusedUpdateIsNotTakenAsSent) {
+    pal_.Fail(1);
+    EXPECT_EQ(-EIO, agg_.Update(&s1_, {music_}, true));
+    agg_.CancelPending();
+    Settle();
+    EXPECT_EQ(1, pal_.Calls());
+
+    /* same tracks again, PAL never took them so they go out */
+    EXPECT_EQ(0, agg_.Update(&s1_, {music_}, true));
+    ASSERT_EQ(1u, pal_.Accepted().size());
+    EXPECT_EQ(tracks_t({music_}), pal_.Accepted()[0]);
+}
+
+TEST_F(MetadataAggregatorTest, CancelledTrailingUpdateIsDropped) {
+    EXPECT_EQ(0, agg_.Update(&s1_, {music_}, true));
+    EXPECT_EQ(0, agg_.Update(&s2_, {game_}, true));
+    agg_.CancelPending();
+    Settle();
+    EXPECT_EQ(1, pal_.Calls());
+}
+
+TEST_F(MetadataAggregatorTest, RemovedStreamLeavesTheAggregate) {
+    EXPECT_EQ(0, agg_.Update(&s1_, {music_}, true));
+    EXPECT_EQ(0, agg_.Update(&s2_, {game_}, false));
+    agg_.Remove(&s1_);
+    EXPECT_EQ(0, agg_.Flush());
+    ASSERT_EQ(2u, pal_.Accepted().size());
+    EXPECT_EQ(tracks_t({game_}), pal_.Accepted()[1]);
+}
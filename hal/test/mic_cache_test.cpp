@@ -0,0 +1,204 @@
+/*
+ * Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "MicCache.h"
+
+static const char kXml[] =
+    "<microphone_characteristics>\n"
+    "  <microphones>\n"
+    "    <microphone valid_mask=\"31\" device_id=\"builtin_mic\" type=\"AUDIO_DEVICE_IN_BUILTIN_MIC\"/>\n"
+    "  </microphones>\n"
+    "</microphone_characteristics>\n";
+
+class MicCacheTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        char tmpl[] = "/tmp/mic_cache_test.XXXXXX";
+
+        ASSERT_NE(nullptr, mkdtemp(tmpl));
+        dir_ = tmpl;
+        xml_ = dir_ + "/microphone_characteristics.xml";
+        cache_ = dir_ + "/microphone_characteristics.bin";
+        WriteFile(xml_, kXml, sizeof(kXml) - 1);
+
+        /* stands in for the microphone and device map tables */
+        std::mt19937 gen(1);
+        payload_.resize(4096);
+        for (auto& b : payload_)
+            b = (uint8_t)gen();
+    }
+
+    void TearDown() override {
+        unlink(xml_.c_str());
+        unlink(cache_.c_str());
+        unlink((cache_ + ".tmp").c_str());
+        rmdir(dir_.c_str());
+    }
+
+    static void WriteFile(const std::string& path, const void *data, size_t size) {
+        FILE *f = fopen(path.c_str(), "wb");
+
+        ASSERT_NE(nullptr, f);
+        ASSERT_EQ(size, fwrite(data, 1, size, f));
+        fclose(f);
+    }
+
+    static std::vector<uint8_t> ReadFile(const std::string& path) {
+        std::vector<uint8_t> data;
+        FILE *f = fopen(path.c_str(), "rb");
+        int c;
+
+        if (!f)
+            return data;
+        while ((c = fgetc(f)) != EOF)
+            data.push_back((uint8_t)c);
+        fclose(f);
+        return data;
+    }
+
+    /* what parse_xml does: fingerprint, then store after a parse */
+    void Store() {
+        mic_cache_header_t hdr;
+
+        ASSERT_EQ(0, MicCacheFingerprint(xml_.c_str(), payload_.size(), &hdr));
+        ASSERT_EQ(0, MicCacheStore(cache_.c_str(), &hdr, payload_.data(), payload_.size()));
+    }
+
+    int Load(std::vector<uint8_t> *out) {
+        mic_cache_header_t hdr;
+        int ret = MicCacheFingerprint(xml_.c_str(), payload_.size(), &hdr);
+
+        if (ret)
+            return ret;
+        out->assign(payload_.size(), 0);
+        return MicCacheLoad(cache_.c_str(), &hdr, out->data(), out->size());
+    }
+
+    std::string dir_, xml_, cache_;
+    std::vector<uint8_t> payload_;
+};
+
+TEST_F(MicCacheTest, RoundTrip) {
+    std::vector<uint8_t> loaded;
+
+    Store();
+    ASSERT_EQ(0, Load(&loaded));
+    EXPECT_EQ(payload_, loaded);
+    EXPECT_NE(0, access((cache_ + ".tmp").c_str(), F_OK)) << "temp file left behind";
+}
+
+TEST_F(MicCacheTest, MissingFilesFallBack) {
+    std::vector<uint8_t> loaded;
+    mic_cache_header_t hdr;
+
+    EXPECT_EQ(-ENOENT, Load(&loaded)) << "no cache yet";
+    unlink(xml_.c_str());
+    EXPECT_EQ(-ENOENT, MicCacheFingerprint(xml_.c_str(), payload_.size(), &hdr));
+}
+
+TEST_F(MicCacheTest, EditedXmlIsStale) {
+    std::vector<uint8_t> loaded;
+    std::string edited(kXml);
+
+    Store();
+    /* same size, different content */
+    edited[edited.find("31")] = '7';
+    WriteFile(xml_, edited.data(), edited.size());
+    EXPECT_EQ(-EINVAL, Load(&loaded));
+}
+
+TEST_F(MicCacheTest, TouchedXmlIsStale) {
+    std::vector<uint8_t> loaded;
+    struct timespec times[2] = {{0, UTIME_OMIT}, {12345, 0}};
+
+    Store();
+    ASSERT_EQ(0, utimensat(AT_FDCWD, xml_.c_str(), times, 0));
+    EXPECT_EQ(-EINVAL, Load(&loaded));
+}
+
+TEST_F(MicCacheTest, OtherTableLayoutIsStale) {
+    std::vector<uint8_t> loaded(payload_.size() + 4);
+    mic_cache_header_t hdr;
+
+    Store();
+    /* a HAL whose tables grew reads neither the old image nor past it */
+    ASSERT_EQ(0, MicCacheFingerprint(xml_.c_str(), loaded.size(), &hdr));
+    EXPECT_EQ(-EINVAL, MicCacheLoad(cache_.c_str(), &hdr, loaded.data(), loaded.size()));
+}
+
+TEST_F(MicCacheTest, CorruptImageIsRejected) {
+    std::vector<uint8_t> image, loaded;
+
+    Store();
+    image = ReadFile(cache_);
+    ASSERT_EQ(sizeof(mic_cache_header_t) + payload_.size(), image.size());
+
+    /* a flipped payload byte */
+    image[sizeof(mic_cache_header_t) + 100] ^= 0x40;
+    WriteFile(cache_, image.data(), image.size());
+    EXPECT_EQ(-EINVAL, Load(&loaded));
+
+    /* a header from another version */
+    image[sizeof(mic_cache_header_t) + 100] ^= 0x40;
+    ((mic_cache_header_t *)image.data())->version++;
+    WriteFile(cache_, image.data(), image.size());
+    EXPECT_EQ(-EINVAL, Load(&loaded));
+}
+
+TEST_F(MicCacheTest, TruncatedImageIsRejected) {
+    std::vector<uint8_t> image, loaded;
+
+    Store();
+    image = ReadFile(cache_);
+    for (size_t len : {(size_t)0, sizeof(mic_cache_header_t) - 1, sizeof(mic_cache_header_t),
+                       image.size() - 1}) {
+        SCOPED_TRACE(len);
+        WriteFile(cache_, image.data(), len);
+        EXPECT_EQ(-EINVAL, Load(&loaded));
+    }
+}
+
+TEST_F(MicCacheTest, RandomDamageNeverLoads) {
+    std::vector<uint8_t> image, damaged, loaded;
+    std::mt19937 gen(2);
+
+    Store();
+    image = ReadFile(cache_);
+    for (int round = 0; round < 500; round++) {
+        damaged = image;
+        for (int n = 1 + gen() % 4; n > 0; n--)
+            damaged[gen() % damaged.size()] ^= 1 + gen() % 255;
+        if (damaged == image)
+            continue;
+        WriteFile(cache_, damaged.data(), damaged.size());
+        ASSERT_NE(0, Load(&loaded)) << "round " << round;
+    }
+}
+
+TEST_F(MicCacheTest, UnwritableDirectoryFails) {
+    mic_cache_header_t hdr;
+
+    ASSERT_EQ(0, MicCacheFingerprint(xml_.c_str(), payload_.size(), &hdr));
+    EXPECT_NE(0, MicCacheStore((dir_ + "/missing/cache.bin").c_str(), &hdr,
+                               payload_.data(), payload_.size()));
+}
+
+TEST(MicCacheHash, IsFnv1a) {
+    EXPECT_EQ(0xcbf29ce484222325ULL, MicCacheHash("", 0));
+    EXPECT_EQ(0xaf63dc4c8601ec8cULL, MicCacheHash("a", 1));
+}
@@ -0,0 +1,202 @@
+/*
+ * Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+#include <math.h>
+#include <stdint.h>
+
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "MmapPosition.h"
+
+static const uint32_t kRate = 48000;
+static const int32_t kBurst = 96;           /* 2 ms */
+static const int64_t kQueryNs = 1000000;    /* AAudio asks every 1 ms */
+static const int64_t kSparseNs = 9700000;   /* not a multiple of the burst */
+
+typedef struct run_error {
+    double max;                 /* frames, furthest from the true position */
+    double mean;                /* frames, signed, reported minus true */
+} run_error_t;
+
+/*
+ * A DSP whose clock runs ppm off nominal. The DMA position moves a burst
+ * at a time and the timestamp carries up to 200 us of query latency.
+ */
+class MmapPositionTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        struct audio_mmap_buffer_info info = {};
+
+        info.buffer_size_frames = kBurst * 4;
+        info.burst_size_frames = kBurst;
+        pos_.Configure(true, kRate, 4, &info);
+    }
+
+    /* what PAL reports at t_ns, and the true position then */
+    struct audio_mmap_position Read(int64_t t_ns, double ppm, double *true_frames) {
+        struct audio_mmap_position p;
+
+        *true_frames = (t_ns - start_ns_) * kRate * (1 + ppm / 1e6) / 1e9 + offset_;
+        p.position_frames = (int32_t)(floor(*true_frames / kBurst) * kBurst);
+        p.time_nanoseconds = t_ns + std::uniform_int_distribution<int64_t>(0, 200000)(gen_);
+        return p;
+    }
+
+    /*
+     * queries every query_ns for ms, checking every answer is monotonic
+     * and never ahead of the PAL position it came from
+     */
+    run_error_t Run(int64_t ms, double ppm, int64_t query_ns = kQueryNs) {
+        run_error_t err = {0, 0};
+        int64_t n = ms * 1000000 / query_ns;
+
+        for (int64_t i = 0; i < n; i++) {
+            double true_frames;
+            struct audio_mmap_position p = Read(now_ns_, ppm, &true_frames);
+            int32_t raw = p.position_frames;
+
+            pos_.Update(&p);
+            EXPECT_LE(p.position_frames, raw);
+            EXPECT_GE(p.position_frames, last_.position_frames);
+            EXPECT_GE(p.time_nanoseconds, last_.time_nanoseconds);
+            err.max = std::max(err.max, fabs(p.position_frames - true_frames));
+            err.mean += (p.position_frames - true_frames) / n;
+            last_ = p;
+            now_ns_ += query_ns;
+        }
+        return err;
+    }
+
+    MmapPosition pos_;
+    std::mt19937 gen_{1};
+    int64_t start_ns_ = 1000000000;
+    int64_t now_ns_ = 1000000000;
+    double offset_ = 0;
+    struct audio_mmap_position last_ = {};
+};
+
+TEST_F(MmapPositionTest, MonotonicWithinABurst) {
+    /* the raw position stalls a whole burst and then jumps, the filter does not */
+    EXPECT_LE(Run(2000, 0).max, kBurst);
+}
+
+TEST_F(MmapPositionTest, NoTimestampPassesThrough) {
+    struct audio_mmap_position p = {0, 0};
+
+    pos_.Update(&p);
+    EXPECT_EQ(0, p.position_frames);
+    EXPECT_EQ(0, p.time_nanoseconds);
+}
+
+TEST_F(MmapPositionTest, TracksDrift) {
+    double fast;
+
+    /*
+     * Sparse queries, so a loop that only corrected phase would trail a
+     * fast clock and lead a slow one by several frames. Once settled, the
+     * rate loop leaves both at the same offset to the true position.
+     */
+    Run(60000, 450, kSparseNs);
+    fast = Run(20000, 450, kSparseNs).mean;
+    pos_.Reset();
+    last_ = {};
+    Run(60000, -450, kSparseNs);
+    EXPECT_NEAR(fast, Run(20000, -450, kSparseNs).mean, 1.0);
+}
+
+TEST_F(MmapPositionTest, NeverPassesThePalPosition) {
+    double true_frames;
+    struct audio_mmap_position p;
+
+    /* a fast clock queried sparsely, where the loop predicts furthest ahead */
+    Run(10000, 450, kSparseNs);
+    /* a query right after a burst landed, stamped late by the query latency */
+    p = Read(now_ns_, 450, &true_frames);
+    p.time_nanoseconds += 200000;
+    int32_t raw = p.position_frames;
+    pos_.Update(&p);
+    EXPECT_LE(p.position_frames, raw);
+    EXPECT_GE(p.position_frames, raw - kBurst);
+}
+
+TEST_F(MmapPositionTest, ClampsDriftToTheLimit) {
+    /* a clock that far off is a fault, the bound to the raw position still holds */
+    EXPECT_LE(Run(10000, 5000).max, kBurst);
+}
+
+TEST_F(MmapPositionTest, ResyncsOnForwardJump) {
+    double true_frames;
+    struct audio_mmap_position p;
+
+    Run(1000, 0);
+    /* an xrun skips ten bursts */
+    offset_ += 10 * kBurst;
+    p = Read(now_ns_, 0, &true_frames);
+    pos_.Update(&p);
+    EXPECT_NEAR(true_frames, p.position_frames, kBurst);
+    last_ = p;
+    now_ns_ += kQueryNs;
+    EXPECT_LE(Run(1000, 0).max, kBurst);
+}
+
+TEST_F(MmapPositionTest, ResyncsOnDspRestart) {
+    double true_frames;
+    struct audio_mmap_position p;
+
+    Run(1000, 0);
+    /* the DSP comes back from zero, monotonic or not */
+    start_ns_ = now_ns_;
+    p = Read(now_ns_, 0, &true_frames);
+    pos_.Update(&p);
+    EXPECT_EQ(0, p.position_frames);
+    last_ = p;
+    now_ns_ += kQueryNs;
+    EXPECT_LE(Run(1000, 0).max, kBurst);
+}
+
+TEST_F(MmapPositionTest, SmallStepIsFiltered) {
+    double true_frames;
+    struct audio_mmap_position p;
+
+    Run(1000, 0);
+    /* one burst late is jitter, not a resync */
+    offset_ -= kBurst;
+    p = Read(now_ns_, 0, &true_frames);
+    pos_.Update(&p);
+    EXPECT_GE(p.position_frames, last_.position_frames);
+}
+
+TEST_F(MmapPositionTest, ResetDropsHistory) {
+    struct audio_mmap_position p;
+
+    Run(1000, 0);
+    /* without the reset this would be held at the last position */
+    pos_.Reset();
+    p.position_frames = last_.position_frames - kBurst;
+    p.time_nanoseconds = now_ns_;
+    pos_.Update(&p);
+    EXPECT_EQ(last_.position_frames - kBurst, p.position_frames);
+}
+
+TEST(MmapPositionConfigure, ClearsPlaybackBuffer) {
+    std::vector<uint8_t> buf(kBurst * 4 * 4, 0xa5);
+    struct audio_mmap_buffer_info info = {};
+    MmapPosition pos;
+
+    info.shared_memory_address = buf.data();
+    info.buffer_size_frames = kBurst * 4;
+    info.burst_size_frames = kBurst;
+    pos.Configure(true, kRate, 4, &info);
+    for (uint8_t b : buf)
+        ASSERT_EQ(0, b);
+
+    /* capture leaves the DSP's buffer alone */
+    std::fill(buf.begin(), buf.end(), 0xa5);
+    pos.Configure(false, kRate, 4, &info);
+    EXPECT_EQ(0xa5, buf[0]);
+}
@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+#include <string.h>
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "ParamKeys.h"
+
+/* a slice of the SetParameters table, with a key owned by two handlers */
+static const param_key_t table[] = {
+    {"screen_state", 0},
+    {"UHQA", 1},
+    {"connect", 2},
+    {"disconnect", 3},
+    {"A2dpSuspended", 4},
+    {"bt_ble", 5},
+    {"bt_ble", 6},
+    {"bt_swb", 7},
+    {"BT_SCO", 8},
+    {"bt_wbs", 9},
+    {"latency_probe", 10},
+    {"rotation", 11},
+};
+
+class ParamKeysTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        keys_.assign(table, table + sizeof(table) / sizeof(table[0]));
+        SortParamKeys(keys_);
+    }
+
+    /* what the old code did: look every table key up in every pair */
+    uint64_t Linear(const std::string& kvpairs) {
+        uint64_t mask = 0;
+        size_t start = 0;
+
+        while (start <= kvpairs.size()) {
+            size_t end = kvpairs.find(';', start);
+            std::string pair = kvpairs.substr(start, end == std::string::npos ?
+                                                     std::string::npos : end - start);
+            std::string key = pair.substr(0, pair.find('='));
+
+            for (auto& k : table)
+                if (!key.empty() && key == k.key)
+                    mask |= 1ULL << k.handler;
+            if (end == std::string::npos)
+                break;
+            start = end + 1;
+        }
+        return mask;
+    }
+
+    std::vector<param_key_t> keys_;
+};
+
+TEST_F(ParamKeysTest, SortedByKey) {
+    for (size_t i = 1; i < keys_.size(); i++)
+        EXPECT_LE(strcmp(keys_[i - 1].key, keys_[i].key), 0);
+}
+
+TEST_F(ParamKeysTest, SharedKeyKeepsTableOrder) {
+    auto it = std::find_if(keys_.begin(), keys_.end(),
+                           [](const param_key_t& k) { return !strcmp(k.key, "bt_ble"); });
+
+    ASSERT_NE(keys_.end(), it);
+    EXPECT_EQ(5u, it[0].handler);
+    EXPECT_EQ(6u, it[1].handler);
+}
+
+TEST_F(ParamKeysTest, MatchesSetStyleString) {
+    EXPECT_EQ(1ULL << 0, MatchParamKeys(keys_, "screen_state=on"));
+    EXPECT_EQ((1ULL << 2) | (1ULL << 11),
+              MatchParamKeys(keys_, "connect=2;rotation=90;card=1"));
+    EXPECT_EQ((1ULL << 5) | (1ULL << 6), MatchParamKeys(keys_, "bt_ble=true"));
+}
+
+TEST_F(ParamKeysTest, MatchesGetStyleString) {
+    EXPECT_EQ((1ULL << 4) | (1ULL << 10), MatchParamKeys(keys_, "A2dpSuspended;latency_probe"));
+}
+
+TEST_F(ParamKeysTest, PrefixesAndExtensionsDoNotMatch) {
+    EXPECT_EQ(0u, MatchParamKeys(keys_, "bt_bl=1"));
+    EXPECT_EQ(0u, MatchParamKeys(keys_, "bt_ble_x=1"));
+    EXPECT_EQ(0u, MatchParamKeys(keys_, "bt=1;b=2;z=3"));
+    EXPECT_EQ(0u, MatchParamKeys(keys_, "uhqa=on"));
+    /* the value is not a key */
+    EXPECT_EQ(0u, MatchParamKeys(keys_, "foo=screen_state"));
+}
+
+TEST_F(ParamKeysTest, DegenerateStrings) {
+    EXPECT_EQ(0u, MatchParamKeys(keys_, nullptr));
+    EXPECT_EQ(0u, MatchParamKeys(keys_, ""));
+    EXPECT_EQ(0u, MatchParamKeys(keys_, ";;;"));
+    EXPECT_EQ(0u, MatchParamKeys(keys_, "="));
+    EXPECT_EQ(1ULL << 1, MatchParamKeys(keys_, ";UHQA=on;"));
+    EXPECT_EQ(0u, MatchParamKeys(std::vector<param_key_t>(), "UHQA=on"));
+}
+
+TEST_F(ParamKeysTest, AgreesWithLinearLookup) {
+    std::mt19937 gen(7);
+    std::vector<std::string> words;
+
+    for (auto& k : table) {
+        std::string key = k.key;
+
+        words.push_back(key);
+        words.push_back(key.substr(0, key.size() - 1));
+        words.push_back(key + "x");
+    }
+    words.push_back("");
+
+    for (int round = 0; round < 2000; round++) {
+        std::string kvpairs;
+        int pairs = gen() % 6;
+
+        for (int i = 0; i < pairs; i++) {
+            if (i)
+                kvpairs += ';';
+            kvpairs += words[gen() % words.size()];
+            if (gen() % 2)
+                kvpairs += "=" + std::to_string(gen() % 100);
+        }
+        ASSERT_EQ(Linear(kvpairs), MatchParamKeys(keys_, kvpairs.c_str())) << kvpairs;
+    }
+}
@@ -0,0 +1,217 @@
+/*
+ * Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <linux/capability.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "ThreadPolicy.h"
+
+/* one class line of ThreadPolicy::Dump */
+struct class_stats_t {
+    bool found;
+    uint32_t threads;
+    std::string applied;
+    uint32_t hist[THREAD_POLICY_HIST_BUCKETS];
+    uint64_t max_us;
+};
+
+static class_stats_t DumpClass(const char *name) {
+    class_stats_t stats = {};
+    FILE *f = tmpfile();
+    char line[256];
+    char cls[16];
+    char applied[16];
+    uint32_t *h = stats.hist;
+
+    if (!f)
+        return stats;
+    ThreadPolicy::Dump(fileno(f));
+    rewind(f);
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, " %15s %u threads, %15s %u %u %u %u %u %u %u, %" SCNu64 " us",
+                   cls, &stats.threads, applied, &h[0], &h[1], &h[2], &h[3], &h[4],
+                   &h[5], &h[6], &stats.max_us) == 11 && !strcmp(cls, name)) {
+            stats.found = true;
+            stats.applied = applied;
+            break;
+        }
+    }
+    fclose(f);
+    return stats;
+}
+
+/* Apply on a throwaway thread, so the test process keeps its policy */
+static void ApplyOnThread(ahal_thread_class_t cls) {
+    std::thread([cls] { ThreadPolicy::Apply(cls); }).join();
+}
+
+TEST(ThreadPolicy, WakeupBucketBoundaries) {
+    /* each bucket's bound goes to the next bucket */
+    static const struct {
+        uint64_t late_ns;
+        int bucket;
+    } cases[] = {
+        {0, 0}, {99999, 0},
+        {100000, 1}, {499999, 1},
+        {500000, 2}, {999999, 2},
+        {1000000, 3}, {1999999, 3},
+        {2000000, 4}, {4999999, 4},
+        {5000000, 5}, {9999999, 5},
+        {10000000, 6}, {1000000000, 6},
+    };
+    class_stats_t before, after;
+
+    ApplyOnThread(AHAL_THREAD_TIMER);
+    for (auto& c : cases) {
+        SCOPED_TRACE(c.late_ns);
+        before = DumpClass("timer");
+        ASSERT_TRUE(before.found);
+        ThreadPolicy::RecordWakeup(AHAL_THREAD_TIMER, c.late_ns);
+        after = DumpClass("timer");
+        for (int i = 0; i < THREAD_POLICY_HIST_BUCKETS; i++)
+            EXPECT_EQ(before.hist[i] + (i == c.bucket), after.hist[i]) << "bucket " << i;
+    }
+    EXPECT_EQ(1000000u, after.max_us);
+}
+
+TEST(ThreadPolicy, MaxSurvivesConcurrentWakeups) {
+    const int kThreads = 8;
+    const int kWakeups = 10000;
+    std::vector<std::thread> threads;
+    class_stats_t before, after;
+    uint32_t total = 0;
+
+    ApplyOnThread(AHAL_THREAD_WORKER);
+    before = DumpClass("worker");
+    ASSERT_TRUE(before.found);
+    EXPECT_EQ(0u, before.max_us);
+
+    /* every thread climbs, the largest value of all has to stick */
+    for (int t = 0; t < kThreads; t++) {
+        threads.emplace_back([t] {
+            for (int i = 0; i < kWakeups; i++)
+                ThreadPolicy::RecordWakeup(AHAL_THREAD_WORKER,
+                                           (uint64_t)(i * kThreads + t) * 1000);
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+
+    after = DumpClass("worker");
+    EXPECT_EQ((uint64_t)(kWakeups * kThreads - 1), after.max_us);
+    for (int i = 0; i < THREAD_POLICY_HIST_BUCKETS; i++)
+        total += after.hist[i] - before.hist[i];
+    EXPECT_EQ((uint32_t)(kThreads * kWakeups), total);
+
+    /* a smaller value does not lower it */
+    ThreadPolicy::RecordWakeup(AHAL_THREAD_WORKER, 1000);
+    EXPECT_EQ(after.max_us, DumpClass("worker").max_us);
+}
+
+TEST(ThreadPolicy, OutOfRangeClassIsIgnored) {
+    ThreadPolicy::RecordWakeup(AHAL_THREAD_CLASS_MAX, 1000);
+    ThreadPolicy::RecordWakeup((ahal_thread_class_t)-1, 1000);
+    ThreadPolicy::Apply(AHAL_THREAD_CLASS_MAX);
+}
+
+static int CurrentCpus(cpu_set_t *set) {
+    CPU_ZERO(set);
+    return sched_getaffinity(0, sizeof(*set), set);
+}
+
+TEST(ThreadPolicy, AffinityStaysInsideTheAllowedSet) {
+    std::thread([] {
+        cpu_set_t allowed, now;
+        char mask[32];
+        int first = -1;
+
+        ASSERT_EQ(0, CurrentCpus(&allowed));
+        for (int cpu = 0; cpu < 63 && first < 0; cpu++) {
+            if (CPU_ISSET(cpu, &allowed))
+                first = cpu;
+        }
+        ASSERT_LE(0, first);
+
+        /* only that cpu is allowed from here on */
+        CPU_ZERO(&now);
+        CPU_SET(first, &now);
+        ASSERT_EQ(0, sched_setaffinity(0, sizeof(now), &now));
+        ASSERT_EQ(0, CurrentCpus(&allowed));
+
+        /* a mask with no allowed cpu leaves the affinity alone */
+        snprintf(mask, sizeof(mask), "%llx", 1ULL << (first + 1));
+        EXPECT_EQ(-EINVAL, ThreadPolicy::SetAffinity("test", mask));
+        EXPECT_EQ(-EINVAL, ThreadPolicy::SetAffinity("test", "0"));
+        EXPECT_EQ(-EINVAL, ThreadPolicy::SetAffinity("test", "zz"));
+        ASSERT_EQ(0, CurrentCpus(&now));
+        EXPECT_TRUE(CPU_EQUAL(&allowed, &now));
+
+        /* a mask reaching past the allowed set is cut down to it */
+        snprintf(mask, sizeof(mask), "%llx", (1ULL << first) | (1ULL << (first + 1)));
+        EXPECT_EQ(0, ThreadPolicy::SetAffinity("test", mask));
+        ASSERT_EQ(0, CurrentCpus(&now));
+        EXPECT_TRUE(CPU_EQUAL(&allowed, &now));
+    }).join();
+}
+
+/*
+ * Without an RT budget SCHED_FIFO is refused and the visualizer class
+ * falls back. Run in a child, dropping RLIMIT_RTPRIO and CAP_SYS_NICE
+ * cannot be undone.
+ */
+TEST(ThreadPolicy, RefusedFifoFallsBack) {
+    int status = 0;
+    pid_t pid = fork();
+
+    ASSERT_LE(0, pid);
+    if (pid == 0) {
+        struct rlimit limit = {0, 0};
+        struct sched_param param = {};
+        struct __user_cap_header_struct cap_hdr = {_LINUX_CAPABILITY_VERSION_3, 0};
+        struct __user_cap_data_struct cap[2] = {};
+        class_stats_t stats;
+
+        setrlimit(RLIMIT_RTPRIO, &limit);
+        if (!syscall(SYS_capget, &cap_hdr, cap)) {
+            cap[0].effective &= ~(1U << CAP_SYS_NICE);
+            cap[0].permitted &= ~(1U << CAP_SYS_NICE);
+            syscall(SYS_capset, &cap_hdr, cap);
+        }
+        param.sched_priority = 1;
+        /* still allowed, nothing to fall back from */
+        if (!sched_setscheduler(0, SCHED_FIFO, &param))
+            _exit(2);
+
+        ThreadPolicy::Apply(AHAL_THREAD_VISUALIZER);
+        stats = DumpClass("visualizer");
+        if (!stats.found || stats.threads != 1)
+            _exit(3);
+        if (stats.applied != "fallback")
+            _exit(4);
+        if (sched_getscheduler(0) != SCHED_OTHER)
+            _exit(5);
+        _exit(0);
+    }
+
+    ASSERT_EQ(pid, waitpid(pid, &status, 0));
+    ASSERT_TRUE(WIFEXITED(status));
+    if (WEXITSTATUS(status) == 2)
+        GTEST_SKIP() << "SCHED_FIFO is allowed here";
+    EXPECT_EQ(0, WEXITSTATUS(status));
+}
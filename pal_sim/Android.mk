@@ -0,0 +1,24 @@
+LOCAL_PATH := $(call my-dir)
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := hal_loopback
+LOCAL_MODULE_TAGS := optional
+LOCAL_MODULE_OWNER := qti
+LOCAL_VENDOR_MODULE := true
+LOCAL_MULTILIB := first
+
+LOCAL_SRC_FILES := hal_loopback.cpp
+
+LOCAL_CFLAGS += -Wall -Werror -Wno-unused-parameter
+ifeq ($(TARGET_IS_64_BIT),true)
+LOCAL_CFLAGS += -DLOOPBACK_DEFAULT_HAL=\"/vendor/lib64/hw/audio.primary.$(TARGET_BOARD_PLATFORM).so\"
+else
+LOCAL_CFLAGS += -DLOOPBACK_DEFAULT_HAL=\"/vendor/lib/hw/audio.primary.$(TARGET_BOARD_PLATFORM).so\"
+endif
+LOCAL_CPPFLAGS += -fexceptions
+
+LOCAL_HEADER_LIBRARIES := libhardware_headers libaudio_system_headers
+LOCAL_SHARED_LIBRARIES := libdl
+
+include $(BUILD_EXECUTABLE)
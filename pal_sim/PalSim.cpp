@@ -0,0 +1,990 @@
+/*
+ * Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+#define LOG_TAG "PalSim"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include <log/log.h>
+
+#include "PalApi.h"
+#include "PalDefs.h"
+#include "PalSim.h"
+
+#define SIM_DEFAULT_PERIOD_MS 10
+#define SIM_DEFAULT_PERIOD_COUNT 4
+#define SIM_DEFAULT_OFFLOAD_BUF_SIZE (32 * 1024)
+#define SIM_DEFAULT_BT_LATENCY_MS 150
+#define SIM_DEFAULT_OFFLOAD_KBPS 320
+#define SIM_LOOPBACK_MAX_MS 1000
+
+typedef struct sim_stream {
+    struct pal_stream_attributes attr;
+    pal_stream_callback cb;
+    uint64_t cookie;
+    bool output;
+    bool compressed;
+    uint32_t rate;
+    uint32_t frame_size;
+    uint32_t period;          /* frames, bytes for compressed */
+    uint32_t period_count;
+    bool started;
+    bool paused;
+    uint64_t run_start_ns;
+    uint64_t run_base;        /* units consumed before the current run */
+    uint64_t queued_in;       /* units written, or read for capture */
+    void *mmap_buf;
+    size_t mmap_size;
+    int mmap_fd;
+    std::vector<uint32_t> devices;  /* pal_device_id_t of the current route */
+} sim_stream_t;
+
+typedef struct sim_event {
+    sim_stream_t *stream;     /* nullptr for global events */
+    uint32_t id;
+    uint32_t data;
+} sim_event_t;
+
+typedef struct sim_fault {
+    double probability;
+    int32_t err;
+    uint32_t delay_us;
+    uint32_t fail_in;         /* calls until the one-shot fault, 0 for none */
+    int32_t fail_err;
+} sim_fault_t;
+
+static std::mutex sim_mutex;
+static std::condition_variable sim_cv;
+static std::set<sim_stream_t *> sim_streams;
+static std::multimap<uint64_t, sim_event_t> sim_events;
+static std::thread sim_thread;
+static bool sim_exit;
+static bool sim_offline;
+static pal_global_callback sim_global_cb;
+static uint64_t sim_global_cookie;
+static sim_fault_t sim_faults[PAL_SIM_OP_MAX];
+static unsigned int sim_seed;
+static uint32_t sim_bt_latency_ms = SIM_DEFAULT_BT_LATENCY_MS;
+static uint32_t sim_offload_bps = SIM_DEFAULT_OFFLOAD_KBPS * 1000 / 8;
+static bool sim_a2dp_suspended;
+static pal_sim_stats_t sim_stats;
+static bool sim_realtime = true;
+static bool sim_loopback;
+static std::deque<uint8_t> sim_loop;
+static uint32_t sim_loop_rate;
+static uint32_t sim_loop_frame_size;
+static pal_sim_param_hook_t sim_param_hook;
+static void *sim_param_cookie;
+static std::vector<float> sim_volume;
+static std::set<int> sim_perf_locks;
+static int sim_perf_next_handle = 1;
+static uint32_t sim_perf_boost_pct;
+static pal_sim_perf_stats_t sim_perf_stats;
+
+static const char * const sim_op_names[PAL_SIM_OP_MAX] = {
+    "open", "start", "stop", "write", "read", "set_device", "set_param", "get_timestamp",
+};
+
+static uint64_t sim_now_ns()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void sim_sleep_ns(uint64_t ns)
+{
+    struct timespec ts = {(time_t)(ns / 1000000000LL), (long)(ns % 1000000000LL)};
+
+    while (nanosleep(&ts, &ts) && errno == EINTR)
+        ;
+}
+
+/* units per second, frames for PCM and bytes for compressed */
+static uint64_t sim_unit_rate(const sim_stream_t *s)
+{
+    return s->compressed ? sim_offload_bps : s->rate;
+}
+
+/* units the device has consumed (playback) or produced (capture) so far */
+static uint64_t sim_device_pos(const sim_stream_t *s, uint64_t now)
+{
+    if (!s->started || s->paused)
+        return s->run_base;
+    return s->run_base + (now - s->run_start_ns) * sim_unit_rate(s) / 1000000000LL;
+}
+
+static bool sim_loop_source(const sim_stream_t *s)
+{
+    return sim_loopback && s->output && !s->compressed && !s->mmap_buf;
+}
+
+/* appends rendered playback, data or nullptr for silence, to the loopback */
+static void sim_loop_feed(const sim_stream_t *s, const uint8_t *data, uint64_t frames)
+{
+    uint64_t bytes = frames * s->frame_size;
+    uint64_t max = (uint64_t)s->rate * s->frame_size * SIM_LOOPBACK_MAX_MS / 1000;
+
+    if (s->rate != sim_loop_rate || s->frame_size != sim_loop_frame_size) {
+        sim_loop.clear();
+        sim_loop_rate = s->rate;
+        sim_loop_frame_size = s->frame_size;
+    }
+    if (bytes > max) {
+        data = data ? data + bytes - max : nullptr;
+        bytes = max;
+    }
+    if (data)
+        sim_loop.insert(sim_loop.end(), data, data + bytes);
+    else
+        sim_loop.insert(sim_loop.end(), bytes, 0);
+    /* nobody is capturing, keep only the latest second */
+    if (sim_loop.size() > max)
+        sim_loop.erase(sim_loop.begin(), sim_loop.begin() + (sim_loop.size() - max));
+}
+
+/* playback that ran out of data restarts its timeline at the last write */
+static uint64_t sim_sync_playback(sim_stream_t *s, uint64_t now)
+{
+    uint64_t pos = sim_device_pos(s, now);
+
+    if (pos > s->queued_in) {
+        if (s->started && !s->paused && !s->compressed) {
+            sim_stats.underruns++;
+            if (sim_loop_source(s))
+                sim_loop_feed(s, nullptr, pos - s->queued_in);
+        }
+        s->run_base = s->queued_in;
+        s->run_start_ns = now;
+        pos = s->queued_in;
+    }
+    return pos;
+}
+
+static uint64_t sim_capacity(const sim_stream_t *s)
+{
+    return (uint64_t)s->period * s->period_count;
+}
+
+/* called with sim_mutex held, sleeps without it */
+static int32_t sim_check_op(pal_sim_op_t op, std::unique_lock<std::mutex>& lock)
+{
+    sim_fault_t *f = &sim_faults[op];
+
+    if (f->delay_us) {
+        uint32_t delay = f->delay_us;
+
+        if (!sim_perf_locks.empty())
+            delay -= (uint64_t)delay * std::min<uint32_t>(sim_perf_boost_pct, 100) / 100;
+
+        lock.unlock();
+        sim_sleep_ns((uint64_t)delay * 1000);
+        lock.lock();
+    }
+    if (f->fail_in && !--f->fail_in) {
+        sim_stats.faults++;
+        ALOGI("%s: injected one-shot fault %d", sim_op_names[op], f->fail_err);
+        return f->fail_err;
+    }
+    if (f->probability > 0 && (double)rand_r(&sim_seed) / RAND_MAX < f->probability) {
+        sim_stats.faults++;
+        ALOGI("%s: injected fault %d", sim_op_names[op], f->err);
+        return f->err;
+    }
+    return 0;
+}
+
+static void sim_post(uint64_t when, sim_stream_t *s, uint32_t id, uint32_t data)
+{
+    sim_events.emplace(when, sim_event_t{s, id, data});
+    sim_cv.notify_all();
+}
+
+static void sim_cancel(sim_stream_t *s)
+{
+    for (auto it = sim_events.begin(); it != sim_events.end();) {
+        if (it->second.stream == s)
+            it = sim_events.erase(it);
+        else
+            ++it;
+    }
+}
+
+static void sim_event_loop()
+{
+    std::unique_lock<std::mutex> lock(sim_mutex);
+
+    while (!sim_exit) {
+        if (sim_events.empty()) {
+            sim_cv.wait(lock);
+            continue;
+        }
+
+        auto it = sim_events.begin();
+        uint64_t now = sim_now_ns();
+
+        if (it->first > now) {
+            sim_cv.wait_for(lock, std::chrono::nanoseconds(it->first - now));
+            continue;
+        }
+
+        sim_event_t ev = it->second;
+        sim_events.erase(it);
+
+        if (!ev.stream) {
+            pal_global_callback cb = sim_global_cb;
+            uint64_t cookie = sim_global_cookie;
+            uint32_t state = ev.data;
+
+            sim_offline = state == CARD_STATUS_OFFLINE;
+            lock.unlock();
+            if (cb)
+                cb(ev.id, &state, cookie);
+            lock.lock();
+            continue;
+        }
+        if (!sim_streams.count(ev.stream) || !ev.stream->cb)
+            continue;
+
+        pal_stream_callback cb = ev.stream->cb;
+        uint64_t cookie = ev.stream->cookie;
+        uint32_t data = ev.data;
+
+        lock.unlock();
+        cb((pal_stream_handle_t *)ev.stream, ev.id, &data, sizeof(data), cookie);
+        lock.lock();
+    }
+}
+
+static void sim_parse_faults(const char *spec)
+{
+    char buf[256];
+    char *saveptr = NULL;
+
+    snprintf(buf, sizeof(buf), "%s", spec);
+    for (char *tok = strtok_r(buf, ",", &saveptr); tok; tok = strtok_r(NULL, ",", &saveptr)) {
+        char *prob = strchr(tok, ':');
+        char *err;
+
+        if (!prob)
+            continue;
+        *prob++ = '\0';
+        err = strchr(prob, ':');
+        if (err)
+            *err++ = '\0';
+        for (int op = 0; op < PAL_SIM_OP_MAX; op++) {
+            if (!strcmp(tok, sim_op_names[op])) {
+                sim_faults[op].probability = atof(prob);
+                sim_faults[op].err = err ? atoi(err) : -EIO;
+            }
+        }
+    }
+}
+
+int32_t pal_init(void)
+{
+    std::lock_guard<std::mutex> lock(sim_mutex);
+    const char *env;
+
+    if (sim_thread.joinable())
+        return 0;
+
+    if ((env = getenv("PAL_SIM_BT_LATENCY_MS")))
+        sim_bt_latency_ms = atoi(env);
+    if ((env = getenv("PAL_SIM_OFFLOAD_KBPS")) && atoi(env) > 0)
+        sim_offload_bps = atoi(env) * 1000 / 8;
+    if ((env = getenv("PAL_SIM_FAULTS")))
+        sim_parse_faults(env);
+    if ((env = getenv("PAL_SIM_LOOPBACK")))
+        sim_loopback = atoi(env) != 0;
+    env = getenv("PAL_SIM_SEED");
+    sim_seed = env && atoi(env) ? atoi(env) : (unsigned int)sim_now_ns();
+
+    sim_exit = false;
+    sim_offline = false;
+    sim_thread = std::thread(sim_event_loop);
+    ALOGI("PAL simulator up, bt latency %u ms, offload %u B/s",
+          sim_bt_latency_ms, sim_offload_bps);
+    return 0;
+}
+
+void pal_deinit(void)
+{
+    {
+        std::lock_guard<std::mutex> lock(sim_mutex);
+
+        sim_exit = true;
+        sim_events.clear();
+    }
+    sim_cv.notify_all();
+    if (sim_thread.joinable())
+        sim_thread.join();
+}
+
+int32_t pal_register_global_callback(pal_global_callback cb, uint64_t cookie)
+{
+    std::lock_guard<std::mutex> lock(sim_mutex);
+
+    sim_global_cb = cb;
+    sim_global_cookie = cookie;
+    return 0;
+}
+
+int32_t pal_stream_open(struct pal_stream_attributes *attributes,
+                        uint32_t no_of_devices, struct pal_device *devices,
+                        uint32_t no_of_modifiers, struct modifier_kv *modifiers,
+                        pal_stream_callback cb, uint64_t cookie,
+                        pal_stream_handle_t **stream_handle)
+{
+    std::unique_lock<std::mutex> lock(sim_mutex);
+    struct pal_media_config *config;
+    sim_stream_t *s;
+    int32_t ret;
+
+    if (!attributes || !stream_handle)
+        return -EINVAL;
+    if (sim_offline)
+        return -EIO;
+    if ((ret = sim_check_op(PAL_SIM_OP_OPEN, lock)))
+        return ret;
+
+    s = new (std::nothrow) sim_stream_t();
+    if (!s)
+        return -ENOMEM;
+
+    s->attr = *attributes;
+    s->cb = cb;
+    s->cookie = cookie;
+    s->output = attributes->direction != PAL_AUDIO_INPUT;
+    s->compressed = attributes->type == PAL_STREAM_COMPRESSED;
+    config = s->output ? &attributes->out_media_config : &attributes->in_media_config;
+    s->rate = config->sample_rate ? config->sample_rate : 48000;
+    s->frame_size = std::max<uint32_t>(1, config->ch_info.channels) *
+                    (config->bit_width == 24 ? 4 : std::max<uint32_t>(1, config->bit_width / 8));
+    s->period = s->compressed ? SIM_DEFAULT_OFFLOAD_BUF_SIZE :
+                                s->rate * SIM_DEFAULT_PERIOD_MS / 1000;
+    s->period_count = SIM_DEFAULT_PERIOD_COUNT;
+    s->mmap_fd = -1;
+    for (uint32_t i = 0; devices && i < no_of_devices; i++)
+        s->devices.push_back(devices[i].id);
+
+    sim_streams.insert(s);
+    sim_stats.opens++;
+    *stream_handle = (pal_stream_handle_t *)s;
+    ALOGV("open %p type %d %s rate %u frame %u", s, attributes->type,
+          s->output ? "out" : "in", s->rate, s->frame_size);
+    return 0;
+}
+
+static sim_stream_t *sim_get(pal_stream_handle_t *handle)
+{
+    sim_stream_t *s = (sim_stream_t *)handle;
+
+    return s && sim_streams.count(s) ? s : nullptr;
+}
+
+int32_t pal_stream_close(pal_stream_handle_t *stream_handle)
+{
+    std::lock_guard<std::mutex> lock(sim_mutex);
+    sim_stream_t *s = sim_get(stream_handle);
+
+    if (!s)
+        return -EINVAL;
+    sim_cancel(s);
+    sim_streams.erase(s);
+    if (s->mmap_buf)
+        munmap(s->mmap_buf, s->mmap_size);
+    if (s->mmap_fd >= 0)
+        close(s->mmap_fd);
+    delete s;
+    return 0;
+}
+
+int32_t pal_stream_start(pal_stream_handle_t *stream_handle)
+{
+    std::unique_lock<std::mutex> lock(sim_mutex);
+    sim_stream_t *s = sim_get(stream_handle);
+    int32_t ret;
+
+    if (!s)
+        return -EINVAL;
+    if (sim_offline)
+        return -ENETRESET;
+    if ((ret = sim_check_op(PAL_SIM_OP_START, lock)))
+        return ret;
+    if (!sim_get(stream_handle))
+        return -EINVAL;
+
+    s->started = true;
+    s->paused = false;
+    s->run_start_ns = sim_now_ns();
+    s->run_base = 0;
+    s->queued_in = 0;
+    return 0;
+}
+
+int32_t pal_stream_stop(pal_stream_handle_t *stream_handle)
+{
+    std::unique_lock<std::mutex> lock(sim_mutex);
+    sim_stream_t *s = sim_get(stream_handle);
+    int32_t ret;
+
+    if (!s)
+        return -EINVAL;
+    if ((ret = sim_check_op(PAL_SIM_OP_STOP, lock)))
+        return ret;
+    if (!sim_get(stream_handle))
+        return -EINVAL;
+    sim_cancel(s);
+    s->started = false;
+    s->paused = false;
+    return 0;
+}
+
+int32_t pal_stream_pause(pal_stream_handle_t *stream_handle)
+{
+    std::lock_guard<std::mutex> lock(sim_mutex);
+    sim_stream_t *s = sim_get(stream_handle);
+
+    if (!s)
+        return -EINVAL;
+    if (s->output)
+        sim_sync_playback(s, sim_now_ns());
+    s->run_base = sim_device_pos(s, sim_now_ns());
+    s->paused = true;
+    return 0;
+}
+
+int32_t pal_stream_resume(pal_stream_handle_t *stream_handle)
+{
+    std::lock_guard<std::mutex> lock(sim_mutex);
+    sim_stream_t *s = sim_get(stream_handle);
+
+    if (!s)
+        return -EINVAL;
+    s->paused = false;
+    s->run_start_ns = sim_now_ns();
+    return 0;
+}
+
+int32_t pal_stream_flush(pal_stream_handle_t *stream_handle)
+{
+    std::lock_guard<std::mutex> lock(sim_mutex);
+    sim_stream_t *s = sim_get(stream_handle);
+
+    if (!s)
+        return -EINVAL;
+    sim_cancel(s);
+    s->queued_in = s->run_base = sim_device_pos(s, sim_now_ns());
+    s->run_start_ns = sim_now_ns();
+    return 0;
+}
+
+int32_t pal_stream_drain(pal_stream_handle_t *stream_handle, pal_drain_type_t type)
+{
+    std::lock_guard<std::mutex> lock(sim_mutex);
+    sim_stream_t *s = sim_get(stream_handle);
+    uint64_t now = sim_now_ns();
+    uint64_t left;
+
+    if (!s || !s->output)
+        return -EINVAL;
+    left = s->queued_in - sim_sync_playback(s, now);
+    sim_post(now + left * 1000000000LL / sim_unit_rate(s), s,
+             type == PAL_DRAIN_PARTIAL ? PAL_STREAM_CBK_EVENT_PARTIAL_DRAIN_READY :
+                                         PAL_STREAM_CBK_EVENT_DRAIN_READY, 0);
+    return 0;
+}
+
+int32_t pal_stream_set_buffer_size(pal_stream_handle_t *stream_handle,
+                                   pal_buffer_config_t *in_buff_cfg,
+                                   pal_buffer_config_t *out_buff_cfg)
+{
+    std::lock_guard<std::mutex> lock(sim_mutex);
+    sim_stream_t *s = sim_get(stream_handle);
+    pal_buffer_config_t *cfg;
+
+    if (!s)
+        return -EINVAL;
+    cfg = s->output ? out_buff_cfg : in_buff_cfg;
+    if (!cfg || !cfg->buf_size || !cfg->buf_count)
+        return 0;
+    s->period = s->compressed ? cfg->buf_size : std::max<uint32_t>(1, cfg->buf_size / s->frame_size);
+    s->period_count = cfg->buf_count;
+    return 0;
+}
+
+ssize_t pal_stream_write(pal_stream_handle_t *stream_handle, struct pal_buffer *buf)
+{
+    std::unique_lock<std::mutex> lock(sim_mutex);
+    sim_stream_t *s = sim_get(stream_handle);
+    uint64_t units;
+    uint64_t queued;
+    uint64_t now;
+    int32_t ret;
+
+    if (!s || !buf || !s->output)
+        return -EINVAL;
+    if (sim_offline)
+        return -ENETRESET;
+    if ((ret = sim_check_op(PAL_SIM_OP_WRITE, lock)))
+        return ret;
+    if (!(s = sim_get(stream_handle)))
+        return -EINVAL;
+
+    sim_stats.writes++;
+    units = s->compressed ? buf->size : buf->size / s->frame_size;
+    now = sim_now_ns();
+    queued = s->queued_in - sim_sync_playback(s, now);
+
+    if (s->compressed) {
+        /* non-blocking, take what fits and call back once a period drained */
+        uint64_t space = sim_capacity(s) > queued ? sim_capacity(s) - queued : 0;
+
+        if (units > space) {
+            units = space;
+            sim_post(now + (queued + units - (sim_capacity(s) - s->period)) *
+                     1000000000LL / sim_unit_rate(s), s, PAL_STREAM_CBK_EVENT_WRITE_READY, 0);
+        }
+        s->queued_in += units;
+        return units;
+    }
+
+    /* PCM blocks until the device drained enough, like a full DMA ring */
+    if (s->started && !s->paused && queued + units > sim_capacity(s)) {
+        uint64_t wait_ns = (queued + units - sim_capacity(s)) * 1000000000LL / s->rate;
+
+        if (!sim_realtime) {
+            /* free running, the device takes what did not fit at once */
+            s->run_base += queued + units - sim_capacity(s);
+        } else {
+            lock.unlock();
+            sim_sleep_ns(wait_ns);
+            lock.lock();
+            if (!(s = sim_get(stream_handle)))
+                return -EINVAL;
+        }
+    }
+    if (sim_loop_source(s))
+        sim_loop_feed(s, buf->buffer, units);
+    s->queued_in += units;
+    return buf->size;
+}
+
+ssize_t pal_stream_read(pal_stream_handle_t *stream_handle, struct pal_buffer *buf)
+{
+    std::unique_lock<std::mutex> lock(sim_mutex);
+    sim_stream_t *s = sim_get(stream_handle);
+    uint64_t frames;
+    uint64_t avail;
+    int32_t ret;
+
+    if (!s || !buf || s->output)
+        return -EINVAL;
+    if (sim_offline)
+        return -ENETRESET;
+    if ((ret = sim_check_op(PAL_SIM_OP_READ, lock)))
+        return ret;
+    if (!(s = sim_get(stream_handle)))
+        return -EINVAL;
+
+    sim_stats.reads++;
+    frames = buf->size / s->frame_size;
+    avail = sim_device_pos(s, sim_now_ns()) - s->queued_in;
+    if (avail > sim_capacity(s)) {
+        sim_stats.overruns++;
+        s->queued_in += avail - sim_capacity(s);
+        avail = sim_capacity(s);
+    }
+    if (s->started && !s->paused && avail < frames) {
+        uint64_t wait_ns = (frames - avail) * 1000000000LL / s->rate;
+
+        if (!sim_realtime) {
+            /* free running, the device has it ready at once */
+            s->run_base += frames - avail;
+        } else {
+            lock.unlock();
+            sim_sleep_ns(wait_ns);
+            lock.lock();
+            if (!(s = sim_get(stream_handle)))
+                return -EINVAL;
+        }
+    }
+    s->queued_in += frames;
+    memset(buf->buffer, 0, buf->size);
+    if (sim_loopback && s->rate == sim_loop_rate && s->frame_size == sim_loop_frame_size) {
+        size_t bytes = std::min<size_t>(frames * s->frame_size, sim_loop.size());
+
+        std::copy(sim_loop.begin(), sim_loop.begin() + bytes, buf->buffer);
+        sim_loop.erase(sim_loop.begin(), sim_loop.begin() + bytes);
+    }
+    return buf->size;
+}
+
+int32_t pal_get_timestamp(pal_stream_handle_t *stream_handle, struct pal_session_time *stime)
+{
+    std::unique_lock<std::mutex> lock(sim_mutex);
+    sim_stream_t *s = sim_get(stream_handle);
+    uint64_t now;
+    uint64_t pos;
+    uint64_t us;
+    int32_t ret;
+
+    if (!s || !stime)
+        return -EINVAL;
+    if ((ret = sim_check_op(PAL_SIM_OP_GET_TIMESTAMP, lock)))
+        return ret;
+    if (!(s = sim_get(stream_handle)))
+        return -EINVAL;
+
+    now = sim_now_ns();
+    pos = s->output ? sim_sync_playback(s, now) : sim_device_pos(s, now);
+    us = pos * 1000000LL / sim_unit_rate(s);
+    memset(stime, 0, sizeof(*stime));
+    stime->session_time.value_lsw = (uint32_t)us;
+    stime->session_time.value_msw = (uint32_t)(us >> 32);
+    stime->absolute_time.value_lsw = (uint32_t)(now / 1000);
+    stime->absolute_time.value_msw = (uint32_t)((now / 1000) >> 32);
+    return 0;
+}
+
+int32_t pal_stream_create_mmap_buffer(pal_stream_handle_t *stream_handle,
+                                      int32_t min_size_frames, struct pal_mmap_buffer *info)
+{
+    std::lock_guard<std::mutex> lock(sim_mutex);
+    sim_stream_t *s = sim_get(stream_handle);
+    uint32_t frames;
+
+    if (!s || !info || min_size_frames <= 0)
+        return -EINVAL;
+
+    frames = (min_size_frames + s->period - 1) / s->period * s->period;
+    s->mmap_size = (size_t)frames * s->frame_size;
+    s->mmap_fd = memfd_create("pal_sim_mmap", 0);
+    if (s->mmap_fd < 0 || ftruncate(s->mmap_fd, s->mmap_size))
+        return -errno;
+    s->mmap_buf = mmap(NULL, s->mmap_size, PROT_READ | PROT_WRITE, MAP_SHARED, s->mmap_fd, 0);
+    if (s->mmap_buf == MAP_FAILED) {
+        s->mmap_buf = NULL;
+        return -errno;
+    }
+    s->period_count = frames / s->period;
+
+    memset(info, 0, sizeof(*info));
+    info->buffer = s->mmap_buf;
+    info->fd = s->mmap_fd;
+    info->buffer_size_frames = frames;
+    info->burst_size_frames = s->period;
+    return 0;
+}
+
+int32_t pal_stream_get_mmap_position(pal_stream_handle_t *stream_handle,
+                                     struct pal_mmap_position *position)
+{
+    std::lock_guard<std::mutex> lock(sim_mutex);
+    sim_stream_t *s = sim_get(stream_handle);
+    uint64_t now = sim_now_ns();
+
+    if (!s || !position)
+        return -EINVAL;
+    /* the client owns the mmap ring, the device just keeps running */
+    position->position_frames = (int32_t)sim_device_pos(s, now);
+    position->time_nanoseconds = now;
+    return 0;
+}
+
+int32_t pal_stream_set_device(pal_stream_handle_t *stream_handle,
+                              uint32_t no_of_devices, struct pal_device *devices)
+{
+    std::unique_lock<std::mutex> lock(sim_mutex);
+    sim_stream_t *s;
+    int32_t ret;
+
+    if (!sim_get(stream_handle))
+        return -EINVAL;
+    if ((ret = sim_check_op(PAL_SIM_OP_SET_DEVICE, lock)))
+        return ret;
+    if (!(s = sim_get(stream_handle)))
+        return -EINVAL;
+
+    s->devices.clear();
+    for (uint32_t i = 0; devices && i < no_of_devices; i++)
+        s->devices.push_back(devices[i].id);
+    return 0;
+}
+
+int32_t pal_stream_set_param(pal_stream_handle_t *stream_handle, uint32_t param_id,
+                             pal_param_payload *param_payload)
+{
+    std::unique_lock<std::mutex> lock(sim_mutex);
+    sim_stream_t *s = sim_get(stream_handle);
+    pal_sim_param_hook_t hook;
+    void *cookie;
+    uint64_t render_ns;
+    uint64_t now;
+    int32_t ret;
+
+    if (!s)
+        return -EINVAL;
+    if ((ret = sim_check_op(PAL_SIM_OP_SET_PARAM, lock)))
+        return ret;
+    if (!(s = sim_get(stream_handle)))
+        return -EINVAL;
+
+    hook = sim_param_hook;
+    cookie = sim_param_cookie;
+    if (!hook || !param_payload || !s->output || s->compressed || s->mmap_buf)
+        return 0;
+
+    /* applied from the next frame written, heard once what is queued drained */
+    now = sim_now_ns();
+    render_ns = now + (s->queued_in - std::min(sim_device_pos(s, now), s->queued_in)) *
+                1000000000LL / s->rate;
+    lock.unlock();
+    hook(param_id, param_payload->payload, param_payload->payload_size, render_ns, cookie);
+    return 0;
+}
+
+int32_t pal_stream_get_param(pal_stream_handle_t *stream_handle, uint32_t param_id,
+                             pal_param_payload **param_payload)
+{
+    return -ENOSYS;
+}
+
+int32_t pal_stream_set_volume(pal_stream_handle_t *stream_handle, struct pal_volume_data *volume)
+{
+    std::lock_guard<std::mutex> lock(sim_mutex);
+
+    if (!sim_get(stream_handle) || !volume)
+        return -EINVAL;
+
+    sim_volume.clear();
+    for (uint32_t i = 0; i < volume->no_of_volpair; i++)
+        sim_volume.push_back(volume->volume_pair[i].vol);
+    sim_stats.volumes++;
+    return 0;
+}
+
+int32_t pal_stream_set_mute(pal_stream_handle_t *stream_handle, bool state)
+{
+    std::lock_guard<std::mutex> lock(sim_mutex);
+
+    return sim_get(stream_handle) ? 0 : -EINVAL;
+}
+
+int32_t pal_add_remove_effect(pal_stream_handle_t *stream_handle, pal_audio_effect_t effect,
+                              bool enable)
+{
+    std::lock_guard<std::mutex> lock(sim_mutex);
+
+    return sim_get(stream_handle) ? 0 : -EINVAL;
+}
+
+int32_t pal_set_param(uint32_t param_id, void *param_payload, size_t payload_size)
+{
+    std::unique_lock<std::mutex> lock(sim_mutex);
+    int32_t ret;
+
+    if ((ret = sim_check_op(PAL_SIM_OP_SET_PARAM, lock)))
+        return ret;
+    if (param_id == PAL_PARAM_ID_BT_A2DP_SUSPENDED && param_payload)
+        sim_a2dp_suspended = ((pal_param_bta2dp_t *)param_payload)->a2dp_suspended;
+    return 0;
+}
+
+int32_t pal_get_param(uint32_t param_id, void **param_payload, size_t *payload_size,
+                      void *query)
+{
+    std::lock_guard<std::mutex> lock(sim_mutex);
+    pal_param_bta2dp_t *bt;
+
+    if (!param_payload || !payload_size)
+        return -EINVAL;
+
+    switch (param_id) {
+    case PAL_PARAM_ID_BT_A2DP_ENCODER_LATENCY:
+    case PAL_PARAM_ID_BT_A2DP_DECODER_LATENCY:
+    case PAL_PARAM_ID_BT_A2DP_SUSPENDED:
+        /* the HAL hands in its own struct to fill, as with the real PAL */
+        bt = (pal_param_bta2dp_t *)*param_payload;
+        if (!bt)
+            return -EINVAL;
+        bt->latency = sim_bt_latency_ms;
+        bt->a2dp_suspended = sim_a2dp_suspended;
+        *payload_size = sizeof(*bt);
+        return 0;
+    default:
+        *payload_size = 0;
+        return -ENOSYS;
+    }
+}
+
+void pal_sim_set_fault(pal_sim_op_t op, double probability, int32_t err)
+{
+    std::lock_guard<std::mutex> lock(sim_mutex);
+
+    if (op < PAL_SIM_OP_MAX) {
+        sim_faults[op].probability = probability;
+        sim_faults[op].err = err;
+    }
+}
+
+void pal_sim_fail_once(pal_sim_op_t op, uint32_t nth, int32_t err)
+{
+    std::lock_guard<std::mutex> lock(sim_mutex);
+
+    if (op < PAL_SIM_OP_MAX) {
+        sim_faults[op].fail_in = nth;
+        sim_faults[op].fail_err = err;
+    }
+}
+
+void pal_sim_clear_faults(void)
+{
+    std::lock_guard<std::mutex> lock(sim_mutex);
+
+    memset(sim_faults, 0, sizeof(sim_faults));
+}
+
+void pal_sim_set_delay_us(pal_sim_op_t op, uint32_t delay_us)
+{
+    std::lock_guard<std::mutex> lock(sim_mutex);
+
+    if (op < PAL_SIM_OP_MAX)
+        sim_faults[op].delay_us = delay_us;
+}
+
+void pal_sim_set_bt_latency_ms(uint32_t latency_ms)
+{
+    std::lock_guard<std::mutex> lock(sim_mutex);
+
+    sim_bt_latency_ms = latency_ms;
+}
+
+void pal_sim_trigger_ssr(uint32_t offline_ms)
+{
+    std::lock_guard<std::mutex> lock(sim_mutex);
+    uint64_t now = sim_now_ns();
+
+    /* running streams see errors right away, like after a real crash */
+    sim_offline = true;
+    for (auto s : sim_streams) {
+        sim_cancel(s);
+        s->started = false;
+    }
+    sim_post(now, nullptr, PAL_SND_CARD_STATE, CARD_STATUS_OFFLINE);
+    sim_post(now + (uint64_t)offline_ms * 1000000, nullptr, PAL_SND_CARD_STATE,
+             CARD_STATUS_ONLINE);
+}
+
+void pal_sim_set_loopback(bool enable)
+{
+    std::lock_guard<std::mutex> lock(sim_mutex);
+
+    sim_loopback = enable;
+    sim_loop.clear();
+}
+
+void pal_sim_set_realtime(bool enable)
+{
+    std::lock_guard<std::mutex> lock(sim_mutex);
+
+    sim_realtime = enable;
+}
+
+void pal_sim_set_param_hook(pal_sim_param_hook_t hook, void *cookie)
+{
+    std::lock_guard<std::mutex> lock(sim_mutex);
+
+    sim_param_hook = hook;
+    sim_param_cookie = cookie;
+}
+
+void pal_sim_get_stats(pal_sim_stats_t *stats)
+{
+    std::lock_guard<std::mutex> lock(sim_mutex);
+
+    if (stats)
+        *stats = sim_stats;
+}
+
+uint32_t pal_sim_streams_on(uint32_t device_id)
+{
+    std::lock_guard<std::mutex> lock(sim_mutex);
+    uint32_t count = 0;
+
+    for (auto s : sim_streams) {
+        if (std::find(s->devices.begin(), s->devices.end(), device_id) != s->devices.end())
+            count++;
+    }
+    return count;
+}
+
+uint32_t pal_sim_get_volume(float *vol, uint32_t max)
+{
+    std::lock_guard<std::mutex> lock(sim_mutex);
+
+    for (uint32_t i = 0; vol && i < max && i < sim_volume.size(); i++)
+        vol[i] = sim_volume[i];
+    return sim_volume.size();
+}
+
+void pal_sim_set_perf_boost(uint32_t boost_pct)
+{
+    std::lock_guard<std::mutex> lock(sim_mutex);
+
+    sim_perf_boost_pct = boost_pct;
+}
+
+void pal_sim_get_perf_stats(pal_sim_perf_stats_t *stats)
+{
+    std::lock_guard<std::mutex> lock(sim_mutex);
+
+    if (stats) {
+        *stats = sim_perf_stats;
+        stats->held = sim_perf_locks.size();
+    }
+}
+
+/* perf HAL, a held handle passed back in is extended rather than stacked */
+int perf_lock_acq(int handle, int duration, int *opts, int size)
+{
+    std::lock_guard<std::mutex> lock(sim_mutex);
+
+    if (!opts || size <= 0 || size % 2)
+        return -EINVAL;
+    if (handle <= 0 || !sim_perf_locks.count(handle))
+        handle = sim_perf_next_handle++;
+    sim_perf_locks.insert(handle);
+    sim_perf_stats.acquires++;
+    sim_perf_stats.last_duration_ms = duration;
+    return handle;
+}
+
+int perf_lock_rel(int handle)
+{
+    std::lock_guard<std::mutex> lock(sim_mutex);
+
+    if (!sim_perf_locks.erase(handle))
+        return -EINVAL;
+    sim_perf_stats.releases++;
+    return 0;
+}
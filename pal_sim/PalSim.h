@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+#ifndef PAL_SIM_H
+#define PAL_SIM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Control interface of the PAL simulator, libpal_sim.
+ *
+ * libpal_sim exports the PAL API the HAL uses, so the HAL links against
+ * it in place of libar-pal on a Linux host. Streams run against the wall
+ * clock: playback drains and capture fills at the stream rate, paced by
+ * the configured period, and timestamps follow the frames rendered.
+ * Compressed offload streams are non-blocking and get WRITE_READY and
+ * DRAIN_READY callbacks like on target.
+ *
+ * The same knobs can be set from the environment before pal_init():
+ *   PAL_SIM_BT_LATENCY_MS   encoder/decoder latency reported for BT (150)
+ *   PAL_SIM_OFFLOAD_KBPS    compressed stream consumption rate (320)
+ *   PAL_SIM_FAULTS          op:probability:errno,... e.g. "open:0.01:-12"
+ *   PAL_SIM_SEED            seed for fault injection (0 = from time)
+ *   PAL_SIM_LOOPBACK        1 to loop PCM playback back into capture
+ */
+
+typedef enum {
+    PAL_SIM_OP_OPEN = 0,
+    PAL_SIM_OP_START,
+    PAL_SIM_OP_STOP,
+    PAL_SIM_OP_WRITE,
+    PAL_SIM_OP_READ,
+    PAL_SIM_OP_SET_DEVICE,
+    PAL_SIM_OP_SET_PARAM,
+    PAL_SIM_OP_GET_TIMESTAMP,
+    PAL_SIM_OP_MAX,
+} pal_sim_op_t;
+
+/* fail op with err on average once every 1/probability calls */
+void pal_sim_set_fault(pal_sim_op_t op, double probability, int32_t err);
+/* fail only the nth call of op from now on, once, with err */
+void pal_sim_fail_once(pal_sim_op_t op, uint32_t nth, int32_t err);
+void pal_sim_clear_faults(void);
+/* extra latency added to every call of op, to model a slow DSP */
+void pal_sim_set_delay_us(pal_sim_op_t op, uint32_t delay_us);
+void pal_sim_set_bt_latency_ms(uint32_t latency_ms);
+/* takes the sound card offline now and back online after offline_ms */
+void pal_sim_trigger_ssr(uint32_t offline_ms);
+/*
+ * Capture streams read back what PCM playback rendered, with silence where
+ * playback underran. Capture gets silence while its rate or frame size
+ * differ from the playback stream feeding the loop.
+ */
+void pal_sim_set_loopback(bool enable);
+/*
+ * Streams follow the wall clock by default. With realtime off a full
+ * playback ring or an empty capture ring is served at once instead of
+ * blocking, so benchmarks measure the caller and not the stream rate.
+ */
+void pal_sim_set_realtime(bool enable);
+/*
+ * Called after every stream set_param of a PCM output that succeeded, with
+ * the time the first frame written after it reaches the device, to measure
+ * control to sound latency. Runs on the caller's thread without the
+ * simulator lock; nullptr removes the hook.
+ */
+typedef void (*pal_sim_param_hook_t)(uint32_t param_id, const void *payload, size_t size,
+                                     uint64_t render_ns, void *cookie);
+void pal_sim_set_param_hook(pal_sim_param_hook_t hook, void *cookie);
+
+typedef struct pal_sim_stats {
+    uint64_t opens;
+    uint64_t writes;
+    uint64_t reads;
+    uint64_t underruns;      /* playback buffer ran empty while started */
+    uint64_t overruns;       /* capture buffer overflowed while started */
+    uint64_t faults;         /* injected failures */
+    uint64_t volumes;        /* stream set_volume calls that succeeded */
+} pal_sim_stats_t;
+
+void pal_sim_get_stats(pal_sim_stats_t *stats);
+/*
+ * Volume pairs of the last successful stream set_volume, any stream. Copies
+ * at most max levels and returns how many pairs there were.
+ */
+uint32_t pal_sim_get_volume(float *vol, uint32_t max);
+/* open streams whose last open or set_device included the PAL device id */
+uint32_t pal_sim_streams_on(uint32_t device_id);
+
+/*
+ * libpal_sim also stands in for the perf HAL: the host HAL finds
+ * perf_lock_acq/perf_lock_rel here through ro.vendor.extension_library.
+ * While a lock is held, the delays set with pal_sim_set_delay_us shrink
+ * by boost_pct percent, like DSP bring up on boosted clocks.
+ */
+typedef struct pal_sim_perf_stats {
+    uint64_t acquires;
+    uint64_t releases;
+    uint32_t held;           /* locks held now */
+    int32_t last_duration_ms;
+} pal_sim_perf_stats_t;
+
+void pal_sim_set_perf_boost(uint32_t boost_pct);
+void pal_sim_get_perf_stats(pal_sim_perf_stats_t *stats);
+int perf_lock_acq(int handle, int duration, int *opts, int size);
+int perf_lock_rel(int handle);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PAL_SIM_H */
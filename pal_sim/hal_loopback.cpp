@@ -0,0 +1,533 @@
+/*
+ * Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+/*
+ * hal_loopback: plays a pilot tone through an output stream of the audio
+ * HAL, captures it back through a loopback and reports every click,
+ * dropout and level jump with its sample position.
+ *
+ *   hal_loopback [-l hal.so] [-d seconds] [-f tone_hz] [-r rate] [-c channels]
+ *                [-F out_flags] [-o out_device] [-i in_device] [-s source]
+ *                [-t threshold_db] [-w capture.raw]
+ *   hal_loopback -T [-f tone_hz] [-r rate] [-t threshold_db]
+ *
+ * On a host the HAL runs on top of libpal_sim with its loopback enabled,
+ * so capture reads back what playback rendered. On target, stop the audio
+ * HAL service and pick devices that loop back in hardware, e.g. the AFE
+ * proxy. Exits 0 when the tone came back clean, 2 on glitches and 1 when
+ * the test could not run, so it can gate a CI job.
+ *
+ * Detection works on the first captured channel. A sine obeys
+ * x[n] = 2cos(w)x[n-1] - x[n-2], so the prediction error stays at the
+ * quantization noise until the waveform breaks. Every sample where it
+ * exceeds the threshold is classified:
+ *   dropout     the tone is replaced by silence, reported with its length
+ *   level       the tone continues at a level more than 1 dB away
+ *   click       anything else, a phase jump or a repeated/missing period
+ *
+ * -T checks the detector itself without a HAL: a synthetic tone, clean and
+ * with one block dropped, repeated, silenced or attenuated, has to give
+ * exactly the expected glitch at the block. Exits 0 when all cases pass.
+ */
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <hardware/audio.h>
+#include <hardware/hardware.h>
+
+#include "PalSim.h"
+
+#ifndef LOOPBACK_DEFAULT_HAL
+#define LOOPBACK_DEFAULT_HAL "audio.primary.default.so"
+#endif
+#define LOOPBACK_OUT_HANDLE 13
+#define LOOPBACK_IN_HANDLE 21
+#define LOOPBACK_PRIME_MS 50        /* playback queued before capture starts */
+#define LOOPBACK_LOCK_PERIODS 8     /* clean tone periods needed to lock on */
+#define LOOPBACK_MIN_DROPOUT 3      /* silent samples that make a dropout */
+#define LOOPBACK_LEVEL_DB 1.0       /* level change that makes a level jump */
+#define LOOPBACK_MAX_LISTED 32
+#define SELFTEST_BLOCK_MS 5         /* one period of a typical stream */
+#define SELFTEST_POS_TOLERANCE 4    /* frames between the fault and its report */
+
+typedef enum {
+    GLITCH_CLICK = 0,
+    GLITCH_DROPOUT,
+    GLITCH_LEVEL,
+    GLITCH_MAX,
+} glitch_type_t;
+
+static const char * const glitch_names[GLITCH_MAX] = {"click", "dropout", "level"};
+
+typedef struct glitch {
+    glitch_type_t type;
+    uint64_t pos;               /* capture frame */
+    uint32_t len;               /* frames, dropouts only */
+    double db;                  /* error or level change, dB re tone */
+} glitch_t;
+
+typedef enum {
+    FAULT_NONE = 0,
+    FAULT_DROP,                 /* a block never reaches capture */
+    FAULT_REPEAT,               /* the previous block is played twice */
+    FAULT_SILENCE,              /* a block of zeros replaces the tone */
+    FAULT_ATTENUATE,            /* the tone continues 6 dB lower */
+} selftest_fault_t;
+
+typedef struct loopback_config {
+    uint32_t seconds = 10;
+    double tone_hz = 997;       /* not a divisor of common rates */
+    uint32_t rate = 48000;
+    uint32_t channels = 2;
+    audio_output_flags_t out_flags =
+            (audio_output_flags_t)(AUDIO_OUTPUT_FLAG_PRIMARY | AUDIO_OUTPUT_FLAG_FAST);
+    audio_devices_t out_device = AUDIO_DEVICE_OUT_SPEAKER;
+    audio_devices_t in_device = AUDIO_DEVICE_IN_BUILTIN_MIC;
+    audio_source_t source = AUDIO_SOURCE_MIC;
+    double threshold_db = -40;  /* prediction error re tone amplitude */
+    const char *dump_path = nullptr;
+} loopback_config_t;
+
+static audio_hw_device_t *adev;
+static std::atomic<bool> capture_stop;
+static std::vector<int16_t> captured;
+static int capture_err;
+
+/* simulator hooks, looked up so the same tool runs against a real PAL */
+static void (*sim_set_loopback)(bool);
+static void (*sim_get_stats)(pal_sim_stats_t *);
+
+static void capture_loop(struct audio_stream_in *in, uint32_t channels)
+{
+    size_t bytes = in->common.get_buffer_size(&in->common);
+    std::vector<int16_t> buf(bytes / sizeof(int16_t));
+    size_t frames;
+    ssize_t ret;
+
+    if (!bytes || bytes % (channels * sizeof(int16_t))) {
+        capture_err = -EINVAL;
+        return;
+    }
+    while (!capture_stop) {
+        ret = in->read(in, buf.data(), bytes);
+        if (ret < 0) {
+            capture_err = ret;
+            return;
+        }
+        frames = ret / (channels * sizeof(int16_t));
+        for (size_t i = 0; i < frames; i++)
+            captured.push_back(buf[i * channels]);
+    }
+}
+
+static int play_tone(struct audio_stream_out *out, const loopback_config_t *cfg,
+                     std::thread *capture, struct audio_stream_in *in)
+{
+    size_t bytes = out->common.get_buffer_size(&out->common);
+    size_t frames = bytes / (cfg->channels * sizeof(int16_t));
+    uint64_t total = (uint64_t)cfg->seconds * cfg->rate;
+    uint64_t prime = (uint64_t)cfg->rate * LOOPBACK_PRIME_MS / 1000;
+    std::vector<int16_t> buf(frames * cfg->channels);
+    double step = 2 * M_PI * cfg->tone_hz / cfg->rate;
+    double phase = 0;
+    ssize_t ret;
+
+    if (!frames)
+        return -EINVAL;
+    for (uint64_t written = 0; written < total; written += frames) {
+        for (size_t i = 0; i < frames; i++) {
+            int16_t v = (int16_t)lrint(16384 * sin(phase));
+
+            for (uint32_t c = 0; c < cfg->channels; c++)
+                buf[i * cfg->channels + c] = v;
+            phase += step;
+            if (phase >= 2 * M_PI)
+                phase -= 2 * M_PI;
+        }
+        ret = out->write(out, buf.data(), bytes);
+        if (ret < 0) {
+            fprintf(stderr, "write failed: %zd\n", ret);
+            return ret;
+        }
+        /* capture starts behind playback, the loop never runs dry on jitter */
+        if (!capture->joinable() && written + frames >= prime)
+            *capture = std::thread(capture_loop, in, cfg->channels);
+    }
+    return 0;
+}
+
+static double tone_amplitude(const int16_t *x, size_t n)
+{
+    double sum = 0;
+
+    for (size_t i = 0; i < n; i++)
+        sum += (double)x[i] * x[i];
+    return n ? sqrt(2 * sum / n) : 0;
+}
+
+static double to_db(double ratio)
+{
+    return 20 * log10(ratio > 1e-9 ? ratio : 1e-9);
+}
+
+/* first sample of LOOPBACK_LOCK_PERIODS periods of clean tone, or x.size() */
+static size_t find_lock(const std::vector<int16_t>& x, double c, uint32_t period,
+                        double threshold_db)
+{
+    size_t window = (size_t)period * LOOPBACK_LOCK_PERIODS;
+    size_t clean = 0;
+
+    for (size_t n = 2; n < x.size(); n++) {
+        double amp = n >= period ? tone_amplitude(&x[n - period], period) : 0;
+        double err = x[n] - c * x[n - 1] + x[n - 2];
+
+        /* at least -40 dBFS and following the tone */
+        if (amp > 327 && fabs(err) < amp * pow(10, threshold_db / 20))
+            clean++;
+        else
+            clean = 0;
+        if (clean == window)
+            return n + 1 - window;
+    }
+    return x.size();
+}
+
+static void analyze(const std::vector<int16_t>& x, const loopback_config_t *cfg,
+                    size_t *lock, double *amplitude, std::vector<glitch_t>& glitches)
+{
+    double w = 2 * M_PI * cfg->tone_hz / cfg->rate;
+    double c = 2 * cos(w);
+    uint32_t period = (uint32_t)ceil(cfg->rate / cfg->tone_hz);
+    double amp;
+    double threshold;
+    double silence;
+    size_t n;
+
+    *lock = find_lock(x, c, period, cfg->threshold_db);
+    if (*lock + period >= x.size())
+        return;
+    amp = tone_amplitude(&x[*lock], period * LOOPBACK_LOCK_PERIODS);
+    *amplitude = amp;
+
+    for (n = *lock + 2; n < x.size(); n++) {
+        double err = x[n] - c * x[n - 1] + x[n - 2];
+        size_t silent = 0;
+        size_t back = 0;
+        glitch_t g = {};
+
+        /* quantization alone stays within 2 LSB */
+        threshold = std::max(4.0, amp * pow(10, cfg->threshold_db / 20));
+        silence = std::max(2.0, amp / 100);
+        if (fabs(err) <= threshold)
+            continue;
+
+        while (n + silent < x.size() && fabs(x[n + silent]) <= silence)
+            silent++;
+        /* a dropout starting near a zero crossing is only seen a sample late */
+        while (n - back > *lock + 2 && fabs(x[n - back - 1]) <= silence)
+            back++;
+        if (silent + back >= LOOPBACK_MIN_DROPOUT) {
+            n -= back;
+            silent += back;
+        }
+        g.pos = n;
+        if (silent >= LOOPBACK_MIN_DROPOUT) {
+            /* the tone stopping at the end of the run is not a glitch */
+            if (n + silent == x.size())
+                break;
+            g.type = GLITCH_DROPOUT;
+            g.len = silent;
+            g.db = to_db(fabs(err) / amp);
+            n += silent + 1;
+        } else {
+            size_t after = n + 2;
+            double level = after + period <= x.size() ?
+                           tone_amplitude(&x[after], period) : amp;
+            double change = to_db(level / amp);
+
+            if (fabs(change) > LOOPBACK_LEVEL_DB) {
+                g.type = GLITCH_LEVEL;
+                g.db = change;
+                amp = level;
+            } else {
+                g.type = GLITCH_CLICK;
+                g.db = to_db(fabs(err) / amp);
+            }
+            /* one break disturbs the two predictions that use it */
+            n += 1;
+        }
+        glitches.push_back(g);
+    }
+}
+
+static int report(const std::vector<int16_t>& x, const loopback_config_t *cfg)
+{
+    std::vector<glitch_t> glitches;
+    uint32_t counts[GLITCH_MAX] = {};
+    double amplitude = 0;
+    size_t lock = 0;
+
+    analyze(x, cfg, &lock, &amplitude, glitches);
+    printf("captured %zu frames (%.2f s)\n", x.size(), (double)x.size() / cfg->rate);
+    if (lock >= x.size()) {
+        printf("tone not found in the capture, check the loopback path\n");
+        return 1;
+    }
+    printf("tone locked at frame %zu (%.2f ms), level %.1f dBFS\n", lock,
+           lock * 1000.0 / cfg->rate, to_db(amplitude / 32768));
+
+    for (const glitch_t& g : glitches)
+        counts[g.type]++;
+    printf("glitches: %zu (", glitches.size());
+    for (int i = 0; i < GLITCH_MAX; i++)
+        printf("%s%s %u", i ? ", " : "", glitch_names[i], counts[i]);
+    printf(")\n");
+
+    for (size_t i = 0; i < glitches.size() && i < LOOPBACK_MAX_LISTED; i++) {
+        const glitch_t& g = glitches[i];
+
+        printf("  %-8s frame %10llu  %10.3f ms", glitch_names[g.type],
+               (unsigned long long)g.pos, (g.pos - lock) * 1000.0 / cfg->rate);
+        if (g.type == GLITCH_DROPOUT)
+            printf("  %u frames (%.3f ms)", g.len, g.len * 1000.0 / cfg->rate);
+        printf("  %+.1f dB\n", g.db);
+    }
+    if (glitches.size() > LOOPBACK_MAX_LISTED)
+        printf("  ... %zu more\n", glitches.size() - LOOPBACK_MAX_LISTED);
+    return glitches.empty() ? 0 : 2;
+}
+
+/* one second of tone as a clean loopback would capture it, with fault at pos */
+static std::vector<int16_t> synth_capture(const loopback_config_t *cfg, selftest_fault_t fault,
+                                          size_t pos, size_t block)
+{
+    double step = 2 * M_PI * cfg->tone_hz / cfg->rate;
+    std::vector<int16_t> x(cfg->rate);
+    std::vector<int16_t> prev;
+
+    for (size_t i = 0; i < x.size(); i++)
+        x[i] = (int16_t)lrint(16384 * sin(step * i));
+
+    switch (fault) {
+    case FAULT_DROP:
+        x.erase(x.begin() + pos, x.begin() + pos + block);
+        break;
+    case FAULT_REPEAT:
+        prev.assign(x.begin() + pos - block, x.begin() + pos);
+        x.insert(x.begin() + pos, prev.begin(), prev.end());
+        break;
+    case FAULT_SILENCE:
+        std::fill(x.begin() + pos, x.begin() + pos + block, 0);
+        break;
+    case FAULT_ATTENUATE:
+        for (size_t i = pos; i < x.size(); i++)
+            x[i] /= 2;
+        break;
+    default:
+        break;
+    }
+    return x;
+}
+
+static int self_test(const loopback_config_t *cfg)
+{
+    static const struct {
+        const char *name;
+        selftest_fault_t fault;
+        size_t glitches;
+        glitch_type_t type;
+    } cases[] = {
+        {"clean", FAULT_NONE, 0, GLITCH_MAX},
+        {"dropped block", FAULT_DROP, 1, GLITCH_CLICK},
+        {"repeated block", FAULT_REPEAT, 1, GLITCH_CLICK},
+        {"silent block", FAULT_SILENCE, 1, GLITCH_DROPOUT},
+        {"6 dB step", FAULT_ATTENUATE, 1, GLITCH_LEVEL},
+    };
+    size_t pos = cfg->rate / 2;
+    size_t block = (size_t)cfg->rate * SELFTEST_BLOCK_MS / 1000;
+    int failed = 0;
+
+    for (const auto& c : cases) {
+        std::vector<int16_t> x = synth_capture(cfg, c.fault, pos, block);
+        std::vector<glitch_t> glitches;
+        double amplitude = 0;
+        size_t lock = 0;
+        bool pass;
+
+        analyze(x, cfg, &lock, &amplitude, glitches);
+        pass = lock < x.size() && glitches.size() == c.glitches &&
+               (!c.glitches || (glitches[0].type == c.type &&
+                                glitches[0].pos + SELFTEST_POS_TOLERANCE >= pos &&
+                                glitches[0].pos <= pos + SELFTEST_POS_TOLERANCE));
+        printf("%-16s %s, %zu glitches", c.name, pass ? "pass" : "FAIL", glitches.size());
+        if (!glitches.empty())
+            printf(", %s at frame %llu", glitch_names[glitches[0].type],
+                   (unsigned long long)glitches[0].pos);
+        printf("\n");
+        if (!pass)
+            failed++;
+    }
+    return failed ? 1 : 0;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-l hal.so] [-d seconds] [-f tone_hz] [-r rate] [-c channels]\n"
+                    "       [-F out_flags] [-o out_device] [-i in_device] [-s source]\n"
+                    "       [-t threshold_db] [-w capture.raw]\n"
+                    "       %s -T [-f tone_hz] [-r rate] [-t threshold_db]\n", prog, prog);
+}
+
+int main(int argc, char **argv)
+{
+    const char *hal_path = LOOPBACK_DEFAULT_HAL;
+    loopback_config_t cfg;
+    struct audio_config config = AUDIO_CONFIG_INITIALIZER;
+    struct audio_stream_out *out = nullptr;
+    struct audio_stream_in *in = nullptr;
+    struct hw_module_t *module;
+    std::thread capture;
+    void *lib;
+    bool selftest = false;
+    int ret = 1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "l:d:f:r:c:F:o:i:s:t:w:Th")) != -1) {
+        switch (opt) {
+        case 'l':
+            hal_path = optarg;
+            break;
+        case 'd':
+            cfg.seconds = atoi(optarg);
+            break;
+        case 'f':
+            cfg.tone_hz = atof(optarg);
+            break;
+        case 'r':
+            cfg.rate = atoi(optarg);
+            break;
+        case 'c':
+            cfg.channels = atoi(optarg);
+            break;
+        case 'F':
+            cfg.out_flags = (audio_output_flags_t)strtoul(optarg, NULL, 0);
+            break;
+        case 'o':
+            cfg.out_device = (audio_devices_t)strtoul(optarg, NULL, 0);
+            break;
+        case 'i':
+            cfg.in_device = (audio_devices_t)strtoul(optarg, NULL, 0);
+            break;
+        case 's':
+            cfg.source = (audio_source_t)atoi(optarg);
+            break;
+        case 't':
+            cfg.threshold_db = atof(optarg);
+            break;
+        case 'w':
+            cfg.dump_path = optarg;
+            break;
+        case 'T':
+            selftest = true;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (!cfg.seconds || !cfg.rate || cfg.channels < 1 || cfg.channels > 2 ||
+        cfg.tone_hz <= 0 || cfg.tone_hz >= cfg.rate / 2) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (selftest)
+        return self_test(&cfg);
+
+    sim_set_loopback = (void (*)(bool))dlsym(RTLD_DEFAULT, "pal_sim_set_loopback");
+    sim_get_stats = (void (*)(pal_sim_stats_t *))dlsym(RTLD_DEFAULT, "pal_sim_get_stats");
+    if (sim_set_loopback)
+        sim_set_loopback(true);
+
+    lib = dlopen(hal_path, RTLD_NOW | RTLD_GLOBAL);
+    if (!lib) {
+        fprintf(stderr, "cannot load %s: %s\n", hal_path, dlerror());
+        return 1;
+    }
+    module = (struct hw_module_t *)dlsym(lib, HAL_MODULE_INFO_SYM_AS_STR);
+    if (!module || module->methods->open(module, AUDIO_HARDWARE_INTERFACE,
+                                         (struct hw_device_t **)&adev)) {
+        fprintf(stderr, "cannot open the audio HAL in %s\n", hal_path);
+        return 1;
+    }
+
+    config.sample_rate = cfg.rate;
+    config.format = AUDIO_FORMAT_PCM_16_BIT;
+    config.channel_mask = audio_channel_out_mask_from_count(cfg.channels);
+    if (adev->open_output_stream(adev, LOOPBACK_OUT_HANDLE, cfg.out_device, cfg.out_flags,
+                                 &config, &out, "")) {
+        fprintf(stderr, "cannot open output stream\n");
+        goto close_dev;
+    }
+    config.sample_rate = cfg.rate;
+    config.format = AUDIO_FORMAT_PCM_16_BIT;
+    config.channel_mask = audio_channel_in_mask_from_count(cfg.channels);
+    if (adev->open_input_stream(adev, LOOPBACK_IN_HANDLE, cfg.in_device, &config, &in,
+                                AUDIO_INPUT_FLAG_NONE, "", cfg.source)) {
+        fprintf(stderr, "cannot open input stream\n");
+        goto close_out;
+    }
+
+    printf("playing %.1f Hz for %u s, %u Hz %u ch, out flags %#x\n", cfg.tone_hz,
+           cfg.seconds, cfg.rate, cfg.channels, cfg.out_flags);
+    captured.reserve((size_t)(cfg.seconds + 1) * cfg.rate);
+    ret = play_tone(out, &cfg, &capture, in);
+    capture_stop = true;
+    if (capture.joinable())
+        capture.join();
+    out->common.standby(&out->common);
+    in->common.standby(&in->common);
+    if (capture_err)
+        fprintf(stderr, "read failed: %d\n", capture_err);
+
+    if (cfg.dump_path) {
+        FILE *f = fopen(cfg.dump_path, "wb");
+
+        if (f) {
+            fwrite(captured.data(), sizeof(int16_t), captured.size(), f);
+            fclose(f);
+        } else {
+            fprintf(stderr, "cannot write %s: %s\n", cfg.dump_path, strerror(errno));
+        }
+    }
+    ret = ret || capture_err ? 1 : report(captured, &cfg);
+
+    if (sim_get_stats) {
+        pal_sim_stats_t sim;
+
+        sim_get_stats(&sim);
+        printf("simulator: %llu underruns, %llu overruns, %llu faults\n",
+               (unsigned long long)sim.underruns, (unsigned long long)sim.overruns,
+               (unsigned long long)sim.faults);
+    }
+
+    adev->close_input_stream(adev, in);
+close_out:
+    adev->close_output_stream(adev, out);
+close_dev:
+    adev->common.close(&adev->common);
+    return ret;
+}
@@ -0,0 +1,527 @@
+/*
+ * Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+ * SPDX-License-Identifier: BSD-3-Clause-Clear
+ */
+
+/*
+ * hal_replay: drives the audio HAL with a call recording taken on a
+ * device (vendor.audio.call_record.enable) and reports per call latency
+ * next to the latency seen when it was recorded.
+ *
+ * The HAL is loaded with dlopen on top of libpal_sim, so it runs against
+ * the simulator instead of the DSP. Every stream gets its own thread, as
+ * AudioFlinger gives it one, and device calls run on the main thread.
+ *
+ *   hal_replay [-l hal.so] [-s speed] recording.bin
+ *
+ * -s 1 keeps the recorded timing, -s 4 compresses the gaps between calls
+ * four times and -s 0 issues calls back to back. Writes and reads still
+ * block at the stream rate in the simulator, so speeding up only removes
+ * idle time. At any speed calls start in the order they started on the
+ * device, across threads, so a stream open still follows the set_parameters
+ * that routed it.
+ */
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <hardware/audio.h>
+#include <hardware/hardware.h>
+
+#include "CallRecorder.h"
+#include "PalSim.h"
+
+#define REPLAY_DEFAULT_HAL "audio.primary.default.so"
+#define REPLAY_CALLBACK_TIMEOUT_MS 5000
+
+static const char * const call_names[CALL_MAX] = {
+    "open_output", "close_output", "open_input", "close_input", "adev_set_params",
+    "set_mode", "set_mic_mute", "set_voice_volume", "create_patch", "release_patch",
+    "out_write", "out_standby", "out_set_params", "out_set_volume", "out_pause",
+    "out_resume", "out_flush", "out_drain", "in_read", "in_standby", "in_set_params",
+};
+
+typedef struct replay_call {
+    call_record_t rec;
+    std::vector<uint8_t> payload;
+    size_t order;                /* index in the recording, by seq */
+} replay_call_t;
+
+typedef struct replay_lane {
+    std::vector<const replay_call_t *> calls;
+    struct audio_stream_out *out = nullptr;
+    struct audio_stream_in *in = nullptr;
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool nonblocking = false;
+    bool wait_write_ready = false;
+    bool wait_drain_ready = false;
+} replay_lane_t;
+
+typedef struct replay_stats {
+    std::vector<uint64_t> replay_ns;
+    uint64_t recorded_ns = 0;
+    uint32_t recorded_max_ns = 0;
+    uint32_t errors = 0;       /* failed now but not when recorded */
+} replay_stats_t;
+
+static audio_hw_device_t *adev;
+static double replay_speed = 1.0;
+static uint64_t replay_start_ns;
+static std::mutex stats_mutex;
+static replay_stats_t stats[CALL_MAX];
+static std::map<int32_t, audio_patch_handle_t> patches;
+static std::mutex order_mutex;
+static std::condition_variable order_cv;
+static size_t order_next;      /* calls started so far */
+
+static uint64_t now_ns()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void wait_until(uint64_t recorded_ns)
+{
+    uint64_t due;
+    uint64_t now;
+
+    if (replay_speed <= 0)
+        return;
+    due = replay_start_ns + (uint64_t)(recorded_ns / replay_speed);
+    now = now_ns();
+    if (due > now) {
+        struct timespec ts = {(time_t)((due - now) / 1000000000LL),
+                              (long)((due - now) % 1000000000LL)};
+
+        while (nanosleep(&ts, &ts) && errno == EINTR)
+            ;
+    }
+}
+
+/* waits until every call recorded before this one has started, on any lane */
+static void take_turn(const replay_call_t *call)
+{
+    std::unique_lock<std::mutex> lock(order_mutex);
+
+    order_cv.wait(lock, [call] { return order_next == call->order; });
+    order_next++;
+    order_cv.notify_all();
+}
+
+static int load_recording(const char *path, std::vector<replay_call_t>& calls)
+{
+    call_record_header_t hdr;
+    size_t truncated = 0;
+    FILE *f = fopen(path, "rb");
+
+    if (!f) {
+        fprintf(stderr, "cannot open %s: %s\n", path, strerror(errno));
+        return -errno;
+    }
+    if (fread(&hdr, sizeof(hdr), 1, f) != 1 || hdr.magic != CALL_RECORD_MAGIC ||
+        hdr.version != CALL_RECORD_VERSION || hdr.record_size != sizeof(call_record_t)) {
+        fprintf(stderr, "%s is not a version %d call recording\n", path, CALL_RECORD_VERSION);
+        fclose(f);
+        return -EINVAL;
+    }
+
+    for (;;) {
+        replay_call_t call;
+
+        if (fread(&call.rec, sizeof(call.rec), 1, f) != 1)
+            break;
+        call.payload.resize(call.rec.payload_len);
+        if (call.rec.payload_len &&
+            fread(call.payload.data(), call.rec.payload_len, 1, f) != 1) {
+            fprintf(stderr, "truncated record at call %zu\n", calls.size());
+            break;
+        }
+        if (call.rec.type >= CALL_MAX)
+            continue;
+        if (call.rec.flags & CALL_RECORD_FLAG_TRUNCATED)
+            truncated++;
+        calls.push_back(std::move(call));
+    }
+    fclose(f);
+    if (truncated)
+        fprintf(stderr, "%zu calls have a payload truncated to %d bytes\n", truncated,
+                CALL_RECORD_MAX_PAYLOAD);
+    /* records are appended as calls finish, replay them in start order */
+    std::stable_sort(calls.begin(), calls.end(),
+                     [](const replay_call_t& a, const replay_call_t& b) {
+                         return a.rec.seq < b.rec.seq;
+                     });
+    for (size_t i = 0; i < calls.size(); i++)
+        calls[i].order = i;
+    return 0;
+}
+
+static int stream_callback(stream_callback_event_t event, void *param, void *cookie)
+{
+    replay_lane_t *lane = (replay_lane_t *)cookie;
+    std::lock_guard<std::mutex> lock(lane->mutex);
+
+    if (event == STREAM_CBK_EVENT_WRITE_READY)
+        lane->wait_write_ready = false;
+    else if (event == STREAM_CBK_EVENT_DRAIN_READY)
+        lane->wait_drain_ready = false;
+    lane->cv.notify_all();
+    return 0;
+}
+
+/* non-blocking streams: the next call waits for the callback the last one asked for */
+static void wait_callbacks(replay_lane_t *lane)
+{
+    std::unique_lock<std::mutex> lock(lane->mutex);
+
+    if (!lane->cv.wait_for(lock, std::chrono::milliseconds(REPLAY_CALLBACK_TIMEOUT_MS),
+                           [lane] { return !lane->wait_write_ready && !lane->wait_drain_ready; }))
+        fprintf(stderr, "stream callback timed out\n");
+    lane->wait_write_ready = false;
+    lane->wait_drain_ready = false;
+}
+
+static std::string payload_str(const replay_call_t *call)
+{
+    std::string str((const char *)call->payload.data(), call->payload.size());
+
+    /* a truncated kvpairs string ends in a partial pair, keep the whole ones */
+    if (call->rec.flags & CALL_RECORD_FLAG_TRUNCATED) {
+        size_t end = str.rfind(';');
+
+        str.erase(end == std::string::npos ? 0 : end);
+    }
+    return str;
+}
+
+template <typename T>
+static T payload_val(const replay_call_t *call)
+{
+    T val = T();
+
+    if (call->payload.size() >= sizeof(T))
+        memcpy(&val, call->payload.data(), sizeof(T));
+    return val;
+}
+
+static int open_stream(const replay_call_t *call, replay_lane_t *lane, bool output)
+{
+    const call_record_open_t *o = (const call_record_open_t *)call->payload.data();
+    struct audio_config config = AUDIO_CONFIG_INITIALIZER;
+    std::string address;
+    int ret;
+
+    if (call->payload.size() < sizeof(*o))
+        return -EINVAL;
+    address.assign(o->address, call->payload.size() - sizeof(*o));
+    config.sample_rate = o->sample_rate;
+    config.channel_mask = (audio_channel_mask_t)o->channel_mask;
+    config.format = (audio_format_t)o->format;
+
+    if (output) {
+        ret = adev->open_output_stream(adev, call->rec.handle, (audio_devices_t)o->devices,
+                                       (audio_output_flags_t)o->flags, &config, &lane->out,
+                                       address.c_str());
+        if (!ret && lane->out && lane->out->set_callback &&
+            (o->flags & AUDIO_OUTPUT_FLAG_NON_BLOCKING))
+            lane->nonblocking = !lane->out->set_callback(lane->out, stream_callback, lane);
+    } else {
+        ret = adev->open_input_stream(adev, call->rec.handle, (audio_devices_t)o->devices,
+                                      &config, &lane->in, (audio_input_flags_t)o->flags,
+                                      address.c_str(), (audio_source_t)o->source);
+    }
+    return ret;
+}
+
+static int create_patch(const replay_call_t *call)
+{
+    const call_record_patch_t *p = (const call_record_patch_t *)call->payload.data();
+    std::vector<struct audio_port_config> ports;
+    audio_patch_handle_t handle = AUDIO_PATCH_HANDLE_NONE;
+    int ret;
+
+    if (call->payload.size() < sizeof(*p) ||
+        call->payload.size() < sizeof(*p) + (p->num_sources + p->num_sinks) *
+                                            sizeof(struct audio_port_config))
+        return -EINVAL;
+    ports.resize(p->num_sources + p->num_sinks);
+    memcpy(ports.data(), p + 1, ports.size() * sizeof(struct audio_port_config));
+
+    /* an update of a patch made earlier in the recording goes to the replayed patch */
+    if (p->handle_in != AUDIO_PATCH_HANDLE_NONE && patches.count(p->handle_in))
+        handle = patches[p->handle_in];
+    ret = adev->create_audio_patch(adev, p->num_sources, ports.data(), p->num_sinks,
+                                   ports.data() + p->num_sources, &handle);
+    if (!ret) {
+        patches.erase(p->handle_in);
+        patches[call->rec.handle] = handle;
+    }
+    return ret;
+}
+
+static int run_call(const replay_call_t *call, replay_lane_t *lane, std::vector<uint8_t>& buf)
+{
+    struct audio_stream_out *out = lane->out;
+    struct audio_stream_in *in = lane->in;
+    uint32_t bytes;
+    int ret;
+
+    switch (call->rec.type) {
+    case CALL_ADEV_OPEN_OUTPUT:
+        return open_stream(call, lane, true);
+    case CALL_ADEV_OPEN_INPUT:
+        return open_stream(call, lane, false);
+    case CALL_ADEV_CLOSE_OUTPUT:
+        if (out)
+            adev->close_output_stream(adev, out);
+        lane->out = nullptr;
+        lane->nonblocking = false;
+        return 0;
+    case CALL_ADEV_CLOSE_INPUT:
+        if (in)
+            adev->close_input_stream(adev, in);
+        lane->in = nullptr;
+        return 0;
+    case CALL_ADEV_SET_PARAMS:
+        return adev->set_parameters(adev, payload_str(call).c_str());
+    case CALL_ADEV_SET_MODE:
+        return adev->set_mode(adev, (audio_mode_t)payload_val<int32_t>(call));
+    case CALL_ADEV_SET_MIC_MUTE:
+        return adev->set_mic_mute(adev, payload_val<int32_t>(call));
+    case CALL_ADEV_SET_VOICE_VOLUME:
+        return adev->set_voice_volume(adev, payload_val<float>(call));
+    case CALL_ADEV_CREATE_PATCH:
+        return create_patch(call);
+    case CALL_ADEV_RELEASE_PATCH:
+        if (!patches.count(call->rec.handle))
+            return -EINVAL;
+        ret = adev->release_audio_patch(adev, patches[call->rec.handle]);
+        patches.erase(call->rec.handle);
+        return ret;
+    default:
+        break;
+    }
+
+    if (call->rec.type < CALL_IN_READ && !out)
+        return -ENODEV;
+    if (call->rec.type >= CALL_IN_READ && !in)
+        return -ENODEV;
+
+    switch (call->rec.type) {
+    case CALL_OUT_WRITE:
+        bytes = payload_val<uint32_t>(call);
+        if (buf.size() < bytes)
+            buf.resize(bytes);
+        ret = out->write(out, buf.data(), bytes);
+        if (ret >= 0 && (uint32_t)ret < bytes) {
+            std::lock_guard<std::mutex> lock(lane->mutex);
+
+            lane->wait_write_ready = lane->nonblocking;
+        }
+        return ret;
+    case CALL_OUT_STANDBY:
+        return out->common.standby(&out->common);
+    case CALL_OUT_SET_PARAMS:
+        return out->common.set_parameters(&out->common, payload_str(call).c_str());
+    case CALL_OUT_SET_VOLUME:
+        return out->set_volume(out, payload_val<float>(call),
+                               call->payload.size() >= 2 * sizeof(float) ?
+                               ((const float *)call->payload.data())[1] : 0);
+    case CALL_OUT_PAUSE:
+        return out->pause ? out->pause(out) : -ENOSYS;
+    case CALL_OUT_RESUME:
+        return out->resume ? out->resume(out) : -ENOSYS;
+    case CALL_OUT_FLUSH:
+        return out->flush ? out->flush(out) : -ENOSYS;
+    case CALL_OUT_DRAIN:
+        if (!out->drain)
+            return -ENOSYS;
+        ret = out->drain(out, (audio_drain_type_t)payload_val<int32_t>(call));
+        if (!ret) {
+            std::lock_guard<std::mutex> lock(lane->mutex);
+
+            lane->wait_drain_ready = lane->nonblocking;
+        }
+        return ret;
+    case CALL_IN_READ:
+        bytes = payload_val<uint32_t>(call);
+        if (buf.size() < bytes)
+            buf.resize(bytes);
+        return in->read(in, buf.data(), bytes);
+    case CALL_IN_STANDBY:
+        return in->common.standby(&in->common);
+    case CALL_IN_SET_PARAMS:
+        return in->common.set_parameters(&in->common, payload_str(call).c_str());
+    default:
+        return -EINVAL;
+    }
+}
+
+static void run_lane(replay_lane_t *lane)
+{
+    std::vector<uint8_t> buf;
+
+    for (const replay_call_t *call : lane->calls) {
+        uint64_t start;
+        uint64_t ns;
+        int ret;
+
+        wait_until(call->rec.start_ns);
+        if (lane->nonblocking)
+            wait_callbacks(lane);
+        take_turn(call);
+
+        start = now_ns();
+        ret = run_call(call, lane, buf);
+        ns = now_ns() - start;
+
+        std::lock_guard<std::mutex> lock(stats_mutex);
+        replay_stats_t *s = &stats[call->rec.type];
+
+        s->replay_ns.push_back(ns);
+        s->recorded_ns += call->rec.duration_ns;
+        s->recorded_max_ns = std::max(s->recorded_max_ns, call->rec.duration_ns);
+        if (ret < 0 && call->rec.ret >= 0)
+            s->errors++;
+    }
+}
+
+static bool is_device_call(uint16_t type)
+{
+    switch (type) {
+    case CALL_ADEV_SET_PARAMS:
+    case CALL_ADEV_SET_MODE:
+    case CALL_ADEV_SET_MIC_MUTE:
+    case CALL_ADEV_SET_VOICE_VOLUME:
+    case CALL_ADEV_CREATE_PATCH:
+    case CALL_ADEV_RELEASE_PATCH:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static void report()
+{
+    pal_sim_stats_t sim;
+
+    printf("%-18s %8s %6s %12s %12s %12s %12s %12s\n", "call", "count", "errors",
+           "rec mean us", "rec max us", "mean us", "p99 us", "max us");
+    for (int i = 0; i < CALL_MAX; i++) {
+        replay_stats_t *s = &stats[i];
+        size_t n = s->replay_ns.size();
+        uint64_t total = 0;
+
+        if (!n)
+            continue;
+        std::sort(s->replay_ns.begin(), s->replay_ns.end());
+        for (uint64_t ns : s->replay_ns)
+            total += ns;
+        printf("%-18s %8zu %6u %12.1f %12.1f %12.1f %12.1f %12.1f\n", call_names[i], n,
+               s->errors, s->recorded_ns / 1000.0 / n, s->recorded_max_ns / 1000.0,
+               total / 1000.0 / n, s->replay_ns[(n * 99 + 99) / 100 - 1] / 1000.0,
+               s->replay_ns.back() / 1000.0);
+    }
+
+    pal_sim_get_stats(&sim);
+    printf("simulator: %llu opens, %llu writes, %llu reads, %llu underruns, %llu overruns\n",
+           (unsigned long long)sim.opens, (unsigned long long)sim.writes,
+           (unsigned long long)sim.reads, (unsigned long long)sim.underruns,
+           (unsigned long long)sim.overruns);
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-l hal.so] [-s speed] recording.bin\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+    const char *hal_path = REPLAY_DEFAULT_HAL;
+    std::vector<replay_call_t> calls;
+    std::map<int32_t, replay_lane_t> lanes;
+    std::vector<std::thread> threads;
+    replay_lane_t *device_lane;
+    struct hw_module_t *module;
+    void *lib;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "l:s:h")) != -1) {
+        switch (opt) {
+        case 'l':
+            hal_path = optarg;
+            break;
+        case 's':
+            replay_speed = atof(optarg);
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (optind >= argc) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (load_recording(argv[optind], calls))
+        return 1;
+
+    /* the HAL resolves its PAL symbols against the simulator linked in here */
+    lib = dlopen(hal_path, RTLD_NOW | RTLD_GLOBAL);
+    if (!lib) {
+        fprintf(stderr, "cannot load %s: %s\n", hal_path, dlerror());
+        return 1;
+    }
+    module = (struct hw_module_t *)dlsym(lib, HAL_MODULE_INFO_SYM_AS_STR);
+    if (!module || module->methods->open(module, AUDIO_HARDWARE_INTERFACE,
+                                         (struct hw_device_t **)&adev)) {
+        fprintf(stderr, "cannot open the audio HAL in %s\n", hal_path);
+        return 1;
+    }
+
+    /* lane 0 takes device calls, every stream lane starts with its open */
+    device_lane = &lanes[0];
+    for (const replay_call_t& call : calls) {
+        if (is_device_call(call.rec.type))
+            device_lane->calls.push_back(&call);
+        else
+            lanes[call.rec.handle ? call.rec.handle : -1].calls.push_back(&call);
+    }
+    printf("replaying %zu calls on %zu streams at %s speed\n", calls.size(),
+           lanes.size() - 1, replay_speed > 0 ? std::to_string(replay_speed).c_str() : "full");
+
+    replay_start_ns = now_ns();
+    for (auto& it : lanes) {
+        if (it.first != 0)
+            threads.emplace_back(run_lane, &it.second);
+    }
+    run_lane(device_lane);
+    for (auto& t : threads)
+        t.join();
+
+    for (auto& it : lanes) {
+        if (it.second.out)
+            adev->close_output_stream(adev, it.second.out);
+        if (it.second.in)
+            adev->close_input_stream(adev, it.second.in);
+    }
+    adev->common.close(&adev->common);
+    report();
+    return 0;
+}